@@ -2,8 +2,10 @@
 
 #include "Kr/KrString.h"
 #include "Kr/KrThread.h"
+#include "Kr/KrAtomic.h"
 
 #include "Websocket.h"
+#include "Http2.h"
 #include "Json.h"
 
 #include <stdlib.h>
@@ -12,6 +14,7 @@
 
 constexpr int DISCORD_HTTP_SEND_BUFFER_SIZE    = MegaBytes(16);
 constexpr int DISCORD_HTTP_RECEIVE_BUFFER_SIZE = MegaBytes(16);
+constexpr int DISCORD_MAX_EVENT_BATCH         = 64;
 
 namespace Discord {
 	const String UserAgent        = "Katachi (https://github.com/Zero5620/Katachi, 0.1.1)";
@@ -93,7 +96,8 @@ static Discord::Timestamp Discord_ParseTimestamp(String timestamp) {
 
 	char buffer[32];
 
-	if (timestamp.length > sizeof(buffer) - 1)
+	// Optional timestamps are null
+	if (!timestamp.length || timestamp.length > (ptrdiff_t)sizeof(buffer) - 1)
 		return 0;
 
 	int len = (int)timestamp.length;
@@ -1552,7 +1556,7 @@ static void Discord_Deserialize(const Json_Object &obj, Discord::Message *messag
 	Json_Array reactions = JsonGetArray(obj, "reactions");
 	message->reactions.Resize(reactions.count);
 	for (ptrdiff_t index = 0; index < message->reactions.count; ++index) {
-		Discord_Deserialize(JsonGetObject(reactions[0]), &message->reactions[index]);
+		Discord_Deserialize(JsonGetObject(reactions[index]), &message->reactions[index]);
 	}
 
 	message->nonce = JsonGetString(obj, "nonce");
@@ -2110,19 +2114,48 @@ static int Discord_ShardThreadProc(void *arg) {
 	return 0;
 }
 
+static int Discord_EventLoopThreadProc(void *arg) {
+	Net_EventLoopRun((Net_Event_Loop *)arg);
+	return 0;
+}
+
 //
 //
 //
 
 static void Discord_HandleWebsocketEvent(Discord::Client *client, const Websocket_Event &event);
 
-static bool Discord_CustomMethod(Discord::Client *client, const String method, const String api_endpoint, const Http_Query_Params &params, const String content_type, const String body, Json *json);
+static bool Discord_CreateHttpPool(Discord::Client *client, uint32_t connections, const Net_Socket_Options &socket);
+
+static bool Discord_StartRestWorkers(Discord::Client *client, uint32_t count, bool http2, uint32_t arena_size, const Net_Socket_Options &socket);
+static void Discord_StopRestWorkers(Discord::Client *client);
+static void Discord_DispatchCompletedRequests(Discord::Client *client);
+
+static bool Discord_CustomMethod(Discord::Client *client, const String method, const String api_endpoint, const Http_Query_Params &params, const String content_type, const String body, Array_View<Buffer> segments, Json *json);
+
+static Array_View<Discord::Request> Discord_GetPipelined(Discord::Client *client, Array_View<String> api_endpoints);
+static bool Discord_ParseResponse(const Discord::Request &request, Json *json);
+
+static bool Discord_CustomMethod(Discord::Client *client, const String method, const String api_endpoint, const Http_Query_Params &params, const String content_type, const String body, Json *res) {
+	return Discord_CustomMethod(client, method, api_endpoint, params, content_type, body, Array_View<Buffer>(), res);
+}
 
 static bool Discord_CustomMethod(Discord::Client *client, const String method, const String api_endpoint, const String content_type, const String body, Json *res) {
 	Http_Query_Params params;
 	return Discord_CustomMethod(client, method, api_endpoint, params, content_type, body, res);
 }
 
+// Multipart bodies with attachments are sent from the segments, body holds the json when there are none
+static inline bool Discord_Post(Discord::Client *client, const String api_endpoint, const String content_type, const String body, Array_View<Buffer> segments, Json *res) {
+	Http_Query_Params params;
+	return Discord_CustomMethod(client, "POST", api_endpoint, params, content_type, body, segments, res);
+}
+
+static inline bool Discord_Patch(Discord::Client *client, const String api_endpoint, const String content_type, const String body, Array_View<Buffer> segments, Json *res) {
+	Http_Query_Params params;
+	return Discord_CustomMethod(client, "PATCH", api_endpoint, params, content_type, body, segments, res);
+}
+
 static inline bool Discord_Get(Discord::Client *client, const String api_endpoint, const Http_Query_Params &params, const String content_type, const String body, Json *res) {
 	return Discord_CustomMethod(client, "GET", api_endpoint, params, content_type, body, res);
 }
@@ -2163,1366 +2196,4546 @@ static inline bool Discord_Delete(Discord::Client *client, const String api_endp
 	return Discord_CustomMethod(client, "DELETE", api_endpoint, content_type, body, res);
 }
 
-//
-//
-//
+static bool Discord_BuildMessagePost(Memory_Arena *arena, const Discord::MessagePost &msg, String *content_type, String *body, Array_View<Buffer> *segments) {
+	Jsonify j(arena);
 
-namespace Discord {
-	
-	struct Client {
-		Websocket *      websocket = nullptr;
-		Heartbeat        heartbeat;
+	j.BeginObject();
 
-		Http *           http = nullptr;
-		String           authorization;
+	if (msg.content.length)
+		j.KeyValue("content", msg.content);
 
-		EventHandler     onevent;
+	if (msg.tts)
+		j.KeyValue("tts", msg.tts);
 
-		Memory_Arena *   scratch   = nullptr;
-		Memory_Allocator allocator = ThreadContext.allocator;
+	if (msg.embeds.count) {
+		j.PushKey("embeds");
+		j.BeginArray();
+		for (const auto &embed : msg.embeds)
+			Discord_Jsonify(embed, &j);
+		j.EndArray();
+	}
 
-		Identify         identify;
-		uint8_t          session_id[1024] = {0};
-		int              sequence = -1;
-		bool             running = false;
-		bool             closing = false;
-	};
+	if (msg.allowed_mentions) {
+		j.PushKey("allowed_mentions");
+		Discord_Jsonify(*msg.allowed_mentions, &j);
+	}
 
-	void IdentifyCommand(Client *client) {
-		Jsonify j(client->scratch);
-		j.BeginObject();
-		j.KeyValue("op", (int)Opcode::IDENTIFY);
-		j.PushKey("d");
-		Discord_Jsonify(client->identify, &j);
-		j.EndObject();
-		String msg = Jsonify_BuildString(&j);
-		Websocket_SendText(client->websocket, msg);
+	if (msg.message_reference) {
+		j.PushKey("message_reference");
+		Discord_Jsonify(*msg.message_reference, &j);
 	}
 
-	void ResumeCommand(Client *client) {
-		Jsonify j(client->scratch);
-		j.BeginObject();
-		j.KeyValue("op", (int)Opcode::RESUME);
-		j.PushKey("d");
-		j.BeginObject();
-		j.KeyValue("token", client->identify.token);
-		j.KeyValue("session_id", String(client->session_id, strlen((char *)client->session_id)));
-		if (client->sequence >= 0)
-			j.KeyValue("seq", client->sequence);
-		else
-			j.KeyNull("seq");
-		j.EndObject();
-		j.EndObject();
-		String msg = Jsonify_BuildString(&j);
-		Websocket_SendText(client->websocket, msg);
+	if (msg.components.count) {
+		j.PushKey("components");
+		j.BeginArray();
+		for (const auto &comp : msg.components)
+			Discord_Jsonify(comp, &j);
+		j.EndArray();
 	}
 
-	void HearbeatCommand(Client *client) {
-		if (client->heartbeat.count != client->heartbeat.acknowledged) {
-			LogWarningEx("Discord", "No Acknowledgement %d", client->heartbeat.acknowledged);
-			Websocket_Close(client->websocket, WEBSOCKET_CLOSE_ABNORMAL_CLOSURE);
-			return;
+	if (msg.sticker_ids.count) {
+		j.PushKey("sticker_ids");
+		j.BeginArray();
+		for (const auto &id : msg.sticker_ids)
+			j.PushId(id.value);
+		j.EndArray();
+	}
+
+	if (msg.attachments.count) {
+		j.PushKey("attachments");
+		j.BeginArray();
+		for (int id = 0; id < (int)msg.attachments.count; ++id) {
+			j.BeginObject();
+			j.KeyValue("id", id);
+			j.KeyValue("filename", msg.attachments[id].filename);
+			if (msg.attachments[id].description.length)
+				j.KeyValue("description", msg.attachments[id].description);
+			j.EndObject();
 		}
+		j.EndArray();
+	}
 
-		Jsonify j(client->scratch);
-		j.BeginObject();
-		j.KeyValue("op", (int)Opcode::HEARTBEAT);
-		if (client->sequence >= 0)
-			j.KeyValue("d", client->sequence);
-		else
-			j.KeyNull("d");
-		j.EndObject();
+	if (msg.flags) j.KeyValue("flags", msg.flags);
 
-		String msg = Jsonify_BuildString(&j);
-		Websocket_SendText(client->websocket, msg);
-		client->heartbeat.count += 1;
+	j.EndObject();
+
+	String payload_json = Jsonify_BuildString(&j);
+
+	uint8_t buffer[4096];
+	int     len = 0;
+
+	if (!msg.attachments.count) {
+		*body         = payload_json;
+		*content_type = "application/json";
+	} else {
+		Http_Multipart multipart = Http_MultipartBegin(arena);
+		if (!Http_MultipartData(&multipart, payload_json, "application/json", "name=\"payload_json\""))
+			return false;
+		for (int id = 0; id < (int)msg.attachments.count; ++id) {
+			const auto &attachment = msg.attachments[id];
+			len = snprintf((char *)buffer, sizeof(buffer), "name=\"files[%d]\"; filename=\"" StrFmt "\"", id, StrArg(attachment.filename));
+			String content_disposition(buffer, len);
+			if (!Http_MultipartReference(&multipart, attachment.content, attachment.content_type, content_disposition))
+				return false;
+		}
+
+		*segments = Http_MultipartEndSegments(&multipart);
+		if (!segments->count)
+			return false;
+
+		String boundary = String(multipart.boundary, HTTP_MULTIPART_LENGTH);
+		*content_type = FmtStr(arena, "multipart/form-data; boundary=" StrFmt, StrArg(boundary));
 	}
 
-	void GuildMembersRequestCommand(Client *client, const GuildMembersRequest &req_guild_mems) {
-		Jsonify j(client->scratch);
-		j.BeginObject();
-		j.KeyValue("op", (int)Opcode::REQUEST_GUILD_MEMBERS);
-		j.PushKey("d");
-		Discord_Jsonify(req_guild_mems, &j);
-		j.EndObject();
-		String msg = Jsonify_BuildString(&j);
-		Websocket_SendText(client->websocket, msg);
+	return true;
+}
+
+static bool Discord_BuildMessagePatch(Memory_Arena *arena, const Discord::MessagePatch &msg, String *content_type, String *body, Array_View<Buffer> *segments) {
+	Jsonify j(arena);
+
+	j.BeginObject();
+
+	if (msg.content) j.KeyValue("content", *msg.content);
+	if (msg.flags) j.KeyValue("flags", *msg.flags);
+
+	if (msg.embeds.count) {
+		j.PushKey("embeds");
+		j.BeginArray();
+		for (const auto &embed : msg.embeds)
+			Discord_Jsonify(embed, &j);
+		j.EndArray();
 	}
 
-	void VoiceStateUpdateCommand(Client *client, const VoiceStateUpdate &update_voice_state) {
-		Jsonify j(client->scratch);
-		j.BeginObject();
-		j.KeyValue("op", (int)Opcode::UPDATE_VOICE_STATE);
-		j.PushKey("d");
-		Discord_Jsonify(update_voice_state, &j);
-		j.EndObject();
-		String msg = Jsonify_BuildString(&j);
-		Websocket_SendText(client->websocket, msg);
+	if (msg.allowed_mentions) {
+		j.PushKey("allowed_mentions");
+		Discord_Jsonify(*msg.allowed_mentions, &j);
 	}
 
-	void PresenceUpdateCommand(Client *client, const PresenceUpdate &presence_update) {
-		Jsonify j(client->scratch);
-		j.BeginObject();
-		j.KeyValue("op", (int)Opcode::UPDATE_PRESECE);
-		j.PushKey("d");
-		Discord_Jsonify(presence_update, &j);
-		j.EndObject();
-		String msg = Jsonify_BuildString(&j);
-		Websocket_SendText(client->websocket, msg);
+	if (msg.components.count) {
+		j.PushKey("components");
+		j.BeginArray();
+		for (const auto &comp : msg.components)
+			Discord_Jsonify(comp, &j);
+		j.EndArray();
 	}
 
-	void Login(const String token, int32_t intents, EventHandler onevent, PresenceUpdate *presence, ClientSpec spec) {
-		Assert(spec.tick_ms >= 0);
+	if (msg.attachments.count) {
+		j.PushKey("attachments");
+		j.BeginArray();
+		for (int id = 0; id < (int)msg.attachments.count; ++id) {
+			j.BeginObject();
+			j.KeyValue("id", id);
+			j.KeyValue("filename", msg.attachments[id].filename);
+			if (msg.attachments[id].description.length)
+				j.KeyValue("description", msg.attachments[id].description);
+			j.EndObject();
+		}
+		j.EndArray();
+	}
 
-		constexpr ClientSpec DefaultClientSpec = ClientSpec();
-		
-		int tick          = spec.tick_ms;
-		spec.scratch_size = Maximum(spec.scratch_size, DefaultClientSpec.scratch_size);
-		spec.read_size    = Maximum(spec.read_size,    DefaultClientSpec.read_size);
-		spec.write_size   = Maximum(spec.write_size,   DefaultClientSpec.write_size);
-		spec.queue_size   = Maximum(spec.queue_size,   DefaultClientSpec.queue_size);
+	j.EndObject();
 
-		Websocket_Spec websocket_spec;
-		websocket_spec.read_size  = spec.read_size;
-		websocket_spec.write_size = spec.write_size;
-		websocket_spec.queue_size = spec.queue_size;
+	String payload_json = Jsonify_BuildString(&j);
 
-		Memory_Arena *arena = MemoryArenaAllocate(spec.scratch_size);
-		Defer{ if (arena) MemoryArenaFree(arena); };
+	uint8_t buffer[4096];
+	int     len = 0;
 
-		if (!arena) {
-			LogErrorEx("Discord", "Memory allocation failed");
-			return;
+	if (!msg.attachments.count) {
+		*body         = payload_json;
+		*content_type = "application/json";
+	} else {
+		Http_Multipart multipart = Http_MultipartBegin(arena);
+		if (!Http_MultipartData(&multipart, payload_json, "application/json", "name=\"payload_json\""))
+			return false;
+		for (int id = 0; id < (int)msg.attachments.count; ++id) {
+			const auto &attachment = msg.attachments[id];
+			len = snprintf((char *)buffer, sizeof(buffer), "name=\"files[%d]\"; filename=\"" StrFmt "\"", id, StrArg(attachment.filename));
+			String content_disposition(buffer, len);
+			if (!Http_MultipartReference(&multipart, attachment.content, attachment.content_type, content_disposition))
+				return false;
 		}
 
-		Discord::Client client;
-		client.scratch    = arena;
-		client.allocator  = spec.allocator;
-		client.identify   = Discord::Identify(token, intents, presence);
-		client.onevent    = onevent;
-		client.running    = true;
-		client.closing    = false;
+		*segments = Http_MultipartEndSegments(&multipart);
+		if (!segments->count)
+			return false;
 
-		client.identify.shard[0] = spec.shards[0];
-		client.identify.shard[1] = spec.shards[1];
+		String boundary = String(multipart.boundary, HTTP_MULTIPART_LENGTH);
+		*content_type = FmtStr(arena, "multipart/form-data; boundary=" StrFmt, StrArg(boundary));
+	}
 
-		client.identify.properties.browser = "Katachi";
-		client.identify.properties.device  = "Katachi";
+	return true;
+}
 
-		client.authorization = FmtStr(client.allocator, "Bot " StrFmt, StrArg(client.identify.token));
+static String Discord_BuildChannelPatch(Memory_Arena *arena, const Discord::ChannelPatch &patch) {
+	Jsonify j(arena);
 
-		ThreadContext.allocator = MemoryArenaAllocator(arena);
+	j.BeginObject();
 
-		Discord_SetupEventHandlers(&client.onevent);
+	if (patch.name.length)
+		j.KeyValue("name", patch.name);
 
-		while (client.running) {
-			client.heartbeat = Discord::Heartbeat();
+	if (patch.icon.length)
+		j.KeyValue("icon", patch.icon);
 
-			for (int reconnect = 0; !client.websocket; ++reconnect) {
-				client.websocket = Discord_ConnectToGateway(token, arena, spec.allocator, websocket_spec);
-				if (!client.websocket) {
-					int maximum_backoff = 32; // secs
-					int wait_time = Minimum((int)powf(2.0f, (float)reconnect), maximum_backoff);
-					LogInfoEx("Discord", "Reconnect after %d secs...", wait_time);
-					wait_time = wait_time * 1000 + rand() % 1000; // to ms
-					Thread_Sleep(wait_time);
-					LogInfoEx("Discord", "Reconnecting...");
-				}
-			}
+	if (patch.type)
+		j.KeyValue("type", (int)*patch.type);
 
-			clock_t counter            = clock();
-			client.heartbeat.remaining = client.heartbeat.interval;
+	if (patch.position)
+		j.KeyValue("position", *patch.position);
 
-			while (Websocket_IsConnected(client.websocket)) {
-				Websocket_Event event;
-				Websocket_Result res = Websocket_Receive(client.websocket, &event, client.scratch, tick);
+	if (patch.topic.length)
+		j.KeyValue("topic", patch.topic);
 
-				if (res == WEBSOCKET_E_CLOSED) break;
+	if (patch.nsfw)
+		j.KeyValue("nsfw", *patch.nsfw);
 
-				if (res == WEBSOCKET_OK) {
-					Discord_HandleWebsocketEvent(&client, event);
-				} else if (res == WEBSOCKET_E_NOMEM) {
-					LogWarningEx("Discord", "Packet lost. Reason: Buffer size too small");
-				}
+	if (patch.rate_limit_per_user)
+		j.KeyValue("rate_limit_per_user", *patch.rate_limit_per_user);
 
-				clock_t new_counter = clock();
-				float spent = (1000.0f * (new_counter - counter)) / CLOCKS_PER_SEC;
-				client.heartbeat.remaining -= spent;
-				counter = new_counter;
+	if (patch.bitrate)
+		j.KeyValue("bitrate", *patch.bitrate);
 
-				if (client.heartbeat.remaining <= 0) {
-					client.heartbeat.remaining = client.heartbeat.interval;
-					Discord::HearbeatCommand(&client);
-					TraceEx("Discord", "Heartbeat (%d)", client.heartbeat.count);
-				}
+	if (patch.user_limit)
+		j.KeyValue("user_limit", *patch.user_limit);
 
-				if (res == WEBSOCKET_E_WAIT) {
-					client.onevent.tick(&client);
-				}
+	if (patch.permission_overwrites.count) {
+		j.PushKey("permission_overwrites");
+		j.BeginArray();
+		for (const auto &overwrite : patch.permission_overwrites) {
+			Discord_Jsonify(overwrite, &j);
+		}
+		j.EndArray();
+	}
 
-				MemoryArenaReset(client.scratch);
-			}
+	if (patch.parent_id.value)
+		j.KeyValue("parent_id", patch.parent_id.value);
 
-			Websocket_Disconnect(client.websocket);
-			client.websocket = nullptr;
-		}
+	if (patch.rtc_region) {
+		if (patch.rtc_region->length)
+			j.KeyValue("rtc_region", *patch.rtc_region);
+		else
+			j.KeyNull("rtc_region");
 	}
 
-	void LoginSharded(const String token, int32_t intents, EventHandler onevent, PresenceUpdate *presence, int32_t shard_count, const ShardSpec &specs) {
-		Memory_Arena *arena = MemoryArenaAllocate(KiloBytes(128));
+	if (patch.video_quality_mode)
+		j.KeyValue("video_quality_mode", *patch.video_quality_mode);
 
-		Discord_GatewayResponse response;
+	if (patch.default_auto_archive_duration)
+		j.KeyValue("default_auto_archive_duration", *patch.default_auto_archive_duration);
 
-		for (int reconnect = 0; ; ++reconnect) {
-			if (Discord_ConnectToGatewayBot(token, arena, &response))
-				break;
+	j.EndObject();
 
-			int maximum_backoff = 32; // secs
-			int wait_time = Minimum((int)powf(2.0f, (float)reconnect), maximum_backoff);
-			LogInfoEx("Discord", "Reconnect after %d secs...", wait_time);
-			wait_time = wait_time * 1000 + rand() % 1000; // to ms
-			Thread_Sleep(wait_time);
-			LogInfoEx("Discord", "Reconnecting...");
-		}
+	return Jsonify_BuildString(&j);
+}
 
-		if (shard_count <= 0) {
-			shard_count = response.shards;
-		}
+static String Discord_BuildBulkDelete(Memory_Arena *arena, Array_View<Discord::Snowflake> messages_ids) {
+	Jsonify j(arena);
+	j.BeginObject();
+	j.PushKey("messages");
+	j.BeginArray();
+	for (const auto id : messages_ids) {
+		j.PushId(id.value);
+	}
+	j.EndArray();
 
-		Thread_Context_Params params = ThreadContextDefaultParams;
-		params.logger                = ThreadContext.logger;
+	j.EndObject();
 
-		Discord_ShardThread *shards = PushArray(arena, Discord_ShardThread, shard_count);
-		if (!shards) {
-			MemoryArenaFree(arena);
-			LogErrorEx("Discord", "Failed to allocate memory to launch shards");
-			return;
-		}
+	return Jsonify_BuildString(&j);
+}
 
-		TraceEx("Discord", "Shard count: %d", shard_count);
+//
+//
+//
 
-		int max_concurrency = response.session_start_limit.max_concurrency;
+constexpr int DISCORD_RATE_LIMIT_ROUTES      = 256;
+constexpr int DISCORD_RATE_LIMIT_BUCKETS     = 512;
+constexpr int DISCORD_RATE_LIMIT_RETRIES     = 3;
+constexpr int DISCORD_RATE_LIMIT_SYNC_WAIT   = 30000; // longest a synchronous request sleeps on its bucket
+constexpr int DISCORD_RATE_LIMIT_NO_TIMEOUT  = -1;
+constexpr int DISCORD_GLOBAL_RATE_LIMIT      = 50; // requests per second for the whole process
+constexpr int DISCORD_GLOBAL_RATE_LIMIT_MS   = 1000;
+constexpr int DISCORD_REST_LOOKAHEAD         = 16;
+constexpr int DISCORD_HTTP2_STREAMS          = 32;
+constexpr int DISCORD_HTTP2_POLL_MS          = 50;
+
+struct Discord_Route {
+	uint64_t path;  // method and path, with the ids other than the major parameter stripped
+	uint64_t major; // channel, guild or webhook the request acts on
+};
 
-		for (int32_t shard_id = 0; shard_id < shard_count - 1; ++shard_id) {
-			Discord_ShardThread *shard = &shards[shard_id];
-			shard->token               = token;
-			shard->intents             = intents;
-			shard->onevent             = onevent;
-			shard->presence            = nullptr;
+struct Discord_Route_Bucket {
+	uint64_t path;
+	uint64_t bucket; // hash of X-RateLimit-Bucket
+};
 
-			if (shard_id < specs.specs.count) {
-				shard->spec = specs.specs[shard_id];
-			} else {
-				shard->spec = specs.default_spec;
-				shard->spec.shards[0] = shard_id;
-				shard->spec.shards[1] = shard_count;
-			}
+struct Discord_Rate_Limit {
+	uint64_t key;
+	int32_t  limit;
+	int32_t  remaining;
+	uint64_t reset;
+	uint64_t used;
+};
 
-			shard->handle = Thread_Create(Discord_ShardThreadProc, shard, 0, params);
+struct Discord_Rate_Limiter {
+	Atomic_Guard         guard;
+	Discord_Route_Bucket routes[DISCORD_RATE_LIMIT_ROUTES];
+	Discord_Rate_Limit   buckets[DISCORD_RATE_LIMIT_BUCKETS];
+	uint64_t             global_window;
+	int32_t              global_count;
+	uint64_t             global_reset; // set when Discord reports the global limit was hit
+};
 
-			int rate_limit_key = shard_id % max_concurrency;
-			if (!shard_id && !rate_limit_key) {
-				Thread_Sleep(5000);
-			}
-		}
+// Shared by every shard of the process since the global limit applies to the bot token
+static Discord_Rate_Limiter DiscordRateLimiter;
 
-		int32_t shard_id = shard_count - 1;
-		Discord_ShardThread *shard = &shards[shard_id];
+static uint64_t Discord_Hash(uint64_t hash, String str) {
+	for (ptrdiff_t index = 0; index < str.length; ++index) {
+		hash ^= str.data[index];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
 
-		shard->token    = token;
-		shard->intents  = intents;
-		shard->onevent  = onevent;
-		shard->presence = presence;
+static Discord_Route Discord_GetRoute(String method, String endpoint) {
+	constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
 
-		if (shard_id < specs.specs.count) {
-			shard->spec = specs.specs[shard_id];
+	Discord_Route route;
+	route.path  = Discord_Hash(FNV_OFFSET_BASIS, method);
+	route.major = 0;
+
+	String previous;
+	ptrdiff_t pos = 0;
+
+	while (pos < endpoint.length) {
+		ptrdiff_t end = StrFindChar(endpoint, '/', pos + 1);
+		if (end < 0) end = endpoint.length;
+
+		String segment = SubStr(endpoint, pos + 1, end - pos - 1);
+
+		bool major = !route.major && (previous == "channels" || previous == "guilds" || previous == "webhooks");
+		ptrdiff_t id;
+
+		if (major) {
+			route.major = Discord_Hash(FNV_OFFSET_BASIS, segment);
+			route.path  = Discord_Hash(route.path, "/:major");
+		} else if (previous == "reactions") {
+			// Every emoji shares the bucket of the message
+			route.path = Discord_Hash(route.path, "/:emoji");
+		} else if (segment.length && ParseInt(segment, &id)) {
+			route.path = Discord_Hash(route.path, "/:id");
 		} else {
-			shards[shard_id].spec = specs.default_spec;
-			shard->spec.shards[0] = shard_id;
-			shard->spec.shards[1] = shard_count;
+			route.path = Discord_Hash(route.path, String(endpoint.data + pos, end - pos));
 		}
-		
-		shard->handle = nullptr;
 
-		Discord_ShardThreadProc(shard);
+		previous = segment;
+		pos      = end;
+	}
 
-		for (int32_t shard_id = 0; shard_id < shard_count - 1; ++shard_id) {
-			Thread_Wait(shards[shard_id].handle, -1);
+	return route;
+}
+
+static uint64_t Discord_ParseMillisecs(String secs) {
+	uint64_t millisecs = 0;
+	ptrdiff_t index    = 0;
+
+	for (; index < secs.length && IsNumber(secs[index]); ++index)
+		millisecs = millisecs * 10 + (secs[index] - '0');
+	millisecs *= 1000;
+
+	if (index < secs.length && secs[index] == '.') {
+		index += 1;
+		uint64_t scale = 100;
+		for (; index < secs.length && IsNumber(secs[index]); ++index) {
+			millisecs += (secs[index] - '0') * scale;
+			scale /= 10;
 		}
+		// Rounded up by a millisecond to never retry early
+		millisecs += 1;
+	}
 
-		for (int32_t shard_id = 0; shard_id < shard_count - 1; ++shard_id) {
-			Thread_Destroy(shards[shard_id].handle);
+	return millisecs;
+}
+
+static uint64_t Discord_RateLimitKey(const Discord_Route &route) {
+	uint64_t bucket = route.path;
+	for (const Discord_Route_Bucket &entry : DiscordRateLimiter.routes) {
+		if (entry.path == route.path && entry.bucket) {
+			bucket = entry.bucket;
+			break;
 		}
+	}
+	return bucket ^ (route.major * 0x9e3779b97f4a7c15ull);
+}
 
-		MemoryArenaFree(arena);
+static Discord_Rate_Limit *Discord_RateLimitFind(uint64_t key) {
+	for (Discord_Rate_Limit &limit : DiscordRateLimiter.buckets) {
+		if (limit.key == key)
+			return &limit;
 	}
+	return nullptr;
+}
 
-	void Logout(Client *client) {
-		if (client->running && !client->closing) {
-			LogInfoEx("Discord", "Logging out...");
-			Websocket_Close(client->websocket, WEBSOCKET_CLOSE_NORMAL);
-			client->closing = true;
+// Returns the number of milliseconds to wait before the route can be used, when zero is returned a request
+// has been accounted for in the global limit and the bucket of the route if reserve is set
+static uint64_t Discord_RateLimitAcquire(const Discord_Route &route, bool reserve) {
+	uint64_t now  = Net_GetMilliseconds();
+	uint64_t wait = 0;
+
+	SpinLock(&DiscordRateLimiter.guard);
+
+	if (now < DiscordRateLimiter.global_reset) {
+		wait = DiscordRateLimiter.global_reset - now;
+	} else {
+		if (now - DiscordRateLimiter.global_window >= DISCORD_GLOBAL_RATE_LIMIT_MS) {
+			DiscordRateLimiter.global_window = now;
+			DiscordRateLimiter.global_count  = 0;
 		}
-	}
 
-	Shard GetShard(Client *client) {
-		return { client->identify.shard[0], client->identify.shard[1] };
+		if (DiscordRateLimiter.global_count >= DISCORD_GLOBAL_RATE_LIMIT)
+			wait = DiscordRateLimiter.global_window + DISCORD_GLOBAL_RATE_LIMIT_MS - now;
 	}
 
-	void Initialize() {
-		Net_Initialize();
-		srand((unsigned int)time(0));
+	Discord_Rate_Limit *limit = Discord_RateLimitFind(Discord_RateLimitKey(route));
+
+	if (limit && now >= limit->reset && limit->remaining <= 0) {
+		// Optimistically refilled, the next response corrects it
+		limit->remaining = Maximum(limit->limit, 1);
 	}
 
-	Channel *GetChannel(Client *client, Snowflake channel_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu", channel_id);
+	if (limit && limit->remaining <= 0)
+		wait = Maximum(wait, limit->reset - now);
 
-		Json res;
-		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
-			Channel *channel = new Channel;
-			if (channel)
-				Discord_Deserialize(JsonGetObject(res), channel);
-			return channel;
+	if (!wait && reserve) {
+		DiscordRateLimiter.global_count += 1;
+		if (limit) {
+			limit->remaining -= 1;
+			limit->used       = now;
 		}
-		return nullptr;
 	}
 
-	Channel *ModifyChannel(Client *client, Snowflake channel_id, const ChannelPatch &patch) {
-		Jsonify j(client->scratch);
+	SpinUnlock(&DiscordRateLimiter.guard);
 
-		j.BeginObject();
+	return wait;
+}
 
-		if (patch.name.length)
-			j.KeyValue("name", patch.name);
+// Gives back a request reserved by Discord_RateLimitAcquire that was never sent
+static void Discord_RateLimitRelease(const Discord_Route &route) {
+	SpinLock(&DiscordRateLimiter.guard);
 
-		if (patch.icon.length)
-			j.KeyValue("icon", patch.icon);
+	if (DiscordRateLimiter.global_count > 0)
+		DiscordRateLimiter.global_count -= 1;
 
-		if (patch.type)
-			j.KeyValue("type", (int)*patch.type);
+	Discord_Rate_Limit *limit = Discord_RateLimitFind(Discord_RateLimitKey(route));
+	if (limit && limit->remaining < limit->limit)
+		limit->remaining += 1;
 
-		if (patch.position)
-			j.KeyValue("position", *patch.position);
+	SpinUnlock(&DiscordRateLimiter.guard);
+}
 
-		if (patch.topic.length)
-			j.KeyValue("topic", patch.topic);
+// Returns the number of milliseconds after which the request may be retried if it was rate limited
+static uint64_t Discord_RateLimitUpdate(const Discord_Route &route, Http_Response *res) {
+	uint64_t now = Net_GetMilliseconds();
 
-		if (patch.nsfw)
-			j.KeyValue("nsfw", *patch.nsfw);
+	String bucket      = Http_GetHeader(res, "X-RateLimit-Bucket");
+	String limit       = Http_GetHeader(res, "X-RateLimit-Limit");
+	String remaining   = Http_GetHeader(res, "X-RateLimit-Remaining");
+	String reset_after = Http_GetHeader(res, "X-RateLimit-Reset-After");
+	String global      = Http_GetHeader(res, "X-RateLimit-Global");
+	String retry_after = Http_GetHeader(res, HTTP_HEADER_RETRY_AFTER);
 
-		if (patch.rate_limit_per_user)
-			j.KeyValue("rate_limit_per_user", *patch.rate_limit_per_user);
+	bool     limited = res->status.code == 429;
+	uint64_t retry   = 0;
 
-		if (patch.bitrate)
-			j.KeyValue("bitrate", *patch.bitrate);
+	if (limited) {
+		retry = Discord_ParseMillisecs(retry_after.length ? retry_after : reset_after);
+		retry = Maximum(retry, 1);
+	}
 
-		if (patch.user_limit)
-			j.KeyValue("user_limit", *patch.user_limit);
+	SpinLock(&DiscordRateLimiter.guard);
 
-		if (patch.permission_overwrites.count) {
-			j.PushKey("permission_overwrites");
-			j.BeginArray();
-			for (const auto &overwrite : patch.permission_overwrites) {
-				Discord_Jsonify(overwrite, &j);
-			}
-			j.EndArray();
-		}
+	if (limited && StrMatchICase(global, "true")) {
+		DiscordRateLimiter.global_reset = Maximum(DiscordRateLimiter.global_reset, now + retry);
+		SpinUnlock(&DiscordRateLimiter.guard);
+		return retry;
+	}
 
-		if (patch.parent_id.value)
-			j.KeyValue("parent_id", patch.parent_id.value);
+	if (bucket.length) {
+		uint64_t bucket_hash = Discord_Hash(0xcbf29ce484222325ull, bucket);
 
-		if (patch.rtc_region) {
-			if (patch.rtc_region->length)
-				j.KeyValue("rtc_region", *patch.rtc_region);
-			else
-				j.KeyNull("rtc_region");
+		Discord_Route_Bucket *dst = nullptr;
+		for (Discord_Route_Bucket &entry : DiscordRateLimiter.routes) {
+			if (entry.path == route.path || !entry.bucket) {
+				dst = &entry;
+				break;
+			}
 		}
 
-		if (patch.video_quality_mode)
-			j.KeyValue("video_quality_mode", *patch.video_quality_mode);
+		// Table is full, routes that are rarely used are relearnt from their next response
+		if (!dst) dst = &DiscordRateLimiter.routes[route.path % DISCORD_RATE_LIMIT_ROUTES];
 
-		if (patch.default_auto_archive_duration)
-			j.KeyValue("default_auto_archive_duration", *patch.default_auto_archive_duration);
+		dst->path   = route.path;
+		dst->bucket = bucket_hash;
+	}
 
-		j.EndObject();
+	if (bucket.length || limited) {
+		uint64_t key = Discord_RateLimitKey(route);
 
-		String endpoint = FmtStr(client->scratch, "/channels/%zu", channel_id);
-		String body     = Jsonify_BuildString(&j);
+		Discord_Rate_Limit *dst = Discord_RateLimitFind(key);
+		if (!dst) {
+			// Replace the least recently used bucket
+			dst = &DiscordRateLimiter.buckets[0];
+			for (Discord_Rate_Limit &entry : DiscordRateLimiter.buckets) {
+				if (entry.used < dst->used)
+					dst = &entry;
+			}
+			memset(dst, 0, sizeof(*dst));
+			dst->key = key;
+		}
 
-		Json res;
-		if (Discord_Patch(client, endpoint, "application/json", body, &res)) {
-			Channel *channel = new Channel;
-			if (channel)
-				Discord_Deserialize(JsonGetObject(res), channel);
-			return channel;
+		ptrdiff_t value;
+		if (limit.length && ParseInt(limit, &value))
+			dst->limit = (int32_t)value;
+		if (remaining.length && ParseInt(remaining, &value))
+			dst->remaining = (int32_t)value;
+		if (reset_after.length)
+			dst->reset = now + Discord_ParseMillisecs(reset_after);
+
+		if (limited) {
+			dst->remaining = 0;
+			dst->reset     = Maximum(dst->reset, now + retry);
 		}
-		return nullptr;
+
+		dst->used = now;
 	}
 
-	Channel *DeleteChannel(Client *client, Snowflake channel_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu", channel_id);
+	SpinUnlock(&DiscordRateLimiter.guard);
 
-		Json res;
-		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
-			Channel *channel = new Channel;
-			if (channel)
-				Discord_Deserialize(JsonGetObject(res), channel);
-			return channel;
+	return retry;
+}
+
+// Sleeps until the route can be used. REST workers wait for as long as it takes, synchronous requests run
+// on the calling thread so they give up once the total wait would exceed max_wait milliseconds
+static bool Discord_RateLimitWait(const Discord_Route &route, int max_wait) {
+	uint64_t waited = 0;
+	for (uint64_t wait = Discord_RateLimitAcquire(route, true); wait; wait = Discord_RateLimitAcquire(route, true)) {
+		if (max_wait != DISCORD_RATE_LIMIT_NO_TIMEOUT && waited + wait > (uint64_t)max_wait) {
+			LogWarningEx("Discord", "Rate limited, request can be retried after %d ms", (int)wait);
+			return false;
 		}
-		return nullptr;
+		TraceEx("Discord", "Rate limited, waiting %d ms", (int)wait);
+		Thread_Sleep((int)wait);
+		waited += wait;
 	}
+	return true;
+}
 
-	Array_View<Message> GetChannelMessages(Client *client, Snowflake channel_id, int limit, Snowflake around, Snowflake before, Snowflake after) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages", channel_id);
+//
+//
+//
 
-		Http_Query_Params params;
-		if (limit > 0)
-			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%d", limit));
-		if (around)
-			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%zu", around.value));
-		else if (before)
-			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%zu", before.value));
-		else if (after)
-			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%zu", after.value));
+typedef void(*Discord_Request_Complete)(Discord::Client *client, Discord::Request *request);
 
-		Json res;
-		if (Discord_Get(client, endpoint, params, "application/json", String(), &res)) {
-			Json_Array arr = JsonGetArray(res);
-			Array<Message> messages;
-			messages.Resize(arr.count);
-			for (ptrdiff_t index = 0; index < messages.count; ++index) {
-				Discord_Deserialize(JsonGetObject(arr[index]), &messages[index]);
-			}
-			return messages;
-		}
-		return Array_View<Message>();
+namespace Discord {
+	struct Request {
+		String                   method;
+		String                   endpoint;
+		String                   content_type;
+		String                   body;
+		Array_View<Buffer>       segments;     // multipart body referencing the attachments, sent in place of body
+		Http_Query_Params        params;
+
+		volatile int32_t         status       = (int32_t)RequestStatus::PENDING;
+		uint32_t                 http_status  = 0;
+		Buffer                   response;
+
+		Discord_Request_Complete complete     = nullptr;
+		void *                   callback     = nullptr;
+		void *                   context      = nullptr;
+
+		Memory_Allocator         allocator;
+		ptrdiff_t                allocated    = 0;
+		int32_t                  attempts     = 0; // retries on the HTTP/2 connection
+	};
+}
+
+struct Discord_Rest_Worker {
+	struct Discord_Rest_Queue *queue;
+	Thread *                   thread;
+	Memory_Arena *             arena;
+};
+
+struct Discord_Rest_Queue {
+	Http_Pool *                 http = nullptr;
+	String                      authorization;
+	Memory_Allocator            allocator;
+	Semaphore *                 signal = nullptr;
+	Atomic_Guard                guard;     // protects pending, completed and running
+	Array<Discord::Request *>   pending;   // oldest first
+	Array<Discord::Request *>   completed; // waiting to be dispatched on the gateway thread
+	Net_Socket_Options          socket;    // used by the HTTP/2 connections of the workers
+	ptrdiff_t                   pending_head   = 0; // entries before the heads have been taken
+	ptrdiff_t                   completed_head = 0;
+	Array<Discord_Rest_Worker>  workers;
+	bool                        running = false;
+};
+
+// Taking from the front is O(1), requests skipped over within the lookahead are shifted forward
+static Discord::Request *Discord_RestQueueTake(Array<Discord::Request *> *requests, ptrdiff_t *head, ptrdiff_t index) {
+	Discord::Request *request = (*requests)[index];
+	memmove(requests->data + *head + 1, requests->data + *head, (index - *head) * sizeof(Discord::Request *));
+	*head += 1;
+
+	if (*head == requests->count) {
+		requests->Reset();
+		*head = 0;
 	}
 
-	Message *GetChannelMessage(Client *client, Snowflake channel_id, Snowflake message_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu", channel_id, message_id);
+	return request;
+}
 
-		Json res;
-		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
-			Message *message = new Message;
-			if (message)
-				Discord_Deserialize(JsonGetObject(res), message);
-			return message;
-		}
-		return nullptr;
+// Space before the head is reclaimed once it is half of the array
+static void Discord_RestQueueCompact(Array<Discord::Request *> *requests, ptrdiff_t *head) {
+	if (*head >= DISCORD_REST_LOOKAHEAD && *head * 2 >= requests->count) {
+		memmove(requests->data, requests->data + *head, (requests->count - *head) * sizeof(Discord::Request *));
+		requests->count -= *head;
+		*head = 0;
 	}
+}
 
-	Message *CreateMessage(Client *client, Snowflake channel_id, const MessagePost &msg) {
-		Jsonify j(client->scratch);
+struct Discord_Http2_Stream {
+	Discord_Rest_Queue *queue;
+	Discord::Request *  request; // null when the slot is free
+	Discord_Route       route;
+	Http_Response       response;
+	uint8_t *           body;
+	ptrdiff_t           length;
+	ptrdiff_t           capacity;
+	bool                overflow;
+};
 
-		j.BeginObject();
+//
+// Member Store
+//
 
-		if (msg.content.length)
-			j.KeyValue("content", msg.content);
+constexpr uint32_t DISCORD_MEMBER_EPOCH        = 1420070400; // 2015-01-01, joined_at is stored in seconds since then
+constexpr uint32_t DISCORD_INDEX_INITIAL_SIZE  = 1024;
+constexpr uint32_t DISCORD_STRING_COMPACT_SIZE = KiloBytes(64);
 
-		if (msg.tts)
-			j.KeyValue("tts", msg.tts);
+enum Discord_Member_Flag : uint16_t {
+	DISCORD_MEMBER_BOT     = 0x1,
+	DISCORD_MEMBER_DEAF    = 0x2,
+	DISCORD_MEMBER_MUTE    = 0x4,
+	DISCORD_MEMBER_PENDING = 0x8,
+};
 
-		if (msg.embeds.count) {
-			j.PushKey("embeds");
-			j.BeginArray();
-			for (const auto &embed : msg.embeds)
-				Discord_Jsonify(embed, &j);
-			j.EndArray();
-		}
+// Open addressing with linear probing over 32 bit values, a slot holds value + 1 and 0 when empty
+static void Discord_IndexInsert(Array<uint32_t> *index, uint32_t hash, uint32_t value) {
+	uint32_t mask = (uint32_t)index->count - 1;
+	uint32_t pos  = hash & mask;
+	while (index->data[pos])
+		pos = (pos + 1) & mask;
+	index->data[pos] = value + 1;
+}
 
-		if (msg.allowed_mentions) {
-			j.PushKey("allowed_mentions");
-			Discord_Jsonify(*msg.allowed_mentions, &j);
-		}
+template <typename Hash_Proc>
+static void Discord_IndexRemove(Array<uint32_t> *index, uint32_t hash, uint32_t value, Hash_Proc hash_proc) {
+	uint32_t mask = (uint32_t)index->count - 1;
+	uint32_t pos  = hash & mask;
+	while (index->data[pos] != value + 1) {
+		if (!index->data[pos]) return;
+		pos = (pos + 1) & mask;
+	}
 
-		if (msg.message_reference) {
-			j.PushKey("message_reference");
-			Discord_Jsonify(*msg.message_reference, &j);
+	// Slots after the removed one are shifted back unless they are already at or after their home slot
+	uint32_t hole = pos;
+	for (uint32_t next = (pos + 1) & mask; index->data[next]; next = (next + 1) & mask) {
+		uint32_t home = hash_proc(index->data[next] - 1) & mask;
+		bool     move = hole <= next ? (home <= hole || home > next) : (home <= hole && home > next);
+		if (move) {
+			index->data[hole] = index->data[next];
+			hole = next;
 		}
+	}
+	index->data[hole] = 0;
+}
 
-		if (msg.components.count) {
-			j.PushKey("components");
-			j.BeginArray();
-			for (const auto &comp : msg.components)
-				Discord_Jsonify(comp, &j);
-			j.EndArray();
-		}
+static bool Discord_IndexReset(Array<uint32_t> *index, uint32_t capacity) {
+	index->Reset();
+	return index->Resize(capacity);
+}
 
-		if (msg.sticker_ids.count) {
-			j.PushKey("sticker_ids");
-			j.BeginArray();
-			for (const auto &id : msg.sticker_ids)
-				j.PushId(id.value);
-			j.EndArray();
-		}
+struct Discord_Interned {
+	uint32_t offset;
+	uint32_t length;
+	uint32_t refs;
+	uint32_t hash;
+};
 
-		if (msg.attachments.count) {
-			j.PushKey("attachments");
-			j.BeginArray();
-			for (int id = 0; id < (int)msg.attachments.count; ++id) {
-				j.BeginObject();
-				j.KeyValue("id", id);
-				j.KeyValue("filename", msg.attachments[id].filename);
-				if (msg.attachments[id].description.length)
-					j.KeyValue("description", msg.attachments[id].description);
-				j.EndObject();
-			}
-			j.EndArray();
-		}
+// Names shared by members are stored once with a reference count, id 0 is the empty string
+struct Discord_String_Pool {
+	Array<uint8_t>          bytes;
+	Array<Discord_Interned> strings;
+	Array<uint32_t>         free;
+	Array<uint32_t>         index;
+	uint32_t                live;
+	uint64_t                garbage; // bytes of released strings
+};
 
-		if (msg.flags) j.KeyValue("flags", msg.flags);
+static uint32_t Discord_StringHash(String str) {
+	uint32_t hash = 2166136261u;
+	for (ptrdiff_t index = 0; index < str.length; ++index)
+		hash = (hash ^ str.data[index]) * 16777619u;
+	return hash;
+}
 
-		j.EndObject();
+static String Discord_StringGet(Discord_String_Pool *pool, uint32_t id) {
+	const Discord_Interned &interned = pool->strings[id];
+	return String(pool->bytes.data + interned.offset, interned.length);
+}
 
-		String payload_json = Jsonify_BuildString(&j);
+static bool Discord_StringRebuildIndex(Discord_String_Pool *pool, uint32_t capacity) {
+	if (!Discord_IndexReset(&pool->index, capacity))
+		return false;
+	for (uint32_t id = 1; id < (uint32_t)pool->strings.count; ++id) {
+		if (pool->strings[id].refs)
+			Discord_IndexInsert(&pool->index, pool->strings[id].hash, id);
+	}
+	return true;
+}
 
-		String body;
-		String content_type;
+static void Discord_StringCompact(Discord_String_Pool *pool) {
+	Array<uint8_t> bytes(pool->bytes.allocator);
+	if (!bytes.Reserve(pool->bytes.count - (ptrdiff_t)pool->garbage))
+		return;
 
-		uint8_t buffer[4096];
-		int     len = 0;
+	for (Discord_Interned &interned : pool->strings) {
+		if (!interned.refs) continue;
+		uint32_t offset = (uint32_t)bytes.count;
+		bytes.AddN(interned.length);
+		memcpy(bytes.data + offset, pool->bytes.data + interned.offset, interned.length);
+		interned.offset = offset;
+	}
 
-		if (!msg.attachments.count) {
-			body = payload_json;
-			content_type = "application/json";
-		} else {
-			Http_Multipart multipart = Http_MultipartBegin(client->scratch);
-			if (!Http_MultipartData(&multipart, payload_json, "application/json", "name=\"payload_json\""))
-				return nullptr;
-			for (int id = 0; id < (int)msg.attachments.count; ++id) {
-				const auto &attachment = msg.attachments[id];
-				len = snprintf((char *)buffer, sizeof(buffer), "name=\"files[%d]\"; filename=\"" StrFmt "\"", id, StrArg(attachment.filename));
-				String content_disposition(buffer, len);
-				if (!Http_MultipartData(&multipart, attachment.content, attachment.content_type, content_disposition))
-					return nullptr;
-			}
+	Free(&pool->bytes);
+	pool->bytes   = bytes;
+	pool->garbage = 0;
+}
 
-			body = Http_MultipartEnd(&multipart);
-			
-			String boundary = String(multipart.boundary, HTTP_MULTIPART_LENGTH);
-			len = snprintf((char *)buffer, sizeof(buffer), "multipart/form-data; boundary=" StrFmt, StrArg(boundary));
-			content_type = String(buffer, len);
-		}
+static uint32_t Discord_StringIntern(Discord_String_Pool *pool, String str) {
+	if (!str.length)
+		return 0;
 
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages", channel_id.value);
+	if (!pool->strings.count) {
+		pool->strings.Add(Discord_Interned{});
+		if (!Discord_StringRebuildIndex(pool, DISCORD_INDEX_INITIAL_SIZE))
+			return 0;
+	}
 
-		Json res;
-		if (Discord_Post(client, endpoint, content_type, body, &res)) {
-			Message *message = new Message;
-			if (message)
-				Discord_Deserialize(JsonGetObject(res), message);
-			return message;
+	uint32_t hash = Discord_StringHash(str);
+	uint32_t mask = (uint32_t)pool->index.count - 1;
+	for (uint32_t pos = hash & mask; pool->index[pos]; pos = (pos + 1) & mask) {
+		uint32_t id = pool->index[pos] - 1;
+		if (pool->strings[id].hash == hash && Discord_StringGet(pool, id) == str) {
+			pool->strings[id].refs += 1;
+			return id;
 		}
-		return nullptr;
 	}
 
-	Message *CrossPost(Client *client, Snowflake channel_id, Snowflake message_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/crosspost", channel_id, message_id);
+	if ((pool->live + 1) * 4 > pool->index.count * 3) {
+		if (!Discord_StringRebuildIndex(pool, (uint32_t)pool->index.count * 2))
+			return 0;
+	}
 
-		Json res;
-		if (Discord_Post(client, endpoint, "application/json", String(), &res)) {
-			Message *message = new Message;
-			if (message)
-				Discord_Deserialize(JsonGetObject(res), message);
-			return message;
-		}
+	uint32_t id;
+	if (pool->free.count) {
+		id = pool->free.Last();
+		pool->free.RemoveLast();
+	} else {
+		id = (uint32_t)pool->strings.count;
+		if (!pool->strings.Add())
+			return 0;
+	}
 
-		return nullptr;
+	uint32_t offset = (uint32_t)pool->bytes.count;
+	if (!pool->bytes.AddN((uint32_t)str.length)) {
+		pool->free.Add(id);
+		return 0;
 	}
+	memcpy(pool->bytes.data + offset, str.data, str.length);
 
-	bool CreateReaction(Client *client, Snowflake channel_id, Snowflake message_id, String emoji) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s/@me", channel_id, message_id, StrArg(emoji));
+	pool->strings[id] = Discord_Interned{ offset, (uint32_t)str.length, 1, hash };
+	pool->live       += 1;
+	Discord_IndexInsert(&pool->index, hash, id);
 
-		Json res;
-		if (Discord_Put(client, endpoint, "application/json", String(), &res)) {
-			return true;
-		}
-		return false;
-	}
+	return id;
+}
 
-	bool DeleteReaction(Client *client, Snowflake channel_id, Snowflake message_id, String emoji) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s/@me", channel_id, message_id, StrArg(emoji));
+static void Discord_StringRelease(Discord_String_Pool *pool, uint32_t id) {
+	if (!id) return;
 
-		Json res;
-		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
-			return true;
-		}
-		return false;
-	}
+	Discord_Interned &interned = pool->strings[id];
+	interned.refs -= 1;
+	if (interned.refs)
+		return;
 
-	bool DeleteUserReaction(Client *client, Snowflake channel_id, Snowflake message_id, String emoji, Snowflake user_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s/%zu", channel_id, message_id, StrArg(emoji), user_id);
+	Discord_IndexRemove(&pool->index, interned.hash, id, [pool](uint32_t other) { return pool->strings[other].hash; });
+	pool->live    -= 1;
+	pool->garbage += interned.length;
+	pool->free.Add(id);
 
-		Json res;
-		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
-			return true;
-		}
-		return false;
-	}
+	if (pool->garbage > DISCORD_STRING_COMPACT_SIZE && pool->garbage * 2 > (uint64_t)pool->bytes.count)
+		Discord_StringCompact(pool);
+}
 
-	Array_View<User> GetReactions(Client *client, Snowflake channel_id, Snowflake message_id, String emoji, int32_t after, int32_t limit) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s", channel_id, message_id, StrArg(emoji));
+struct Discord_Member_Guild {
+	Discord::Snowflake id;
+	Array<uint32_t>    rows; // members of the guild, densely packed
+};
 
-		Http_Query_Params params;
-		if (after >= 0)
-			Http_QueryParamSet(&params, "after", FmtStr(client->scratch, "%d", after));
-		if (limit >= 0)
-			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%d", limit));
+// Members are stored as columns with one row per member of a guild and are found by guild and user
+// through an index of row numbers. The role ids of a member are a range of the roles column.
+// Rows that have not been touched for the longest time are evicted when the store grows past budget
+struct Discord_Member_Store {
+	uint64_t                    budget;
+	uint32_t                    clock;      // advanced after every event batch
+	uint32_t                    generation; // gateway session
+
+	Array<uint64_t>             user_id;
+	Array<uint32_t>             guild;      // slot in guilds
+	Array<uint32_t>             guild_pos;  // position in the rows of the guild
+	Array<uint32_t>             roles_offset;
+	Array<uint16_t>             roles_count;
+	Array<uint16_t>             flags;
+	Array<uint32_t>             joined_at;
+	Array<uint32_t>             username;   // interned strings
+	Array<uint32_t>             discriminator;
+	Array<uint32_t>             avatar;
+	Array<uint32_t>             nick;
+	Array<uint32_t>             guild_avatar;
+	Array<uint32_t>             premium_since;
+	Array<uint32_t>             communication_disabled_until;
+	Array<uint64_t>             permissions;
+	Array<uint32_t>             active;     // clock when the row was last updated or read
+	Array<uint32_t>             updated;    // generation in which the row was last updated
+
+	Array<uint64_t>             roles;
+	uint64_t                    roles_garbage;
+
+	Array<uint32_t>             index;
+	Array<Discord_Member_Guild> guilds;
+	Hash_Table<Discord::Snowflake, uint32_t> guild_slots;
+	Discord_String_Pool         strings;
+};
 
-		Json res;
-		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
-			Json_Array arr = JsonGetArray(res);
-			Array<User> users;
-			users.Resize(arr.count);
-			for (ptrdiff_t index = 0; index < users.count; ++index) {
-				Discord_Deserialize(JsonGetObject(arr[index]), &users[index]);
-			}
+// Columns, index slot and position in the rows of the guild
+constexpr uint32_t DISCORD_MEMBER_ROW_SIZE = 2 * sizeof(uint64_t) + 16 * sizeof(uint32_t) + 2 * sizeof(uint16_t);
+
+static void Discord_MemberStoreInit(Discord_Member_Store *store, uint64_t budget, Memory_Allocator allocator) {
+	*store = Discord_Member_Store{};
+	store->budget           = budget;
+	store->user_id          = Array<uint64_t>(allocator);
+	store->guild            = Array<uint32_t>(allocator);
+	store->guild_pos        = Array<uint32_t>(allocator);
+	store->roles_offset     = Array<uint32_t>(allocator);
+	store->roles_count      = Array<uint16_t>(allocator);
+	store->flags            = Array<uint16_t>(allocator);
+	store->joined_at        = Array<uint32_t>(allocator);
+	store->username         = Array<uint32_t>(allocator);
+	store->discriminator    = Array<uint32_t>(allocator);
+	store->avatar           = Array<uint32_t>(allocator);
+	store->nick             = Array<uint32_t>(allocator);
+	store->guild_avatar     = Array<uint32_t>(allocator);
+	store->premium_since    = Array<uint32_t>(allocator);
+	store->communication_disabled_until = Array<uint32_t>(allocator);
+	store->permissions      = Array<uint64_t>(allocator);
+	store->active           = Array<uint32_t>(allocator);
+	store->updated          = Array<uint32_t>(allocator);
+	store->roles            = Array<uint64_t>(allocator);
+	store->index            = Array<uint32_t>(allocator);
+	store->guilds           = Array<Discord_Member_Guild>(allocator);
+	store->guild_slots      = Hash_Table<Discord::Snowflake, uint32_t>(allocator);
+	store->strings.bytes    = Array<uint8_t>(allocator);
+	store->strings.strings  = Array<Discord_Interned>(allocator);
+	store->strings.free     = Array<uint32_t>(allocator);
+	store->strings.index    = Array<uint32_t>(allocator);
+}
+
+static void Discord_MemberStoreFree(Discord_Member_Store *store) {
+	Free(&store->user_id);
+	Free(&store->guild);
+	Free(&store->guild_pos);
+	Free(&store->roles_offset);
+	Free(&store->roles_count);
+	Free(&store->flags);
+	Free(&store->joined_at);
+	Free(&store->username);
+	Free(&store->discriminator);
+	Free(&store->avatar);
+	Free(&store->nick);
+	Free(&store->guild_avatar);
+	Free(&store->premium_since);
+	Free(&store->communication_disabled_until);
+	Free(&store->permissions);
+	Free(&store->active);
+	Free(&store->updated);
+	Free(&store->roles);
+	Free(&store->index);
+	for (Discord_Member_Guild &guild : store->guilds)
+		Free(&guild.rows);
+	Free(&store->guilds);
+	Free(&store->guild_slots);
+	Free(&store->strings.bytes);
+	Free(&store->strings.strings);
+	Free(&store->strings.free);
+	Free(&store->strings.index);
+}
+
+static uint32_t Discord_MemberHash(uint32_t guild, uint64_t user_id) {
+	uint64_t hash = (user_id ^ ((uint64_t)guild << 40)) * 0x9E3779B97F4A7C15ull;
+	return (uint32_t)(hash >> 32);
+}
+
+static ptrdiff_t Discord_MemberFindGuild(Discord_Member_Store *store, Discord::Snowflake guild_id) {
+	uint32_t *slot = store->guild_slots.Find(guild_id);
+	return slot ? (ptrdiff_t)*slot : -1;
+}
+
+static ptrdiff_t Discord_MemberFind(Discord_Member_Store *store, uint32_t guild, uint64_t user_id) {
+	if (!store->index.count)
+		return -1;
+
+	uint32_t mask = (uint32_t)store->index.count - 1;
+	for (uint32_t pos = Discord_MemberHash(guild, user_id) & mask; store->index[pos]; pos = (pos + 1) & mask) {
+		uint32_t row = store->index[pos] - 1;
+		if (store->user_id[row] == user_id && store->guild[row] == guild)
+			return row;
+	}
+	return -1;
+}
+
+static bool Discord_MemberRebuildIndex(Discord_Member_Store *store, uint32_t capacity) {
+	if (!Discord_IndexReset(&store->index, capacity))
+		return false;
+	for (uint32_t row = 0; row < (uint32_t)store->user_id.count; ++row)
+		Discord_IndexInsert(&store->index, Discord_MemberHash(store->guild[row], store->user_id[row]), row);
+	return true;
+}
 
-			return users;
-		}
-		return Array_View<User>();
+static void Discord_MemberSetRoles(Discord_Member_Store *store, uint32_t row, const Json_Array &roles) {
+	uint16_t count = (uint16_t)Minimum(roles.count, (ptrdiff_t)UINT16_MAX);
+
+	// Ranges that don't fit are appended, the old range becomes garbage until the column is compacted
+	if (count > store->roles_count[row]) {
+		store->roles_garbage     += store->roles_count[row];
+		store->roles_offset[row]  = (uint32_t)store->roles.count;
+		store->roles_count[row]   = 0;
+		if (!store->roles.AddN(count))
+			return;
+	} else {
+		store->roles_garbage += store->roles_count[row] - count;
 	}
 
-	bool DeleteAllReactions(Client *client, Snowflake channel_id, Snowflake message_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions", channel_id, message_id);
+	for (uint16_t index = 0; index < count; ++index)
+		store->roles[store->roles_offset[row] + index] = Discord_ParseId(JsonGetString(roles[index])).value;
+	store->roles_count[row] = count;
+}
 
-		Json res;
-		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
-			return true;
-		}
-		return false;
+static void Discord_MemberCompactRoles(Discord_Member_Store *store) {
+	Array<uint64_t> roles(store->roles.allocator);
+	if (!roles.Reserve(store->roles.count - (ptrdiff_t)store->roles_garbage))
+		return;
+
+	for (ptrdiff_t row = 0; row < store->user_id.count; ++row) {
+		uint32_t offset = (uint32_t)roles.count;
+		roles.AddN(store->roles_count[row]);
+		memcpy(roles.data + offset, store->roles.data + store->roles_offset[row], store->roles_count[row] * sizeof(uint64_t));
+		store->roles_offset[row] = offset;
 	}
 
-	bool DeleteAllReactionsForEmoji(Client *client, Snowflake channel_id, Snowflake message_id, String emoji) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s", channel_id, message_id, StrArg(emoji));
+	Free(&store->roles);
+	store->roles         = roles;
+	store->roles_garbage = 0;
+}
 
-		Json res;
-		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
-			return true;
-		}
-		return false;
-	}
+static void Discord_MemberSetString(Discord_Member_Store *store, uint32_t *column, String str) {
+	uint32_t id = Discord_StringIntern(&store->strings, str);
+	Discord_StringRelease(&store->strings, *column);
+	*column = id;
+}
 
-	Message *EditMessage(Client *client, Snowflake channel_id, Snowflake message_id, const MessagePatch &msg) {
-		Jsonify j(client->scratch);
+static void Discord_MemberStorePut(Discord_Member_Store *store, Discord::Snowflake guild_id, const Json &json) {
+	Json_Object obj  = JsonGetObject(json);
+	Json_Object user = JsonGetObject(obj, "user");
+	uint64_t user_id = Discord_ParseId(JsonGetString(user, "id")).value;
+	if (!user_id || !store->budget) return;
 
-		j.BeginObject();
+	ptrdiff_t guild = Discord_MemberFindGuild(store, guild_id);
+	if (guild < 0) {
+		Discord_Member_Guild *slot = store->guilds.Add();
+		if (!slot) return;
+		slot->id   = guild_id;
+		slot->rows = Array<uint32_t>(store->guilds.allocator);
+		guild      = store->guilds.count - 1;
+		store->guild_slots.Put(guild_id, (uint32_t)guild);
+	}
 
-		if (msg.content) j.KeyValue("content", *msg.content);
-		if (msg.flags) j.KeyValue("flags", *msg.flags);
+	ptrdiff_t row = Discord_MemberFind(store, (uint32_t)guild, user_id);
 
-		if (msg.embeds.count) {
-			j.PushKey("embeds");
-			j.BeginArray();
-			for (const auto &embed : msg.embeds)
-				Discord_Jsonify(embed, &j);
-			j.EndArray();
+	if (row < 0) {
+		if (!store->index.count || (store->user_id.count + 1) * 4 > store->index.count * 3) {
+			if (!Discord_MemberRebuildIndex(store, store->index.count ? (uint32_t)store->index.count * 2 : DISCORD_INDEX_INITIAL_SIZE))
+				return;
 		}
 
-		if (msg.allowed_mentions) {
-			j.PushKey("allowed_mentions");
-			Discord_Jsonify(*msg.allowed_mentions, &j);
-		}
+		row = store->user_id.count;
+		store->user_id.Add(user_id);
+		store->guild.Add((uint32_t)guild);
+		store->guild_pos.Add((uint32_t)store->guilds[guild].rows.count);
+		store->roles_offset.Add(0);
+		store->roles_count.Add(0);
+		store->flags.Add(0);
+		store->joined_at.Add(0);
+		store->username.Add(0);
+		store->discriminator.Add(0);
+		store->avatar.Add(0);
+		store->nick.Add(0);
+		store->guild_avatar.Add(0);
+		store->premium_since.Add(0);
+		store->communication_disabled_until.Add(0);
+		store->permissions.Add(0);
+		store->active.Add(0);
+		store->updated.Add(0);
+		store->guilds[guild].rows.Add((uint32_t)row);
+
+		Discord_IndexInsert(&store->index, Discord_MemberHash((uint32_t)guild, user_id), (uint32_t)row);
+	}
+
+	// Updates may be partial, fields that are not present are kept
+	if (user.Find("username")) {
+		Discord_MemberSetString(store, &store->username[row], JsonGetString(user, "username"));
+		Discord_MemberSetString(store, &store->discriminator[row], JsonGetString(user, "discriminator"));
+		Discord_MemberSetString(store, &store->avatar[row], JsonGetString(user, "avatar"));
+	}
+
+	if (obj.Find("nick"))
+		Discord_MemberSetString(store, &store->nick[row], JsonGetString(obj, "nick"));
+
+	if (obj.Find("avatar"))
+		Discord_MemberSetString(store, &store->guild_avatar[row], JsonGetString(obj, "avatar"));
+
+	if (obj.Find("permissions"))
+		store->permissions[row] = Discord_ParseBigInt(JsonGetString(obj, "permissions"));
+
+	Json roles = JsonGet(obj, "roles");
+	if (roles.type == JSON_TYPE_ARRAY)
+		Discord_MemberSetRoles(store, (uint32_t)row, JsonGetArray(roles));
+
+	const struct { String key; Array<uint32_t> *column; } timestamps[] = {
+		{ "joined_at", &store->joined_at }, { "premium_since", &store->premium_since },
+		{ "communication_disabled_until", &store->communication_disabled_until },
+	};
 
-		if (msg.components.count) {
-			j.PushKey("components");
-			j.BeginArray();
-			for (const auto &comp : msg.components)
-				Discord_Jsonify(comp, &j);
-			j.EndArray();
-		}
+	// A null timestamp clears the column, a missing one is kept
+	for (const auto &field : timestamps) {
+		if (!obj.Find(field.key)) continue;
+		Discord::Timestamp value = Discord_ParseTimestamp(JsonGetString(obj, field.key));
+		(*field.column)[row] = value.value > DISCORD_MEMBER_EPOCH ? (uint32_t)(value.value - DISCORD_MEMBER_EPOCH) : 0;
+	}
 
-		if (msg.attachments.count) {
-			j.PushKey("attachments");
-			j.BeginArray();
-			for (int id = 0; id < (int)msg.attachments.count; ++id) {
-				j.BeginObject();
-				j.KeyValue("id", id);
-				j.KeyValue("filename", msg.attachments[id].filename);
-				if (msg.attachments[id].description.length)
-					j.KeyValue("description", msg.attachments[id].description);
-				j.EndObject();
+	const struct { String key; Json_Object *obj; uint16_t flag; } bools[] = {
+		{ "bot", &user, DISCORD_MEMBER_BOT }, { "deaf", &obj, DISCORD_MEMBER_DEAF },
+		{ "mute", &obj, DISCORD_MEMBER_MUTE }, { "pending", &obj, DISCORD_MEMBER_PENDING },
+	};
+
+	for (const auto &field : bools) {
+		Json value = JsonGet(*field.obj, field.key);
+		if (value.type == JSON_TYPE_BOOL)
+			store->flags[row] = value.value.boolean ? (store->flags[row] | field.flag) : (store->flags[row] & ~field.flag);
+	}
+
+	store->active[row]  = store->clock;
+	store->updated[row] = store->generation;
+}
+
+static void Discord_MemberStoreRemoveRow(Discord_Member_Store *store, uint32_t row) {
+	Discord_IndexRemove(&store->index, Discord_MemberHash(store->guild[row], store->user_id[row]), row,
+		[store](uint32_t other) { return Discord_MemberHash(store->guild[other], store->user_id[other]); });
+
+	Discord_StringRelease(&store->strings, store->username[row]);
+	Discord_StringRelease(&store->strings, store->discriminator[row]);
+	Discord_StringRelease(&store->strings, store->avatar[row]);
+	Discord_StringRelease(&store->strings, store->nick[row]);
+	Discord_StringRelease(&store->strings, store->guild_avatar[row]);
+	store->roles_garbage += store->roles_count[row];
+
+	Array<uint32_t> &rows = store->guilds[store->guild[row]].rows;
+	uint32_t pos          = store->guild_pos[row];
+	rows[pos]             = rows.Last();
+	store->guild_pos[rows[pos]] = pos;
+	rows.RemoveLast();
+
+	uint32_t last = (uint32_t)store->user_id.count - 1;
+	if (row != last) {
+		// The last row takes the place of the removed one
+		uint32_t mask = (uint32_t)store->index.count - 1;
+		uint32_t slot = Discord_MemberHash(store->guild[last], store->user_id[last]) & mask;
+		while (store->index[slot] != last + 1)
+			slot = (slot + 1) & mask;
+		store->index[slot] = row + 1;
+
+		store->guilds[store->guild[last]].rows[store->guild_pos[last]] = row;
+
+		store->user_id[row]       = store->user_id[last];
+		store->guild[row]         = store->guild[last];
+		store->guild_pos[row]     = store->guild_pos[last];
+		store->roles_offset[row]  = store->roles_offset[last];
+		store->roles_count[row]   = store->roles_count[last];
+		store->flags[row]         = store->flags[last];
+		store->joined_at[row]     = store->joined_at[last];
+		store->username[row]      = store->username[last];
+		store->avatar[row]        = store->avatar[last];
+		store->discriminator[row] = store->discriminator[last];
+		store->nick[row]          = store->nick[last];
+		store->guild_avatar[row]  = store->guild_avatar[last];
+		store->premium_since[row] = store->premium_since[last];
+		store->communication_disabled_until[row] = store->communication_disabled_until[last];
+		store->permissions[row]   = store->permissions[last];
+		store->active[row]        = store->active[last];
+		store->updated[row]       = store->updated[last];
+	}
+
+	store->user_id.RemoveLast();
+	store->guild.RemoveLast();
+	store->guild_pos.RemoveLast();
+	store->roles_offset.RemoveLast();
+	store->roles_count.RemoveLast();
+	store->flags.RemoveLast();
+	store->joined_at.RemoveLast();
+	store->username.RemoveLast();
+	store->discriminator.RemoveLast();
+	store->avatar.RemoveLast();
+	store->nick.RemoveLast();
+	store->guild_avatar.RemoveLast();
+	store->premium_since.RemoveLast();
+	store->communication_disabled_until.RemoveLast();
+	store->permissions.RemoveLast();
+	store->active.RemoveLast();
+	store->updated.RemoveLast();
+}
+
+static void Discord_MemberStoreRemove(Discord_Member_Store *store, Discord::Snowflake guild_id, Discord::Snowflake user_id) {
+	ptrdiff_t guild = Discord_MemberFindGuild(store, guild_id);
+	ptrdiff_t row   = guild >= 0 ? Discord_MemberFind(store, (uint32_t)guild, user_id.value) : -1;
+	if (row >= 0)
+		Discord_MemberStoreRemoveRow(store, (uint32_t)row);
+}
+
+static void Discord_MemberStoreRemoveGuild(Discord_Member_Store *store, Discord::Snowflake guild_id) {
+	ptrdiff_t guild = Discord_MemberFindGuild(store, guild_id);
+	if (guild < 0) return;
+
+	Array<uint32_t> &rows = store->guilds[guild].rows;
+	while (rows.count)
+		Discord_MemberStoreRemoveRow(store, rows.Last());
+}
+
+static uint64_t Discord_MemberStoreSize(Discord_Member_Store *store) {
+	return (uint64_t)store->user_id.count * DISCORD_MEMBER_ROW_SIZE +
+		((uint64_t)store->roles.count - store->roles_garbage) * sizeof(uint64_t) +
+		((uint64_t)store->strings.bytes.count - store->strings.garbage) +
+		(uint64_t)store->strings.live * (sizeof(Discord_Interned) + sizeof(uint32_t));
+}
+
+static uint32_t Discord_SelectNth(uint32_t *values, ptrdiff_t count, ptrdiff_t nth) {
+	ptrdiff_t lo = 0, hi = count - 1;
+	while (lo < hi) {
+		uint32_t  pivot = values[lo + (hi - lo) / 2];
+		ptrdiff_t i = lo, j = hi;
+		while (i <= j) {
+			while (values[i] < pivot) i += 1;
+			while (values[j] > pivot) j -= 1;
+			if (i <= j) {
+				uint32_t temp = values[i];
+				values[i] = values[j];
+				values[j] = temp;
+				i += 1;
+				j -= 1;
 			}
-			j.EndArray();
 		}
+		if (nth <= j)      hi = j;
+		else if (nth >= i) lo = i;
+		else break;
+	}
+	return values[nth];
+}
 
-		j.EndObject();
+// Called after every event batch, evicts the least recently active rows down to 7/8 of the budget
+static void Discord_MemberStoreEndBatch(Discord_Member_Store *store) {
+	store->clock += 1;
 
-		String payload_json = Jsonify_BuildString(&j);
+	uint64_t size = Discord_MemberStoreSize(store);
+	if (size > store->budget && store->user_id.count) {
+		uint64_t  target = store->budget - store->budget / 8;
+		uint64_t  per_row = Maximum(size / store->user_id.count, 1);
+		ptrdiff_t evict   = (ptrdiff_t)Minimum((size - target + per_row - 1) / per_row, (uint64_t)store->user_id.count);
 
-		String body;
-		String content_type;
+		Array<uint32_t> active;
+		if (active.Resize(store->active.count)) {
+			memcpy(active.data, store->active.data, active.count * sizeof(uint32_t));
 
-		uint8_t buffer[4096];
-		int     len = 0;
+			uint32_t  threshold = Discord_SelectNth(active.data, active.count, evict - 1);
+			ptrdiff_t below     = 0;
+			for (uint32_t value : store->active)
+				below += value < threshold;
+			ptrdiff_t ties = evict - below;
 
-		if (!msg.attachments.count) {
-			body = payload_json;
-			content_type = "application/json";
-		} else {
-			Http_Multipart multipart = Http_MultipartBegin(client->scratch);
-			if (!Http_MultipartData(&multipart, payload_json, "application/json", "name=\"payload_json\""))
-				return nullptr;
-			for (int id = 0; id < (int)msg.attachments.count; ++id) {
-				const auto &attachment = msg.attachments[id];
-				len = snprintf((char *)buffer, sizeof(buffer), "name=\"files[%d]\"; filename=\"" StrFmt "\"", id, StrArg(attachment.filename));
-				String content_disposition(buffer, len);
-				if (!Http_MultipartData(&multipart, attachment.content, attachment.content_type, content_disposition))
-					return nullptr;
+			// Rows are visited from the end so that the rows moved into removed ones have been visited
+			for (ptrdiff_t row = store->user_id.count - 1; row >= 0; --row) {
+				uint32_t value = store->active[row];
+				if (value < threshold || (value == threshold && ties-- > 0))
+					Discord_MemberStoreRemoveRow(store, (uint32_t)row);
 			}
+			Free(&active);
 
-			body = Http_MultipartEnd(&multipart);
-
-			String boundary = String(multipart.boundary, HTTP_MULTIPART_LENGTH);
-			len = snprintf((char *)buffer, sizeof(buffer), "multipart/form-data; boundary=" StrFmt, StrArg(boundary));
-			content_type = String(buffer, len);
+			TraceEx("Discord", "Evicted %zd members from the member cache", evict);
 		}
+	}
 
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu", channel_id, message_id);
+	if (store->roles_garbage > (uint64_t)store->roles.count / 2 && store->roles_garbage > DISCORD_STRING_COMPACT_SIZE / sizeof(uint64_t))
+		Discord_MemberCompactRoles(store);
+}
 
-		Json res;
-		if (Discord_Patch(client, endpoint, content_type, body, &res)) {
-			Message *message = new Message;
-			if (message)
-				Discord_Deserialize(JsonGetObject(res), message);
-			return message;
-		}
+static String Discord_MemberCopyString(Discord_Member_Store *store, uint32_t id) {
+	String src = Discord_StringGet(&store->strings, id);
+	if (!src.length)
+		return String();
+	uint8_t *dst = (uint8_t *)MemoryAllocate(src.length);
+	if (!dst)
+		return String();
+	memcpy(dst, src.data, src.length);
+	return String(dst, src.length);
+}
+
+// The member is allocated from the thread allocator with its strings copied, the store may change after
+static Discord::GuildMember *Discord_MemberStoreGet(Discord_Member_Store *store, Discord::Snowflake guild_id, Discord::Snowflake user_id, bool fresh) {
+	ptrdiff_t guild = Discord_MemberFindGuild(store, guild_id);
+	ptrdiff_t row   = guild >= 0 ? Discord_MemberFind(store, (uint32_t)guild, user_id.value) : -1;
+	if (row < 0 || (fresh && store->updated[row] != store->generation))
 		return nullptr;
-	}
 
-	bool DeleteMessage(Client *client, Snowflake channel_id, Snowflake message_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu", channel_id, message_id);
+	store->active[row] = store->clock;
 
-		Json res;
-		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
-			return true;
-		}
-		return false;
-	}
+	Discord::GuildMember *member = new Discord::GuildMember;
+	Discord::User *       user   = new Discord::User;
+	if (!member || !user)
+		return nullptr;
 
-	bool BulkDeleteMessages(Client *client, Snowflake channel_id, Array_View<Snowflake> messages_ids) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/bulk-delete", channel_id);
+	uint16_t flags = store->flags[row];
 
-		Jsonify j(client->scratch);
-		j.BeginObject();
-		j.PushKey("messages");
-		j.BeginArray();
-		for (const auto id : messages_ids) {
-			j.PushId(id.value);
-		}
-		j.EndArray();
+	user->id            = user_id;
+	user->username      = Discord_MemberCopyString(store, store->username[row]);
+	user->discriminator = Discord_MemberCopyString(store, store->discriminator[row]);
+	user->avatar        = Discord_MemberCopyString(store, store->avatar[row]);
+	user->bot           = (flags & DISCORD_MEMBER_BOT) != 0;
 
-		j.EndObject();
+	member->user    = user;
+	member->nick        = Discord_MemberCopyString(store, store->nick[row]);
+	member->avatar      = Discord_MemberCopyString(store, store->guild_avatar[row]);
+	member->deaf        = (flags & DISCORD_MEMBER_DEAF) != 0;
+	member->mute        = (flags & DISCORD_MEMBER_MUTE) != 0;
+	member->pending     = (flags & DISCORD_MEMBER_PENDING) != 0;
+	member->permissions = store->permissions[row];
 
-		String body = Jsonify_BuildString(&j);
+	if (store->joined_at[row])
+		member->joined_at = (ptrdiff_t)store->joined_at[row] + DISCORD_MEMBER_EPOCH;
+	if (store->premium_since[row])
+		member->premium_since = (ptrdiff_t)store->premium_since[row] + DISCORD_MEMBER_EPOCH;
+	if (store->communication_disabled_until[row])
+		member->communication_disabled_until = (ptrdiff_t)store->communication_disabled_until[row] + DISCORD_MEMBER_EPOCH;
 
-		Json res;
-		if (Discord_Post(client, endpoint, "application/json", body, &res)) {
-			return true;
-		}
-		return false;
+	if (member->roles.Resize(store->roles_count[row])) {
+		for (uint16_t index = 0; index < store->roles_count[row]; ++index)
+			member->roles[index] = store->roles[store->roles_offset[row] + index];
 	}
 
-	bool EditChannelPermissions(Client *client, Snowflake channel_id, Snowflake overwrite_id, Permission allow, Permission deny, OverwriteType type) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/permissions/%zu", channel_id, overwrite_id);
+	return member;
+}
 
-		Jsonify j(client->scratch);
-		j.BeginObject();
-		j.KeyValue("allow", allow);
-		j.KeyValue("deny", deny);
-		j.KeyValue("tye", (int)type);
-		j.EndObject();
+//
+// Message Cache
+//
 
-		String body = Jsonify_BuildString(&j);
+constexpr uint32_t DISCORD_SLAB_PAGE_SIZE = KiloBytes(64);
+constexpr uint32_t DISCORD_SLAB_MIN_SIZE  = 256;
+constexpr int      DISCORD_SLAB_CLASSES   = 9; // blocks of 256 bytes upto 64 KB
 
-		Json res;
-		if (Discord_Put(client, endpoint, "application/json", body, &res)) {
-			return true;
-		}
-		return false;
+// Blocks of a size class are carved out of pages and reused through the free list of the class
+struct Discord_Slab_Page {
+	uint8_t *data;
+	uint32_t live; // blocks in use
+};
+
+struct Discord_Slab {
+	Array<Discord_Slab_Page> pages; // sorted by address
+	Array<uint8_t *>         free[DISCORD_SLAB_CLASSES];
+	uint64_t                 used; // bytes of blocks in use
+};
+
+static int Discord_SlabClass(ptrdiff_t length) {
+	for (int size_class = 0; size_class < DISCORD_SLAB_CLASSES; ++size_class) {
+		if ((ptrdiff_t)(DISCORD_SLAB_MIN_SIZE << size_class) >= length)
+			return size_class;
 	}
+	return -1;
+}
 
-	Array_View<Invite> GetChannelInvites(Client *client, Snowflake channel_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/invites", channel_id);
+static Discord_Slab_Page *Discord_SlabFindPage(Discord_Slab *slab, uint8_t *block) {
+	ptrdiff_t lo = 0, hi = slab->pages.count - 1;
+	while (lo < hi) {
+		ptrdiff_t mid = hi - (hi - lo) / 2;
+		if (slab->pages[mid].data <= block) lo = mid;
+		else hi = mid - 1;
+	}
+	return &slab->pages[lo];
+}
 
-		Json res;
-		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
-			Json_Array arr = JsonGetArray(res);
-			Array<Invite> invites;
-			invites.Resize(arr.count);
-			for (ptrdiff_t index = 0; index < invites.count; ++index)
-				Discord_Deserialize(JsonGetObject(arr[index]), &invites[index]);
-			return invites;
+static uint8_t *Discord_SlabAlloc(Discord_Slab *slab, int size_class) {
+	uint32_t size = DISCORD_SLAB_MIN_SIZE << size_class;
+	Array<uint8_t *> &free = slab->free[size_class];
+
+	if (!free.count) {
+		if (!free.Reserve(DISCORD_SLAB_PAGE_SIZE / size))
+			return nullptr;
+		uint8_t *page = (uint8_t *)MemoryAllocate(DISCORD_SLAB_PAGE_SIZE, slab->pages.allocator);
+		if (!page) return nullptr;
+
+		ptrdiff_t pos = slab->pages.count;
+		if (!slab->pages.Add()) {
+			MemoryFree(page, DISCORD_SLAB_PAGE_SIZE, slab->pages.allocator);
+			return nullptr;
 		}
+		for (; pos && slab->pages[pos - 1].data > page; --pos)
+			slab->pages[pos] = slab->pages[pos - 1];
+		slab->pages[pos] = Discord_Slab_Page{ page, 0 };
 
-		return Array_View<Invite>();
+		for (uint32_t offset = DISCORD_SLAB_PAGE_SIZE; offset >= size; offset -= size)
+			free.Add(page + offset - size);
 	}
 
-	Invite *CreateChannelInvite(Client *client, Snowflake channel_id, const InvitePost &invite) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/invites", channel_id);
+	uint8_t *block = free.Last();
+	free.RemoveLast();
+	Discord_SlabFindPage(slab, block)->live += 1;
+	slab->used += size;
+	return block;
+}
 
-		Jsonify j(client->scratch);
-		j.BeginObject();
-		j.KeyValue("max_age", invite.max_age);
-		j.KeyValue("max_uses", invite.max_uses);
-		j.KeyValue("temporary", invite.temporary);
-		j.KeyValue("unique", invite.unique);
-		if (invite.target_type != InviteTargetType::NONE) j.KeyValue("target_type", (int)invite.target_type);
-		if (invite.target_user_id.value) j.KeyValue("target_user_id", invite.target_user_id.value);
-		if (invite.target_application_id.value) j.KeyValue("target_application_id", invite.target_application_id.value);
-		j.EndObject();
+static void Discord_SlabFree(Discord_Slab *slab, uint8_t *block, int size_class) {
+	slab->free[size_class].Add(block);
+	Discord_SlabFindPage(slab, block)->live -= 1;
+	slab->used -= DISCORD_SLAB_MIN_SIZE << size_class;
+}
 
-		String body = Jsonify_BuildString(&j);
+// Empty pages are released once per event batch rather than on every free, so that a page is not
+// released and allocated again while messages replace each other
+static void Discord_SlabTrim(Discord_Slab *slab) {
+	ptrdiff_t empty = 0;
+	for (const Discord_Slab_Page &page : slab->pages)
+		empty += !page.live;
+	if (!empty) return;
 
-		Json res;
-		if (Discord_Post(client, endpoint, "application/json", body, & res)) {
-			Invite *invite = new Invite;
-			if (invite)
-				Discord_Deserialize(JsonGetObject(res), invite);
-			return invite;
+	for (Array<uint8_t *> &free : slab->free) {
+		ptrdiff_t kept = 0;
+		for (uint8_t *block : free) {
+			if (Discord_SlabFindPage(slab, block)->live)
+				free[kept++] = block;
 		}
+		free.count = kept;
+	}
 
-		return nullptr;
+	ptrdiff_t kept = 0;
+	for (const Discord_Slab_Page &page : slab->pages) {
+		if (page.live)
+			slab->pages[kept++] = page;
+		else
+			MemoryFree(page.data, DISCORD_SLAB_PAGE_SIZE, slab->pages.allocator);
 	}
+	slab->pages.count = kept;
+}
 
-	bool DeleteChannelPermission(Client *client, Snowflake channel_id, Snowflake overwrite_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/permissions/%zu", channel_id, overwrite_id);
+// Messages are packed into a compact binary form of their json, strings are stored unescaped
+// with their length so that they can be referenced in place when unpacked
+enum Discord_Pack_Tag : uint8_t {
+	DISCORD_PACK_NULL,
+	DISCORD_PACK_FALSE,
+	DISCORD_PACK_TRUE,
+	DISCORD_PACK_NUMBER,
+	DISCORD_PACK_STRING,
+	DISCORD_PACK_ARRAY,
+	DISCORD_PACK_OBJECT,
+};
 
-		Json res;
-		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
-			return true;
-		}
-		return false;
+static void Discord_PackLength(Array<uint8_t> *out, uint32_t length) {
+	while (length >= 0x80) {
+		out->Add((uint8_t)(length | 0x80));
+		length >>= 7;
 	}
+	out->Add((uint8_t)length);
+}
 
-	FollowedChannel *FollowNewsChannel(Client *client, Snowflake channel_id, Snowflake webhook_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/followers", channel_id);
+static void Discord_PackString(Array<uint8_t> *out, String str) {
+	Discord_PackLength(out, (uint32_t)str.length);
+	uint8_t *dst = out->AddN((uint32_t)str.length);
+	if (dst) memcpy(dst, str.data, str.length);
+}
+
+static void Discord_PackJson(Array<uint8_t> *out, const Json &json) {
+	switch (json.type) {
+		case JSON_TYPE_BOOL: {
+			out->Add(json.value.boolean ? DISCORD_PACK_TRUE : DISCORD_PACK_FALSE);
+		} break;
+
+		case JSON_TYPE_NUMBER: {
+			out->Add(DISCORD_PACK_NUMBER);
+			uint8_t *dst = out->AddN(sizeof(Json_Number));
+			if (dst) memcpy(dst, &json.value.number, sizeof(Json_Number));
+		} break;
+
+		case JSON_TYPE_STRING: {
+			out->Add(DISCORD_PACK_STRING);
+			Discord_PackString(out, json.value.string.value);
+		} break;
+
+		case JSON_TYPE_ARRAY: {
+			out->Add(DISCORD_PACK_ARRAY);
+			Discord_PackLength(out, (uint32_t)json.value.array.count);
+			for (const Json &elem : json.value.array)
+				Discord_PackJson(out, elem);
+		} break;
+
+		case JSON_TYPE_OBJECT: {
+			out->Add(DISCORD_PACK_OBJECT);
+			Discord_PackLength(out, (uint32_t)json.value.object.storage.count);
+			for (const auto &pair : json.value.object) {
+				Discord_PackString(out, pair.key);
+				Discord_PackJson(out, pair.value);
+			}
+		} break;
+
+		default: {
+			out->Add(DISCORD_PACK_NULL);
+		} break;
+	}
+}
+
+struct Discord_Unpacker {
+	uint8_t * data;
+	ptrdiff_t length;
+	ptrdiff_t pos;
+	bool      failed;
+};
+
+static uint32_t Discord_UnpackLength(Discord_Unpacker *unpacker) {
+	uint32_t length = 0;
+	for (int shift = 0; shift < 32 && unpacker->pos < unpacker->length; shift += 7) {
+		uint8_t byte = unpacker->data[unpacker->pos++];
+		length |= (uint32_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return length;
+	}
+	unpacker->failed = true;
+	return 0;
+}
+
+static String Discord_UnpackString(Discord_Unpacker *unpacker) {
+	uint32_t length = Discord_UnpackLength(unpacker);
+	if (unpacker->failed || length > unpacker->length - unpacker->pos) {
+		unpacker->failed = true;
+		return String();
+	}
+	String str(unpacker->data + unpacker->pos, length);
+	unpacker->pos += length;
+	return str;
+}
+
+// Strings of the unpacked json point into the packed data
+static Json Discord_UnpackJson(Discord_Unpacker *unpacker) {
+	if (unpacker->failed || unpacker->pos >= unpacker->length) {
+		unpacker->failed = true;
+		return Json();
+	}
+
+	uint8_t tag = unpacker->data[unpacker->pos++];
+
+	switch (tag) {
+		case DISCORD_PACK_FALSE: return Json(false);
+		case DISCORD_PACK_TRUE: return Json(true);
+
+		case DISCORD_PACK_NUMBER: {
+			if (unpacker->length - unpacker->pos < (ptrdiff_t)sizeof(Json_Number)) {
+				unpacker->failed = true;
+				return Json();
+			}
+			Json json(0);
+			memcpy(&json.value.number, unpacker->data + unpacker->pos, sizeof(Json_Number));
+			unpacker->pos += sizeof(Json_Number);
+			return json;
+		}
+
+		case DISCORD_PACK_STRING: return Json(Discord_UnpackString(unpacker));
+
+		case DISCORD_PACK_ARRAY: {
+			uint32_t   count = Discord_UnpackLength(unpacker);
+			Json_Array array;
+			array.Reserve(Minimum(count, (uint32_t)(unpacker->length - unpacker->pos)));
+			for (uint32_t index = 0; index < count && !unpacker->failed; ++index)
+				array.Add(Discord_UnpackJson(unpacker));
+			return Json(array);
+		}
+
+		case DISCORD_PACK_OBJECT: {
+			uint32_t    count = Discord_UnpackLength(unpacker);
+			Json_Object object;
+			for (uint32_t index = 0; index < count && !unpacker->failed; ++index) {
+				String key = Discord_UnpackString(unpacker);
+				object.Put(key, Discord_UnpackJson(unpacker));
+			}
+			return Json(object);
+		}
+	}
+
+	if (tag != DISCORD_PACK_NULL)
+		unpacker->failed = true;
+	return Json();
+}
+
+struct Discord_Message_Slot {
+	Discord::Snowflake id;
+	uint8_t *          data;
+	uint32_t           length;
+	int                size_class;
+};
+
+struct Discord_Message_Ring {
+	Discord::Snowflake    guild_id;
+	Discord_Message_Slot *slots;
+	uint32_t              head;   // slot of the next message, the oldest message is replaced once the ring is full
+	uint32_t              active; // clock when the ring was last updated or read
+};
+
+// The most recent messages of every channel are kept in rings of a fixed capacity. Rings of the
+// least recently active channels are dropped when the packed messages grow past budget
+struct Discord_Message_Cache {
+	uint32_t         capacity; // messages per channel
+	uint64_t         budget;
+	uint32_t         clock;
+	Discord_Slab     slab;
+	Hash_Table<Discord::Snowflake, Discord_Message_Ring> channels;
+};
+
+static void Discord_MessageCacheInit(Discord_Message_Cache *cache, uint32_t capacity, uint64_t budget, Memory_Allocator allocator) {
+	*cache = Discord_Message_Cache{};
+	cache->capacity   = capacity;
+	cache->budget     = budget;
+	cache->slab.pages = Array<Discord_Slab_Page>(allocator);
+	for (Array<uint8_t *> &free : cache->slab.free)
+		free = Array<uint8_t *>(allocator);
+	cache->channels   = Hash_Table<Discord::Snowflake, Discord_Message_Ring>(allocator);
+}
+
+static void Discord_MessageCacheFree(Discord_Message_Cache *cache) {
+	Memory_Allocator allocator = cache->slab.pages.allocator;
+	for (auto &pair : cache->channels)
+		MemoryFree(pair.value.slots, cache->capacity * sizeof(Discord_Message_Slot), allocator);
+	for (const Discord_Slab_Page &page : cache->slab.pages)
+		MemoryFree(page.data, DISCORD_SLAB_PAGE_SIZE, allocator);
+	for (Array<uint8_t *> &free : cache->slab.free)
+		Free(&free);
+	Free(&cache->slab.pages);
+	Free(&cache->channels);
+}
+
+static uint64_t Discord_MessageCacheSize(Discord_Message_Cache *cache) {
+	return (uint64_t)cache->slab.pages.count * DISCORD_SLAB_PAGE_SIZE + (uint64_t)cache->channels.storage.count * cache->capacity * sizeof(Discord_Message_Slot);
+}
+
+static Discord_Message_Slot *Discord_MessageFindSlot(Discord_Message_Cache *cache, Discord_Message_Ring *ring, Discord::Snowflake id) {
+	if (!id) return nullptr;
+	for (uint32_t index = 0; index < cache->capacity; ++index) {
+		if (ring->slots[index].id == id)
+			return &ring->slots[index];
+	}
+	return nullptr;
+}
+
+static void Discord_MessageReleaseSlot(Discord_Message_Cache *cache, Discord_Message_Slot *slot) {
+	if (slot->data)
+		Discord_SlabFree(&cache->slab, slot->data, slot->size_class);
+	*slot = Discord_Message_Slot{};
+}
+
+static bool Discord_MessageStoreSlot(Discord_Message_Cache *cache, Discord_Message_Slot *slot, Discord::Snowflake id, const Json &json) {
+	Array<uint8_t> packed;
+	Discord_PackJson(&packed, json);
+
+	int size_class = Discord_SlabClass(packed.count);
+	uint8_t *block = size_class >= 0 ? Discord_SlabAlloc(&cache->slab, size_class) : nullptr;
+
+	Discord_MessageReleaseSlot(cache, slot);
+	if (!block)
+		return false;
+
+	memcpy(block, packed.data, packed.count);
+	slot->id         = id;
+	slot->data       = block;
+	slot->length     = (uint32_t)packed.count;
+	slot->size_class = size_class;
+	return true;
+}
+
+static Json Discord_MessageUnpackSlot(Discord_Message_Slot *slot) {
+	// The slot may be replaced while the message is still in use
+	uint8_t *data = (uint8_t *)MemoryAllocate(slot->length);
+	if (!data)
+		return Json();
+	memcpy(data, slot->data, slot->length);
+
+	Discord_Unpacker unpacker = { data, slot->length, 0, false };
+	Json json = Discord_UnpackJson(&unpacker);
+	return unpacker.failed ? Json() : json;
+}
+
+static void Discord_MessageCachePut(Discord_Message_Cache *cache, const Json &json) {
+	if (!cache->capacity)
+		return;
+
+	Json_Object obj               = JsonGetObject(json);
+	Discord::Snowflake id         = Discord_ParseId(JsonGetString(obj, "id"));
+	Discord::Snowflake channel_id = Discord_ParseId(JsonGetString(obj, "channel_id"));
+	if (!id || !channel_id) return;
+
+	Discord_Message_Ring *ring = cache->channels.Find(channel_id);
+	if (!ring) {
+		Discord_Message_Ring created = {};
+		created.guild_id = Discord_ParseId(JsonGetString(obj, "guild_id"));
+		created.slots    = (Discord_Message_Slot *)MemoryAllocate(cache->capacity * sizeof(Discord_Message_Slot), cache->slab.pages.allocator);
+		if (!created.slots) return;
+		for (uint32_t index = 0; index < cache->capacity; ++index)
+			created.slots[index] = Discord_Message_Slot{};
+		cache->channels.Put(channel_id, created);
+		ring = cache->channels.Find(channel_id);
+	}
+
+	ring->active = cache->clock;
+
+	Discord_Message_Slot *slot = Discord_MessageFindSlot(cache, ring, id);
+	if (!slot) {
+		slot       = &ring->slots[ring->head];
+		ring->head = (ring->head + 1) % cache->capacity;
+	}
+
+	Discord_MessageStoreSlot(cache, slot, id, json);
+}
+
+// Updates only carry the fields that changed, they replace the fields of the cached message
+static void Discord_MessageCacheUpdate(Discord_Message_Cache *cache, const Json &json) {
+	Json_Object update            = JsonGetObject(json);
+	Discord::Snowflake id         = Discord_ParseId(JsonGetString(update, "id"));
+	Discord::Snowflake channel_id = Discord_ParseId(JsonGetString(update, "channel_id"));
+
+	Discord_Message_Ring *ring = cache->channels.Find(channel_id);
+	Discord_Message_Slot *slot = ring ? Discord_MessageFindSlot(cache, ring, id) : nullptr;
+	if (!slot) return;
+
+	Json message = Discord_MessageUnpackSlot(slot);
+	if (message.type != JSON_TYPE_OBJECT) {
+		Discord_MessageReleaseSlot(cache, slot);
+		return;
+	}
+
+	for (const auto &pair : update)
+		message.value.object.Put(pair.key, pair.value);
+
+	ring->active = cache->clock;
+	Discord_MessageStoreSlot(cache, slot, id, message);
+}
+
+static bool Discord_MessageEmojiEquals(const Json_Object &a, const Json_Object &b) {
+	String id = JsonGetString(a, "id");
+	if (id.length)
+		return id == JsonGetString(b, "id");
+	return !JsonGetString(b, "id").length && JsonGetString(a, "name") == JsonGetString(b, "name");
+}
+
+// Reaction events change the count of the reactions of the emoji by delta, a delta of 0 drops them and
+// events without an emoji drop every reaction. Self is set when the current user reacted
+static void Discord_MessageCacheReact(Discord_Message_Cache *cache, const Json_Object &event, int delta, bool self) {
+	Discord::Snowflake id         = Discord_ParseId(JsonGetString(event, "message_id"));
+	Discord::Snowflake channel_id = Discord_ParseId(JsonGetString(event, "channel_id"));
+
+	Discord_Message_Ring *ring = cache->channels.Find(channel_id);
+	Discord_Message_Slot *slot = ring ? Discord_MessageFindSlot(cache, ring, id) : nullptr;
+	if (!slot) return;
+
+	Json message = Discord_MessageUnpackSlot(slot);
+	if (message.type != JSON_TYPE_OBJECT) {
+		Discord_MessageReleaseSlot(cache, slot);
+		return;
+	}
+
+	const Json *emoji = event.Find("emoji");
+	Json_Array  reactions;
+	bool        found = false;
+
+	for (const Json &elem : JsonGetArray(message.value.object, "reactions")) {
+		Json_Object reaction = JsonGetObject(elem);
+		if (emoji && !Discord_MessageEmojiEquals(JsonGetObject(*emoji), JsonGetObject(reaction, "emoji"))) {
+			reactions.Add(elem);
+			continue;
+		}
+
+		found = true;
+		int32_t count = JsonGetInt(reaction, "count") + delta;
+		if (!delta || count <= 0) continue;
+
+		Json_Object patched;
+		for (const auto &pair : reaction)
+			patched.Put(pair.key, pair.value);
+		patched.Put("count", Json(count));
+		if (self)
+			patched.Put("me", Json(delta > 0));
+		reactions.Add(Json(patched));
+	}
+
+	if (!found && emoji && delta > 0) {
+		Json_Object added;
+		added.Put("count", Json(delta));
+		added.Put("me", Json(self));
+		added.Put("emoji", *emoji);
+		reactions.Add(Json(added));
+	} else if (!found) {
+		return;
+	}
+
+	message.value.object.Put("reactions", Json(reactions));
+	ring->active = cache->clock;
+	Discord_MessageStoreSlot(cache, slot, id, message);
+}
+
+static void Discord_MessageCacheRemove(Discord_Message_Cache *cache, Discord::Snowflake channel_id, Discord::Snowflake id) {
+	Discord_Message_Ring *ring = cache->channels.Find(channel_id);
+	Discord_Message_Slot *slot = ring ? Discord_MessageFindSlot(cache, ring, id) : nullptr;
+	if (slot)
+		Discord_MessageReleaseSlot(cache, slot);
+}
+
+static void Discord_MessageCacheRemoveChannel(Discord_Message_Cache *cache, Discord::Snowflake channel_id) {
+	Discord_Message_Ring *ring = cache->channels.Find(channel_id);
+	if (!ring) return;
+
+	for (uint32_t index = 0; index < cache->capacity; ++index)
+		Discord_MessageReleaseSlot(cache, &ring->slots[index]);
+	MemoryFree(ring->slots, cache->capacity * sizeof(Discord_Message_Slot), cache->slab.pages.allocator);
+	cache->channels.Remove(channel_id);
+}
+
+static void Discord_MessageCacheRemoveGuild(Discord_Message_Cache *cache, Discord::Snowflake guild_id) {
+	for (ptrdiff_t index = 0; index < cache->channels.storage.count;) {
+		auto &pair = cache->channels.storage[index];
+		if (pair.value.guild_id == guild_id) {
+			// Removing moves the last pair into this index
+			Discord_MessageCacheRemoveChannel(cache, pair.key);
+		} else {
+			index += 1;
+		}
+	}
+}
+
+static void Discord_MessageCacheClear(Discord_Message_Cache *cache) {
+	while (cache->channels.storage.count)
+		Discord_MessageCacheRemoveChannel(cache, cache->channels.storage.Last().key);
+}
+
+static void Discord_MessageCacheEndBatch(Discord_Message_Cache *cache) {
+	cache->clock += 1;
+	Discord_SlabTrim(&cache->slab);
+
+	while (cache->channels.storage.count && Discord_MessageCacheSize(cache) > cache->budget) {
+		ptrdiff_t oldest = 0;
+		for (ptrdiff_t index = 1; index < cache->channels.storage.count; ++index) {
+			if (cache->channels.storage[index].value.active < cache->channels.storage[oldest].value.active)
+				oldest = index;
+		}
+		Discord_MessageCacheRemoveChannel(cache, cache->channels.storage[oldest].key);
+		Discord_SlabTrim(&cache->slab);
+	}
+}
+
+// The message is allocated from the thread allocator and does not reference the cache
+static Discord::Message *Discord_MessageCacheGet(Discord_Message_Cache *cache, Discord::Snowflake channel_id, Discord::Snowflake id) {
+	Discord_Message_Ring *ring = cache->channels.Find(channel_id);
+	Discord_Message_Slot *slot = ring ? Discord_MessageFindSlot(cache, ring, id) : nullptr;
+	if (!slot) return nullptr;
+
+	Json json = Discord_MessageUnpackSlot(slot);
+	if (json.type != JSON_TYPE_OBJECT)
+		return nullptr;
 
+	ring->active = cache->clock;
+
+	Discord::Message *message = new Discord::Message;
+	if (message)
+		Discord_Deserialize(JsonGetObject(json), message);
+	return message;
+}
+
+//
+// Entity Cache
+//
+
+struct Discord_Cache_Entry {
+	Json               json;       // owned by the cache
+	Discord::Snowflake guild_id;
+	uint32_t           generation; // gateway session in which the entry was last updated
+};
+
+typedef Hash_Table<Discord::Snowflake, Discord_Cache_Entry> Discord_Cache_Table;
+
+constexpr ptrdiff_t DISCORD_PERMISSION_MEMO_MAX = 65536;
+
+// Permissions of a set of roles in a channel before the overwrite of the member is applied
+struct Discord_Permission_Memo {
+	Discord::Permission permissions;
+	bool                administrator;
+};
+
+// Memos are keyed by the hash of the roles within a channel and the channels within a guild, so that
+// updates of a channel or of the roles of a guild only drop the memos that depend on them
+typedef Hash_Table<uint64_t, Discord_Permission_Memo>              Discord_Permission_Channel;
+typedef Hash_Table<Discord::Snowflake, Discord_Permission_Channel> Discord_Permission_Guild;
+typedef Hash_Table<Discord::Snowflake, Discord_Permission_Guild>   Discord_Permission_Table;
+
+// Only the gateway thread of the client updates and reads the cache. Entities handed out point into the
+// cached json, so replaced entries are retired and only freed once the event batch has been handled
+struct Discord_Cache {
+	bool                     enabled = false;
+	bool                     members_tracked = false; // GUILD_MEMBERS intent keeps the stored members up to date
+	uint32_t                 generation = 0;
+	Memory_Allocator         allocator;
+	Discord_Cache_Table      guilds;
+	Discord_Cache_Table      channels;
+	Discord_Cache_Table      roles;
+	Discord_Cache_Table      emojis;
+	Discord_Cache_Table      users;
+	Discord_Member_Store     members;
+	Discord_Message_Cache    messages;
+	Discord_Permission_Table permissions;
+	ptrdiff_t                permissions_count = 0; // memos of every guild
+	Discord::Snowflake       user_id; // current user
+	Array<Json>              retired;
+	const void *             thread = nullptr; // gateway thread, see Discord_CacheQuery
+};
+
+static thread_local char DiscordCacheThread;
+
+// Reads of the cache take no lock, so they are only valid on the gateway thread of the client. Queries from
+// other threads trip the assertion in debug builds and find nothing otherwise
+static bool Discord_CacheQuery(const Discord_Cache *cache) {
+	if (!cache->enabled)
+		return false;
+	bool owned = cache->thread == &DiscordCacheThread;
+	Assert(owned);
+	return owned;
+}
+
+static Json Discord_CacheCopyJson(const Json &src, Memory_Allocator allocator, Array_View<String> exclude = Array_View<String>()) {
+	if (src.type == JSON_TYPE_STRING) {
+		String   value = src.value.string.value;
+		uint8_t *data  = value.length ? (uint8_t *)MemoryAllocate(value.length, allocator) : nullptr;
+		if (data)
+			memcpy(data, value.data, value.length);
+		Json dst(String(data, data ? value.length : 0));
+		dst.value.string.allocator = allocator;
+		return dst;
+	}
+
+	if (src.type == JSON_TYPE_ARRAY) {
+		Json_Array array(allocator);
+		array.Reserve(src.value.array.count);
+		for (const Json &elem : src.value.array)
+			array.Add(Discord_CacheCopyJson(elem, allocator));
+		return Json(array);
+	}
+
+	if (src.type == JSON_TYPE_OBJECT) {
+		Json_Object object(allocator);
+		for (const auto &pair : src.value.object) {
+			bool skip = false;
+			for (const String &key : exclude)
+				skip = skip || key == pair.key;
+			if (skip) continue;
+
+			uint8_t *key = (uint8_t *)MemoryAllocate(pair.key.length, allocator);
+			if (!key) continue;
+			memcpy(key, pair.key.data, pair.key.length);
+			object.Put(String(key, pair.key.length), Discord_CacheCopyJson(pair.value, allocator));
+		}
+		return Json(object);
+	}
+
+	return src;
+}
+
+static void Discord_CacheFreeJson(Json *json, Memory_Allocator allocator) {
+	if (json->type == JSON_TYPE_STRING) {
+		MemoryFree(json->value.string.value.data, json->value.string.value.length, allocator);
+	} else if (json->type == JSON_TYPE_ARRAY) {
+		for (Json &elem : json->value.array)
+			Discord_CacheFreeJson(&elem, allocator);
+		Free(&json->value.array);
+	} else if (json->type == JSON_TYPE_OBJECT) {
+		for (auto &pair : json->value.object) {
+			MemoryFree(pair.key.data, pair.key.length, allocator);
+			Discord_CacheFreeJson(&pair.value, allocator);
+		}
+		Free(&json->value.object);
+	}
+	*json = Json();
+}
+
+static void Discord_CacheInit(Discord_Cache *cache, const Discord::ClientSpec &spec) {
+	Memory_Allocator allocator = spec.allocator;
+
+	cache->enabled   = spec.cache;
+	cache->allocator = allocator;
+	cache->guilds    = Discord_Cache_Table(allocator);
+	cache->channels  = Discord_Cache_Table(allocator);
+	cache->roles     = Discord_Cache_Table(allocator);
+	cache->emojis    = Discord_Cache_Table(allocator);
+	cache->users     = Discord_Cache_Table(allocator);
+	Discord_MemberStoreInit(&cache->members, spec.member_cache_size, allocator);
+	Discord_MessageCacheInit(&cache->messages, spec.message_cache_count, spec.message_cache_size, allocator);
+	cache->permissions = Discord_Permission_Table(allocator);
+	cache->retired   = Array<Json>(allocator);
+}
+
+static void Discord_CacheFlushRetired(Discord_Cache *cache) {
+	for (Json &json : cache->retired)
+		Discord_CacheFreeJson(&json, cache->allocator);
+	cache->retired.Reset();
+}
+
+static void Discord_CacheEndBatch(Discord_Cache *cache) {
+	Discord_CacheFlushRetired(cache);
+	if (cache->enabled) {
+		Discord_MemberStoreEndBatch(&cache->members);
+		Discord_MessageCacheEndBatch(&cache->messages);
+	}
+}
+
+template <typename Table>
+static void Discord_CacheFreeTable(Discord_Cache *cache, Table *table) {
+	for (auto &pair : *table)
+		Discord_CacheFreeJson(&pair.value.json, cache->allocator);
+	Free(table);
+}
+
+static void Discord_CacheFreePermissions(Discord_Cache *cache) {
+	for (auto &guild : cache->permissions) {
+		for (auto &channel : guild.value)
+			Free(&channel.value);
+		Free(&guild.value);
+	}
+	Free(&cache->permissions);
+	cache->permissions_count = 0;
+}
+
+static void Discord_CacheFree(Discord_Cache *cache) {
+	Discord_CacheFlushRetired(cache);
+	Discord_CacheFreeTable(cache, &cache->guilds);
+	Discord_CacheFreeTable(cache, &cache->channels);
+	Discord_CacheFreeTable(cache, &cache->roles);
+	Discord_CacheFreeTable(cache, &cache->emojis);
+	Discord_CacheFreeTable(cache, &cache->users);
+	Discord_MemberStoreFree(&cache->members);
+	Discord_MessageCacheFree(&cache->messages);
+	Discord_CacheFreePermissions(cache);
+	Free(&cache->retired);
+}
+
+// Memoized permissions depend on the roles of the guild and the overwrites of the channel
+static void Discord_CacheInvalidatePermissions(Discord_Cache *cache, Discord_Cache_Table *table, Discord::Snowflake id, Discord::Snowflake guild_id) {
+	Discord_Permission_Guild *guild = cache->permissions.Find(guild_id);
+	if (!guild) return;
+
+	if (table == &cache->channels) {
+		Discord_Permission_Channel *channel = guild->Find(id);
+		if (channel) {
+			cache->permissions_count -= channel->storage.count;
+			Free(channel);
+			guild->Remove(id);
+		}
+	} else if (table == &cache->roles || table == &cache->guilds) {
+		for (auto &pair : *guild) {
+			cache->permissions_count -= pair.value.storage.count;
+			Free(&pair.value);
+		}
+		Free(guild);
+		cache->permissions.Remove(guild_id);
+	}
+}
+
+template <typename Table, typename Key>
+static void Discord_CachePut(Discord_Cache *cache, Table *table, Key key, const Json &json, Discord::Snowflake guild_id, Array_View<String> exclude = Array_View<String>()) {
+	if (json.type != JSON_TYPE_OBJECT)
+		return;
+
+	Discord_Cache_Entry *entry = table->Find(key);
+	if (!entry) {
+		entry = table->FindOrDefault(key, Discord_Cache_Entry{});
+		if (!entry) return;
+	} else {
+		cache->retired.Add(entry->json);
+	}
+
+	entry->json       = Discord_CacheCopyJson(json, cache->allocator, exclude);
+	entry->guild_id   = guild_id;
+	entry->generation = cache->generation;
+
+	Discord_CacheInvalidatePermissions(cache, table, key, guild_id);
+}
+
+template <typename Table, typename Key>
+static void Discord_CacheRemove(Discord_Cache *cache, Table *table, Key key) {
+	Discord_Cache_Entry *entry = table->Find(key);
+	if (entry) {
+		Discord::Snowflake guild_id = entry->guild_id;
+		cache->retired.Add(entry->json);
+		table->Remove(key);
+		Discord_CacheInvalidatePermissions(cache, table, key, guild_id);
+	}
+}
+
+template <typename Table>
+static void Discord_CacheRemoveGuild(Discord_Cache *cache, Table *table, Discord::Snowflake guild_id) {
+	for (ptrdiff_t index = 0; index < table->storage.count;) {
+		auto &pair = table->storage[index];
+		if (pair.value.guild_id == guild_id) {
+			// Removing moves the last pair into this index
+			Discord_CacheRemove(cache, table, pair.key);
+		} else {
+			index += 1;
+		}
+	}
+}
+
+static void Discord_CachePutObjects(Discord_Cache *cache, Discord_Cache_Table *table, Discord::Snowflake guild_id, const Json_Array &array) {
+	for (const Json &json : array) {
+		Discord::Snowflake id = Discord_ParseId(JsonGetString(JsonGetObject(json), "id"));
+		if (id) Discord_CachePut(cache, table, id, json, guild_id);
+	}
+}
+
+//
+//
+//
+
+namespace Discord {
+	
+	struct Client {
+		Websocket *      websocket = nullptr;
+		Heartbeat        heartbeat;
+
+		Http_Pool *      http = nullptr;
+		String           authorization;
+		Discord_Rest_Queue rest;
+		uint32_t         pipeline_depth = 1;
+
+		EventHandler     onevent;
+
+		Memory_Arena *   scratch   = nullptr;
+		Memory_Allocator allocator = ThreadContext.allocator;
+
+		Discord_Cache    cache;
+
+		Identify         identify;
+		uint8_t          session_id[1024] = {0};
+		int              sequence = -1;
+		bool             running = false;
+		bool             closing = false;
+	};
+
+	void IdentifyCommand(Client *client) {
 		Jsonify j(client->scratch);
 		j.BeginObject();
-		j.KeyValue("webhook_channel_id", webhook_id.value);
+		j.KeyValue("op", (int)Opcode::IDENTIFY);
+		j.PushKey("d");
+		Discord_Jsonify(client->identify, &j);
+		j.EndObject();
+		String msg = Jsonify_BuildString(&j);
+		Websocket_SendText(client->websocket, msg);
+	}
+
+	void ResumeCommand(Client *client) {
+		Jsonify j(client->scratch);
+		j.BeginObject();
+		j.KeyValue("op", (int)Opcode::RESUME);
+		j.PushKey("d");
+		j.BeginObject();
+		j.KeyValue("token", client->identify.token);
+		j.KeyValue("session_id", String(client->session_id, strlen((char *)client->session_id)));
+		if (client->sequence >= 0)
+			j.KeyValue("seq", client->sequence);
+		else
+			j.KeyNull("seq");
+		j.EndObject();
 		j.EndObject();
+		String msg = Jsonify_BuildString(&j);
+		Websocket_SendText(client->websocket, msg);
+	}
+
+	void HearbeatCommand(Client *client) {
+		if (client->heartbeat.count != client->heartbeat.acknowledged) {
+			LogWarningEx("Discord", "No Acknowledgement %d", client->heartbeat.acknowledged);
+			Websocket_Close(client->websocket, WEBSOCKET_CLOSE_ABNORMAL_CLOSURE);
+			return;
+		}
+
+		Jsonify j(client->scratch);
+		j.BeginObject();
+		j.KeyValue("op", (int)Opcode::HEARTBEAT);
+		if (client->sequence >= 0)
+			j.KeyValue("d", client->sequence);
+		else
+			j.KeyNull("d");
+		j.EndObject();
+
+		String msg = Jsonify_BuildString(&j);
+		Websocket_SendText(client->websocket, msg);
+		client->heartbeat.count += 1;
+	}
+
+	void GuildMembersRequestCommand(Client *client, const GuildMembersRequest &req_guild_mems) {
+		Jsonify j(client->scratch);
+		j.BeginObject();
+		j.KeyValue("op", (int)Opcode::REQUEST_GUILD_MEMBERS);
+		j.PushKey("d");
+		Discord_Jsonify(req_guild_mems, &j);
+		j.EndObject();
+		String msg = Jsonify_BuildString(&j);
+		Websocket_SendText(client->websocket, msg);
+	}
+
+	void VoiceStateUpdateCommand(Client *client, const VoiceStateUpdate &update_voice_state) {
+		Jsonify j(client->scratch);
+		j.BeginObject();
+		j.KeyValue("op", (int)Opcode::UPDATE_VOICE_STATE);
+		j.PushKey("d");
+		Discord_Jsonify(update_voice_state, &j);
+		j.EndObject();
+		String msg = Jsonify_BuildString(&j);
+		Websocket_SendText(client->websocket, msg);
+	}
+
+	void PresenceUpdateCommand(Client *client, const PresenceUpdate &presence_update) {
+		Jsonify j(client->scratch);
+		j.BeginObject();
+		j.KeyValue("op", (int)Opcode::UPDATE_PRESECE);
+		j.PushKey("d");
+		Discord_Jsonify(presence_update, &j);
+		j.EndObject();
+		String msg = Jsonify_BuildString(&j);
+		Websocket_SendText(client->websocket, msg);
+	}
+
+	void Login(const String token, int32_t intents, EventHandler onevent, PresenceUpdate *presence, ClientSpec spec) {
+		Assert(spec.tick_ms >= 0);
+
+		constexpr ClientSpec DefaultClientSpec = ClientSpec();
+		
+		int tick          = spec.tick_ms;
+		spec.scratch_size = Maximum(spec.scratch_size, DefaultClientSpec.scratch_size);
+		spec.read_size    = Maximum(spec.read_size,    DefaultClientSpec.read_size);
+		spec.write_size   = Maximum(spec.write_size,   DefaultClientSpec.write_size);
+		spec.queue_size   = Maximum(spec.queue_size,   DefaultClientSpec.queue_size);
+		spec.message_size = Maximum(spec.message_size, spec.read_size);
+
+		Websocket_Spec websocket_spec   = WebsocketDefaultSpec;
+		websocket_spec.read_size        = spec.read_size;
+		websocket_spec.write_size       = spec.write_size;
+		websocket_spec.queue_size       = spec.queue_size;
+		websocket_spec.max_message_size = spec.message_size;
+		websocket_spec.socket           = spec.socket;
+		websocket_spec.loop             = spec.loop;
+
+		Memory_Arena *arena = MemoryArenaAllocate(spec.scratch_size);
+		Defer{ if (arena) MemoryArenaFree(arena); };
+
+		if (!arena) {
+			LogErrorEx("Discord", "Memory allocation failed");
+			return;
+		}
+
+		Discord::Client client;
+		client.scratch    = arena;
+		client.allocator  = spec.allocator;
+		client.identify   = Discord::Identify(token, intents, presence);
+		client.onevent    = onevent;
+		client.running    = true;
+		client.closing    = false;
+
+		client.pipeline_depth = spec.pipeline_depth;
+
+		Discord_CacheInit(&client.cache, spec);
+		Defer{ Discord_CacheFree(&client.cache); };
+
+		client.cache.members_tracked = (intents & Intent::GUILD_MEMBERS) != 0;
+		client.cache.thread          = &DiscordCacheThread;
+
+		client.identify.shard[0] = spec.shards[0];
+		client.identify.shard[1] = spec.shards[1];
+
+		client.identify.properties.browser = "Katachi";
+		client.identify.properties.device  = "Katachi";
+
+		client.authorization = FmtStr(client.allocator, "Bot " StrFmt, StrArg(client.identify.token));
+
+		// Connections are opened up front so the first REST calls don't pay for the handshake
+		Discord_CreateHttpPool(&client, spec.connections, spec.socket);
+		Defer{ if (client.http) Http_DestroyPool(client.http); };
+
+		// Workers must be stopped before the pool they use is destroyed
+		Discord_StartRestWorkers(&client, spec.rest_workers, spec.http2, spec.message_size, spec.socket);
+		Defer{ Discord_StopRestWorkers(&client); };
+
+		ThreadContext.allocator = MemoryArenaAllocator(arena);
+
+		Discord_SetupEventHandlers(&client.onevent);
+
+		while (client.running) {
+			client.heartbeat = Discord::Heartbeat();
+
+			for (int reconnect = 0; !client.websocket; ++reconnect) {
+				client.websocket = Discord_ConnectToGateway(token, arena, spec.allocator, websocket_spec);
+				if (!client.websocket) {
+					int maximum_backoff = 32; // secs
+					int wait_time = Minimum((int)powf(2.0f, (float)reconnect), maximum_backoff);
+					LogInfoEx("Discord", "Reconnect after %d secs...", wait_time);
+					wait_time = wait_time * 1000 + rand() % 1000; // to ms
+					Thread_Sleep(wait_time);
+					LogInfoEx("Discord", "Reconnecting...");
+				}
+			}
+
+			clock_t counter            = clock();
+			client.heartbeat.remaining = client.heartbeat.interval;
+
+			while (Websocket_IsConnected(client.websocket)) {
+				Websocket_Event events[DISCORD_MAX_EVENT_BATCH];
+				int             count = 0;
+
+				Websocket_Result res = Websocket_ReceiveMany(client.websocket, events, ArrayCount(events), &count, client.scratch, tick);
+
+				if (res == WEBSOCKET_E_CLOSED) break;
+
+				for (int index = 0; index < count; ++index)
+					Discord_HandleWebsocketEvent(&client, events[index]);
+
+				Discord_DispatchCompletedRequests(&client);
+
+				if (res == WEBSOCKET_E_NOMEM) {
+					LogWarningEx("Discord", "Packet lost. Reason: Buffer size too small");
+				}
+
+				clock_t new_counter = clock();
+				float spent = (1000.0f * (new_counter - counter)) / CLOCKS_PER_SEC;
+				client.heartbeat.remaining -= spent;
+				counter = new_counter;
+
+				if (client.heartbeat.remaining <= 0) {
+					client.heartbeat.remaining = client.heartbeat.interval;
+					Discord::HearbeatCommand(&client);
+					TraceEx("Discord", "Heartbeat (%d)", client.heartbeat.count);
+				}
+
+				if (res == WEBSOCKET_E_WAIT) {
+					client.onevent.tick(&client);
+					if (client.http)
+						Http_PoolEvictIdle(client.http);
+				}
+
+				Discord_CacheEndBatch(&client.cache);
+				MemoryArenaReset(client.scratch);
+			}
+
+			Websocket_Disconnect(client.websocket);
+			client.websocket = nullptr;
+		}
+	}
+
+	void LoginSharded(const String token, int32_t intents, EventHandler onevent, PresenceUpdate *presence, int32_t shard_count, const ShardSpec &specs) {
+		Memory_Arena *arena = MemoryArenaAllocate(KiloBytes(128));
+
+		Discord_GatewayResponse response;
+
+		for (int reconnect = 0; ; ++reconnect) {
+			if (Discord_ConnectToGatewayBot(token, arena, &response))
+				break;
+
+			int maximum_backoff = 32; // secs
+			int wait_time = Minimum((int)powf(2.0f, (float)reconnect), maximum_backoff);
+			LogInfoEx("Discord", "Reconnect after %d secs...", wait_time);
+			wait_time = wait_time * 1000 + rand() % 1000; // to ms
+			Thread_Sleep(wait_time);
+			LogInfoEx("Discord", "Reconnecting...");
+		}
+
+		if (shard_count <= 0) {
+			shard_count = response.shards;
+		}
+
+		Thread_Context_Params params = ThreadContextDefaultParams;
+		params.logger                = ThreadContext.logger;
+
+		Discord_ShardThread *shards = PushArray(arena, Discord_ShardThread, shard_count);
+		if (!shards) {
+			MemoryArenaFree(arena);
+			LogErrorEx("Discord", "Failed to allocate memory to launch shards");
+			return;
+		}
+
+		TraceEx("Discord", "Shard count: %d", shard_count);
+
+		// Gateway connections of the shards are serviced by a single I/O thread
+		Net_Event_Loop *loop        = Net_CreateEventLoop(ThreadContextDefaultParams.allocator);
+		Thread *        loop_thread = loop ? Thread_Create(Discord_EventLoopThreadProc, loop, 0, params) : nullptr;
+		if (!loop_thread) {
+			LogWarningEx("Discord", "Failed to start the event loop, shards use an I/O thread each");
+			if (loop) Net_DestroyEventLoop(loop);
+			loop = nullptr;
+		}
+
+		int max_concurrency = response.session_start_limit.max_concurrency;
+
+		for (int32_t shard_id = 0; shard_id < shard_count - 1; ++shard_id) {
+			Discord_ShardThread *shard = &shards[shard_id];
+			shard->token               = token;
+			shard->intents             = intents;
+			shard->onevent             = onevent;
+			shard->presence            = nullptr;
+
+			if (shard_id < specs.specs.count) {
+				shard->spec = specs.specs[shard_id];
+			} else {
+				shard->spec = specs.default_spec;
+				shard->spec.shards[0] = shard_id;
+				shard->spec.shards[1] = shard_count;
+			}
+			if (!shard->spec.loop)
+				shard->spec.loop = loop;
+
+			shard->handle = Thread_Create(Discord_ShardThreadProc, shard, 0, params);
+
+			int rate_limit_key = shard_id % max_concurrency;
+			if (!shard_id && !rate_limit_key) {
+				Thread_Sleep(5000);
+			}
+		}
+
+		int32_t shard_id = shard_count - 1;
+		Discord_ShardThread *shard = &shards[shard_id];
+
+		shard->token    = token;
+		shard->intents  = intents;
+		shard->onevent  = onevent;
+		shard->presence = presence;
+
+		if (shard_id < specs.specs.count) {
+			shard->spec = specs.specs[shard_id];
+		} else {
+			shards[shard_id].spec = specs.default_spec;
+			shard->spec.shards[0] = shard_id;
+			shard->spec.shards[1] = shard_count;
+		}
+		if (!shard->spec.loop)
+			shard->spec.loop = loop;
+
+		shard->handle = nullptr;
+
+		Discord_ShardThreadProc(shard);
+
+		for (int32_t shard_id = 0; shard_id < shard_count - 1; ++shard_id) {
+			Thread_Wait(shards[shard_id].handle, -1);
+		}
+
+		for (int32_t shard_id = 0; shard_id < shard_count - 1; ++shard_id) {
+			Thread_Destroy(shards[shard_id].handle);
+		}
+
+		if (loop) {
+			Net_EventLoopStop(loop);
+			Thread_Wait(loop_thread, -1);
+			Thread_Destroy(loop_thread);
+			Net_DestroyEventLoop(loop);
+		}
+
+		MemoryArenaFree(arena);
+	}
+
+	void Logout(Client *client) {
+		if (client->running && !client->closing) {
+			LogInfoEx("Discord", "Logging out...");
+			Websocket_Close(client->websocket, WEBSOCKET_CLOSE_NORMAL);
+			client->closing = true;
+		}
+	}
+
+	Shard GetShard(Client *client) {
+		return { client->identify.shard[0], client->identify.shard[1] };
+	}
+
+	void Initialize() {
+		// REST uploads and gateway writes are encrypted by the kernel where it's supported
+		Net_EnableKernelTLS(true);
+		Net_Initialize();
+		srand((unsigned int)time(0));
+	}
+
+	template <typename T, typename Table, typename Key>
+	static T *Discord_CacheGet(Client *client, Table *table, Key key, bool fresh) {
+		if (!Discord_CacheQuery(&client->cache))
+			return nullptr;
+
+		Discord_Cache_Entry *entry = table->Find(key);
+		if (!entry || (fresh && entry->generation != client->cache.generation))
+			return nullptr;
+
+		T *value = new T;
+		if (value)
+			Discord_Deserialize(JsonGetObject(entry->json), value);
+		return value;
+	}
+
+	static Channel *Discord_CacheGetChannel(Client *client, Snowflake channel_id, bool fresh) {
+		Channel *channel = Discord_CacheGet<Channel>(client, &client->cache.channels, channel_id, fresh);
+		// Channels of GUILD_CREATE don't carry the guild id
+		if (channel && !channel->guild_id)
+			channel->guild_id = client->cache.channels.Find(channel_id)->guild_id;
+		return channel;
+	}
+
+	Guild *CachedGuild(Client *client, Snowflake guild_id) {
+		Guild *guild = Discord_CacheGet<Guild>(client, &client->cache.guilds, guild_id, false);
+		if (!guild)
+			return nullptr;
+
+		for (auto &pair : client->cache.roles) {
+			if (pair.value.guild_id == guild_id) {
+				Role *role = guild->roles.Add();
+				if (role) Discord_Deserialize(JsonGetObject(pair.value.json), role);
+			}
+		}
+
+		for (auto &pair : client->cache.emojis) {
+			if (pair.value.guild_id == guild_id) {
+				Emoji *emoji = guild->emojis.Add();
+				if (emoji) Discord_Deserialize(JsonGetObject(pair.value.json), emoji);
+			}
+		}
+
+		return guild;
+	}
+
+	Channel *CachedChannel(Client *client, Snowflake channel_id) {
+		return Discord_CacheGetChannel(client, channel_id, false);
+	}
+
+	Role *CachedRole(Client *client, Snowflake role_id) {
+		return Discord_CacheGet<Role>(client, &client->cache.roles, role_id, false);
+	}
+
+	Emoji *CachedEmoji(Client *client, Snowflake emoji_id) {
+		return Discord_CacheGet<Emoji>(client, &client->cache.emojis, emoji_id, false);
+	}
+
+	User *CachedUser(Client *client, Snowflake user_id) {
+		User *user = Discord_CacheGet<User>(client, &client->cache.users, user_id, false);
+		if (user || !Discord_CacheQuery(&client->cache))
+			return user;
+
+		// Users of members are only stored with the member
+		for (const Discord_Member_Guild &guild : client->cache.members.guilds) {
+			GuildMember *member = Discord_MemberStoreGet(&client->cache.members, guild.id, user_id, false);
+			if (member)
+				return member->user;
+		}
+		return nullptr;
+	}
+
+	GuildMember *CachedGuildMember(Client *client, Snowflake guild_id, Snowflake user_id) {
+		if (!Discord_CacheQuery(&client->cache))
+			return nullptr;
+		return Discord_MemberStoreGet(&client->cache.members, guild_id, user_id, false);
+	}
+
+	Message *CachedMessage(Client *client, Snowflake channel_id, Snowflake message_id) {
+		if (!Discord_CacheQuery(&client->cache))
+			return nullptr;
+		return Discord_MessageCacheGet(&client->cache.messages, channel_id, message_id);
+	}
+
+	ptrdiff_t CachedGuildMemberCount(Client *client, Snowflake guild_id) {
+		if (!Discord_CacheQuery(&client->cache))
+			return 0;
+		ptrdiff_t guild = Discord_MemberFindGuild(&client->cache.members, guild_id);
+		return guild >= 0 ? client->cache.members.guilds[guild].rows.count : 0;
+	}
+
+	//
+	// Permissions
+	//
+
+	constexpr Permission DISCORD_PERMISSION_ALL = (PermissionBit::MODERATE_MEMBERS << 1) - 1;
+
+	static Permission Discord_RolePermissions(Client *client, Snowflake role_id) {
+		Discord_Cache_Entry *role = client->cache.roles.Find(role_id);
+		return role ? Discord_ParseBigInt(JsonGetString(JsonGetObject(role->json), "permissions")) : 0;
+	}
+
+	static void Discord_ApplyOverwrite(const Json_Object &overwrite, Permission *permissions) {
+		*permissions &= ~Discord_ParseBigInt(JsonGetString(overwrite, "deny"));
+		*permissions |= Discord_ParseBigInt(JsonGetString(overwrite, "allow"));
+	}
+
+	// Order of the roles does not matter, so the hashes of the role ids are summed
+	static uint64_t Discord_RolesHash(const uint64_t *roles, ptrdiff_t count) {
+		uint64_t hash = 0;
+		for (ptrdiff_t index = 0; index < count; ++index) {
+			uint64_t value = (roles[index] ^ (roles[index] >> 31)) * 0x9E3779B97F4A7C15ull;
+			hash += value ^ (value >> 29);
+		}
+		return hash;
+	}
+
+	// Base permissions of the roles with the @everyone and role overwrites of the channel applied
+	static Discord_Permission_Memo Discord_ComputeRolePermissions(Client *client, Snowflake guild_id, const uint64_t *roles, ptrdiff_t count, const Json_Array &overwrites) {
+		Permission permissions = Discord_RolePermissions(client, guild_id); // @everyone role has the id of the guild
+		for (ptrdiff_t index = 0; index < count; ++index)
+			permissions |= Discord_RolePermissions(client, roles[index]);
+
+		if (permissions & PermissionBit::ADMINISTRATOR)
+			return Discord_Permission_Memo{ DISCORD_PERMISSION_ALL, true };
+
+		for (const Json &overwrite : overwrites) {
+			Json_Object obj = JsonGetObject(overwrite);
+			if (Discord_ParseId(JsonGetString(obj, "id")) == guild_id)
+				Discord_ApplyOverwrite(obj, &permissions);
+		}
+
+		Permission allow = 0, deny = 0;
+		for (const Json &overwrite : overwrites) {
+			Json_Object obj = JsonGetObject(overwrite);
+			if ((OverwriteType)JsonGetInt(obj, "type") != OverwriteType::ROLE)
+				continue;
+			Snowflake id = Discord_ParseId(JsonGetString(obj, "id"));
+			for (ptrdiff_t index = 0; index < count; ++index) {
+				if (roles[index] == id.value) {
+					allow |= Discord_ParseBigInt(JsonGetString(obj, "allow"));
+					deny  |= Discord_ParseBigInt(JsonGetString(obj, "deny"));
+					break;
+				}
+			}
+		}
+
+		permissions &= ~deny;
+		permissions |= allow;
+
+		return Discord_Permission_Memo{ permissions, false };
+	}
+
+	bool ComputePermissions(Client *client, Snowflake channel_id, Snowflake user_id, Permission *permissions) {
+		Discord_Cache *cache = &client->cache;
+		if (!Discord_CacheQuery(cache))
+			return false;
+
+		Discord_Cache_Entry *channel = cache->channels.Find(channel_id);
+		if (!channel)
+			return false;
+
+		// Threads have the overwrites of their parent channel
+		ChannelType type = (ChannelType)JsonGetInt(JsonGetObject(channel->json), "type");
+		bool thread      = type == ChannelType::GUILD_NEWS_THREAD || type == ChannelType::GUILD_PUBLIC_THREAD || type == ChannelType::GUILD_PRIVATE_THREAD;
+		if (thread) {
+			channel_id = Discord_ParseId(JsonGetString(JsonGetObject(channel->json), "parent_id"));
+			channel    = cache->channels.Find(channel_id);
+			if (!channel)
+				return false;
+		}
+
+		Snowflake guild_id         = channel->guild_id;
+		Discord_Cache_Entry *guild = cache->guilds.Find(guild_id);
+		if (!guild)
+			return false;
+
+		// Owner of the guild has every permission even when its member entry is not cached
+		if (Discord_ParseId(JsonGetString(JsonGetObject(guild->json), "owner_id")) == user_id) {
+			*permissions = DISCORD_PERMISSION_ALL;
+			return true;
+		}
+
+		Discord_Member_Store *store = &cache->members;
+		ptrdiff_t slot = Discord_MemberFindGuild(store, guild_id);
+		ptrdiff_t row  = slot >= 0 ? Discord_MemberFind(store, (uint32_t)slot, user_id.value) : -1;
+		if (row < 0)
+			return false;
+
+		const uint64_t *roles       = store->roles.data + store->roles_offset[row];
+		ptrdiff_t       roles_count = store->roles_count[row];
+		Json_Array      overwrites  = JsonGetArray(JsonGetObject(channel->json), "permission_overwrites");
+
+		store->active[row] = store->clock;
+
+		uint64_t                    key           = Discord_RolesHash(roles, roles_count);
+		Discord_Permission_Guild *  guild_memos   = cache->permissions.Find(guild_id);
+		Discord_Permission_Channel *channel_memos = guild_memos ? guild_memos->Find(channel_id) : nullptr;
+		Discord_Permission_Memo *   memo          = channel_memos ? channel_memos->Find(key) : nullptr;
+		Discord_Permission_Memo     computed;
+
+		if (memo) {
+			computed = *memo;
+		} else {
+			computed = Discord_ComputeRolePermissions(client, guild_id, roles, roles_count, overwrites);
+			if (cache->permissions_count >= DISCORD_PERMISSION_MEMO_MAX)
+				Discord_CacheFreePermissions(cache);
+
+			guild_memos   = cache->permissions.FindOrDefault(guild_id, Discord_Permission_Guild(cache->allocator));
+			channel_memos = guild_memos ? guild_memos->FindOrDefault(channel_id, Discord_Permission_Channel(cache->allocator)) : nullptr;
+			if (channel_memos) {
+				channel_memos->Put(key, computed);
+				cache->permissions_count += 1;
+			}
+		}
+
+		Permission result = computed.permissions;
+
+		if (!computed.administrator) {
+			for (const Json &overwrite : overwrites) {
+				Json_Object obj = JsonGetObject(overwrite);
+				if ((OverwriteType)JsonGetInt(obj, "type") == OverwriteType::MEMBER && Discord_ParseId(JsonGetString(obj, "id")) == user_id) {
+					Discord_ApplyOverwrite(obj, &result);
+					break;
+				}
+			}
+
+			// Permissions that are implicitly denied
+			Permission send = thread ? PermissionBit::SEND_MESSAGES_IN_THREADS : PermissionBit::SEND_MESSAGES;
+			if (!(result & PermissionBit::VIEW_CHANNEL))
+				result = 0;
+			else if (!(result & send))
+				result &= ~(PermissionBit::MENTION_EVERYONE | PermissionBit::SEND_TTS_MESSAGES | PermissionBit::ATTACH_FILES | PermissionBit::EMBED_LINKS);
+
+			// Timed out members can only read the channel, this is applied per member so it's not memoized
+			uint32_t timeout = store->communication_disabled_until[row];
+			if (timeout && (ptrdiff_t)timeout + DISCORD_MEMBER_EPOCH > (ptrdiff_t)time(0))
+				result &= PermissionBit::VIEW_CHANNEL | PermissionBit::READ_MESSAGE_HISTORY;
+		}
+
+		*permissions = result;
+		return true;
+	}
+
+	bool ComputeCurrentUserPermissions(Client *client, Snowflake channel_id, Permission *permissions) {
+		return ComputePermissions(client, channel_id, client->cache.user_id, permissions);
+	}
+
+	Channel *GetChannel(Client *client, Snowflake channel_id) {
+		Channel *channel = Discord_CacheGetChannel(client, channel_id, true);
+		if (channel)
+			return channel;
+
+		String endpoint = FmtStr(client->scratch, "/channels/%zu", channel_id);
+
+		Json res;
+		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
+			if (client->cache.enabled)
+				Discord_CachePut(&client->cache, &client->cache.channels, channel_id, res, Discord_ParseId(JsonGetString(JsonGetObject(res), "guild_id")));
+			channel = new Channel;
+			if (channel)
+				Discord_Deserialize(JsonGetObject(res), channel);
+			return channel;
+		}
+		return nullptr;
+	}
+
+	Channel *ModifyChannel(Client *client, Snowflake channel_id, const ChannelPatch &patch) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu", channel_id);
+		String body     = Discord_BuildChannelPatch(client->scratch, patch);
+
+		Json res;
+		if (Discord_Patch(client, endpoint, "application/json", body, &res)) {
+			Channel *channel = new Channel;
+			if (channel)
+				Discord_Deserialize(JsonGetObject(res), channel);
+			return channel;
+		}
+		return nullptr;
+	}
+
+	Channel *DeleteChannel(Client *client, Snowflake channel_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu", channel_id);
+
+		Json res;
+		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
+			Channel *channel = new Channel;
+			if (channel)
+				Discord_Deserialize(JsonGetObject(res), channel);
+			return channel;
+		}
+		return nullptr;
+	}
+
+	Array_View<Message> GetChannelMessages(Client *client, Snowflake channel_id, int limit, Snowflake around, Snowflake before, Snowflake after) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages", channel_id);
+
+		Http_Query_Params params;
+		if (limit > 0)
+			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%d", limit));
+		if (around)
+			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%zu", around.value));
+		else if (before)
+			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%zu", before.value));
+		else if (after)
+			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%zu", after.value));
+
+		Json res;
+		if (Discord_Get(client, endpoint, params, "application/json", String(), &res)) {
+			Json_Array arr = JsonGetArray(res);
+			Array<Message> messages;
+			messages.Resize(arr.count);
+			for (ptrdiff_t index = 0; index < messages.count; ++index) {
+				Discord_Deserialize(JsonGetObject(arr[index]), &messages[index]);
+			}
+			return messages;
+		}
+		return Array_View<Message>();
+	}
+
+	Message *GetChannelMessage(Client *client, Snowflake channel_id, Snowflake message_id) {
+		Message *cached = CachedMessage(client, channel_id, message_id);
+		if (cached)
+			return cached;
+
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu", channel_id, message_id);
+
+		Json res;
+		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
+			Message *message = new Message;
+			if (message)
+				Discord_Deserialize(JsonGetObject(res), message);
+			return message;
+		}
+		return nullptr;
+	}
+
+	Message *CreateMessage(Client *client, Snowflake channel_id, const MessagePost &msg) {
+		String body;
+		String content_type;
+		Array_View<Buffer> segments;
+
+		if (!Discord_BuildMessagePost(client->scratch, msg, &content_type, &body, &segments))
+			return nullptr;
+
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages", channel_id.value);
+
+		Json res;
+		if (Discord_Post(client, endpoint, content_type, body, segments, &res)) {
+			Message *message = new Message;
+			if (message)
+				Discord_Deserialize(JsonGetObject(res), message);
+			return message;
+		}
+		return nullptr;
+	}
+
+	Message *CrossPost(Client *client, Snowflake channel_id, Snowflake message_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/crosspost", channel_id, message_id);
+
+		Json res;
+		if (Discord_Post(client, endpoint, "application/json", String(), &res)) {
+			Message *message = new Message;
+			if (message)
+				Discord_Deserialize(JsonGetObject(res), message);
+			return message;
+		}
+
+		return nullptr;
+	}
+
+	bool CreateReaction(Client *client, Snowflake channel_id, Snowflake message_id, String emoji) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s/@me", channel_id, message_id, StrArg(emoji));
+
+		Json res;
+		if (Discord_Put(client, endpoint, "application/json", String(), &res)) {
+			return true;
+		}
+		return false;
+	}
+
+	bool DeleteReaction(Client *client, Snowflake channel_id, Snowflake message_id, String emoji) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s/@me", channel_id, message_id, StrArg(emoji));
+
+		Json res;
+		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
+			return true;
+		}
+		return false;
+	}
+
+	bool DeleteUserReaction(Client *client, Snowflake channel_id, Snowflake message_id, String emoji, Snowflake user_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s/%zu", channel_id, message_id, StrArg(emoji), user_id);
+
+		Json res;
+		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
+			return true;
+		}
+		return false;
+	}
+
+	Array_View<User> GetReactions(Client *client, Snowflake channel_id, Snowflake message_id, String emoji, int32_t after, int32_t limit) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s", channel_id, message_id, StrArg(emoji));
+
+		Http_Query_Params params;
+		if (after >= 0)
+			Http_QueryParamSet(&params, "after", FmtStr(client->scratch, "%d", after));
+		if (limit >= 0)
+			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%d", limit));
+
+		Json res;
+		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
+			Json_Array arr = JsonGetArray(res);
+			Array<User> users;
+			users.Resize(arr.count);
+			for (ptrdiff_t index = 0; index < users.count; ++index) {
+				Discord_Deserialize(JsonGetObject(arr[index]), &users[index]);
+			}
+
+			return users;
+		}
+		return Array_View<User>();
+	}
+
+	bool DeleteAllReactions(Client *client, Snowflake channel_id, Snowflake message_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions", channel_id, message_id);
+
+		Json res;
+		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
+			return true;
+		}
+		return false;
+	}
+
+	bool DeleteAllReactionsForEmoji(Client *client, Snowflake channel_id, Snowflake message_id, String emoji) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s", channel_id, message_id, StrArg(emoji));
+
+		Json res;
+		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
+			return true;
+		}
+		return false;
+	}
+
+	Message *EditMessage(Client *client, Snowflake channel_id, Snowflake message_id, const MessagePatch &msg) {
+		String body;
+		String content_type;
+		Array_View<Buffer> segments;
+
+		if (!Discord_BuildMessagePatch(client->scratch, msg, &content_type, &body, &segments))
+			return nullptr;
+
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu", channel_id, message_id);
+
+		Json res;
+		if (Discord_Patch(client, endpoint, content_type, body, segments, &res)) {
+			Message *message = new Message;
+			if (message)
+				Discord_Deserialize(JsonGetObject(res), message);
+			return message;
+		}
+		return nullptr;
+	}
+
+	bool DeleteMessage(Client *client, Snowflake channel_id, Snowflake message_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu", channel_id, message_id);
+
+		Json res;
+		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
+			return true;
+		}
+		return false;
+	}
+
+	bool BulkDeleteMessages(Client *client, Snowflake channel_id, Array_View<Snowflake> messages_ids) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/bulk-delete", channel_id);
+
+		String body = Discord_BuildBulkDelete(client->scratch, messages_ids);
+
+		Json res;
+		if (Discord_Post(client, endpoint, "application/json", body, &res)) {
+			return true;
+		}
+		return false;
+	}
+
+	bool EditChannelPermissions(Client *client, Snowflake channel_id, Snowflake overwrite_id, Permission allow, Permission deny, OverwriteType type) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/permissions/%zu", channel_id, overwrite_id);
+
+		Jsonify j(client->scratch);
+		j.BeginObject();
+		j.KeyValue("allow", allow);
+		j.KeyValue("deny", deny);
+		j.KeyValue("tye", (int)type);
+		j.EndObject();
+
+		String body = Jsonify_BuildString(&j);
+
+		Json res;
+		if (Discord_Put(client, endpoint, "application/json", body, &res)) {
+			return true;
+		}
+		return false;
+	}
+
+	Array_View<Invite> GetChannelInvites(Client *client, Snowflake channel_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/invites", channel_id);
+
+		Json res;
+		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
+			Json_Array arr = JsonGetArray(res);
+			Array<Invite> invites;
+			invites.Resize(arr.count);
+			for (ptrdiff_t index = 0; index < invites.count; ++index)
+				Discord_Deserialize(JsonGetObject(arr[index]), &invites[index]);
+			return invites;
+		}
+
+		return Array_View<Invite>();
+	}
+
+	Invite *CreateChannelInvite(Client *client, Snowflake channel_id, const InvitePost &invite) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/invites", channel_id);
+
+		Jsonify j(client->scratch);
+		j.BeginObject();
+		j.KeyValue("max_age", invite.max_age);
+		j.KeyValue("max_uses", invite.max_uses);
+		j.KeyValue("temporary", invite.temporary);
+		j.KeyValue("unique", invite.unique);
+		if (invite.target_type != InviteTargetType::NONE) j.KeyValue("target_type", (int)invite.target_type);
+		if (invite.target_user_id.value) j.KeyValue("target_user_id", invite.target_user_id.value);
+		if (invite.target_application_id.value) j.KeyValue("target_application_id", invite.target_application_id.value);
+		j.EndObject();
+
+		String body = Jsonify_BuildString(&j);
+
+		Json res;
+		if (Discord_Post(client, endpoint, "application/json", body, & res)) {
+			Invite *invite = new Invite;
+			if (invite)
+				Discord_Deserialize(JsonGetObject(res), invite);
+			return invite;
+		}
+
+		return nullptr;
+	}
+
+	bool DeleteChannelPermission(Client *client, Snowflake channel_id, Snowflake overwrite_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/permissions/%zu", channel_id, overwrite_id);
+
+		Json res;
+		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
+			return true;
+		}
+		return false;
+	}
+
+	FollowedChannel *FollowNewsChannel(Client *client, Snowflake channel_id, Snowflake webhook_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/followers", channel_id);
+
+		Jsonify j(client->scratch);
+		j.BeginObject();
+		j.KeyValue("webhook_channel_id", webhook_id.value);
+		j.EndObject();
+
+		String body = Jsonify_BuildString(&j);
+
+		Json res;
+		if (Discord_Post(client, endpoint, "application/json", body, &res)) {
+			FollowedChannel *channel = new FollowedChannel;
+			if (channel)
+				Discord_Deserialize(JsonGetObject(res), channel);
+			return channel;
+		}
+		return nullptr;
+	}
+
+	bool TriggerTypingIndicator(Client *client, Snowflake channel_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/typing", channel_id);
+
+		Json res;
+		if (Discord_Post(client, endpoint, "application/json", String(), &res)) {
+			return true;
+		}
+		return false;
+	}
+
+	Array_View<Message> GetPinnedMessage(Client *client, Snowflake channel_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/pins", channel_id);
+
+		Json res;
+		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
+			Json_Array arr = JsonGetArray(res);
+			Array<Message> pinned;
+			pinned.Resize(arr.count);
+			for (ptrdiff_t index = 0; index < pinned.count; ++index)
+				Discord_Deserialize(JsonGetObject(arr[index]), &pinned[index]);
+			return pinned;
+		}
+		return Array_View<Message>();
+	}
+
+	bool PinMessage(Client *client, Snowflake channel_id, Snowflake message_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/pins/%zu", channel_id, message_id);
+
+		Json res;
+		if (Discord_Put(client, endpoint, "application/json", String(), &res)) {
+			return true;
+		}
+		return false;
+	}
+
+	bool UnpinMessage(Client *client, Snowflake channel_id, Snowflake message_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/pins/%zu", channel_id, message_id);
+
+		Json res;
+		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
+			return true;
+		}
+		return false;
+	}
+
+	bool GroupDMAddRecipient(Client *client, Snowflake channel_id, Snowflake user_id, String access_token, String nick) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/recipients/%zu", channel_id, user_id);
+
+		Jsonify j(client->scratch);
+		j.BeginObject();
+		j.KeyValue("access_token", access_token);
+		j.KeyValue("nick", nick);
+		j.EndObject();
+
+		String body = Jsonify_BuildString(&j);
+
+		Json res;
+		if (Discord_Put(client, endpoint, "application/json", body, &res)) {
+			return true;
+		}
+		return false;
+	}
+
+	bool GroupDMRemoveRecipient(Client *client, Snowflake channel_id, Snowflake user_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/recipients/%zu", channel_id, user_id);
+
+		Json res;
+		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
+			return true;
+		}
+		return false;
+	}
+
+	Channel *StartThreadFromMessage(Client *client, Snowflake channel_id, Snowflake message_id, String name, int32_t auto_archive_duration, int32_t rate_limit_per_user) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/threads", channel_id, message_id);
+
+		Jsonify j(client->scratch);
+		j.BeginObject();
+		j.KeyValue("name", name);
+		if (auto_archive_duration) {
+			auto_archive_duration = Discord_NormalizeThreadAutoArchiveDuration(auto_archive_duration);
+			j.KeyValue("auto_archive_duration", auto_archive_duration);
+		}
+		if (rate_limit_per_user)
+			j.KeyValue("rate_limit_per_user", rate_limit_per_user);
+		j.EndObject();
+
+		String body = Jsonify_BuildString(&j);
+
+		Json res;
+		if (Discord_Post(client, endpoint, "application/json", body, &res)) {
+			Channel *channel = new Channel;
+			if (channel)
+				Discord_Deserialize(JsonGetObject(res), channel);
+			return channel;
+		}
+		return nullptr;
+	}
+
+	Channel *StartThreadWithoutMessage(Client *client, Snowflake channel_id, String name, int32_t auto_archive_duration, ChannelType type, bool invitable, int32_t rate_limit_per_user) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/threads", channel_id);
+
+		Jsonify j(client->scratch);
+		j.BeginObject();
+		j.KeyValue("name", name);
+		if (auto_archive_duration) {
+			auto_archive_duration = Discord_NormalizeThreadAutoArchiveDuration(auto_archive_duration);
+			j.KeyValue("auto_archive_duration", auto_archive_duration);
+		}
+		j.KeyValue("type", (int)type);
+		j.KeyValue("invitable", invitable);
+		if (rate_limit_per_user)
+			j.KeyValue("rate_limit_per_user", rate_limit_per_user);
+		j.EndObject();
+
+		String body = Jsonify_BuildString(&j);
+
+		Json res;
+		if (Discord_Post(client, endpoint, "application/json", body, &res)) {
+			Channel *channel = new Channel;
+			if (channel)
+				Discord_Deserialize(JsonGetObject(res), channel);
+			return channel;
+		}
+		return nullptr;
+	}
+
+	StartForumThreadInfo *StartThreadInForumChannel(Client *client, Snowflake channel_id, String name, const ForumThreadMessageParams &msg, int32_t auto_archive_duration, int32_t rate_limit_per_user) {
+		Jsonify j(client->scratch);
+
+		j.BeginObject();
+
+		j.KeyValue("name", name);
+		if (auto_archive_duration) {
+			auto_archive_duration = Discord_NormalizeThreadAutoArchiveDuration(auto_archive_duration);
+			j.KeyValue("auto_archive_duration", auto_archive_duration);
+		}
+		if (rate_limit_per_user)
+			j.KeyValue("rate_limit_per_user", rate_limit_per_user);
+
+		j.PushKey("message");
+
+		j.BeginObject();
+
+		if (msg.content.length)
+			j.KeyValue("content", msg.content);
+
+		if (msg.embeds.count) {
+			j.PushKey("embeds");
+			j.BeginArray();
+			for (const auto &embed : msg.embeds)
+				Discord_Jsonify(embed, &j);
+			j.EndArray();
+		}
+
+		if (msg.allowed_mentions) {
+			j.PushKey("allowed_mentions");
+			Discord_Jsonify(*msg.allowed_mentions, &j);
+		}
+
+		if (msg.components.count) {
+			j.PushKey("components");
+			j.BeginArray();
+			for (const auto &comp : msg.components)
+				Discord_Jsonify(comp, &j);
+			j.EndArray();
+		}
+
+		if (msg.sticker_ids.count) {
+			j.PushKey("sticker_ids");
+			j.BeginArray();
+			for (const auto &id : msg.sticker_ids)
+				j.PushId(id.value);
+			j.EndArray();
+		}
+
+		if (msg.attachments.count) {
+			j.PushKey("attachments");
+			j.BeginArray();
+			for (int id = 0; id < (int)msg.attachments.count; ++id) {
+				j.BeginObject();
+				j.KeyValue("id", id);
+				j.KeyValue("filename", msg.attachments[id].filename);
+				if (msg.attachments[id].description.length)
+					j.KeyValue("description", msg.attachments[id].description);
+				j.EndObject();
+			}
+			j.EndArray();
+		}
+
+		if (msg.flags) j.KeyValue("flags", msg.flags);
+
+		j.EndObject();
+		j.EndObject();
+
+		String payload_json = Jsonify_BuildString(&j);
+
+		String body;
+		String content_type;
+		Array_View<Buffer> segments;
+
+		uint8_t buffer[4096];
+		int     len = 0;
+
+		if (!msg.attachments.count) {
+			body = payload_json;
+			content_type = "application/json";
+		} else {
+			Http_Multipart multipart = Http_MultipartBegin(client->scratch);
+			if (!Http_MultipartData(&multipart, payload_json, "application/json", "name=\"payload_json\""))
+				return nullptr;
+			for (int id = 0; id < (int)msg.attachments.count; ++id) {
+				const auto &attachment = msg.attachments[id];
+				len = snprintf((char *)buffer, sizeof(buffer), "name=\"files[%d]\"; filename=\"" StrFmt "\"", id, StrArg(attachment.filename));
+				String content_disposition(buffer, len);
+				if (!Http_MultipartReference(&multipart, attachment.content, attachment.content_type, content_disposition))
+					return nullptr;
+			}
+
+			segments = Http_MultipartEndSegments(&multipart);
+			if (!segments.count)
+				return nullptr;
+
+			String boundary = String(multipart.boundary, HTTP_MULTIPART_LENGTH);
+			len = snprintf((char *)buffer, sizeof(buffer), "multipart/form-data; boundary=" StrFmt, StrArg(boundary));
+			content_type = String(buffer, len);
+		}
+
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/threads", channel_id);
+
+		Json res;
+		if (Discord_Post(client, endpoint, content_type, body, segments, &res)) {
+			StartForumThreadInfo *thread = new StartForumThreadInfo;
+			if (thread) {
+				Json_Object obj = JsonGetObject(res);
+				Discord_Deserialize(obj, &thread->channel);
+				Discord_Deserialize(JsonGetObject(obj, "message"), &thread->message);
+			}
+			return thread;
+		}
+
+		return nullptr;
+	}
+
+	bool JoinThread(Client *client, Snowflake channel_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/@me", channel_id);
+
+		Json res;
+		if (Discord_Put(client, endpoint, "application/json", String(), &res)) {
+			return true;
+		}
+		return false;
+	}
+
+	bool AddThreadMember(Client *client, Snowflake channel_id, Snowflake user_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/%zu", channel_id, user_id);
+
+		Json res;
+		if (Discord_Put(client, endpoint, "application/json", String(), &res)) {
+			return false;
+		}
+		return true;
+	}
+
+	bool LeaveThread(Client *client, Snowflake channel_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/@me", channel_id);
+
+		Json res;
+		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
+			return false;
+		}
+		return true;
+	}
+
+	bool RemoveThreadMember(Client *client, Snowflake channel_id, Snowflake user_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/%zu", channel_id, user_id);
+
+		Json res;
+		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
+			return false;
+		}
+		return true;
+	}
+
+	ThreadMember *GetThreadMember(Client *client, Snowflake channel_id, Snowflake user_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/%zu", channel_id, user_id);
+
+		Json res;
+		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
+			ThreadMember *member = new ThreadMember;
+			if (member) {
+				Discord_Deserialize(JsonGetObject(res), member);
+			}
+			return member;
+		}
+		return nullptr;
+	}
+
+	Array_View<ThreadMember> ListThreadMembers(Client *client, Snowflake channel_id) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members", channel_id);
+
+		Json res;
+		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
+			Json_Array arr = JsonGetArray(res);
+			Array<ThreadMember> members;
+			members.Resize(arr.count);
+			for (ptrdiff_t index = 0; index < members.count; ++index) {
+				Discord_Deserialize(JsonGetObject(arr[index]), &members[index]);
+			}
+			return members;
+		}
+		return Array_View<ThreadMember>();
+	}
+
+	ThreadsInfo *ListPublicArchivedThreads(Client *client, Snowflake channel_id, Timestamp before, int32_t limit) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/threads/archived/public", channel_id);
+
+		uint8_t buffer[32];
+
+		Http_Query_Params params;
+		if (before.value) {
+			int len = Discord_FmtTimestamp(buffer, sizeof(buffer), before);
+			Http_QueryParamSet(&params, "before", String(buffer, len));
+		}
+
+		if (limit)
+			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%d", limit));
+
+		Json res;
+		if (Discord_Get(client, endpoint, params, "application/json", String(), &res)) {
+			ThreadsInfo *archived = new ThreadsInfo;
+
+			if (archived) {
+				Json_Object obj = JsonGetObject(res);
+				Json_Array arr;
+				
+				arr = JsonGetArray(obj, "threads");
+				Array<Channel> threads;
+				threads.Resize(arr.count);
+				for (ptrdiff_t index = 0; index < threads.count; ++index)
+					Discord_Deserialize(JsonGetObject(arr[index]), &threads[index]);
+
+				arr = JsonGetArray(obj, "members");
+				Array<ThreadMember> members;
+				members.Resize(arr.count);
+				for (ptrdiff_t index = 0; index < members.count; ++index)
+					Discord_Deserialize(JsonGetObject(arr[index]), &members[index]);
+
+				archived->threads  = threads;
+				archived->members  = members;
+				archived->has_more = JsonGetBool(obj, "has_more");
+			}
+
+			return archived;
+		}
+		return nullptr;
+	}
+
+	ThreadsInfo *ListPrivateArchivedThread(Client *client, Snowflake channel_id, Timestamp before, int32_t limit) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/threads/archived/private", channel_id);
+
+		uint8_t buffer[32];
+
+		Http_Query_Params params;
+		if (before.value) {
+			int len = Discord_FmtTimestamp(buffer, sizeof(buffer), before);
+			Http_QueryParamSet(&params, "before", String(buffer, len));
+		}
+
+		if (limit)
+			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%d", limit));
+
+		Json res;
+		if (Discord_Get(client, endpoint, params, "application/json", String(), &res)) {
+			ThreadsInfo *archived = new ThreadsInfo;
+
+			if (archived) {
+				Json_Object obj = JsonGetObject(res);
+				Json_Array arr;
+
+				arr = JsonGetArray(obj, "threads");
+				Array<Channel> threads;
+				threads.Resize(arr.count);
+				for (ptrdiff_t index = 0; index < threads.count; ++index)
+					Discord_Deserialize(JsonGetObject(arr[index]), &threads[index]);
+
+				arr = JsonGetArray(obj, "members");
+				Array<ThreadMember> members;
+				members.Resize(arr.count);
+				for (ptrdiff_t index = 0; index < members.count; ++index)
+					Discord_Deserialize(JsonGetObject(arr[index]), &members[index]);
+
+				archived->threads = threads;
+				archived->members = members;
+				archived->has_more = JsonGetBool(obj, "has_more");
+			}
+
+			return archived;
+		}
+		return nullptr;
+	}
+
+	ThreadsInfo *ListJoinedArchivedThreads(Client *client, Snowflake channel_id, Timestamp before, int32_t limit) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/users/@me/threads/archived/private", channel_id);
+
+		uint8_t buffer[32];
+
+		Http_Query_Params params;
+		if (before.value) {
+			int len = Discord_FmtTimestamp(buffer, sizeof(buffer), before);
+			Http_QueryParamSet(&params, "before", String(buffer, len));
+		}
+
+		if (limit)
+			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%d", limit));
+
+		Json res;
+		if (Discord_Get(client, endpoint, params, "application/json", String(), &res)) {
+			ThreadsInfo *archived = new ThreadsInfo;
+
+			if (archived) {
+				Json_Object obj = JsonGetObject(res);
+				Json_Array arr;
+
+				arr = JsonGetArray(obj, "threads");
+				Array<Channel> threads;
+				threads.Resize(arr.count);
+				for (ptrdiff_t index = 0; index < threads.count; ++index)
+					Discord_Deserialize(JsonGetObject(arr[index]), &threads[index]);
+
+				arr = JsonGetArray(obj, "members");
+				Array<ThreadMember> members;
+				members.Resize(arr.count);
+				for (ptrdiff_t index = 0; index < members.count; ++index)
+					Discord_Deserialize(JsonGetObject(arr[index]), &members[index]);
+
+				archived->threads = threads;
+				archived->members = members;
+				archived->has_more = JsonGetBool(obj, "has_more");
+			}
+
+			return archived;
+		}
+		return nullptr;
+	}
+
+	Array_View<Channel *> GetChannels(Client *client, Array_View<Snowflake> channel_ids) {
+		Array<Channel *> channels;
+		if (!channels.Resize(channel_ids.count))
+			return Array_View<Channel *>();
+
+		// Only the channels that are not cached are requested
+		Array<String>    endpoints;
+		Array<ptrdiff_t> positions;
+		for (ptrdiff_t index = 0; index < channel_ids.count; ++index) {
+			channels[index] = Discord_CacheGetChannel(client, channel_ids[index], true);
+			if (!channels[index]) {
+				endpoints.Add(FmtStr(client->scratch, "/channels/%zu", channel_ids[index]));
+				positions.Add(index);
+			}
+		}
+
+		if (!endpoints.count)
+			return channels;
+
+		Array_View<Request> requests = Discord_GetPipelined(client, endpoints);
+
+		for (ptrdiff_t index = 0; index < requests.count; ++index) {
+			Json res;
+			if (Discord_ParseResponse(requests[index], &res)) {
+				Channel *channel = new Channel;
+				if (channel)
+					Discord_Deserialize(JsonGetObject(res), channel);
+				channels[positions[index]] = channel;
+			}
+		}
+		return channels;
+	}
+
+	Array_View<Message *> GetChannelMessages(Client *client, Snowflake channel_id, Array_View<Snowflake> message_ids) {
+		Array<String> endpoints;
+		endpoints.Resize(message_ids.count);
+		for (ptrdiff_t index = 0; index < endpoints.count; ++index)
+			endpoints[index] = FmtStr(client->scratch, "/channels/%zu/messages/%zu", channel_id, message_ids[index]);
+
+		Array_View<Request> requests = Discord_GetPipelined(client, endpoints);
+
+		Array<Message *> messages;
+		messages.Resize(requests.count);
+		for (ptrdiff_t index = 0; index < messages.count; ++index) {
+			Json res;
+			if (Discord_ParseResponse(requests[index], &res)) {
+				messages[index] = new Message;
+				if (messages[index])
+					Discord_Deserialize(JsonGetObject(res), messages[index]);
+			}
+		}
+		return messages;
+	}
+
+	Array_View<GuildMember *> GetGuildMembers(Client *client, Snowflake guild_id, Array_View<Snowflake> user_ids) {
+		Array<GuildMember *> members;
+		if (!members.Resize(user_ids.count))
+			return Array_View<GuildMember *>();
+
+		// Without the GUILD_MEMBERS intent the stored members are not updated, they may be stale
+		bool stored = client->cache.members_tracked && Discord_CacheQuery(&client->cache);
+
+		Array<String>    endpoints;
+		Array<ptrdiff_t> positions;
+		for (ptrdiff_t index = 0; index < user_ids.count; ++index) {
+			members[index] = stored ? Discord_MemberStoreGet(&client->cache.members, guild_id, user_ids[index], true) : nullptr;
+			if (!members[index]) {
+				endpoints.Add(FmtStr(client->scratch, "/guilds/%zu/members/%zu", guild_id, user_ids[index]));
+				positions.Add(index);
+			}
+		}
+
+		if (!endpoints.count)
+			return members;
+
+		Array_View<Request> requests = Discord_GetPipelined(client, endpoints);
+
+		for (ptrdiff_t index = 0; index < requests.count; ++index) {
+			Json res;
+			if (Discord_ParseResponse(requests[index], &res)) {
+				GuildMember *member = new GuildMember;
+				if (member)
+					Discord_Deserialize(JsonGetObject(res), member);
+				members[positions[index]] = member;
+			}
+		}
+		return members;
+	}
+
+	bool DownloadAttachment(const Attachment &attachment, String path, uint32_t connections) {
+		Http_Download_Spec spec = HttpDownloadDefaultSpec;
+		spec.connections        = connections;
+
+		if (!Http_Download(attachment.url, path, spec))
+			return false;
+
+		Buffer content;
+		if (!Http_MapFile(path, &content))
+			return false;
+
+		bool matched = content.length == attachment.size;
+		Http_UnmapFile(content);
+
+		if (!matched)
+			LogErrorEx("Discord", "Downloaded attachment size does not match: " StrFmt, StrArg(attachment.filename));
+		return matched;
+	}
+
+	Http_Cache *CreateAssetCache(String directory, uint64_t budget) {
+		Http_Cache_Spec spec = HttpCacheDefaultSpec;
+		spec.budget          = budget;
+		return Http_CreateCache("https://cdn.discordapp.com", directory, spec);
+	}
+
+	void DestroyAssetCache(Http_Cache *cache) {
+		Http_DestroyCache(cache);
+	}
+
+	static bool Discord_AcquireAsset(Http_Cache *cache, Http_Cache_Asset *asset, const char *fmt, ...) {
+		char buffer[512];
+
+		va_list args;
+		va_start(args, fmt);
+		int length = vsnprintf(buffer, sizeof(buffer), fmt, args);
+		va_end(args);
+
+		if (length <= 0 || length >= (int)sizeof(buffer)) {
+			LogErrorEx("Discord", "Asset endpoint too long");
+			return false;
+		}
+
+		return Http_CacheAcquire(cache, String(buffer, length), asset);
+	}
+
+	bool AcquireUserAvatar(Http_Cache *cache, const User &user, Http_Cache_Asset *asset, int32_t size) {
+		if (!user.avatar.length) {
+			ptrdiff_t discriminator = 0;
+			ParseInt(user.discriminator, &discriminator);
+			// Users without a discriminator are assigned the default avatar by their id
+			uint64_t index = discriminator ? (uint64_t)discriminator % 5 : (user.id.value >> 22) % 6;
+			return Discord_AcquireAsset(cache, asset, "/embed/avatars/%u.png", (uint32_t)index);
+		}
+
+		const char *extension = StrStartsWith(user.avatar, "a_") ? "gif" : "png";
+		if (size)
+			return Discord_AcquireAsset(cache, asset, "/avatars/%zu/" StrFmt ".%s?size=%d", user.id.value, StrArg(user.avatar), extension, size);
+		return Discord_AcquireAsset(cache, asset, "/avatars/%zu/" StrFmt ".%s", user.id.value, StrArg(user.avatar), extension);
+	}
+
+	bool AcquireEmoji(Http_Cache *cache, const Emoji &emoji, Http_Cache_Asset *asset, int32_t size) {
+		const char *extension = emoji.animated ? "gif" : "png";
+		if (size)
+			return Discord_AcquireAsset(cache, asset, "/emojis/%zu.%s?size=%d", emoji.id.value, extension, size);
+		return Discord_AcquireAsset(cache, asset, "/emojis/%zu.%s", emoji.id.value, extension);
+	}
+
+	bool AcquireSticker(Http_Cache *cache, const Sticker &sticker, Http_Cache_Asset *asset) {
+		const char *extension = sticker.format_type == StickerFormatType::LOTTIE ? "json" : "png";
+		return Discord_AcquireAsset(cache, asset, "/stickers/%zu.%s", sticker.id.value, extension);
+	}
+
+	void ReleaseAsset(Http_Cache *cache, Http_Cache_Asset *asset) {
+		Http_CacheRelease(cache, asset);
+	}
+}
+
+//
+//
+//
+
+static void Discord_InitHttpRequest(Http *http, Http_Request *req, String authorization, String content_type, String body) {
+	Http_InitRequest(req);
+	Http_SetHost(req, http);
+	Http_SetHeader(req, HTTP_HEADER_CONNECTION, "keep-alive");
+	Http_SetHeader(req, HTTP_HEADER_USER_AGENT, Discord::UserAgent);
+	Http_SetHeader(req, HTTP_HEADER_AUTHORIZATION, authorization);
+	Http_SetContent(req, content_type, body);
+}
+
+static bool Discord_CreateHttpPool(Discord::Client *client, uint32_t connections, const Net_Socket_Options &socket) {
+	const String host = "https://discord.com";
+
+	Http_Pool_Spec spec  = HttpPoolDefaultSpec;
+	spec.max_connections = connections;
+	spec.socket          = socket;
+
+	client->http = Http_CreatePool(host, HTTPS_CONNECTION, spec, client->allocator);
+	if (!client->http) {
+		LogErrorEx("Discord", "Unable to create connection pool for \"" StrFmt "\".", StrArg(host));
+		return false;
+	}
+
+	return true;
+}
+
+static bool Discord_ExecuteRequest(Http_Pool *pool, String authorization, Discord::Request *request, Memory_Arena *arena, int max_wait) {
+	String endpoint = FmtStr(arena, StrFmt StrFmt, StrArg(Discord::BaseHttpUrl), StrArg(request->endpoint));
+
+	Discord_Route route = Discord_GetRoute(request->method, request->endpoint);
+
+	Http_Request req;
+	Http_Response res;
+
+	for (int retry = 0, limited = 0; retry < 2;) {
+		if (!Discord_RateLimitWait(route, max_wait)) {
+			request->http_status = 429;
+			return false;
+		}
+
+		Http *http = Http_PoolCheckout(pool);
+		if (!http) {
+			LogErrorEx("Discord", "Unable to connect to \"discord.com\".");
+			return false;
+		}
+
+		Discord_InitHttpRequest(http, &req, authorization, request->content_type, request->body);
+		if (request->segments.count)
+			Http_SetContent(&req, request->content_type, request->segments.data, request->segments.count);
+
+		bool received = Http_CustomMethod(http, request->method, endpoint, request->params, req, &res, arena);
+
+		// A failed request may have left a partial response on the connection
+		Http_PoolCheckin(pool, http, received && Http_IsKeepAlive(res));
+
+		if (!received) {
+			retry += 1;
+			continue;
+		}
+
+		request->http_status = res.status.code;
+		request->response    = res.body;
+
+		uint64_t retry_after = Discord_RateLimitUpdate(route, &res);
+
+		if (res.status.code == 429 && limited < DISCORD_RATE_LIMIT_RETRIES) {
+			LogWarningEx("Discord", "Rate limited on " StrFmt " " StrFmt ", retrying after %d ms", StrArg(request->method), StrArg(endpoint), (int)retry_after);
+			limited += 1;
+			continue;
+		}
+
+		if (res.status.code > 299) {
+			LogInfo("===> Request :: " StrFmt, StrArg(endpoint));
+			Http_DumpHeader(req);
+			LogInfo(StrFmt, StrArg(req.body));
+			LogInfo("===> Response");
+			Http_DumpHeader(res);
+			LogInfo(StrFmt, StrArg(res.body));
+			return false;
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+static bool Discord_CustomMethod(Discord::Client *client, const String method, const String api_endpoint, const Http_Query_Params &params, const String content_type, const String body, Array_View<Buffer> segments, Json *json) {
+	if (!client->http) {
+		if (!Discord_CreateHttpPool(client, HttpPoolDefaultSpec.max_connections, NetDefaultSocketOptions))
+			return false;
+	}
+
+	// Synchronous requests take the same path as the asynchronous ones but run on the calling thread
+	Discord::Request request;
+	request.method       = method;
+	request.endpoint     = api_endpoint;
+	request.params       = params;
+	request.content_type = content_type;
+	request.body         = body;
+	request.segments     = segments;
+
+	if (!Discord_ExecuteRequest(client->http, client->authorization, &request, client->scratch, DISCORD_RATE_LIMIT_SYNC_WAIT))
+		return false;
+
+	if (JsonParse(request.response, json))
+		return true;
+
+	LogErrorEx("Discord", "Failed to parse HTTP response");
+
+	return false;
+}
+
+// Requests are written back to back on one connection with upto depth of them in flight, the ones
+// that could not be completed on the pipeline, including the rate limited ones, are retried one at a time
+// and wait on their bucket like the other synchronous requests
+static void Discord_ExecutePipelined(Http_Pool *pool, String authorization, Array_View<Discord::Request> requests, uint32_t depth, Memory_Arena *arena, Memory_Allocator allocator) {
+	Http *http = depth > 1 ? Http_PoolCheckout(pool) : nullptr;
+	Http_Pipeline *pipeline = http ? Http_PipelineBegin(http, (int)depth, allocator) : nullptr;
+
+	if (pipeline) {
+		Http_Request req;
+		Http_Response res;
+
+		ptrdiff_t sent     = 0;
+		ptrdiff_t received = 0;
+		bool      limited  = false;
+
+		while (received < requests.count) {
+			while (!limited && sent < requests.count && Http_PipelineCanSend(pipeline)) {
+				Discord::Request *request = &requests[sent];
+				String endpoint = FmtStr(arena, StrFmt StrFmt, StrArg(Discord::BaseHttpUrl), StrArg(request->endpoint));
+
+				if (Discord_RateLimitAcquire(Discord_GetRoute(request->method, request->endpoint), true)) {
+					limited = true;
+					break;
+				}
+				Discord_InitHttpRequest(http, &req, authorization, request->content_type, request->body);
+
+				if (!Http_PipelineSend(pipeline, request->method, endpoint, request->params, req))
+					break;
+				sent += 1;
+			}
+
+			if (received == sent)
+				break;
+
+			if (!Http_PipelineReceive(pipeline, &res, arena))
+				break;
+
+			Discord::Request *request = &requests[received];
+			received += 1;
+
+			Discord_RateLimitUpdate(Discord_GetRoute(request->method, request->endpoint), &res);
+
+			request->http_status = res.status.code;
+			if (res.status.code <= 299)
+				request->response = res.body;
+			else if (res.status.code != 429)
+				LogWarningEx("Discord", "Request " StrFmt " " StrFmt " failed with status %u", StrArg(request->method), StrArg(request->endpoint), res.status.code);
+		}
+
+		Http_PoolCheckin(pool, http, Http_PipelineEnd(pipeline));
+	} else if (http) {
+		Http_PoolCheckin(pool, http, true);
+	}
+
+	for (Discord::Request &request : requests) {
+		if (!request.http_status || request.http_status == 429)
+			Discord_ExecuteRequest(pool, authorization, &request, arena, DISCORD_RATE_LIMIT_SYNC_WAIT);
+	}
+}
+
+static Array_View<Discord::Request> Discord_GetPipelined(Discord::Client *client, Array_View<String> api_endpoints) {
+	if (!client->http) {
+		if (!Discord_CreateHttpPool(client, HttpPoolDefaultSpec.max_connections, NetDefaultSocketOptions))
+			return Array_View<Discord::Request>();
+	}
+
+	Array<Discord::Request> requests;
+	if (!requests.Resize(api_endpoints.count))
+		return Array_View<Discord::Request>();
+
+	for (ptrdiff_t index = 0; index < requests.count; ++index) {
+		requests[index].method       = "GET";
+		requests[index].endpoint     = api_endpoints[index];
+		requests[index].content_type = "application/json";
+	}
+
+	Discord_ExecutePipelined(client->http, client->authorization, requests, client->pipeline_depth, client->scratch, client->allocator);
+
+	return requests;
+}
+
+static bool Discord_ParseResponse(const Discord::Request &request, Json *json) {
+	if (request.http_status < 200 || request.http_status > 299)
+		return false;
+
+	if (JsonParse(request.response, json))
+		return true;
+
+	LogErrorEx("Discord", "Failed to parse HTTP response");
+
+	return false;
+}
+
+//
+//
+//
+
+static void Discord_FinishRequest(Discord_Rest_Queue *queue, Discord::Request *request, bool succeeded) {
+	// The response lives in the arena of the executing thread which is reset independently of the request
+	if (succeeded && request->response.length) {
+		uint8_t *response = (uint8_t *)MemoryAllocate(request->response.length, request->allocator);
+		if (response) {
+			memcpy(response, request->response.data, request->response.length);
+			request->response = Buffer(response, request->response.length);
+		} else {
+			LogErrorEx("Discord", "Failed to allocate memory for the response");
+			succeeded         = false;
+			request->response = Buffer();
+		}
+	} else {
+		request->response = Buffer();
+	}
+
+	Discord::RequestStatus status = succeeded ? Discord::RequestStatus::SUCCEEDED : Discord::RequestStatus::FAILED;
+
+	if (!request->complete) {
+		// The caller is polling the request and may release it as soon as the status changes
+		AtomicStore(&request->status, (int32_t)status);
+		return;
+	}
+
+	request->status = (int32_t)status;
+
+	SpinLock(&queue->guard);
+	Discord::Request **slot = queue->completed.Add();
+	if (slot) *slot = request;
+	SpinUnlock(&queue->guard);
+
+	if (!slot) {
+		LogErrorEx("Discord", "Failed to queue completed request, dropping it");
+		Discord::ReleaseRequest(request);
+	}
+}
+
+static int Discord_RestWorkerProc(void *arg) {
+	Discord_Rest_Worker *worker = (Discord_Rest_Worker *)arg;
+	Discord_Rest_Queue *queue   = worker->queue;
+
+	while (Semaphore_Wait(queue->signal, -1) >= 0) {
+		Discord::Request *request = nullptr;
+
+		SpinLock(&queue->guard);
+		bool running = queue->running;
+		if (running && queue->pending.count > queue->pending_head) {
+			// Prefer the oldest request whose route is not rate limited so that one
+			// exhausted bucket does not hold up the requests queued behind it
+			ptrdiff_t pick  = queue->pending_head;
+			ptrdiff_t count = Minimum(queue->pending.count, queue->pending_head + DISCORD_REST_LOOKAHEAD);
+			for (ptrdiff_t index = queue->pending_head; index < count; ++index) {
+				Discord::Request *next = queue->pending[index];
+				if (!Discord_RateLimitAcquire(Discord_GetRoute(next->method, next->endpoint), false)) {
+					pick = index;
+					break;
+				}
+			}
+			request = Discord_RestQueueTake(&queue->pending, &queue->pending_head, pick);
+			Discord_RestQueueCompact(&queue->pending, &queue->pending_head);
+		}
+		SpinUnlock(&queue->guard);
+
+		if (!running) break;
+		if (!request) continue;
+
+		bool succeeded = Discord_ExecuteRequest(queue->http, queue->authorization, request, worker->arena, DISCORD_RATE_LIMIT_NO_TIMEOUT);
+		Discord_FinishRequest(queue, request, succeeded);
+		MemoryArenaReset(worker->arena);
+	}
+
+	return 0;
+}
 
-		String body = Jsonify_BuildString(&j);
+static void Discord_Http2WriterProc(Http_Header &header, uint8_t *buffer, ptrdiff_t length, void *context) {
+	Discord_Http2_Stream *stream = (Discord_Http2_Stream *)context;
+	if (stream->overflow)
+		return;
 
-		Json res;
-		if (Discord_Post(client, endpoint, "application/json", body, &res)) {
-			FollowedChannel *channel = new FollowedChannel;
-			if (channel)
-				Discord_Deserialize(JsonGetObject(res), channel);
-			return channel;
+	if (stream->length + length > stream->capacity) {
+		ptrdiff_t capacity = Maximum(Maximum(stream->capacity * 2, stream->length + length), KiloBytes(4));
+		uint8_t *body = (uint8_t *)MemoryReallocate(stream->capacity, capacity, stream->body, stream->queue->allocator);
+		if (!body) {
+			LogErrorEx("Discord", "Failed to allocate memory for the response");
+			stream->overflow = true;
+			return;
 		}
-		return nullptr;
+		stream->body     = body;
+		stream->capacity = capacity;
 	}
 
-	bool TriggerTypingIndicator(Client *client, Snowflake channel_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/typing", channel_id);
+	memcpy(stream->body + stream->length, buffer, length);
+	stream->length += length;
+}
 
-		Json res;
-		if (Discord_Post(client, endpoint, "application/json", String(), &res)) {
-			return true;
-		}
+static bool Discord_Http2Requeue(Discord_Rest_Queue *queue, Discord::Request *request) {
+	if (request->attempts >= DISCORD_RATE_LIMIT_RETRIES)
 		return false;
-	}
 
-	Array_View<Message> GetPinnedMessage(Client *client, Snowflake channel_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/pins", channel_id);
+	request->attempts += 1;
 
-		Json res;
-		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
-			Json_Array arr = JsonGetArray(res);
-			Array<Message> pinned;
-			pinned.Resize(arr.count);
-			for (ptrdiff_t index = 0; index < pinned.count; ++index)
-				Discord_Deserialize(JsonGetObject(arr[index]), &pinned[index]);
-			return pinned;
-		}
-		return Array_View<Message>();
-	}
+	SpinLock(&queue->guard);
+	Discord::Request **slot = queue->running ? queue->pending.Add() : nullptr;
+	if (slot) *slot = request;
+	SpinUnlock(&queue->guard);
 
-	bool PinMessage(Client *client, Snowflake channel_id, Snowflake message_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/pins/%zu", channel_id, message_id);
+	return slot != nullptr;
+}
 
-		Json res;
-		if (Discord_Put(client, endpoint, "application/json", String(), &res)) {
-			return true;
+static void Discord_Http2ReleaseStream(Discord_Http2_Stream *stream) {
+	if (stream->body)
+		MemoryFree(stream->body, stream->capacity, stream->queue->allocator);
+	stream->request  = nullptr;
+	stream->body     = nullptr;
+	stream->length   = 0;
+	stream->capacity = 0;
+	stream->overflow = false;
+}
+
+static void Discord_Http2CompletionProc(Http2 *http2, Http_Response *res, bool success, void *context) {
+	Discord_Http2_Stream *stream = (Discord_Http2_Stream *)context;
+	Discord::Request *request    = stream->request;
+	Discord_Rest_Queue *queue    = stream->queue;
+
+	bool retry = !success;
+
+	if (success) {
+		uint64_t retry_after = Discord_RateLimitUpdate(stream->route, res);
+		if (res->status.code == 429) {
+			LogWarningEx("Discord", "Rate limited on " StrFmt " " StrFmt ", retrying after %d ms", StrArg(request->method), StrArg(request->endpoint), (int)retry_after);
+			retry = true;
 		}
-		return false;
 	}
 
-	bool UnpinMessage(Client *client, Snowflake channel_id, Snowflake message_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/pins/%zu", channel_id, message_id);
+	if (retry && Discord_Http2Requeue(queue, request)) {
+		Discord_Http2ReleaseStream(stream);
+		return;
+	}
 
-		Json res;
-		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
-			return true;
-		}
-		return false;
+	request->http_status = success ? res->status.code : 0;
+	request->response    = Buffer(stream->body, stream->length);
+
+	bool succeeded = success && !stream->overflow && res->status.code <= 299;
+
+	if (success && res->status.code > 299) {
+		LogInfo("===> Request :: " StrFmt " " StrFmt, StrArg(request->method), StrArg(request->endpoint));
+		LogInfo("===> Response");
+		Http_DumpHeader(*res);
+		LogInfo(StrFmt, StrArg(request->response));
 	}
 
-	bool GroupDMAddRecipient(Client *client, Snowflake channel_id, Snowflake user_id, String access_token, String nick) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/recipients/%zu", channel_id, user_id);
+	// The response is copied out of the stream buffer
+	Discord_FinishRequest(queue, request, succeeded);
+	Discord_Http2ReleaseStream(stream);
+}
 
-		Jsonify j(client->scratch);
-		j.BeginObject();
-		j.KeyValue("access_token", access_token);
-		j.KeyValue("nick", nick);
-		j.EndObject();
+static bool Discord_Http2Submit(Http2 *http2, Discord_Http2_Stream *stream, Discord::Request *request, Http_Request *req) {
+	Discord_Rest_Queue *queue = stream->queue;
 
-		String body = Jsonify_BuildString(&j);
+	stream->request = request;
+	stream->route   = Discord_GetRoute(request->method, request->endpoint);
 
-		Json res;
-		if (Discord_Put(client, endpoint, "application/json", body, &res)) {
-			return true;
-		}
-		return false;
+	char endpoint[HTTP_MAX_HEADER_SIZE];
+	int length = snprintf(endpoint, sizeof(endpoint), StrFmt StrFmt, StrArg(Discord::BaseHttpUrl), StrArg(request->endpoint));
+
+	Http_InitRequest(req);
+	Http_SetHeader(req, HTTP_HEADER_USER_AGENT, Discord::UserAgent);
+	Http_SetHeader(req, HTTP_HEADER_AUTHORIZATION, queue->authorization);
+	Http_SetContent(req, request->content_type, request->body);
+
+	Http_Writer writer;
+	writer.proc    = Discord_Http2WriterProc;
+	writer.context = stream;
+
+	String path((uint8_t *)endpoint, Minimum(length, (int)sizeof(endpoint) - 1));
+
+	if (Http2_Submit(http2, request->method, path, request->params, *req, &stream->response, writer, Discord_Http2CompletionProc, stream))
+		return true;
+
+	stream->request = nullptr;
+	return false;
+}
+
+// Requests are multiplexed as streams of one HTTP/2 connection, when h2 can not be negotiated the
+// worker falls back to executing the requests one at a time on the HTTP/1.1 pool
+static int Discord_Http2WorkerProc(void *arg) {
+	Discord_Rest_Worker *worker = (Discord_Rest_Worker *)arg;
+	Discord_Rest_Queue *queue   = worker->queue;
+
+	const String host = "https://discord.com";
+
+	Http2 *http2 = Http2_Connect(host, queue->allocator, queue->socket);
+	if (!http2) {
+		LogWarningEx("Discord", "HTTP/2 is not available, REST requests use HTTP/1.1");
+		return Discord_RestWorkerProc(arg);
 	}
 
-	bool GroupDMRemoveRecipient(Client *client, Snowflake channel_id, Snowflake user_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/recipients/%zu", channel_id, user_id);
+	ptrdiff_t streams_size        = sizeof(Discord_Http2_Stream) * DISCORD_HTTP2_STREAMS;
+	Discord_Http2_Stream *streams = (Discord_Http2_Stream *)MemoryAllocate(streams_size, queue->allocator);
+	Http_Request *req             = (Http_Request *)MemoryAllocate(sizeof(Http_Request), queue->allocator);
 
-		Json res;
-		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
-			return true;
-		}
-		return false;
+	if (!streams || !req) {
+		LogErrorEx("Discord", "Failed to allocate memory for HTTP/2 streams, REST requests use HTTP/1.1");
+		if (streams) MemoryFree(streams, streams_size, queue->allocator);
+		if (req) MemoryFree(req, sizeof(Http_Request), queue->allocator);
+		Http2_Disconnect(http2);
+		return Discord_RestWorkerProc(arg);
 	}
 
-	Channel *StartThreadFromMessage(Client *client, Snowflake channel_id, Snowflake message_id, String name, int32_t auto_archive_duration, int32_t rate_limit_per_user) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/threads", channel_id, message_id);
+	memset((void *)streams, 0, streams_size);
+	for (ptrdiff_t index = 0; index < DISCORD_HTTP2_STREAMS; ++index)
+		streams[index].queue = queue;
 
-		Jsonify j(client->scratch);
-		j.BeginObject();
-		j.KeyValue("name", name);
-		if (auto_archive_duration) {
-			auto_archive_duration = Discord_NormalizeThreadAutoArchiveDuration(auto_archive_duration);
-			j.KeyValue("auto_archive_duration", auto_archive_duration);
-		}
-		if (rate_limit_per_user)
-			j.KeyValue("rate_limit_per_user", rate_limit_per_user);
-		j.EndObject();
+	bool waiting = false;
 
-		String body = Jsonify_BuildString(&j);
+	while (true) {
+		if (http2 && Http2_ActiveStreams(http2)) {
+			if (Http2_Poll(http2, DISCORD_HTTP2_POLL_MS) < 0) {
+				// Streams of the lost connection have been requeued by the completion proc
+				Http2_Disconnect(http2);
+				http2 = nullptr;
+			}
+		} else if (Semaphore_Wait(queue->signal, waiting ? DISCORD_HTTP2_POLL_MS : -1) < 0) {
+			break;
+		}
+
+		// A connection that is going away is replaced once its streams are done
+		if (http2 && !Http2_IsConnected(http2) && !Http2_ActiveStreams(http2)) {
+			Http2_Disconnect(http2);
+			http2 = nullptr;
+		}
+
+		Discord::Request *requests[DISCORD_HTTP2_STREAMS];
+		ptrdiff_t count = 0;
+		ptrdiff_t limit = DISCORD_HTTP2_STREAMS - (http2 ? Http2_ActiveStreams(http2) : 0);
+
+		SpinLock(&queue->guard);
+		bool running = queue->running;
+		if (running) {
+			// Rate limited routes are left in the queue so that they don't hold up the connection
+			ptrdiff_t lookahead = DISCORD_REST_LOOKAHEAD;
+			for (ptrdiff_t index = queue->pending_head; index < queue->pending.count && count < limit && lookahead;) {
+				Discord::Request *next = queue->pending[index];
+				// Taking shifts the skipped requests forward, so the next one is at index + 1 either way
+				if (!Discord_RateLimitAcquire(Discord_GetRoute(next->method, next->endpoint), true))
+					requests[count++] = Discord_RestQueueTake(&queue->pending, &queue->pending_head, index);
+				index     += 1;
+				lookahead -= 1;
+			}
+			Discord_RestQueueCompact(&queue->pending, &queue->pending_head);
+		}
+		waiting = queue->pending.count != queue->pending_head;
+		SpinUnlock(&queue->guard);
 
-		Json res;
-		if (Discord_Post(client, endpoint, "application/json", body, &res)) {
-			Channel *channel = new Channel;
-			if (channel)
-				Discord_Deserialize(JsonGetObject(res), channel);
-			return channel;
+		if (!running) {
+			for (ptrdiff_t index = 0; index < count; ++index) {
+				Discord_RateLimitRelease(Discord_GetRoute(requests[index]->method, requests[index]->endpoint));
+				Discord_FinishRequest(queue, requests[index], false);
+			}
+			break;
 		}
-		return nullptr;
-	}
 
-	Channel *StartThreadWithoutMessage(Client *client, Snowflake channel_id, String name, int32_t auto_archive_duration, ChannelType type, bool invitable, int32_t rate_limit_per_user) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/threads", channel_id);
+		if (count && !http2)
+			http2 = Http2_Connect(host, queue->allocator, queue->socket);
 
-		Jsonify j(client->scratch);
-		j.BeginObject();
-		j.KeyValue("name", name);
-		if (auto_archive_duration) {
-			auto_archive_duration = Discord_NormalizeThreadAutoArchiveDuration(auto_archive_duration);
-			j.KeyValue("auto_archive_duration", auto_archive_duration);
+		for (ptrdiff_t index = 0; index < count; ++index) {
+			Discord::Request *request = requests[index];
+
+			Discord_Http2_Stream *stream = nullptr;
+			for (ptrdiff_t slot = 0; slot < DISCORD_HTTP2_STREAMS; ++slot) {
+				if (!streams[slot].request) {
+					stream = &streams[slot];
+					break;
+				}
+			}
+
+			if (http2 && stream && Http2_CanSubmit(http2) && Discord_Http2Submit(http2, stream, request, req))
+				continue;
+
+			// The request was not sent, both the requeued request and the HTTP/1.1 fallback acquire the route again
+			Discord_RateLimitRelease(Discord_GetRoute(request->method, request->endpoint));
+
+			if (Discord_Http2Requeue(queue, request)) {
+				waiting = true;
+				continue;
+			}
+
+			bool succeeded = Discord_ExecuteRequest(queue->http, queue->authorization, request, worker->arena, DISCORD_RATE_LIMIT_NO_TIMEOUT);
+			Discord_FinishRequest(queue, request, succeeded);
+			MemoryArenaReset(worker->arena);
 		}
-		j.KeyValue("type", (int)type);
-		j.KeyValue("invitable", invitable);
-		if (rate_limit_per_user)
-			j.KeyValue("rate_limit_per_user", rate_limit_per_user);
-		j.EndObject();
+	}
 
-		String body = Jsonify_BuildString(&j);
+	if (http2)
+		Http2_Disconnect(http2);
 
-		Json res;
-		if (Discord_Post(client, endpoint, "application/json", body, &res)) {
-			Channel *channel = new Channel;
-			if (channel)
-				Discord_Deserialize(JsonGetObject(res), channel);
-			return channel;
+	for (ptrdiff_t index = 0; index < DISCORD_HTTP2_STREAMS; ++index) {
+		Discord_Http2_Stream *stream = &streams[index];
+		if (stream->request) {
+			Discord_FinishRequest(queue, stream->request, false);
+			Discord_Http2ReleaseStream(stream);
 		}
-		return nullptr;
 	}
 
-	StartForumThreadInfo *StartThreadInForumChannel(Client *client, Snowflake channel_id, String name, const ForumThreadMessageParams &msg, int32_t auto_archive_duration, int32_t rate_limit_per_user) {
-		Jsonify j(client->scratch);
+	MemoryFree(streams, streams_size, queue->allocator);
+	MemoryFree(req, sizeof(Http_Request), queue->allocator);
 
-		j.BeginObject();
+	return 0;
+}
 
-		j.KeyValue("name", name);
-		if (auto_archive_duration) {
-			auto_archive_duration = Discord_NormalizeThreadAutoArchiveDuration(auto_archive_duration);
-			j.KeyValue("auto_archive_duration", auto_archive_duration);
-		}
-		if (rate_limit_per_user)
-			j.KeyValue("rate_limit_per_user", rate_limit_per_user);
+static bool Discord_StartRestWorkers(Discord::Client *client, uint32_t count, bool http2, uint32_t arena_size, const Net_Socket_Options &socket) {
+	Discord_Rest_Queue *queue = &client->rest;
 
-		j.PushKey("message");
+	queue->http           = client->http;
+	queue->authorization  = client->authorization;
+	queue->allocator      = client->allocator;
+	queue->pending        = Array<Discord::Request *>(client->allocator);
+	queue->completed      = Array<Discord::Request *>(client->allocator);
+	queue->pending_head   = 0;
+	queue->completed_head = 0;
+	queue->socket         = socket;
+	queue->workers        = Array<Discord_Rest_Worker>(client->allocator);
+	queue->running        = true;
 
-		j.BeginObject();
+	if (!count || !queue->http)
+		return true;
 
-		if (msg.content.length)
-			j.KeyValue("content", msg.content);
+	// A single worker multiplexes the requests when HTTP/2 is used
+	if (http2)
+		count = 1;
 
-		if (msg.embeds.count) {
-			j.PushKey("embeds");
-			j.BeginArray();
-			for (const auto &embed : msg.embeds)
-				Discord_Jsonify(embed, &j);
-			j.EndArray();
-		}
+	queue->signal = Semaphore_Create(0);
+	if (!queue->signal) {
+		LogErrorEx("Discord", "Failed to create semaphore for REST workers, requests will run inline");
+		return false;
+	}
 
-		if (msg.allowed_mentions) {
-			j.PushKey("allowed_mentions");
-			Discord_Jsonify(*msg.allowed_mentions, &j);
-		}
+	if (!queue->workers.Reserve(count)) {
+		LogErrorEx("Discord", "Failed to allocate memory for REST workers, requests will run inline");
+		return false;
+	}
 
-		if (msg.components.count) {
-			j.PushKey("components");
-			j.BeginArray();
-			for (const auto &comp : msg.components)
-				Discord_Jsonify(comp, &j);
-			j.EndArray();
+	Thread_Context_Params params = ThreadContextDefaultParams;
+	params.logger                = ThreadContext.logger;
+
+	for (uint32_t index = 0; index < count; ++index) {
+		Memory_Arena *arena = MemoryArenaAllocate(arena_size);
+		if (!arena) {
+			LogErrorEx("Discord", "Failed to allocate memory for REST worker");
+			break;
 		}
 
-		if (msg.sticker_ids.count) {
-			j.PushKey("sticker_ids");
-			j.BeginArray();
-			for (const auto &id : msg.sticker_ids)
-				j.PushId(id.value);
-			j.EndArray();
+		Discord_Rest_Worker *worker = queue->workers.Add();
+		worker->queue  = queue;
+		worker->arena  = arena;
+		worker->thread = Thread_Create(http2 ? Discord_Http2WorkerProc : Discord_RestWorkerProc, worker, 0, params);
+
+		if (!worker->thread) {
+			LogErrorEx("Discord", "Failed to create REST worker thread");
+			MemoryArenaFree(arena);
+			queue->workers.RemoveLast();
+			break;
 		}
+	}
 
-		if (msg.attachments.count) {
-			j.PushKey("attachments");
-			j.BeginArray();
-			for (int id = 0; id < (int)msg.attachments.count; ++id) {
-				j.BeginObject();
-				j.KeyValue("id", id);
-				j.KeyValue("filename", msg.attachments[id].filename);
-				if (msg.attachments[id].description.length)
-					j.KeyValue("description", msg.attachments[id].description);
-				j.EndObject();
-			}
-			j.EndArray();
+	return queue->workers.count != 0;
+}
+
+static void Discord_ReleaseRequests(Array<Discord::Request *> *requests, ptrdiff_t *head) {
+	for (ptrdiff_t index = *head; index < requests->count; ++index) {
+		Discord::Request *request = (*requests)[index];
+		if (request->complete) {
+			Discord::ReleaseRequest(request);
+		} else {
+			// Owned by the caller that is polling it
+			AtomicStore(&request->status, (int32_t)Discord::RequestStatus::FAILED);
 		}
+	}
+	Free(requests);
+	*head = 0;
+}
 
-		if (msg.flags) j.KeyValue("flags", msg.flags);
+static void Discord_StopRestWorkers(Discord::Client *client) {
+	Discord_Rest_Queue *queue = &client->rest;
 
-		j.EndObject();
-		j.EndObject();
+	SpinLock(&queue->guard);
+	queue->running = false;
+	SpinUnlock(&queue->guard);
 
-		String payload_json = Jsonify_BuildString(&j);
+	for (ptrdiff_t index = 0; index < queue->workers.count; ++index)
+		Semaphore_Signal(queue->signal);
 
-		String body;
-		String content_type;
+	for (Discord_Rest_Worker &worker : queue->workers) {
+		Thread_Wait(worker.thread, -1);
+		Thread_Destroy(worker.thread);
+		MemoryArenaFree(worker.arena);
+	}
 
-		uint8_t buffer[4096];
-		int     len = 0;
+	Free(&queue->workers);
 
-		if (!msg.attachments.count) {
-			body = payload_json;
-			content_type = "application/json";
-		} else {
-			Http_Multipart multipart = Http_MultipartBegin(client->scratch);
-			if (!Http_MultipartData(&multipart, payload_json, "application/json", "name=\"payload_json\""))
-				return nullptr;
-			for (int id = 0; id < (int)msg.attachments.count; ++id) {
-				const auto &attachment = msg.attachments[id];
-				len = snprintf((char *)buffer, sizeof(buffer), "name=\"files[%d]\"; filename=\"" StrFmt "\"", id, StrArg(attachment.filename));
-				String content_disposition(buffer, len);
-				if (!Http_MultipartData(&multipart, attachment.content, attachment.content_type, content_disposition))
-					return nullptr;
-			}
+	if (queue->signal) {
+		Semaphore_Destory(queue->signal);
+		queue->signal = nullptr;
+	}
 
-			body = Http_MultipartEnd(&multipart);
+	Discord_ReleaseRequests(&queue->pending, &queue->pending_head);
+	Discord_ReleaseRequests(&queue->completed, &queue->completed_head);
+}
 
-			String boundary = String(multipart.boundary, HTTP_MULTIPART_LENGTH);
-			len = snprintf((char *)buffer, sizeof(buffer), "multipart/form-data; boundary=" StrFmt, StrArg(boundary));
-			content_type = String(buffer, len);
-		}
+static void Discord_DispatchCompletedRequests(Discord::Client *client) {
+	Discord_Rest_Queue *queue = &client->rest;
 
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/threads", channel_id);
+	while (true) {
+		Discord::Request *request = nullptr;
 
-		Json res;
-		if (Discord_Post(client, endpoint, content_type, body, &res)) {
-			StartForumThreadInfo *thread = new StartForumThreadInfo;
-			if (thread) {
-				Json_Object obj = JsonGetObject(res);
-				Discord_Deserialize(obj, &thread->channel);
-				Discord_Deserialize(JsonGetObject(obj, "message"), &thread->message);
-			}
-			return thread;
+		SpinLock(&queue->guard);
+		if (queue->completed.count > queue->completed_head) {
+			request = Discord_RestQueueTake(&queue->completed, &queue->completed_head, queue->completed_head);
+			Discord_RestQueueCompact(&queue->completed, &queue->completed_head);
 		}
+		SpinUnlock(&queue->guard);
+
+		if (!request) break;
+
+		request->complete(client, request);
+		Discord::ReleaseRequest(request);
+	}
+}
+
+static Discord::Request *Discord_SubmitRequest(Discord::Client *client, String method, String endpoint, const Http_Query_Params &params, String content_type, String body, Array_View<Buffer> segments, Discord_Request_Complete complete, void *callback, void *context) {
+	Discord_Rest_Queue *queue = &client->rest;
+
+	if (!client->http) {
+		if (!Discord_CreateHttpPool(client, HttpPoolDefaultSpec.max_connections, NetDefaultSocketOptions))
+			return nullptr;
+		queue->http = client->http;
+	}
+
+	// Strings are copied since the request outlives the caller's scratch memory, a segmented body is
+	// gathered into a single copy that does not depend on the attachments staying mapped
+	if (segments.count) {
+		body = String();
+		for (const Buffer &segment : segments)
+			body.length += segment.length;
+	}
+
+	ptrdiff_t size = sizeof(Discord::Request) + method.length + endpoint.length + content_type.length + body.length;
+	for (ptrdiff_t index = 0; index < params.count; ++index)
+		size += params.queries[index].name.length + params.queries[index].value.length;
 
+	uint8_t *mem = (uint8_t *)MemoryAllocate(size, client->allocator);
+	if (!mem) {
+		LogErrorEx("Discord", "Failed to allocate memory for the request");
 		return nullptr;
 	}
 
-	bool JoinThread(Client *client, Snowflake channel_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/@me", channel_id);
+	Discord::Request *request = (Discord::Request *)mem;
+	*request = Discord::Request{};
+	request->status    = (int32_t)Discord::RequestStatus::PENDING;
+	request->allocator = client->allocator;
+	request->allocated = size;
+	request->complete  = complete;
+	request->callback  = callback;
+	request->context   = context;
 
-		Json res;
-		if (Discord_Put(client, endpoint, "application/json", String(), &res)) {
-			return true;
-		}
-		return false;
-	}
+	uint8_t *ptr = mem + sizeof(Discord::Request);
 
-	bool AddThreadMember(Client *client, Snowflake channel_id, Snowflake user_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/%zu", channel_id, user_id);
+	auto copy = [&ptr](String src) -> String {
+		memcpy(ptr, src.data, src.length);
+		String dst(ptr, src.length);
+		ptr += src.length;
+		return dst;
+	};
 
-		Json res;
-		if (Discord_Put(client, endpoint, "application/json", String(), &res)) {
-			return false;
+	request->method       = copy(method);
+	request->endpoint     = copy(endpoint);
+	request->content_type = copy(content_type);
+
+	if (segments.count) {
+		request->body = String(ptr, body.length);
+		for (const Buffer &segment : segments) {
+			memcpy(ptr, segment.data, segment.length);
+			ptr += segment.length;
 		}
-		return true;
+	} else {
+		request->body = copy(body);
 	}
 
-	bool LeaveThread(Client *client, Snowflake channel_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/@me", channel_id);
-
-		Json res;
-		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
-			return false;
-		}
-		return true;
+	request->params.count = params.count;
+	for (ptrdiff_t index = 0; index < params.count; ++index) {
+		request->params.queries[index].name  = copy(params.queries[index].name);
+		request->params.queries[index].value = copy(params.queries[index].value);
 	}
 
-	bool RemoveThreadMember(Client *client, Snowflake channel_id, Snowflake user_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/%zu", channel_id, user_id);
+	if (queue->workers.count) {
+		SpinLock(&queue->guard);
+		Discord::Request **slot = queue->running ? queue->pending.Add() : nullptr;
+		if (slot) *slot = request;
+		SpinUnlock(&queue->guard);
 
-		Json res;
-		if (Discord_Delete(client, endpoint, "application/json", String(), &res)) {
-			return false;
+		bool queued = slot != nullptr;
+
+		if (queued) {
+			Semaphore_Signal(queue->signal);
+			return request;
 		}
-		return true;
 	}
 
-	ThreadMember *GetThreadMember(Client *client, Snowflake channel_id, Snowflake user_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/%zu", channel_id, user_id);
+	// No workers available, the request is executed right away but still completes through the queue
+	bool succeeded = Discord_ExecuteRequest(client->http, client->authorization, request, client->scratch, DISCORD_RATE_LIMIT_SYNC_WAIT);
+	Discord_FinishRequest(queue, request, succeeded);
 
-		Json res;
-		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
-			ThreadMember *member = new ThreadMember;
-			if (member) {
-				Discord_Deserialize(JsonGetObject(res), member);
-			}
-			return member;
-		}
-		return nullptr;
-	}
+	return request;
+}
 
-	Array_View<ThreadMember> ListThreadMembers(Client *client, Snowflake channel_id) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members", channel_id);
+static void Discord_RequestCompleteRaw(Discord::Client *client, Discord::Request *request) {
+	if (request->callback)
+		((Discord::RequestCompletionProc)request->callback)(client, request, request->context);
+}
 
-		Json res;
-		if (Discord_Get(client, endpoint, "application/json", String(), &res)) {
-			Json_Array arr = JsonGetArray(res);
-			Array<ThreadMember> members;
-			members.Resize(arr.count);
-			for (ptrdiff_t index = 0; index < members.count; ++index) {
-				Discord_Deserialize(JsonGetObject(arr[index]), &members[index]);
-			}
-			return members;
-		}
-		return Array_View<ThreadMember>();
+static void Discord_RequestCompleteMessage(Discord::Client *client, Discord::Request *request) {
+	Discord::Message *message = nullptr;
+
+	Json res;
+	if (Discord::GetRequestResponse(client, request, &res)) {
+		message = new Discord::Message;
+		if (message)
+			Discord_Deserialize(JsonGetObject(res), message);
 	}
 
-	ThreadsInfo *ListPublicArchivedThreads(Client *client, Snowflake channel_id, Timestamp before, int32_t limit) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/threads/archived/public", channel_id);
+	if (request->callback)
+		((Discord::MessageCompletionProc)request->callback)(client, message, request->context);
+}
 
-		uint8_t buffer[32];
+static void Discord_RequestCompleteChannel(Discord::Client *client, Discord::Request *request) {
+	Discord::Channel *channel = nullptr;
 
-		Http_Query_Params params;
-		if (before.value) {
-			int len = Discord_FmtTimestamp(buffer, sizeof(buffer), before);
-			Http_QueryParamSet(&params, "before", String(buffer, len));
-		}
+	Json res;
+	if (Discord::GetRequestResponse(client, request, &res)) {
+		channel = new Discord::Channel;
+		if (channel)
+			Discord_Deserialize(JsonGetObject(res), channel);
+	}
 
-		if (limit)
-			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%d", limit));
+	if (request->callback)
+		((Discord::ChannelCompletionProc)request->callback)(client, channel, request->context);
+}
 
-		Json res;
-		if (Discord_Get(client, endpoint, params, "application/json", String(), &res)) {
-			ThreadsInfo *archived = new ThreadsInfo;
+static void Discord_RequestCompleteResult(Discord::Client *client, Discord::Request *request) {
+	bool succeeded = request->status == (int32_t)Discord::RequestStatus::SUCCEEDED;
+	if (request->callback)
+		((Discord::ResultCompletionProc)request->callback)(client, succeeded, request->context);
+}
 
-			if (archived) {
-				Json_Object obj = JsonGetObject(res);
-				Json_Array arr;
-				
-				arr = JsonGetArray(obj, "threads");
-				Array<Channel> threads;
-				threads.Resize(arr.count);
-				for (ptrdiff_t index = 0; index < threads.count; ++index)
-					Discord_Deserialize(JsonGetObject(arr[index]), &threads[index]);
+static bool Discord_SubmitRequest(Discord::Client *client, String method, String endpoint, String content_type, String body, Discord_Request_Complete complete, void *callback, void *context) {
+	Http_Query_Params params;
+	return Discord_SubmitRequest(client, method, endpoint, params, content_type, body, Array_View<Buffer>(), complete, callback, context) != nullptr;
+}
 
-				arr = JsonGetArray(obj, "members");
-				Array<ThreadMember> members;
-				members.Resize(arr.count);
-				for (ptrdiff_t index = 0; index < members.count; ++index)
-					Discord_Deserialize(JsonGetObject(arr[index]), &members[index]);
+namespace Discord {
+	Request *SubmitRequest(Client *client, String method, String endpoint, String content_type, String body) {
+		Http_Query_Params params;
+		return Discord_SubmitRequest(client, method, endpoint, params, content_type, body, Array_View<Buffer>(), nullptr, nullptr, nullptr);
+	}
 
-				archived->threads  = threads;
-				archived->members  = members;
-				archived->has_more = JsonGetBool(obj, "has_more");
-			}
+	bool SubmitRequest(Client *client, String method, String endpoint, String content_type, String body, RequestCompletionProc proc, void *context) {
+		return Discord_SubmitRequest(client, method, endpoint, content_type, body, Discord_RequestCompleteRaw, (void *)proc, context);
+	}
 
-			return archived;
-		}
-		return nullptr;
+	RequestStatus PollRequest(Request *request) {
+		return (RequestStatus)AtomicLoad(&request->status);
 	}
 
-	ThreadsInfo *ListPrivateArchivedThread(Client *client, Snowflake channel_id, Timestamp before, int32_t limit) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/threads/archived/private", channel_id);
+	uint32_t GetRequestHttpStatus(Request *request) {
+		return request->http_status;
+	}
 
-		uint8_t buffer[32];
+	bool GetRequestResponse(Client *client, Request *request, Json *json) {
+		if (PollRequest(request) != RequestStatus::SUCCEEDED)
+			return false;
 
-		Http_Query_Params params;
-		if (before.value) {
-			int len = Discord_FmtTimestamp(buffer, sizeof(buffer), before);
-			Http_QueryParamSet(&params, "before", String(buffer, len));
+		// Parsed values refer to the response, so it is copied to give them the lifetime of scratch memory
+		uint8_t *response = (uint8_t *)PushSize(client->scratch, request->response.length);
+		if (!response && request->response.length) {
+			LogErrorEx("Discord", "Failed to allocate memory for the response");
+			return false;
 		}
+		memcpy(response, request->response.data, request->response.length);
 
-		if (limit)
-			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%d", limit));
+		if (JsonParse(Buffer(response, request->response.length), json))
+			return true;
 
-		Json res;
-		if (Discord_Get(client, endpoint, params, "application/json", String(), &res)) {
-			ThreadsInfo *archived = new ThreadsInfo;
+		LogErrorEx("Discord", "Failed to parse HTTP response");
 
-			if (archived) {
-				Json_Object obj = JsonGetObject(res);
-				Json_Array arr;
+		return false;
+	}
 
-				arr = JsonGetArray(obj, "threads");
-				Array<Channel> threads;
-				threads.Resize(arr.count);
-				for (ptrdiff_t index = 0; index < threads.count; ++index)
-					Discord_Deserialize(JsonGetObject(arr[index]), &threads[index]);
+	void ReleaseRequest(Request *request) {
+		if (request->response.length)
+			MemoryFree(request->response.data, request->response.length, request->allocator);
+		Memory_Allocator allocator = request->allocator;
+		ptrdiff_t        allocated = request->allocated;
+		MemoryFree(request, allocated, allocator);
+	}
 
-				arr = JsonGetArray(obj, "members");
-				Array<ThreadMember> members;
-				members.Resize(arr.count);
-				for (ptrdiff_t index = 0; index < members.count; ++index)
-					Discord_Deserialize(JsonGetObject(arr[index]), &members[index]);
+	bool CreateMessageAsync(Client *client, Snowflake channel_id, const MessagePost &msg, MessageCompletionProc proc, void *context) {
+		String body;
+		String content_type;
+		Array_View<Buffer> segments;
 
-				archived->threads = threads;
-				archived->members = members;
-				archived->has_more = JsonGetBool(obj, "has_more");
-			}
+		if (!Discord_BuildMessagePost(client->scratch, msg, &content_type, &body, &segments))
+			return false;
 
-			return archived;
-		}
-		return nullptr;
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages", channel_id.value);
+
+		Http_Query_Params params;
+		return Discord_SubmitRequest(client, "POST", endpoint, params, content_type, body, segments, Discord_RequestCompleteMessage, (void *)proc, context) != nullptr;
 	}
 
-	ThreadsInfo *ListJoinedArchivedThreads(Client *client, Snowflake channel_id, Timestamp before, int32_t limit) {
-		String endpoint = FmtStr(client->scratch, "/channels/%zu/users/@me/threads/archived/private", channel_id);
+	bool GetChannelAsync(Client *client, Snowflake channel_id, ChannelCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu", channel_id.value);
+		return Discord_SubmitRequest(client, "GET", endpoint, "application/json", String(), Discord_RequestCompleteChannel, (void *)proc, context);
+	}
 
-		uint8_t buffer[32];
+	bool GetChannelMessageAsync(Client *client, Snowflake channel_id, Snowflake message_id, MessageCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu", channel_id.value, message_id.value);
+		return Discord_SubmitRequest(client, "GET", endpoint, "application/json", String(), Discord_RequestCompleteMessage, (void *)proc, context);
+	}
 
-		Http_Query_Params params;
-		if (before.value) {
-			int len = Discord_FmtTimestamp(buffer, sizeof(buffer), before);
-			Http_QueryParamSet(&params, "before", String(buffer, len));
-		}
+	bool CreateReactionAsync(Client *client, Snowflake channel_id, Snowflake message_id, String emoji, ResultCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s/@me", channel_id.value, message_id.value, StrArg(emoji));
+		return Discord_SubmitRequest(client, "PUT", endpoint, "application/json", String(), Discord_RequestCompleteResult, (void *)proc, context);
+	}
 
-		if (limit)
-			Http_QueryParamSet(&params, "limit", FmtStr(client->scratch, "%d", limit));
+	bool DeleteReactionAsync(Client *client, Snowflake channel_id, Snowflake message_id, String emoji, ResultCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s/@me", channel_id.value, message_id.value, StrArg(emoji));
+		return Discord_SubmitRequest(client, "DELETE", endpoint, "application/json", String(), Discord_RequestCompleteResult, (void *)proc, context);
+	}
 
-		Json res;
-		if (Discord_Get(client, endpoint, params, "application/json", String(), &res)) {
-			ThreadsInfo *archived = new ThreadsInfo;
+	bool DeleteMessageAsync(Client *client, Snowflake channel_id, Snowflake message_id, ResultCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu", channel_id.value, message_id.value);
+		return Discord_SubmitRequest(client, "DELETE", endpoint, "application/json", String(), Discord_RequestCompleteResult, (void *)proc, context);
+	}
 
-			if (archived) {
-				Json_Object obj = JsonGetObject(res);
-				Json_Array arr;
+	bool TriggerTypingIndicatorAsync(Client *client, Snowflake channel_id, ResultCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/typing", channel_id.value);
+		return Discord_SubmitRequest(client, "POST", endpoint, "application/json", String(), Discord_RequestCompleteResult, (void *)proc, context);
+	}
 
-				arr = JsonGetArray(obj, "threads");
-				Array<Channel> threads;
-				threads.Resize(arr.count);
-				for (ptrdiff_t index = 0; index < threads.count; ++index)
-					Discord_Deserialize(JsonGetObject(arr[index]), &threads[index]);
+	bool ModifyChannelAsync(Client *client, Snowflake channel_id, const ChannelPatch &patch, ChannelCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu", channel_id.value);
+		String body     = Discord_BuildChannelPatch(client->scratch, patch);
+		return Discord_SubmitRequest(client, "PATCH", endpoint, "application/json", body, Discord_RequestCompleteChannel, (void *)proc, context);
+	}
 
-				arr = JsonGetArray(obj, "members");
-				Array<ThreadMember> members;
-				members.Resize(arr.count);
-				for (ptrdiff_t index = 0; index < members.count; ++index)
-					Discord_Deserialize(JsonGetObject(arr[index]), &members[index]);
+	bool DeleteChannelAsync(Client *client, Snowflake channel_id, ChannelCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu", channel_id.value);
+		return Discord_SubmitRequest(client, "DELETE", endpoint, "application/json", String(), Discord_RequestCompleteChannel, (void *)proc, context);
+	}
 
-				archived->threads = threads;
-				archived->members = members;
-				archived->has_more = JsonGetBool(obj, "has_more");
-			}
+	bool EditMessageAsync(Client *client, Snowflake channel_id, Snowflake message_id, const MessagePatch &msg, MessageCompletionProc proc, void *context) {
+		String body;
+		String content_type;
+		Array_View<Buffer> segments;
 
-			return archived;
-		}
-		return nullptr;
+		if (!Discord_BuildMessagePatch(client->scratch, msg, &content_type, &body, &segments))
+			return false;
+
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu", channel_id.value, message_id.value);
+
+		Http_Query_Params params;
+		return Discord_SubmitRequest(client, "PATCH", endpoint, params, content_type, body, segments, Discord_RequestCompleteMessage, (void *)proc, context) != nullptr;
 	}
-}
 
-//
-//
-//
+	bool CrossPostAsync(Client *client, Snowflake channel_id, Snowflake message_id, MessageCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/crosspost", channel_id.value, message_id.value);
+		return Discord_SubmitRequest(client, "POST", endpoint, "application/json", String(), Discord_RequestCompleteMessage, (void *)proc, context);
+	}
 
-static void Discord_InitHttpRequest(Http *http, Http_Request *req, String authorization, String content_type, String body) {
-	Http_InitRequest(req);
-	Http_SetHost(req, http);
-	Http_SetHeader(req, HTTP_HEADER_CONNECTION, "keep-alive");
-	Http_SetHeader(req, HTTP_HEADER_USER_AGENT, Discord::UserAgent);
-	Http_SetHeader(req, HTTP_HEADER_AUTHORIZATION, authorization);
-	Http_SetContent(req, content_type, body);
-}
+	bool DeleteUserReactionAsync(Client *client, Snowflake channel_id, Snowflake message_id, String emoji, Snowflake user_id, ResultCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s/%zu", channel_id.value, message_id.value, StrArg(emoji), user_id.value);
+		return Discord_SubmitRequest(client, "DELETE", endpoint, "application/json", String(), Discord_RequestCompleteResult, (void *)proc, context);
+	}
 
-static bool Discord_HttpConnect(Discord::Client *client) {
-	const String host = "https://discord.com";
-	client->http = Http_Connect(host, HTTPS_CONNECTION, client->allocator);
-	if (!client->http) {
-		LogErrorEx("Discord", "Unable to connect to \"" StrFmt "\".", StrArg(host));
-		return nullptr;
+	bool DeleteAllReactionsAsync(Client *client, Snowflake channel_id, Snowflake message_id, ResultCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions", channel_id.value, message_id.value);
+		return Discord_SubmitRequest(client, "DELETE", endpoint, "application/json", String(), Discord_RequestCompleteResult, (void *)proc, context);
 	}
 
-	return true;
-}
+	bool DeleteAllReactionsForEmojiAsync(Client *client, Snowflake channel_id, Snowflake message_id, String emoji, ResultCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/%zu/reactions/%.*s", channel_id.value, message_id.value, StrArg(emoji));
+		return Discord_SubmitRequest(client, "DELETE", endpoint, "application/json", String(), Discord_RequestCompleteResult, (void *)proc, context);
+	}
 
-static bool Discord_CustomMethod(Discord::Client *client, const String method, const String api_endpoint, const Http_Query_Params &params, const String content_type, const String body, Json *json) {
-	if (!client->http) {
-		if (!Discord_HttpConnect(client))
-			return false;
+	bool BulkDeleteMessagesAsync(Client *client, Snowflake channel_id, Array_View<Snowflake> messages_ids, ResultCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/messages/bulk-delete", channel_id.value);
+		String body     = Discord_BuildBulkDelete(client->scratch, messages_ids);
+		return Discord_SubmitRequest(client, "POST", endpoint, "application/json", body, Discord_RequestCompleteResult, (void *)proc, context);
 	}
 
-	String endpoint = FmtStr(client->scratch, StrFmt StrFmt, StrArg(Discord::BaseHttpUrl), StrArg(api_endpoint));
+	bool DeleteChannelPermissionAsync(Client *client, Snowflake channel_id, Snowflake overwrite_id, ResultCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/permissions/%zu", channel_id.value, overwrite_id.value);
+		return Discord_SubmitRequest(client, "DELETE", endpoint, "application/json", String(), Discord_RequestCompleteResult, (void *)proc, context);
+	}
 
-	Http_Request req;
-	Http_Response res;
+	bool PinMessageAsync(Client *client, Snowflake channel_id, Snowflake message_id, ResultCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/pins/%zu", channel_id.value, message_id.value);
+		return Discord_SubmitRequest(client, "PUT", endpoint, "application/json", String(), Discord_RequestCompleteResult, (void *)proc, context);
+	}
 
-	for (int retry = 0; retry < 2; ++retry) {
-		Discord_InitHttpRequest(client->http, &req, client->authorization, content_type, body);
-		if (Http_CustomMethod(client->http, method, endpoint, params, req, &res, client->scratch)) {
-			if (res.status.code > 299) {
-				LogInfo("===> Request :: " StrFmt, StrArg(endpoint));
-				Http_DumpHeader(req);
-				LogInfo(StrFmt, StrArg(req.body));
-				LogInfo("===> Response");
-				Http_DumpHeader(res);
-				LogInfo(StrFmt, StrArg(res.body));
-
-				// @todo: handle rate limiting
-				return false;
-			}
+	bool UnpinMessageAsync(Client *client, Snowflake channel_id, Snowflake message_id, ResultCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/pins/%zu", channel_id.value, message_id.value);
+		return Discord_SubmitRequest(client, "DELETE", endpoint, "application/json", String(), Discord_RequestCompleteResult, (void *)proc, context);
+	}
 
-			if (JsonParse(res.body, json))
-				return true;
+	bool JoinThreadAsync(Client *client, Snowflake channel_id, ResultCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/@me", channel_id.value);
+		return Discord_SubmitRequest(client, "PUT", endpoint, "application/json", String(), Discord_RequestCompleteResult, (void *)proc, context);
+	}
 
-			LogErrorEx("Discord", "Failed to parse HTTP response");
+	bool AddThreadMemberAsync(Client *client, Snowflake channel_id, Snowflake user_id, ResultCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/%zu", channel_id.value, user_id.value);
+		return Discord_SubmitRequest(client, "PUT", endpoint, "application/json", String(), Discord_RequestCompleteResult, (void *)proc, context);
+	}
 
-			return false;
-		} else {
-			Http_Disconnect(client->http);
-			if (!Discord_HttpConnect(client))
-				return false;
-		}
+	bool LeaveThreadAsync(Client *client, Snowflake channel_id, ResultCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/@me", channel_id.value);
+		return Discord_SubmitRequest(client, "DELETE", endpoint, "application/json", String(), Discord_RequestCompleteResult, (void *)proc, context);
 	}
 
-	return false;
+	bool RemoveThreadMemberAsync(Client *client, Snowflake channel_id, Snowflake user_id, ResultCompletionProc proc, void *context) {
+		String endpoint = FmtStr(client->scratch, "/channels/%zu/thread-members/%zu", channel_id.value, user_id.value);
+		return Discord_SubmitRequest(client, "DELETE", endpoint, "application/json", String(), Discord_RequestCompleteResult, (void *)proc, context);
+	}
 }
 
 //
@@ -3531,6 +6744,20 @@ static bool Discord_CustomMethod(Discord::Client *client, const String method, c
 
 typedef void(*Discord_Event_Handler)(Discord::Client *client, const Json &data);
 
+// Guilds are cached without the entities that are cached on their own or that only GUILD_CREATE carries
+static String DiscordCacheGuildExcluded[] = {
+	"roles", "emojis", "members", "channels", "threads", "presences", "voice_states", "stage_instances", "guild_scheduled_events"
+};
+
+static void Discord_CachePutGuild(Discord_Cache *cache, const Json_Object &obj, const Json &data) {
+	Discord::Snowflake guild_id = Discord_ParseId(JsonGetString(obj, "id"));
+	if (!guild_id) return;
+
+	Discord_CachePut(cache, &cache->guilds, guild_id, data, guild_id, Array_View<String>(DiscordCacheGuildExcluded, ArrayCount(DiscordCacheGuildExcluded)));
+	Discord_CachePutObjects(cache, &cache->roles, guild_id, JsonGetArray(obj, "roles"));
+	Discord_CachePutObjects(cache, &cache->emojis, guild_id, JsonGetArray(obj, "emojis"));
+}
+
 static void Discord_EventHandlerNone(Discord::Client *client, const Json &data) {}
 
 static void Discord_EventHandlerHello(Discord::Client *client, const Json &data) {
@@ -3543,6 +6770,16 @@ static void Discord_EventHandlerReady(Discord::Client *client, const Json &data)
 	Discord::Ready ready;
 
 	Json_Object obj = JsonGetObject(data);
+
+	// Entries of earlier sessions may have missed updates, REST requests are no longer served from them
+	if (client->cache.enabled) {
+		client->cache.generation += 1;
+		client->cache.members.generation = client->cache.generation;
+		Discord_MessageCacheClear(&client->cache.messages);
+		Json user = JsonGet(obj, "user");
+		client->cache.user_id = Discord_ParseId(JsonGetString(JsonGetObject(user), "id"));
+		Discord_CachePut(&client->cache, &client->cache.users, client->cache.user_id, user, Discord::Snowflake());
+	}
 	ready.v = JsonGetInt(obj, "v");
 	Discord_Deserialize(JsonGetObject(obj, "user"), &ready.user);
 
@@ -3617,12 +6854,16 @@ static void Discord_EventHandlerApplicationCommandPermissionsUpdate(Discord::Cli
 static void Discord_EventHandlerChannelCreate(Discord::Client *client, const Json &data) {
 	Discord::Channel channel;
 	Discord_Deserialize(JsonGetObject(data), &channel);
+	if (client->cache.enabled)
+		Discord_CachePut(&client->cache, &client->cache.channels, channel.id, data, channel.guild_id);
 	client->onevent.channel_create(client, channel);
 }
 
 static void Discord_EventHandlerChannelUpdate(Discord::Client *client, const Json &data) {
 	Discord::Channel channel;
 	Discord_Deserialize(JsonGetObject(data), &channel);
+	if (client->cache.enabled)
+		Discord_CachePut(&client->cache, &client->cache.channels, channel.id, data, channel.guild_id);
 	client->onevent.channel_update(client, channel);
 }
 
@@ -3630,6 +6871,10 @@ static void Discord_EventHandlerChannelDelete(Discord::Client *client, const Jso
 	Discord::Channel channel;
 	Discord_Deserialize(JsonGetObject(data), &channel);
 	client->onevent.channel_delete(client, channel);
+	if (client->cache.enabled) {
+		Discord_CacheRemove(&client->cache, &client->cache.channels, channel.id);
+		Discord_MessageCacheRemoveChannel(&client->cache.messages, channel.id);
+	}
 }
 
 static void Discord_EventHandlerChannelPinsUpdate(Discord::Client *client, const Json &data) {
@@ -3644,6 +6889,8 @@ static void Discord_EventHandlerThreadCreate(Discord::Client *client, const Json
 	Discord::Channel thread;
 	Json_Object obj = JsonGetObject(data);
 	Discord_Deserialize(obj, &thread);
+	if (client->cache.enabled)
+		Discord_CachePut(&client->cache, &client->cache.channels, thread.id, data, thread.guild_id);
 	bool newly_created = JsonGetBool(obj, "newly_created");
 	client->onevent.thread_create(client, thread, newly_created);
 }
@@ -3652,6 +6899,8 @@ static void Discord_EventHandlerThreadUpdate(Discord::Client *client, const Json
 	Discord::Channel thread;
 	Json_Object obj = JsonGetObject(data);
 	Discord_Deserialize(obj, &thread);
+	if (client->cache.enabled)
+		Discord_CachePut(&client->cache, &client->cache.channels, thread.id, data, thread.guild_id);
 	client->onevent.thread_update(client, thread);
 }
 
@@ -3662,6 +6911,10 @@ static void Discord_EventHandlerThreadDelete(Discord::Client *client, const Json
 	Discord::Snowflake parent_id = Discord_ParseId(JsonGetString(obj, "parent_id"));
 	Discord::ChannelType type    = (Discord::ChannelType)JsonGetInt(obj, "type");
 	client->onevent.thread_delete(client, id, guild_id, parent_id, type);
+	if (client->cache.enabled) {
+		Discord_CacheRemove(&client->cache, &client->cache.channels, id);
+		Discord_MessageCacheRemoveChannel(&client->cache.messages, id);
+	}
 }
 
 static void Discord_EventHandlerThreadListSync(Discord::Client *client, const Json &data) {
@@ -3682,6 +6935,9 @@ static void Discord_EventHandlerThreadListSync(Discord::Client *client, const Js
 		Discord_Deserialize(JsonGetObject(jsonthreads[index]), &threads[index]);
 	}
 
+	if (client->cache.enabled)
+		Discord_CachePutObjects(&client->cache, &client->cache.channels, guild_id, jsonthreads);
+
 	Json_Array jsonmembers = JsonGetArray(obj, "members");
 	Array<Discord::ThreadMember> members;
 	members.Resize(jsonmembers.count);
@@ -3791,12 +7047,23 @@ static void Discord_EventHandlerGuildCreate(Discord::Client *client, const Json
 	}
 	info.guild_scheduled_events = guild_scheduled_events;
 
+	if (client->cache.enabled) {
+		Discord_Cache *cache = &client->cache;
+		Discord_CachePutGuild(cache, obj, data);
+		Discord_CachePutObjects(cache, &cache->channels, guild.id, jsonchannels);
+		Discord_CachePutObjects(cache, &cache->channels, guild.id, jsonthreads);
+		for (const Json &member : jsonmembers)
+			Discord_MemberStorePut(&cache->members, guild.id, member);
+	}
+
 	client->onevent.guild_create(client, guild, info);
 }
 
 static void Discord_EventHandlerGuildUpdate(Discord::Client *client, const Json &data) {
 	Discord::Guild guild;
 	Discord_Deserialize(JsonGetObject(data), &guild);
+	if (client->cache.enabled)
+		Discord_CachePutGuild(&client->cache, JsonGetObject(data), data);
 	client->onevent.guild_update(client, guild);
 }
 
@@ -3804,6 +7071,16 @@ static void Discord_EventHandlerGuildDelete(Discord::Client *client, const Json
 	Discord::UnavailableGuild guild;
 	Discord_Deserialize(JsonGetObject(data), &guild);
 	client->onevent.guild_delete(client, guild);
+
+	if (client->cache.enabled) {
+		Discord_Cache *cache = &client->cache;
+		Discord_CacheRemove(cache, &cache->guilds, guild.id);
+		Discord_CacheRemoveGuild(cache, &cache->channels, guild.id);
+		Discord_CacheRemoveGuild(cache, &cache->roles, guild.id);
+		Discord_CacheRemoveGuild(cache, &cache->emojis, guild.id);
+		Discord_MemberStoreRemoveGuild(&cache->members, guild.id);
+		Discord_MessageCacheRemoveGuild(&cache->messages, guild.id);
+	}
 }
 
 static void Discord_EventHandlerGuildBanAdd(Discord::Client *client, const Json &data) {
@@ -3833,6 +7110,11 @@ static void Discord_EventHandlerGuildEmojisUpdate(Discord::Client *client, const
 		Discord_Deserialize(JsonGetObject(jsonemojis[index]), &emojis_update[index]);
 	}
 
+	if (client->cache.enabled) {
+		Discord_CacheRemoveGuild(&client->cache, &client->cache.emojis, guild_id);
+		Discord_CachePutObjects(&client->cache, &client->cache.emojis, guild_id, jsonemojis);
+	}
+
 	client->onevent.guild_emojis_update(client, guild_id, emojis_update);
 }
 
@@ -3861,6 +7143,8 @@ static void Discord_EventHandlerGuildMemberAdd(Discord::Client *client, const Js
 	Json_Object obj             = JsonGetObject(data);
 	Discord::Snowflake guild_id = Discord_ParseId(JsonGetString(obj, "guild_id"));
 	Discord_Deserialize(obj, &member);
+	if (client->cache.enabled)
+		Discord_MemberStorePut(&client->cache.members, guild_id, data);
 	client->onevent.guild_member_add(client, guild_id, member);
 }
 
@@ -3870,6 +7154,8 @@ static void Discord_EventHandlerGuildMemberRemove(Discord::Client *client, const
 	Discord::User user;
 	Discord_Deserialize(JsonGetObject(obj, "user"), &user);
 	client->onevent.guild_member_remove(client, guild_id, user);
+	if (client->cache.enabled)
+		Discord_MemberStoreRemove(&client->cache.members, guild_id, user.id);
 }
 
 static void Discord_EventHandlerGuildMemberUpdate(Discord::Client *client, const Json &data) {
@@ -3897,6 +7183,9 @@ static void Discord_EventHandlerGuildMemberUpdate(Discord::Client *client, const
 	member.pending                      = JsonGetBool(obj, "pending");
 	member.communication_disabled_until = Discord_ParseTimestamp(JsonGetString(obj, "communication_disabled_until"));
 
+	if (client->cache.enabled)
+		Discord_MemberStorePut(&client->cache.members, guild_id, data);
+
 	client->onevent.guild_member_update(client, guild_id, member);
 }
 
@@ -3913,6 +7202,11 @@ static void Discord_EventHandlerGuildMembersChunk(Discord::Client *client, const
 	}
 	chunk.members = members;
 
+	if (client->cache.enabled) {
+		for (const Json &member : jsonmembers)
+			Discord_MemberStorePut(&client->cache.members, guild_id, member);
+	}
+
 	chunk.chunk_index = JsonGetInt(obj, "chunk_index");
 	chunk.chunk_count = JsonGetInt(obj, "chunk_count");
 
@@ -3942,6 +7236,8 @@ static void Discord_EventHandlerGuildRoleCreate(Discord::Client *client, const J
 	Discord::Snowflake guild_id = Discord_ParseId(JsonGetString(obj, "guild_id"));
 	Discord::Role role;
 	Discord_Deserialize(JsonGetObject(obj, "role"), &role);
+	if (client->cache.enabled)
+		Discord_CachePut(&client->cache, &client->cache.roles, role.id, JsonGet(obj, "role"), guild_id);
 	client->onevent.guild_role_create(client, guild_id, role);
 }
 
@@ -3950,6 +7246,8 @@ static void Discord_EventHandlerGuildRoleUpdate(Discord::Client *client, const J
 	Discord::Snowflake guild_id = Discord_ParseId(JsonGetString(obj, "guild_id"));
 	Discord::Role role;
 	Discord_Deserialize(JsonGetObject(obj, "role"), &role);
+	if (client->cache.enabled)
+		Discord_CachePut(&client->cache, &client->cache.roles, role.id, JsonGet(obj, "role"), guild_id);
 	client->onevent.guild_role_update(client, guild_id, role);
 }
 
@@ -3958,6 +7256,8 @@ static void Discord_EventHandlerGuildRoleDelete(Discord::Client *client, const J
 	Discord::Snowflake guild_id   = Discord_ParseId(JsonGetString(obj, "guild_id"));
 	Discord::Snowflake role_id    = Discord_ParseId(JsonGetString(obj, "role_id"));
 	client->onevent.guild_role_delete(client, guild_id, role_id);
+	if (client->cache.enabled)
+		Discord_CacheRemove(&client->cache, &client->cache.roles, role_id);
 }
 
 static void Discord_EventHandlerGuildScheduledEventCreate(Discord::Client *client, const Json &data) {
@@ -4077,12 +7377,16 @@ static void Discord_EventHandlerInviteDelete(Discord::Client *client, const Json
 static void Discord_EventHandlerMessageCreate(Discord::Client *client, const Json &data) {
 	Discord::Message message;
 	Discord_Deserialize(JsonGetObject(data), &message);
+	if (client->cache.enabled)
+		Discord_MessageCachePut(&client->cache.messages, data);
 	client->onevent.message_create(client, message);
 }
 
 static void Discord_EventHandlerMessageUpdate(Discord::Client *client, const Json &data) {
 	Discord::Message message;
 	Discord_Deserialize(JsonGetObject(data), &message);
+	if (client->cache.enabled)
+		Discord_MessageCacheUpdate(&client->cache.messages, data);
 	client->onevent.message_update(client, message);
 }
 
@@ -4092,6 +7396,8 @@ static void Discord_EventHandlerMessageDelete(Discord::Client *client, const Jso
 	Discord::Snowflake channel_id = Discord_ParseId(JsonGetString(obj, "channel_id"));
 	Discord::Snowflake guild_id   = Discord_ParseId(JsonGetString(obj, "guild_id"));
 	client->onevent.message_delete(client, id, channel_id, guild_id);
+	if (client->cache.enabled)
+		Discord_MessageCacheRemove(&client->cache.messages, channel_id, id);
 }
 
 static void Discord_EventHandlerMessageDeleteBulk(Discord::Client *client, const Json &data) {
@@ -4107,6 +7413,11 @@ static void Discord_EventHandlerMessageDeleteBulk(Discord::Client *client, const
 	Discord::Snowflake channel_id = Discord_ParseId(JsonGetString(obj, "channel_id"));
 	Discord::Snowflake guild_id   = Discord_ParseId(JsonGetString(obj, "guild_id"));
 	client->onevent.message_delete_bulk(client, ids, channel_id, guild_id);
+
+	if (client->cache.enabled) {
+		for (Discord::Snowflake id : ids)
+			Discord_MessageCacheRemove(&client->cache.messages, channel_id, id);
+	}
 }
 
 static void Discord_EventHandlerMessageReactionAdd(Discord::Client *client, const Json &data) {
@@ -4126,6 +7437,8 @@ static void Discord_EventHandlerMessageReactionAdd(Discord::Client *client, cons
 	}
 
 	Discord_Deserialize(JsonGetObject(obj, "emoji"), &reaction.emoji);
+	if (client->cache.enabled)
+		Discord_MessageCacheReact(&client->cache.messages, obj, 1, reaction.user_id == client->cache.user_id);
 	client->onevent.message_reaction_add(client, reaction);
 }
 
@@ -4137,6 +7450,8 @@ static void Discord_EventHandlerMessageReactionRemove(Discord::Client *client, c
 	Discord::Snowflake guild_id   = Discord_ParseId(JsonGetString(obj, "guild_id"));
 	Discord::Emoji emoji;
 	Discord_Deserialize(JsonGetObject(obj, "emoji"), &emoji);
+	if (client->cache.enabled)
+		Discord_MessageCacheReact(&client->cache.messages, obj, -1, user_id == client->cache.user_id);
 	client->onevent.message_reaction_remove(client, user_id, channel_id, message_id, guild_id, emoji);
 }
 
@@ -4145,6 +7460,8 @@ static void Discord_EventHandlerMessageReactionRemoveAll(Discord::Client *client
 	Discord::Snowflake channel_id = Discord_ParseId(JsonGetString(obj, "channel_id"));
 	Discord::Snowflake message_id = Discord_ParseId(JsonGetString(obj, "message_id"));
 	Discord::Snowflake guild_id   = Discord_ParseId(JsonGetString(obj, "guild_id"));
+	if (client->cache.enabled)
+		Discord_MessageCacheReact(&client->cache.messages, obj, 0, false);
 	client->onevent.message_reaction_remove_all(client, channel_id, message_id, guild_id);
 }
 
@@ -4155,6 +7472,8 @@ static void Discord_EventHandlerMessageReactionRemoveEmoji(Discord::Client *clie
 	Discord::Snowflake message_id = Discord_ParseId(JsonGetString(obj, "message_id"));
 	Discord::Emoji emoji;
 	Discord_Deserialize(JsonGetObject(obj, "emoji"), &emoji);
+	if (client->cache.enabled)
+		Discord_MessageCacheReact(&client->cache.messages, obj, 0, false);
 	client->onevent.message_reaction_remove_emoji(client, channel_id, guild_id, message_id, emoji);
 }
 
@@ -4204,6 +7523,8 @@ static void Discord_EventHandlerTypingStartEvent(Discord::Client *client, const
 static void Discord_EventHandlerUserUpdate(Discord::Client *client, const Json &data) {
 	Discord::User user;
 	Discord_Deserialize(JsonGetObject(data), &user);
+	if (client->cache.enabled)
+		Discord_CachePut(&client->cache, &client->cache.users, user.id, data, Discord::Snowflake());
 	client->onevent.user_update(client, user);
 }
 
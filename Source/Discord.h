@@ -1,6 +1,10 @@
 #pragma once
 #include "Kr/KrBasic.h"
 #include "Json.h"
+#include "Network.h"
+
+struct Http_Cache;
+struct Http_Cache_Asset;
 
 namespace Discord {
 	struct Snowflake {
@@ -1528,7 +1532,18 @@ namespace Discord {
 		uint32_t         read_size    = MegaBytes(2);
 		uint32_t         write_size   = KiloBytes(8);
 		uint32_t         queue_size   = 32;
+		uint32_t         message_size = MegaBytes(64); // largest gateway message of the connection, spilled over read_size into buffers from allocator
+		uint32_t         connections  = 4; // concurrent REST requests
+		uint32_t         rest_workers = 2; // threads executing asynchronous REST requests, 0 runs them inline
+		uint32_t         pipeline_depth = 8; // GET requests in flight on one connection for bulk fetches, 1 disables pipelining
+		bool             http2        = false; // asynchronous REST requests are multiplexed on one HTTP/2 connection
+		bool             cache        = false; // entities received from the gateway are cached, see CachedChannel
+		uint32_t         member_cache_size = MegaBytes(64); // bytes of cached members, least recently active members are evicted past it
+		uint32_t         message_cache_count = 64; // recent messages cached per channel, 0 disables the message cache
+		uint32_t         message_cache_size  = MegaBytes(32); // bytes of cached messages, least recently active channels are dropped past it
 		Memory_Allocator allocator    = ThreadContextDefaultParams.allocator;
+		Net_Socket_Options socket     = NetDefaultSocketOptions;
+		Net_Event_Loop * loop         = nullptr; // gateway connection is serviced by this event loop instead of an I/O thread of its own, LoginSharded shares one between its shards when not set
 	};
 
 	struct Shard {
@@ -1667,4 +1682,95 @@ namespace Discord {
 	ThreadsInfo *ListPublicArchivedThreads(Client *client, Snowflake channel_id, Timestamp before, int32_t limit);
 	ThreadsInfo *ListPrivateArchivedThread(Client *client, Snowflake channel_id, Timestamp before, int32_t limit);
 	ThreadsInfo *ListJoinedArchivedThreads(Client *client, Snowflake channel_id, Timestamp before, int32_t limit);
+
+	// Guilds, channels, roles, emojis, users and members received from the gateway are cached when
+	// ClientSpec::cache is set. The cache is gateway-thread-only: it takes no locks, so it must only be queried
+	// from the event handlers, queries from other threads trip an assertion. Returned entities live until the
+	// event batch has been handled.
+	// GetChannel, GetChannels and GetGuildMembers are served from entries updated in the current session.
+	// The most recent messages of each channel are kept from MESSAGE_CREATE and GetChannelMessage is served from them
+	Guild *      CachedGuild(Client *client, Snowflake guild_id);
+	Channel *    CachedChannel(Client *client, Snowflake channel_id);
+	Role *       CachedRole(Client *client, Snowflake role_id);
+	Emoji *      CachedEmoji(Client *client, Snowflake emoji_id);
+	User *       CachedUser(Client *client, Snowflake user_id);
+	GuildMember *CachedGuildMember(Client *client, Snowflake guild_id, Snowflake user_id);
+	Message *    CachedMessage(Client *client, Snowflake channel_id, Snowflake message_id);
+	ptrdiff_t    CachedGuildMemberCount(Client *client, Snowflake guild_id);
+
+	// Effective permissions of a member in a channel computed from the cached roles and overwrites of the channel,
+	// false when the channel, its guild or the member is not cached. Results for a set of roles in a channel are
+	// memoized until the roles of the guild or the channel are updated. Timed out members that are neither the owner
+	// nor an administrator only get VIEW_CHANNEL and READ_MESSAGE_HISTORY
+	bool ComputePermissions(Client *client, Snowflake channel_id, Snowflake user_id, Permission *permissions);
+	bool ComputeCurrentUserPermissions(Client *client, Snowflake channel_id, Permission *permissions);
+
+	// Bulk fetches by id, the requests are pipelined on a single connection with upto ClientSpec::pipeline_depth
+	// requests in flight. Entries that could not be fetched are null
+	Array_View<Channel *>     GetChannels(Client *client, Array_View<Snowflake> channel_ids);
+	Array_View<Message *>     GetChannelMessages(Client *client, Snowflake channel_id, Array_View<Snowflake> message_ids);
+	Array_View<GuildMember *> GetGuildMembers(Client *client, Snowflake guild_id, Array_View<Snowflake> user_ids);
+
+	// Downloads the attachment from the CDN into path with parallel ranged requests, an interrupted download is resumed
+	bool DownloadAttachment(const Attachment &attachment, String path, uint32_t connections = 4);
+
+	// Avatars, emojis and stickers are fetched from the CDN through an asset cache on disk and stay mapped until
+	// released. Size is a power of 2 between 16 and 4096, 0 requests the original size
+	Http_Cache *CreateAssetCache(String directory, uint64_t budget = MegaBytes(256));
+	void        DestroyAssetCache(Http_Cache *cache);
+	bool        AcquireUserAvatar(Http_Cache *cache, const User &user, Http_Cache_Asset *asset, int32_t size = 0);
+	bool        AcquireEmoji(Http_Cache *cache, const Emoji &emoji, Http_Cache_Asset *asset, int32_t size = 0);
+	bool        AcquireSticker(Http_Cache *cache, const Sticker &sticker, Http_Cache_Asset *asset);
+	void        ReleaseAsset(Http_Cache *cache, Http_Cache_Asset *asset);
+
+	//
+	//
+	//
+
+	struct Request;
+
+	enum class RequestStatus { PENDING, SUCCEEDED, FAILED };
+
+	typedef void(*RequestCompletionProc)(Client *client, Request *request, void *context);
+	typedef void(*MessageCompletionProc)(Client *client, Message *message, void *context);
+	typedef void(*ChannelCompletionProc)(Client *client, Channel *channel, void *context);
+	typedef void(*ResultCompletionProc)(Client *client, bool success, void *context);
+
+	// Asynchronous requests are executed by the REST workers of the client and return immediately.
+	// Requests submitted without a proc must be polled and released by the caller. With a proc, the
+	// request is owned by the client, the proc is called from the gateway thread between event batches
+	// and the request is released afterwards, so it is not returned.
+	Request *     SubmitRequest(Client *client, String method, String endpoint, String content_type, String body);
+	bool          SubmitRequest(Client *client, String method, String endpoint, String content_type, String body, RequestCompletionProc proc, void *context = nullptr);
+	RequestStatus PollRequest(Request *request);
+	uint32_t      GetRequestHttpStatus(Request *request);
+	bool          GetRequestResponse(Client *client, Request *request, Json *json);
+	void          ReleaseRequest(Request *request);
+
+	// Typed asynchronous variants cover the channel, message, reaction, pin and thread membership endpoints,
+	// whose results are a message, a channel or a success flag. Not covered yet: the guild, member, role, emoji,
+	// invite, webhook and listing endpoints are synchronous only, SubmitRequest can be used for them until they
+	// get typed variants with their own completion procs
+	bool CreateMessageAsync(Client *client, Snowflake channel_id, const MessagePost &msg, MessageCompletionProc proc = nullptr, void *context = nullptr);
+	bool GetChannelAsync(Client *client, Snowflake channel_id, ChannelCompletionProc proc, void *context = nullptr);
+	bool GetChannelMessageAsync(Client *client, Snowflake channel_id, Snowflake message_id, MessageCompletionProc proc, void *context = nullptr);
+	bool CreateReactionAsync(Client *client, Snowflake channel_id, Snowflake message_id, String emoji, ResultCompletionProc proc = nullptr, void *context = nullptr);
+	bool DeleteReactionAsync(Client *client, Snowflake channel_id, Snowflake message_id, String emoji, ResultCompletionProc proc = nullptr, void *context = nullptr);
+	bool DeleteMessageAsync(Client *client, Snowflake channel_id, Snowflake message_id, ResultCompletionProc proc = nullptr, void *context = nullptr);
+	bool TriggerTypingIndicatorAsync(Client *client, Snowflake channel_id, ResultCompletionProc proc = nullptr, void *context = nullptr);
+	bool ModifyChannelAsync(Client *client, Snowflake channel_id, const ChannelPatch &patch, ChannelCompletionProc proc = nullptr, void *context = nullptr);
+	bool DeleteChannelAsync(Client *client, Snowflake channel_id, ChannelCompletionProc proc = nullptr, void *context = nullptr);
+	bool EditMessageAsync(Client *client, Snowflake channel_id, Snowflake message_id, const MessagePatch &msg, MessageCompletionProc proc = nullptr, void *context = nullptr);
+	bool CrossPostAsync(Client *client, Snowflake channel_id, Snowflake message_id, MessageCompletionProc proc = nullptr, void *context = nullptr);
+	bool DeleteUserReactionAsync(Client *client, Snowflake channel_id, Snowflake message_id, String emoji, Snowflake user_id, ResultCompletionProc proc = nullptr, void *context = nullptr);
+	bool DeleteAllReactionsAsync(Client *client, Snowflake channel_id, Snowflake message_id, ResultCompletionProc proc = nullptr, void *context = nullptr);
+	bool DeleteAllReactionsForEmojiAsync(Client *client, Snowflake channel_id, Snowflake message_id, String emoji, ResultCompletionProc proc = nullptr, void *context = nullptr);
+	bool BulkDeleteMessagesAsync(Client *client, Snowflake channel_id, Array_View<Snowflake> messages_ids, ResultCompletionProc proc = nullptr, void *context = nullptr);
+	bool DeleteChannelPermissionAsync(Client *client, Snowflake channel_id, Snowflake overwrite_id, ResultCompletionProc proc = nullptr, void *context = nullptr);
+	bool PinMessageAsync(Client *client, Snowflake channel_id, Snowflake message_id, ResultCompletionProc proc = nullptr, void *context = nullptr);
+	bool UnpinMessageAsync(Client *client, Snowflake channel_id, Snowflake message_id, ResultCompletionProc proc = nullptr, void *context = nullptr);
+	bool JoinThreadAsync(Client *client, Snowflake channel_id, ResultCompletionProc proc = nullptr, void *context = nullptr);
+	bool AddThreadMemberAsync(Client *client, Snowflake channel_id, Snowflake user_id, ResultCompletionProc proc = nullptr, void *context = nullptr);
+	bool LeaveThreadAsync(Client *client, Snowflake channel_id, ResultCompletionProc proc = nullptr, void *context = nullptr);
+	bool RemoveThreadMemberAsync(Client *client, Snowflake channel_id, Snowflake user_id, ResultCompletionProc proc = nullptr, void *context = nullptr);
 }
@@ -1,11 +1,45 @@
 #include "Http.h"
 #include "Kr/KrString.h"
+#include "Kr/KrAtomic.h"
+#include "Kr/KrBasic.h"
+#include "Kr/KrThread.h"
+#include "SHA1.h"
 #include <stdlib.h>
 
+#ifdef HTTP_ZLIB_ENABLE
+#include <zlib.h>
+#endif
+
+#ifdef HTTP_BROTLI_ENABLE
+#include <brotli/decode.h>
+#endif
+
+#if PLATFORM_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif PLATFORM_LINUX || PLATFORM_MAC
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#endif
+
 //
 //
 //
 
+#if defined(HTTP_ZLIB_ENABLE) && defined(HTTP_BROTLI_ENABLE)
+static const String HttpAcceptEncoding = "gzip, deflate, br";
+#elif defined(HTTP_ZLIB_ENABLE)
+static const String HttpAcceptEncoding = "gzip, deflate";
+#elif defined(HTTP_BROTLI_ENABLE)
+static const String HttpAcceptEncoding = "br";
+#else
+static const String HttpAcceptEncoding = "";
+#endif
+
 static const String HttpHeaderMap[] = {
 	"Cache-Control",
 	"Connection",
@@ -65,6 +99,8 @@ static const String HttpHeaderMap[] = {
 
 static_assert(_HTTP_HEADER_COUNT == ArrayCount(HttpHeaderMap), "");
 
+static const char *HttpVersionNames[] = { "HTTP/1.1", "HTTP/1.0", "HTTP/2" };
+
 struct Url {
 	String scheme;
 	String host;
@@ -102,14 +138,11 @@ struct Http { int __unused; };
 Net_Socket *Http_GetSocket(Http *http)    { return (Net_Socket *)http; }
 Http *Http_FromSocket(Net_Socket *socket) { return (Http *)socket; }
 
-Http *Http_Connect(const String host, const String port, Http_Connection connection, Memory_Allocator allocator) {
-	Net_Socket *http = Net_OpenConnection(host, port, NET_SOCKET_TCP, allocator);
+Http *Http_Connect(const String host, const String port, Http_Connection connection, Memory_Allocator allocator, const Net_Socket_Options &options) {
+	Net_Socket *http = Net_OpenConnection(host, port, NET_SOCKET_TCP, allocator, options);
 	if (http) {
-		if (connection == HTTP_DEFAULT && (port == "80" || StrMatchICase(port, "http"))) {
-			connection = HTTP_CONNECTION;
-		} else {
-			connection = HTTPS_CONNECTION;
-		}
+		if (connection == HTTP_DEFAULT)
+			connection = (port == "80" || StrMatchICase(port, "http")) ? HTTP_CONNECTION : HTTPS_CONNECTION;
 
 		if (connection == HTTPS_CONNECTION) {
 			if (Net_OpenSecureChannel(http, true)) {
@@ -125,12 +158,12 @@ Http *Http_Connect(const String host, const String port, Http_Connection connect
 	return nullptr;
 }
 
-Http *Http_Connect(const String hostname, Http_Connection connection, Memory_Allocator allocator) {
+Http *Http_Connect(const String hostname, Http_Connection connection, Memory_Allocator allocator, const Net_Socket_Options &options) {
 	Url url;
 	if (Http_UrlExtract(hostname, &url)) {
 		if (connection == HTTP_DEFAULT && (url.scheme == "80" || StrMatchICase(url.scheme, "http")))
 			connection = HTTP_CONNECTION;
-		return Http_Connect(url.host, url.port, connection, allocator);
+		return Http_Connect(url.host, url.port, connection, allocator, options);
 	}
 	LogErrorEx("Http", "Invalid hostname: %*.s", (int)hostname.length, hostname.data);
 	return nullptr;
@@ -144,6 +177,175 @@ void Http_Disconnect(Http *http) {
 	Net_CloseConnection((Net_Socket *)http);
 }
 
+bool Http_IsKeepAlive(const Http_Response &res) {
+	String connection = res.headers.known[HTTP_HEADER_CONNECTION];
+	if (res.status.version == HTTP_VERSION_1_0)
+		return StrMatchICase(connection, "keep-alive");
+	return !StrMatchICase(connection, "close");
+}
+
+//
+//
+//
+
+constexpr int HTTP_POOL_MAX_HOSTNAME = 512;
+
+struct Http_Pool_Entry {
+	Http *   http;
+	uint64_t idle_since;
+};
+
+struct Http_Pool {
+	Memory_Allocator       allocator;
+	Http_Pool_Spec         spec;
+	Http_Connection        connection;
+	Semaphore *            slots;  // connections that can still be checked out
+	Atomic_Guard           guard;  // protects idle
+	Array<Http_Pool_Entry> idle;   // most recently used at the end
+	ptrdiff_t              length;
+	char                   hostname[HTTP_POOL_MAX_HOSTNAME];
+};
+
+static Http *Http_PoolConnect(Http_Pool *pool) {
+	return Http_Connect(String(pool->hostname, pool->length), pool->connection, pool->allocator, pool->spec.socket);
+}
+
+static bool Http_PoolRelease(Http_Pool *pool, Http *http) {
+	SpinLock(&pool->guard);
+	Http_Pool_Entry *entry = pool->idle.Add();
+	if (entry) {
+		entry->http       = http;
+		entry->idle_since = Net_GetMilliseconds();
+	}
+	SpinUnlock(&pool->guard);
+	return entry != nullptr;
+}
+
+Http_Pool *Http_CreatePool(const String hostname, Http_Connection connection, Http_Pool_Spec spec, Memory_Allocator allocator) {
+	if (hostname.length >= HTTP_POOL_MAX_HOSTNAME) {
+		LogErrorEx("Http", "Hostname too long: " StrFmt, StrArg(hostname));
+		return nullptr;
+	}
+
+	Http_Pool *pool = (Http_Pool *)MemoryAllocate(sizeof(Http_Pool), allocator);
+	if (!pool) {
+		LogErrorEx("Http", "Failed to allocate memory for connection pool");
+		return nullptr;
+	}
+
+	*pool = Http_Pool{};
+
+	spec.max_connections = Maximum(spec.max_connections, 1);
+	spec.prewarm         = Minimum(spec.prewarm, spec.max_connections);
+
+	pool->allocator  = allocator;
+	pool->spec       = spec;
+	pool->connection = connection;
+	pool->idle       = Array<Http_Pool_Entry>(allocator);
+	pool->length     = hostname.length;
+	pool->slots      = Semaphore_Create(spec.max_connections);
+
+	memcpy(pool->hostname, hostname.data, hostname.length);
+
+	if (!pool->slots) {
+		LogErrorEx("Http", "Failed to create semaphore for connection pool");
+		MemoryFree(pool, sizeof(*pool), allocator);
+		return nullptr;
+	}
+
+	Http_PoolPrewarm(pool, spec.prewarm);
+
+	return pool;
+}
+
+void Http_DestroyPool(Http_Pool *pool) {
+	// Connections that are checked out must be returned before destroying the pool
+	for (Http_Pool_Entry &entry : pool->idle)
+		Http_Disconnect(entry.http);
+	Free(&pool->idle);
+	Semaphore_Destory(pool->slots);
+	MemoryFree(pool, sizeof(*pool), pool->allocator);
+}
+
+int Http_PoolPrewarm(Http_Pool *pool, int count) {
+	int warmed = 0;
+	for (; warmed < count; ++warmed) {
+		SpinLock(&pool->guard);
+		bool full = pool->idle.count >= pool->spec.max_connections;
+		SpinUnlock(&pool->guard);
+
+		if (full) break;
+
+		Http *http = Http_PoolConnect(pool);
+		if (!http) break;
+
+		if (!Http_PoolRelease(pool, http)) {
+			Http_Disconnect(http);
+			break;
+		}
+	}
+	return warmed;
+}
+
+Http *Http_PoolCheckout(Http_Pool *pool, int timeout) {
+	if (Semaphore_Wait(pool->slots, timeout) <= 0)
+		return nullptr;
+
+	Http *http   = nullptr;
+	uint64_t now = Net_GetMilliseconds();
+
+	while (!http) {
+		SpinLock(&pool->guard);
+		if (!pool->idle.count) {
+			SpinUnlock(&pool->guard);
+			break;
+		}
+		Http_Pool_Entry entry = pool->idle.Last();
+		pool->idle.RemoveLast();
+		SpinUnlock(&pool->guard);
+
+		// Server may have closed the connection while it was sitting in the pool
+		if (now - entry.idle_since < pool->spec.idle_timeout && Net_IsConnectionIdle(Http_GetSocket(entry.http)))
+			http = entry.http;
+		else
+			Http_Disconnect(entry.http);
+	}
+
+	if (!http)
+		http = Http_PoolConnect(pool);
+
+	if (!http)
+		Semaphore_Signal(pool->slots);
+
+	return http;
+}
+
+void Http_PoolCheckin(Http_Pool *pool, Http *http, bool reuse) {
+	if (!reuse || !Http_PoolRelease(pool, http))
+		Http_Disconnect(http);
+	Semaphore_Signal(pool->slots);
+}
+
+void Http_PoolEvictIdle(Http_Pool *pool) {
+	uint64_t now = Net_GetMilliseconds();
+
+	while (true) {
+		Http *http = nullptr;
+
+		// Oldest connections are at the front
+		SpinLock(&pool->guard);
+		if (pool->idle.count && now - pool->idle[0].idle_since >= pool->spec.idle_timeout) {
+			http = pool->idle[0].http;
+			pool->idle.Remove(0);
+		}
+		SpinUnlock(&pool->guard);
+
+		if (!http) break;
+
+		Http_Disconnect(http);
+	}
+}
+
 //
 //
 //
@@ -163,9 +365,13 @@ String Http_QueryParamGet(Http_Query_Params *params, String name) {
 	return String();
 }
 
+String Http_GetHeaderName(Http_Header_Id id) {
+	return HttpHeaderMap[id];
+}
+
 void Http_DumpHeader(const Http_Request &req) {
 	LogInfoEx("Http", "================== Header Dump ==================");
-	LogInfo("%s ", (req.version == HTTP_VERSION_1_0 ? "HTTP/1.0" : "HTTP/1.1"));
+	LogInfo("%s ", HttpVersionNames[req.version]);
 	for (int id = 0; id < _HTTP_HEADER_COUNT; ++id) {
 		if (req.headers.known[id].length)
 			LogInfo("> " StrFmt ": " StrFmt, StrArg(HttpHeaderMap[id]), StrArg(req.headers.known[id]));
@@ -179,7 +385,7 @@ void Http_DumpHeader(const Http_Request &req) {
 }
 
 void Http_DumpHeader(const Http_Response &res) {
-	const char *version = (res.status.version == HTTP_VERSION_1_0 ? "HTTP/1.0" : "HTTP/1.1");
+	const char *version = HttpVersionNames[res.status.version];
 
 	LogInfoEx("Http", "================== Header Dump ==================");
 	LogInfo("%s %u " StrFmt, version, res.status.code, StrArg(res.status.name));
@@ -197,6 +403,8 @@ void Http_DumpHeader(const Http_Response &res) {
 
 void Http_InitRequest(Http_Request *req) {
 	memset(req, 0, sizeof(*req));
+	if (HttpAcceptEncoding.length)
+		req->headers.known[HTTP_HEADER_ACCEPT_ENCODING] = HttpAcceptEncoding;
 }
 
 void Http_SetHost(Http_Request *req, Http *http) {
@@ -278,6 +486,17 @@ void Http_SetContent(Http_Request *req, String type, Buffer content) {
 	req->body = content;
 }
 
+void Http_SetContent(Http_Request *req, String type, const Buffer *segments, ptrdiff_t count) {
+	ptrdiff_t length = 0;
+	for (ptrdiff_t index = 0; index < count; ++index)
+		length += segments[index].length;
+	Http_SetContentLength(req, length);
+	req->headers.known[HTTP_HEADER_CONTENT_TYPE] = type;
+	req->body          = Buffer();
+	req->segments      = segments;
+	req->segment_count = count;
+}
+
 void Http_SetBody(Http_Request *req, Buffer content) {
 	req->body = content;
 }
@@ -358,6 +577,37 @@ void Http_AppendHeader(Http_Response *res, String name, String value) {
 	Http_SetHeader(res, name, value);
 }
 
+bool Http_StoreHeader(Http_Response *res, String name, String value) {
+	ptrdiff_t available = HTTP_MAX_HEADER_SIZE - res->length;
+	if (name.length + value.length >= available) {
+		LogWarningEx("Http", "Header \"" StrFmt "\" could not be added: out of memory", StrArg(name));
+		return false;
+	}
+
+	uint8_t *dst = res->buffer + res->length;
+	memcpy(dst, name.data, name.length);
+	memcpy(dst + name.length, value.data, value.length);
+	res->length += name.length + value.length;
+
+	name  = String(dst, name.length);
+	value = String(dst + name.length, value.length);
+
+	for (int index = 0; index < _HTTP_HEADER_COUNT; ++index) {
+		if (StrMatchICase(name, HttpHeaderMap[index])) {
+			Http_AppendHeader(res, (Http_Header_Id)index, value);
+			return true;
+		}
+	}
+
+	if (res->headers.raw.count < HTTP_MAX_RAW_HEADERS) {
+		Http_AppendHeader(res, name, value);
+		return true;
+	}
+
+	LogWarningEx("Http", "Custom header  \"" StrFmt "\" could not be added: out of memory", StrArg(name));
+	return false;
+}
+
 void Http_SetContentLength(Http_Response *res, ptrdiff_t length) {
 	if (length >= 0) {
 		int written = snprintf((char *)res->buffer + res->length, HTTP_MAX_HEADER_SIZE - res->length, "%zd", length);
@@ -422,6 +672,49 @@ static inline bool Http_IterateSend(Http *http, uint8_t *bytes, ptrdiff_t bytes_
 	return true;
 }
 
+static bool Http_IterateSendVectored(Http *http, const Buffer *buffers, ptrdiff_t count) {
+	ptrdiff_t index  = 0;
+	ptrdiff_t offset = 0; // bytes of buffers[index] already sent
+
+	while (true) {
+		while (index < count && offset == buffers[index].length) {
+			index += 1;
+			offset = 0;
+		}
+
+		if (index == count)
+			return true;
+
+		Buffer vectors[NET_MAX_IO_VECTORS];
+		int    vector_count = 0;
+
+		for (ptrdiff_t iter = index; iter < count && vector_count < NET_MAX_IO_VECTORS; ++iter) {
+			ptrdiff_t skip = iter == index ? offset : 0;
+			if (buffers[iter].length > skip)
+				vectors[vector_count++] = Buffer(buffers[iter].data + skip, buffers[iter].length - skip);
+		}
+
+		int sent = Net_SendVectoredBlocked((Net_Socket *)http, vectors, vector_count, HTTP_TIMEOUT_MS);
+		if (sent <= 0) {
+			if (Net_GetLastError((Net_Socket *)http) == NET_E_TIMED_OUT)
+				LogErrorEx("Http", "Sending timed out");
+			return false;
+		}
+
+		for (ptrdiff_t remaining = sent; remaining;) {
+			ptrdiff_t left = buffers[index].length - offset;
+			if (remaining < left) {
+				offset   += remaining;
+				remaining = 0;
+			} else {
+				remaining -= left;
+				index     += 1;
+				offset     = 0;
+			}
+		}
+	}
+}
+
 static inline int Http_Receive(Http *http, uint8_t *buffer, int length) {
 	int ret = Net_ReceiveBlocked((Net_Socket *)http, buffer, length, HTTP_TIMEOUT_MS);
 	if (ret >= 0) return ret;
@@ -486,6 +779,18 @@ ptrdiff_t Http_BuildRequest(const String method, const String endpoint, const Ht
 	return header.length;
 }
 
+bool Http_SendRequest(Http *http, const String header, const Http_Request &req) {
+	// Header and body go out together so that small requests fit in a single segment or TLS record
+	if (!req.segments) {
+		Buffer buffers[] = { header, req.body };
+		return Http_IterateSendVectored(http, buffers, ArrayCount(buffers));
+	}
+
+	if (!Http_IterateSendVectored(http, &header, 1))
+		return false;
+	return Http_IterateSendVectored(http, req.segments, req.segment_count);
+}
+
 bool Http_SendRequest(Http *http, const String header, Http_Reader reader) {
 	uint8_t buffer[HTTP_STREAM_CHUNK_SIZE];
 
@@ -502,6 +807,336 @@ bool Http_SendRequest(Http *http, const String header, Http_Reader reader) {
 	return true;
 }
 
+//
+// Content-Encoding is decoded while the body is streamed, the decoded body is passed on to the
+// writer of the caller in blocks of HTTP_STREAM_CHUNK_SIZE so memory use does not depend on body size
+//
+
+enum Http_Content_Coding {
+	HTTP_CODING_IDENTITY,
+	HTTP_CODING_GZIP,
+	HTTP_CODING_DEFLATE,
+	HTTP_CODING_BROTLI,
+	HTTP_CODING_UNSUPPORTED,
+};
+
+struct Http_Decoder {
+	Http_Content_Coding  coding;
+	Http_Writer          writer;
+	bool                 started;
+	bool                 failed;
+	bool                 finished;
+#ifdef HTTP_ZLIB_ENABLE
+	z_stream             zlib;
+#endif
+#ifdef HTTP_BROTLI_ENABLE
+	BrotliDecoderState * brotli;
+#endif
+	uint8_t              output[HTTP_STREAM_CHUNK_SIZE];
+};
+
+static Http_Content_Coding Http_GetContentCoding(const String encoding) {
+	String coding = StrTrim(encoding);
+	if (!coding.length || StrMatchICase(coding, "identity"))
+		return HTTP_CODING_IDENTITY;
+#ifdef HTTP_ZLIB_ENABLE
+	if (StrMatchICase(coding, "gzip") || StrMatchICase(coding, "x-gzip"))
+		return HTTP_CODING_GZIP;
+	if (StrMatchICase(coding, "deflate"))
+		return HTTP_CODING_DEFLATE;
+#endif
+#ifdef HTTP_BROTLI_ENABLE
+	if (StrMatchICase(coding, "br"))
+		return HTTP_CODING_BROTLI;
+#endif
+	return HTTP_CODING_UNSUPPORTED;
+}
+
+static void Http_DecoderFail(Http_Decoder *decoder, const char *reason) {
+	if (!decoder->failed)
+		LogErrorEx("Http", "Decoding body failed: %s", reason);
+	decoder->failed = true;
+}
+
+static bool Http_DecoderBegin(Http_Decoder *decoder, Http_Content_Coding coding, Http_Writer writer) {
+	decoder->coding   = coding;
+	decoder->writer   = writer;
+	decoder->started  = false;
+	decoder->failed   = false;
+	decoder->finished = false;
+
+#ifdef HTTP_ZLIB_ENABLE
+	if (coding == HTTP_CODING_GZIP || coding == HTTP_CODING_DEFLATE) {
+		memset(&decoder->zlib, 0, sizeof(decoder->zlib));
+		// 32 adds automatic zlib/gzip header detection, deflate is supposed to be zlib wrapped
+		// but is sent raw by some servers which is handled when the first block is decoded
+		int window_bits = MAX_WBITS + 32;
+		return inflateInit2(&decoder->zlib, window_bits) == Z_OK;
+	}
+#endif
+
+#ifdef HTTP_BROTLI_ENABLE
+	if (coding == HTTP_CODING_BROTLI) {
+		decoder->brotli = BrotliDecoderCreateInstance(nullptr, nullptr, nullptr);
+		return decoder->brotli != nullptr;
+	}
+#endif
+
+	return false;
+}
+
+static void Http_DecoderEnd(Http_Decoder *decoder) {
+#ifdef HTTP_ZLIB_ENABLE
+	if (decoder->coding == HTTP_CODING_GZIP || decoder->coding == HTTP_CODING_DEFLATE)
+		inflateEnd(&decoder->zlib);
+#endif
+#ifdef HTTP_BROTLI_ENABLE
+	if (decoder->coding == HTTP_CODING_BROTLI)
+		BrotliDecoderDestroyInstance(decoder->brotli);
+#endif
+}
+
+static void Http_DecoderWriterProc(Http_Header &header, uint8_t *buffer, ptrdiff_t length, void *context) {
+	Http_Decoder *decoder = (Http_Decoder *)context;
+
+	if (decoder->failed)
+		return;
+
+	decoder->started |= length > 0;
+
+	if (decoder->finished) {
+		if (length) Http_DecoderFail(decoder, "data after end of stream");
+		return;
+	}
+
+#ifdef HTTP_ZLIB_ENABLE
+	if (decoder->coding == HTTP_CODING_GZIP || decoder->coding == HTTP_CODING_DEFLATE) {
+		z_stream *stream = &decoder->zlib;
+		stream->next_in  = buffer;
+		stream->avail_in = (uInt)length;
+
+		bool first_block = stream->total_in == 0;
+
+		while (stream->avail_in && !decoder->finished) {
+			stream->next_out  = decoder->output;
+			stream->avail_out = sizeof(decoder->output);
+
+			int status = inflate(stream, Z_NO_FLUSH);
+
+			if (status == Z_DATA_ERROR && decoder->coding == HTTP_CODING_DEFLATE && first_block && !stream->total_out) {
+				// Raw deflate without the zlib wrapper
+				first_block = false;
+				inflateReset2(stream, -MAX_WBITS);
+				stream->next_in  = buffer;
+				stream->avail_in = (uInt)length;
+				continue;
+			}
+
+			if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+				Http_DecoderFail(decoder, stream->msg ? stream->msg : "corrupt stream");
+				return;
+			}
+
+			ptrdiff_t produced = sizeof(decoder->output) - stream->avail_out;
+			if (produced)
+				decoder->writer.proc(header, decoder->output, produced, decoder->writer.context);
+
+			if (status == Z_STREAM_END) {
+				decoder->finished = true;
+			} else if (status == Z_BUF_ERROR && !produced) {
+				break;
+			}
+		}
+		return;
+	}
+#endif
+
+#ifdef HTTP_BROTLI_ENABLE
+	if (decoder->coding == HTTP_CODING_BROTLI) {
+		const uint8_t *next_in = buffer;
+		size_t avail_in        = (size_t)length;
+
+		while (true) {
+			uint8_t *next_out = decoder->output;
+			size_t avail_out  = sizeof(decoder->output);
+
+			BrotliDecoderResult result = BrotliDecoderDecompressStream(decoder->brotli, &avail_in, &next_in, &avail_out, &next_out, nullptr);
+
+			ptrdiff_t produced = sizeof(decoder->output) - avail_out;
+			if (produced)
+				decoder->writer.proc(header, decoder->output, produced, decoder->writer.context);
+
+			if (result == BROTLI_DECODER_RESULT_ERROR) {
+				Http_DecoderFail(decoder, BrotliDecoderErrorString(BrotliDecoderGetErrorCode(decoder->brotli)));
+				return;
+			}
+
+			if (result == BROTLI_DECODER_RESULT_SUCCESS) {
+				decoder->finished = true;
+				if (avail_in) Http_DecoderFail(decoder, "data after end of stream");
+				return;
+			}
+
+			if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT)
+				return;
+		}
+	}
+#endif
+}
+
+struct Http_Body_Decoder {
+	Memory_Allocator allocator;
+	Http_Decoder     decoder;
+};
+
+Http_Body_Decoder *Http_BeginBodyDecoder(const String content_encoding, Http_Writer writer, Memory_Allocator allocator) {
+	Http_Content_Coding coding = Http_GetContentCoding(content_encoding);
+	if (coding == HTTP_CODING_IDENTITY || coding == HTTP_CODING_UNSUPPORTED)
+		return nullptr;
+
+	Http_Body_Decoder *body = (Http_Body_Decoder *)MemoryAllocate(sizeof(Http_Body_Decoder), allocator);
+	if (!body) {
+		LogErrorEx("Http", "Decoder allocation failed: out of memory");
+		return nullptr;
+	}
+
+	body->allocator = allocator;
+
+	if (!Http_DecoderBegin(&body->decoder, coding, writer)) {
+		LogErrorEx("Http", "Failed to initialize decoder for Content-Encoding: " StrFmt, StrArg(content_encoding));
+		MemoryFree(body, sizeof(Http_Body_Decoder), allocator);
+		return nullptr;
+	}
+
+	return body;
+}
+
+Http_Writer Http_BodyDecoderWriter(Http_Body_Decoder *body) {
+	Http_Writer writer;
+	writer.proc    = Http_DecoderWriterProc;
+	writer.context = &body->decoder;
+	return writer;
+}
+
+bool Http_EndBodyDecoder(Http_Body_Decoder *body) {
+	Http_Decoder *decoder = &body->decoder;
+	Http_DecoderEnd(decoder);
+
+	if (decoder->started && !decoder->finished && !decoder->failed)
+		Http_DecoderFail(decoder, "truncated stream");
+
+	bool decoded = !decoder->failed;
+	MemoryFree(body, sizeof(Http_Body_Decoder), body->allocator);
+	return decoded;
+}
+
+//
+//
+//
+
+static bool Http_ReceiveBody(Http *http, Http_Response *res, uint8_t *buffer, ptrdiff_t body_read, Http_Writer writer);
+
+// Parses the status line and header fields in res->buffer[0..res->length], which ends with an empty line
+static bool Http_ParseHeader(Http_Response *res) {
+	uint8_t *trav = res->buffer;
+	uint8_t *last = trav + res->length;
+
+	enum { PARSISNG_STATUS, PARSING_FIELDS };
+
+	int state = PARSISNG_STATUS;
+
+	while (true) {
+		String part(trav, last - trav);
+		ptrdiff_t pos = StrFind(part, "\r\n");
+		if (pos == 0) // Finished
+			break;
+
+		if (pos < 0) {
+			LogErrorEx("Http", "Corrupt header received: missing headers");
+			return false;
+		}
+
+		String line(trav, pos);
+		trav += pos + 2;
+
+		if (state == PARSING_FIELDS) {
+			ptrdiff_t colon = StrFindChar(line, ':');
+			if (colon <= 0) {
+				LogErrorEx("Http", "Corrupt header received: value for header not present");
+				return false;
+			}
+
+			String name = SubStr(line, 0, colon);
+			name = StrTrim(name);
+			String value = SubStr(line, colon + 1);
+			value = StrTrim(value);
+
+			bool known_header = false;
+			for (int index = 0; index < _HTTP_HEADER_COUNT; ++index) {
+				if (StrMatchICase(name, HttpHeaderMap[index])) {
+					Http_AppendHeader(res, (Http_Header_Id)index, value);
+					known_header = true;
+					break;
+				}
+			}
+
+			if (!known_header) {
+				if (res->headers.raw.count < HTTP_MAX_HEADER_SIZE) {
+					Http_AppendHeader(res, name, value);
+				} else {
+					LogWarningEx("Http", "Custom header  \"" StrFmt "\" could not be added: out of memory", StrArg(name));
+				}
+			}
+		} else {
+			const String prefixes[] = { "HTTP/1.1 ", "HTTP/1.0 " };
+			constexpr Http_Version versions[] = { HTTP_VERSION_1_1, HTTP_VERSION_1_0 };
+			static_assert(ArrayCount(prefixes) == ArrayCount(versions), "");
+
+			bool prefix_present = false;
+			for (int index = 0; index < (int)ArrayCount(prefixes); ++index) {
+				String prefix = prefixes[index];
+				if (StrStartsWithICase(line, prefix)) {
+					line = StrRemovePrefix(line, prefix.length);
+					res->status.version = versions[index];
+					prefix_present = true;
+					break;
+				}
+			}
+			if (!prefix_present) {
+				LogErrorEx("Http", "Corrupt header received: missing HTTP prefix: " StrFmt, StrArg(line));
+				LogInfoEx("Http", "Received: " StrFmt, StrArg(String(res->buffer, res->length)));
+				return false;
+			}
+
+			line = StrTrim(line);
+			ptrdiff_t name_pos = StrFindChar(line, ' ');
+			if (name_pos < 0) {
+				LogErrorEx("Http", "Corrupt header received: missing status code");
+				LogInfoEx("Http", "Received: " StrFmt, StrArg(String(res->buffer, res->length)));
+				return false;
+			}
+
+			ptrdiff_t status_code;
+			if (!ParseInt(SubStr(line, 0, name_pos), &status_code)) {
+				LogErrorEx("Http", "Corrupt header received: invalid status code");
+				LogInfoEx("Http", "Received: " StrFmt, StrArg(String(res->buffer, res->length)));
+				return false;
+			} else if (status_code < 0) {
+				LogErrorEx("Http", "Corrupt header received: status code is negative");
+				LogInfoEx("Http", "Received: " StrFmt, StrArg(String(res->buffer, res->length)));
+				return false;
+			}
+
+			res->status.code = (uint32_t)status_code;
+			res->status.name = SubStr(line, name_pos + 1);
+
+			state = PARSING_FIELDS;
+		}
+	}
+
+	return true;
+}
+
 bool Http_ReceiveResponse(Http *http, Http_Response *res, Http_Writer writer) {
 	uint8_t buffer[HTTP_STREAM_CHUNK_SIZE];
 
@@ -550,120 +1185,50 @@ bool Http_ReceiveResponse(Http *http, Http_Response *res, Http_Writer writer) {
 		}
 	}
 
-	{
-		// Parse headers
-		uint8_t *trav = res->buffer;
-		uint8_t *last = trav + res->length;
+	if (!Http_ParseHeader(res)) {
+		Http_FlushRead(http, res);
+		return false;
+	}
 
-		enum { PARSISNG_STATUS, PARSING_FIELDS };
+	Http_Content_Coding coding = Http_GetContentCoding(res->headers.known[HTTP_HEADER_CONTENT_ENCODING]);
 
-		int state = PARSISNG_STATUS;
+	if (coding == HTTP_CODING_IDENTITY || coding == HTTP_CODING_UNSUPPORTED) {
+		// Unsupported codings are passed through as is for the caller to handle
+		return Http_ReceiveBody(http, res, buffer, body_read, writer);
+	}
 
-		while (true) {
-			String part(trav, last - trav);
-			ptrdiff_t pos = StrFind(part, "\r\n");
-			if (pos == 0) // Finished
-				break;
+	Http_Decoder decoder;
+	if (!Http_DecoderBegin(&decoder, coding, writer)) {
+		LogErrorEx("Http", "Failed to initialize decoder for Content-Encoding: " StrFmt, StrArg(res->headers.known[HTTP_HEADER_CONTENT_ENCODING]));
+		Http_FlushRead(http, res);
+		return false;
+	}
 
-			if (pos < 0) {
-				LogErrorEx("Http", "Corrupt header received: missing headers");
-				Http_FlushRead(http, res);
-				return false;
-			}
+	Http_Writer decoder_writer;
+	decoder_writer.proc    = Http_DecoderWriterProc;
+	decoder_writer.context = &decoder;
 
-			String line(trav, pos);
-			trav += pos + 2;
+	bool received = Http_ReceiveBody(http, res, buffer, body_read, decoder_writer);
 
-			if (state == PARSING_FIELDS) {
-				ptrdiff_t colon = StrFindChar(line, ':');
-				if (colon <= 0) {
-					LogErrorEx("Http", "Corrupt header received: value for header not present");
-					Http_FlushRead(http, res);
-					return false;
-				}
+	Http_DecoderEnd(&decoder);
 
-				String name = SubStr(line, 0, colon);
-				name = StrTrim(name);
-				String value = SubStr(line, colon + 1);
-				value = StrTrim(value);
+	// An empty body is fine (HEAD, 204, 304), a partial stream is not
+	if (received && decoder.started && !decoder.finished && !decoder.failed)
+		Http_DecoderFail(&decoder, "truncated stream");
 
-				bool known_header = false;
-				for (int index = 0; index < _HTTP_HEADER_COUNT; ++index) {
-					if (StrMatchICase(name, HttpHeaderMap[index])) {
-						Http_AppendHeader(res, (Http_Header_Id)index, value);
-						known_header = true;
-						break;
-					}
-				}
+	return received && !decoder.failed;
+}
 
-				if (!known_header) {
-					if (res->headers.raw.count < HTTP_MAX_HEADER_SIZE) {
-						Http_AppendHeader(res, name, value);
-					} else {
-						LogWarningEx("Http", "Custom header  \"" StrFmt "\" could not be added: out of memory", StrArg(name));
-					}
-				}
-			} else {
-				const String prefixes[] = { "HTTP/1.1 ", "HTTP/1.0 " };
-				constexpr Http_Version versions[] = { HTTP_VERSION_1_1, HTTP_VERSION_1_0 };
-				static_assert(ArrayCount(prefixes) == ArrayCount(versions), "");
-
-				bool prefix_present = false;
-				for (int index = 0; index < ArrayCount(prefixes); ++index) {
-					String prefix = prefixes[index];
-					if (StrStartsWithICase(line, prefix)) {
-						line = StrRemovePrefix(line, prefix.length);
-						res->status.version = versions[index];
-						prefix_present = true;
-						break;
-					}
-				}
-				if (!prefix_present) {
-					LogErrorEx("Http", "Corrupt header received: missing HTTP prefix: " StrFmt, StrArg(line));
-					LogInfoEx("Http", "Received: " StrFmt, StrArg(String(res->buffer, res->length)));
-					Http_FlushRead(http, res);
-					return false;
-				}
-
-				line = StrTrim(line);
-				ptrdiff_t name_pos = StrFindChar(line, ' ');
-				if (name_pos < 0) {
-					LogErrorEx("Http", "Corrupt header received: missing status code");
-					LogInfoEx("Http", "Received: " StrFmt, StrArg(String(res->buffer, res->length)));
-					Http_FlushRead(http, res);
-					return false;
-				}
-
-				ptrdiff_t status_code;
-				if (!ParseInt(SubStr(line, 0, name_pos), &status_code)) {
-					LogErrorEx("Http", "Corrupt header received: invalid status code");
-					LogInfoEx("Http", "Received: " StrFmt, StrArg(String(res->buffer, res->length)));
-					Http_FlushRead(http, res);
-					return false;
-				} else if (status_code < 0) {
-					LogErrorEx("Http", "Corrupt header received: status code is negative");
-					LogInfoEx("Http", "Received: " StrFmt, StrArg(String(res->buffer, res->length)));
-					Http_FlushRead(http, res);
-					return false;
-				}
-
-				res->status.code = (uint32_t)status_code;
-				res->status.name = SubStr(line, name_pos + 1);
-
-				state = PARSING_FIELDS;
-			}
-		}
-	}
-
-	// Body: Content-Length
-	const String content_length_value = res->headers.known[HTTP_HEADER_CONTENT_LENGTH];
-	if (content_length_value.length) {
-		ptrdiff_t content_length = 0;
-		if (!ParseInt(content_length_value, &content_length)) {
-			LogErrorEx("Http", "Corrupt header received: invalid content length");
-			Http_FlushRead(http, res);
-			return false;
-		}
+static bool Http_ReceiveBody(Http *http, Http_Response *res, uint8_t *buffer, ptrdiff_t body_read, Http_Writer writer) {
+	// Body: Content-Length
+	const String content_length_value = res->headers.known[HTTP_HEADER_CONTENT_LENGTH];
+	if (content_length_value.length) {
+		ptrdiff_t content_length = 0;
+		if (!ParseInt(content_length_value, &content_length)) {
+			LogErrorEx("Http", "Corrupt header received: invalid content length");
+			Http_FlushRead(http, res);
+			return false;
+		}
 
 		if (content_length < body_read) {
 			LogErrorEx("Http", "Corrupt header received: invalid content length");
@@ -768,7 +1333,8 @@ bool Http_ReceiveResponse(Http *http, Http_Response *res, Http_Writer writer) {
 	return true;
 }
 
-bool Http_CustomMethod(Http *http, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
+// Without a reader the body is sent directly from the request
+static bool Http_Exchange(Http *http, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, const Http_Reader *reader, Http_Response *res, Http_Writer writer) {
 	uint8_t buffer[HTTP_STREAM_CHUNK_SIZE];
 
 	{
@@ -778,7 +1344,8 @@ bool Http_CustomMethod(Http *http, const String method, const String endpoint, c
 			return false;
 		}
 
-		if (!Http_SendRequest(http, String(buffer, len), reader))
+		bool sent = reader ? Http_SendRequest(http, String(buffer, len), *reader) : Http_SendRequest(http, String(buffer, len), req);
+		if (!sent)
 			return false;
 	}
 
@@ -788,6 +1355,10 @@ bool Http_CustomMethod(Http *http, const String method, const String endpoint, c
 	return received;
 }
 
+bool Http_CustomMethod(Http *http, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
+	return Http_Exchange(http, method, endpoint, params, req, &reader, res, writer);
+}
+
 bool Http_Post(Http *http, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer) {
 	return Http_CustomMethod(http, "POST", endpoint, params, req, reader, res, writer);
 }
@@ -825,32 +1396,8 @@ bool Http_Put(Http *http, const String endpoint, const Http_Request &req, Http_R
 //
 //
 
-struct Http_Buffer_Reader {
-	ptrdiff_t written;
-	ptrdiff_t length;
-	uint8_t * buffer;
-};
-
-static int Http_BufferReaderProc(uint8_t *buffer, int length, void *context) {
-	Http_Buffer_Reader *reader = (Http_Buffer_Reader *)context;
-	int copy_len =(int)Minimum(length, reader->length - reader->written);
-	memcpy(buffer, reader->buffer + reader->written, copy_len);
-	reader->written += copy_len;
-	return copy_len;
-}
-
 bool Http_CustomMethod(Http *http, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Response *res, Http_Writer writer) {
-	Http_Buffer_Reader buffer_reader;
-	buffer_reader.written = 0;
-	buffer_reader.length  = req.body.length;
-	buffer_reader.buffer  = req.body.data;
-
-	Http_Reader reader;
-	reader.proc    = Http_BufferReaderProc;
-	reader.context = &buffer_reader;
-	
-	bool result = Http_CustomMethod(http, method, endpoint, params, req, reader, res, writer);
-	return result;
+	return Http_Exchange(http, method, endpoint, params, req, nullptr, res, writer);
 }
 
 bool Http_Post(Http *http, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Response *res, Http_Writer writer) {
@@ -914,7 +1461,7 @@ static void Http_ArenaWriterProc(Http_Header &header, uint8_t *buffer, ptrdiff_t
 	writer->length = -1;
 }
 
-bool Http_CustomMethod(Http *http, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Memory_Arena *arena) {
+static bool Http_ArenaExchange(Http *http, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, const Http_Reader *reader, Http_Response *res, Memory_Arena *arena) {
 	uint8_t *body = (uint8_t *)MemoryArenaGetCurrent(arena);
 	auto temp     = BeginTemporaryMemory(arena);
 
@@ -928,7 +1475,7 @@ bool Http_CustomMethod(Http *http, const String method, const String endpoint, c
 	writer.proc    = Http_ArenaWriterProc;
 	writer.context = &arena_writer;
 
-	bool result = Http_CustomMethod(http, method, endpoint, params, req, reader, res, writer);
+	bool result = Http_Exchange(http, method, endpoint, params, req, reader, res, writer);
 	if (result && arena_writer.length >= 0) {
 		res->body = Buffer(body, arena_writer.length);
 		return true;
@@ -939,6 +1486,10 @@ bool Http_CustomMethod(Http *http, const String method, const String endpoint, c
 	return false;
 }
 
+bool Http_CustomMethod(Http *http, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Memory_Arena *arena) {
+	return Http_ArenaExchange(http, method, endpoint, params, req, &reader, res, arena);
+}
+
 bool Http_Post(Http *http, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Memory_Arena *arena) {
 	return Http_CustomMethod(http, "POST", endpoint, params, req, reader, res, arena);
 }
@@ -977,17 +1528,7 @@ bool Http_Put(Http *http, const String endpoint, const Http_Request &req, Http_R
 //
 
 bool Http_CustomMethod(Http *http, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Response *res, Memory_Arena *arena) {
-	Http_Buffer_Reader res_body_reader;
-	res_body_reader.written = 0;
-	res_body_reader.length  = req.body.length;
-	res_body_reader.buffer  = req.body.data;
-
-	Http_Reader reader;
-	reader.proc    = Http_BufferReaderProc;
-	reader.context = &res_body_reader;
-
-	bool result = Http_CustomMethod(http, method, endpoint, params, req, reader, res, arena);
-	return result;
+	return Http_ArenaExchange(http, method, endpoint, params, req, nullptr, res, arena);
 }
 
 bool Http_Post(Http *http, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Response *res, Memory_Arena *arena) {
@@ -1154,6 +1695,367 @@ bool Http_Put(Http *http, const String endpoint, const Http_Request &req, Http_R
 	return Http_CustomMethod(http, "PUT", endpoint, req, res, memory, length);
 }
 
+//
+// Incremental response parser, fed with whatever has been received so far
+//
+
+enum Http_Parser_State {
+	HTTP_PARSER_HEADER,
+	HTTP_PARSER_BODY,
+	HTTP_PARSER_CHUNK_SIZE,
+	HTTP_PARSER_CHUNK_DATA,
+	HTTP_PARSER_CHUNK_END,
+	HTTP_PARSER_TRAILER,
+	HTTP_PARSER_DONE,
+	HTTP_PARSER_ERROR,
+};
+
+constexpr int HTTP_PARSER_MAX_LINE = 64;
+
+struct Http_Parser {
+	Http_Parser_State state;
+	Http_Response *   response;
+	Http_Writer       writer;
+	Http_Writer       sink; // writer, or the decoder in front of it
+	ptrdiff_t         remaining;
+	ptrdiff_t         line_length;
+	uint8_t           line[HTTP_PARSER_MAX_LINE];
+	bool              decoding;
+	Http_Decoder      decoder;
+};
+
+static void Http_ParserBegin(Http_Parser *parser, Http_Response *res, Http_Writer writer) {
+	Http_InitResponse(res);
+
+	parser->state       = HTTP_PARSER_HEADER;
+	parser->response    = res;
+	parser->writer      = writer;
+	parser->sink        = writer;
+	parser->remaining   = 0;
+	parser->line_length = 0;
+	parser->decoding    = false;
+}
+
+static bool Http_ParserEnd(Http_Parser *parser) {
+	if (parser->decoding) {
+		Http_DecoderEnd(&parser->decoder);
+		parser->decoding = false;
+
+		if (parser->state == HTTP_PARSER_DONE && parser->decoder.started && !parser->decoder.finished && !parser->decoder.failed)
+			Http_DecoderFail(&parser->decoder, "truncated stream");
+		if (parser->decoder.failed)
+			return false;
+	}
+	return parser->state == HTTP_PARSER_DONE;
+}
+
+static ptrdiff_t Http_ParserError(Http_Parser *parser, const char *reason) {
+	LogErrorEx("Http", "Parsing response failed: %s", reason);
+	parser->state = HTTP_PARSER_ERROR;
+	return 0;
+}
+
+// Consumes upto the end of the current line, returns true once the line is complete. Lines longer
+// than the line buffer are truncated, line_length keeps counting so callers can reject them
+static bool Http_ParserLine(Http_Parser *parser, uint8_t *data, ptrdiff_t length, ptrdiff_t *consumed) {
+	uint8_t *end = (uint8_t *)memchr(data, '\n', length);
+	ptrdiff_t count = end ? (end - data) : length;
+
+	ptrdiff_t copy = Minimum(count, HTTP_PARSER_MAX_LINE - parser->line_length);
+	if (copy > 0)
+		memcpy(parser->line + parser->line_length, data, copy);
+	parser->line_length += count;
+
+	*consumed = end ? count + 1 : count;
+	return end != nullptr;
+}
+
+static String Http_ParserLineString(Http_Parser *parser) {
+	ptrdiff_t length = Minimum(parser->line_length, HTTP_PARSER_MAX_LINE);
+	if (length && parser->line[length - 1] == '\r')
+		length -= 1;
+	return String(parser->line, length);
+}
+
+static ptrdiff_t Http_ParserFeedHeader(Http_Parser *parser, uint8_t *data, ptrdiff_t length) {
+	Http_Response *res = parser->response;
+
+	ptrdiff_t prev = res->length;
+	ptrdiff_t copy = Minimum(length, HTTP_MAX_HEADER_SIZE - prev);
+	memcpy(res->buffer + prev, data, copy);
+
+	ptrdiff_t search = Maximum(prev - 3, 0);
+	ptrdiff_t pos    = StrFind(String(res->buffer + search, prev + copy - search), "\r\n\r\n");
+
+	if (pos < 0) {
+		res->length = prev + copy;
+		if (res->length == HTTP_MAX_HEADER_SIZE)
+			return Http_ParserError(parser, "header too large");
+		return copy;
+	}
+
+	res->length = search + pos + 4;
+	ptrdiff_t consumed = res->length - prev;
+
+	if (!Http_ParseHeader(res)) {
+		parser->state = HTTP_PARSER_ERROR;
+		return consumed;
+	}
+
+	// Interim responses are followed by the final one
+	if (res->status.code >= 100 && res->status.code < 200) {
+		Http_ParserBegin(parser, res, parser->writer);
+		return consumed;
+	}
+
+	if (res->status.code == 204 || res->status.code == 304) {
+		parser->state = HTTP_PARSER_DONE;
+		return consumed;
+	}
+
+	Http_Content_Coding coding = Http_GetContentCoding(res->headers.known[HTTP_HEADER_CONTENT_ENCODING]);
+
+	if (coding != HTTP_CODING_IDENTITY && coding != HTTP_CODING_UNSUPPORTED) {
+		if (!Http_DecoderBegin(&parser->decoder, coding, parser->writer)) {
+			LogErrorEx("Http", "Failed to initialize decoder for Content-Encoding: " StrFmt, StrArg(res->headers.known[HTTP_HEADER_CONTENT_ENCODING]));
+			parser->state = HTTP_PARSER_ERROR;
+			return consumed;
+		}
+		parser->decoding     = true;
+		parser->sink.proc    = Http_DecoderWriterProc;
+		parser->sink.context = &parser->decoder;
+	}
+
+	const String content_length_value = res->headers.known[HTTP_HEADER_CONTENT_LENGTH];
+	const String transfer_encoding    = res->headers.known[HTTP_HEADER_TRANSFER_ENCODING];
+
+	if (content_length_value.length) {
+		if (!ParseInt(content_length_value, &parser->remaining) || parser->remaining < 0) {
+			Http_ParserError(parser, "invalid content length");
+			return consumed;
+		}
+		parser->state = parser->remaining ? HTTP_PARSER_BODY : HTTP_PARSER_DONE;
+	} else if (transfer_encoding.length && StrFindICase(transfer_encoding, "chunked") >= 0) {
+		parser->state = HTTP_PARSER_CHUNK_SIZE;
+	} else {
+		// Same as the blocking receive, a response without framing has no body
+		parser->state = HTTP_PARSER_DONE;
+	}
+
+	return consumed;
+}
+
+// Returns the number of bytes consumed, parsing stops at the end of the response so that
+// the remaining bytes belong to the next response on the connection
+static ptrdiff_t Http_ParserFeed(Http_Parser *parser, uint8_t *data, ptrdiff_t length) {
+	ptrdiff_t offset = 0;
+
+	while (offset < length) {
+		uint8_t * ptr  = data + offset;
+		ptrdiff_t left = length - offset;
+		ptrdiff_t consumed = 0;
+
+		switch (parser->state) {
+			case HTTP_PARSER_HEADER: {
+				consumed = Http_ParserFeedHeader(parser, ptr, left);
+			} break;
+
+			case HTTP_PARSER_BODY:
+			case HTTP_PARSER_CHUNK_DATA: {
+				consumed = Minimum(left, parser->remaining);
+				parser->sink.proc(parser->response->headers, ptr, consumed, parser->sink.context);
+				parser->remaining -= consumed;
+				if (!parser->remaining)
+					parser->state = parser->state == HTTP_PARSER_BODY ? HTTP_PARSER_DONE : HTTP_PARSER_CHUNK_END;
+			} break;
+
+			case HTTP_PARSER_CHUNK_SIZE: {
+				if (!Http_ParserLine(parser, ptr, left, &consumed))
+					break;
+
+				String line = Http_ParserLineString(parser);
+				ptrdiff_t ext = StrFindChar(line, ';');
+				if (ext >= 0)
+					line = SubStr(line, 0, ext);
+				line = StrTrim(line);
+
+				ptrdiff_t chunk_length;
+				if (parser->line_length > HTTP_PARSER_MAX_LINE || !ParseHex(line, &chunk_length) || chunk_length < 0)
+					return offset + Http_ParserError(parser, "invalid chunk size");
+
+				parser->line_length = 0;
+				parser->remaining   = chunk_length;
+				parser->state       = chunk_length ? HTTP_PARSER_CHUNK_DATA : HTTP_PARSER_TRAILER;
+			} break;
+
+			case HTTP_PARSER_CHUNK_END: {
+				if (!Http_ParserLine(parser, ptr, left, &consumed))
+					break;
+				if (Http_ParserLineString(parser).length)
+					return offset + Http_ParserError(parser, "invalid chunks present in the body");
+				parser->line_length = 0;
+				parser->state       = HTTP_PARSER_CHUNK_SIZE;
+			} break;
+
+			case HTTP_PARSER_TRAILER: {
+				if (!Http_ParserLine(parser, ptr, left, &consumed))
+					break;
+				if (!Http_ParserLineString(parser).length)
+					parser->state = HTTP_PARSER_DONE;
+				parser->line_length = 0;
+			} break;
+
+			case HTTP_PARSER_DONE:
+			case HTTP_PARSER_ERROR: {
+				return offset;
+			} break;
+		}
+
+		offset += consumed;
+	}
+
+	return offset;
+}
+
+//
+//
+//
+
+struct Http_Pipeline {
+	Http *           http;
+	Memory_Allocator allocator;
+	int              depth;
+	int              pending;  // requests sent whose response is not yet received
+	bool             closing;  // server is closing the connection after the last received response
+	bool             broken;   // connection is in an unknown state
+	ptrdiff_t        read_pos;
+	ptrdiff_t        read_length;
+	uint8_t          buffer[HTTP_STREAM_CHUNK_SIZE];
+	Http_Parser      parser;
+};
+
+Http_Pipeline *Http_PipelineBegin(Http *http, int depth, Memory_Allocator allocator) {
+	Http_Pipeline *pipeline = (Http_Pipeline *)MemoryAllocate(sizeof(Http_Pipeline), allocator);
+	if (!pipeline) {
+		LogErrorEx("Http", "Pipeline allocation failed: out of memory");
+		return nullptr;
+	}
+
+	pipeline->http        = http;
+	pipeline->allocator   = allocator;
+	pipeline->depth       = Maximum(depth, 1);
+	pipeline->pending     = 0;
+	pipeline->closing     = false;
+	pipeline->broken      = false;
+	pipeline->read_pos    = 0;
+	pipeline->read_length = 0;
+
+	return pipeline;
+}
+
+bool Http_PipelineEnd(Http_Pipeline *pipeline) {
+	// Unread responses or stray bytes leave the connection unusable for the next request
+	bool reusable = !pipeline->broken && !pipeline->closing && !pipeline->pending && pipeline->read_pos == pipeline->read_length;
+	MemoryFree(pipeline, sizeof(Http_Pipeline), pipeline->allocator);
+	return reusable;
+}
+
+int Http_PipelinePending(Http_Pipeline *pipeline) {
+	return pipeline->pending;
+}
+
+bool Http_PipelineCanSend(Http_Pipeline *pipeline) {
+	return !pipeline->broken && !pipeline->closing && pipeline->pending < pipeline->depth;
+}
+
+bool Http_PipelineSend(Http_Pipeline *pipeline, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req) {
+	if (!Http_PipelineCanSend(pipeline))
+		return false;
+
+	uint8_t buffer[HTTP_STREAM_CHUNK_SIZE];
+
+	ptrdiff_t len = Http_BuildRequest(method, endpoint, &params, req, buffer, HTTP_STREAM_CHUNK_SIZE);
+	if (len < 0) {
+		LogErrorEx("Http", "Writing header failed: out of memory");
+		return false;
+	}
+
+	if (!Http_SendRequest(pipeline->http, String(buffer, len), req)) {
+		pipeline->broken = true;
+		return false;
+	}
+
+	pipeline->pending += 1;
+
+	return true;
+}
+
+bool Http_PipelineReceive(Http_Pipeline *pipeline, Http_Response *res, Http_Writer writer) {
+	if (pipeline->broken || !pipeline->pending)
+		return false;
+
+	Http_Parser *parser = &pipeline->parser;
+	Http_ParserBegin(parser, res, writer);
+
+	while (parser->state != HTTP_PARSER_DONE && parser->state != HTTP_PARSER_ERROR) {
+		if (pipeline->read_pos == pipeline->read_length) {
+			int bytes_read = Http_Receive(pipeline->http, pipeline->buffer, HTTP_STREAM_CHUNK_SIZE);
+			if (bytes_read <= 0) {
+				parser->state = HTTP_PARSER_ERROR;
+				break;
+			}
+			pipeline->read_pos    = 0;
+			pipeline->read_length = bytes_read;
+		}
+
+		uint8_t * data   = pipeline->buffer + pipeline->read_pos;
+		ptrdiff_t length = pipeline->read_length - pipeline->read_pos;
+		pipeline->read_pos += Http_ParserFeed(parser, data, length);
+	}
+
+	// A body that failed to decode was still framed correctly, the connection stays in sync
+	bool framed  = parser->state == HTTP_PARSER_DONE;
+	bool decoded = Http_ParserEnd(parser);
+
+	if (!framed) {
+		pipeline->broken = true;
+		return false;
+	}
+
+	pipeline->pending -= 1;
+
+	// Requests queued behind this response will not be answered
+	if (!Http_IsKeepAlive(*res))
+		pipeline->closing = true;
+
+	return decoded;
+}
+
+bool Http_PipelineReceive(Http_Pipeline *pipeline, Http_Response *res, Memory_Arena *arena) {
+	uint8_t *body = (uint8_t *)MemoryArenaGetCurrent(arena);
+	auto temp     = BeginTemporaryMemory(arena);
+
+	Http_Arena_Writer arena_writer;
+	arena_writer.arena    = arena;
+	arena_writer.last_pos = body;
+	arena_writer.length   = 0;
+	arena_writer.socket   = pipeline->http;
+
+	Http_Writer writer;
+	writer.proc    = Http_ArenaWriterProc;
+	writer.context = &arena_writer;
+
+	bool result = Http_PipelineReceive(pipeline, res, writer);
+	if (result && arena_writer.length >= 0) {
+		res->body = Buffer(body, arena_writer.length);
+		return true;
+	}
+
+	EndTemporaryMemory(&temp);
+
+	return false;
+}
+
 //
 //
 //
@@ -1170,9 +2072,26 @@ Http_Multipart Http_MultipartBegin(Memory_Arena *arena) {
 	mt.memory  = (uint8_t *)MemoryArenaGetCurrent(arena);
 	mt.current = mt.memory;
 	mt.length  = 0;
+	mt.segment_count = 0;
 	return mt;
 }
 
+// Bytes written to the arena since the last referenced content become a segment of their own
+static bool Http_MultipartCloseRun(Http_Multipart *mt) {
+	ptrdiff_t length = mt->current - mt->memory;
+	if (!length)
+		return true;
+
+	if (mt->segment_count == HTTP_MULTIPART_MAX_SEGMENTS) {
+		LogErrorEx("Http", "Could not add data to multipart. Reason: Too many segments");
+		return false;
+	}
+
+	mt->segments[mt->segment_count++] = Buffer(mt->memory, length);
+	mt->memory = mt->current;
+	return true;
+}
+
 bool Http_MultipartData(Http_Multipart *mt, String content, String content_disposition) {
 	uint8_t header[HTTP_MAX_HEADER_SIZE];
 
@@ -1235,7 +2154,60 @@ bool Http_MultipartData(Http_Multipart *mt, String content, String content_type,
 	return true;
 }
 
+bool Http_MultipartReference(Http_Multipart *mt, Buffer content, String content_type, String content_disposition) {
+	uint8_t header[HTTP_MAX_HEADER_SIZE];
+
+	int hlen = snprintf((char *)header, HTTP_MAX_HEADER_SIZE,
+		"--" StrFmt "\r\n"
+		"Content-Disposition: form-data; " StrFmt "\r\n"
+		"Content-Type: " StrFmt "\r\n\r\n",
+		StrArg(String(mt->boundary, HTTP_MULTIPART_LENGTH)),
+		StrArg(content_disposition),
+		StrArg(content_type));
+
+	// The header and the CRLF following the content are written to the arena, the content is referenced
+	uint8_t *dst = (uint8_t *)PushSize(mt->arena, hlen);
+	if (!dst) {
+		LogErrorEx("Http", "Could not add data to multipart. Reason: Out of memory");
+		return false;
+	}
+
+	Assert(dst == mt->current);
+
+	memcpy(dst, header, hlen);
+	mt->current = dst + hlen;
+
+	if (!Http_MultipartCloseRun(mt))
+		return false;
+
+	if (mt->segment_count == HTTP_MULTIPART_MAX_SEGMENTS) {
+		LogErrorEx("Http", "Could not add data to multipart. Reason: Too many segments");
+		return false;
+	}
+
+	mt->segments[mt->segment_count++] = content;
+
+	dst = (uint8_t *)PushSize(mt->arena, 2);
+	if (!dst) {
+		LogErrorEx("Http", "Could not add data to multipart. Reason: Out of memory");
+		return false;
+	}
+
+	dst[0] = '\r';
+	dst[1] = '\n';
+
+	mt->length += hlen + content.length + 2;
+	mt->current = dst + 2;
+
+	return true;
+}
+
 String Http_MultipartEnd(Http_Multipart *mt) {
+	if (mt->segment_count) {
+		LogErrorEx("Http", "Multipart with referenced content must be ended with Http_MultipartEndSegments");
+		return String();
+	}
+
 	uint8_t *dst = (uint8_t *)PushSize(mt->arena, 2 + HTTP_MULTIPART_LENGTH + 2);
 	if (!dst)
 		return String();
@@ -1252,3 +2224,1173 @@ String Http_MultipartEnd(Http_Multipart *mt) {
 
 	return String(mt->memory, mt->length);
 }
+
+Array_View<Buffer> Http_MultipartEndSegments(Http_Multipart *mt) {
+	uint8_t *dst = (uint8_t *)PushSize(mt->arena, 2 + HTTP_MULTIPART_LENGTH + 2);
+	if (!dst)
+		return Array_View<Buffer>();
+
+	Assert(dst == mt->current);
+
+	memcpy(dst + 2, mt->boundary, HTTP_MULTIPART_LENGTH);
+	dst[0] = '-';
+	dst[1] = '-';
+	dst[HTTP_MULTIPART_LENGTH + 2 + 0] = '-';
+	dst[HTTP_MULTIPART_LENGTH + 2 + 1] = '-';
+	mt->length += (2 + HTTP_MULTIPART_LENGTH + 2);
+	mt->current = dst + 2 + HTTP_MULTIPART_LENGTH + 2;
+
+	if (!Http_MultipartCloseRun(mt))
+		return Array_View<Buffer>();
+
+	Buffer *segments = (Buffer *)PushSize(mt->arena, sizeof(Buffer) * mt->segment_count);
+	if (!segments)
+		return Array_View<Buffer>();
+
+	memcpy(segments, mt->segments, sizeof(Buffer) * mt->segment_count);
+
+	return Array_View<Buffer>(segments, mt->segment_count);
+}
+
+//
+//
+//
+
+#if PLATFORM_WINDOWS
+
+bool Http_MapFile(const String path, Buffer *content) {
+	wchar_t wpath[1024];
+	int wlen = MultiByteToWideChar(CP_UTF8, 0, (char *)path.data, (int)path.length, wpath, ArrayCount(wpath) - 1);
+	if (!wlen) {
+		LogErrorEx("Http", "Invalid file path: " StrFmt, StrArg(path));
+		return false;
+	}
+	wpath[wlen] = 0;
+
+	HANDLE file = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		LogErrorEx("Http", "Failed to open file: " StrFmt, StrArg(path));
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		LogErrorEx("Http", "Failed to get size of file: " StrFmt, StrArg(path));
+		CloseHandle(file);
+		return false;
+	}
+
+	*content = Buffer();
+
+	if (size.QuadPart) {
+		// The view keeps the file mapped after the handles are closed
+		HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		void *view     = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (mapping) CloseHandle(mapping);
+		if (!view) {
+			LogErrorEx("Http", "Failed to map file: " StrFmt, StrArg(path));
+			CloseHandle(file);
+			return false;
+		}
+		*content = Buffer((uint8_t *)view, (ptrdiff_t)size.QuadPart);
+	}
+
+	CloseHandle(file);
+	return true;
+}
+
+void Http_UnmapFile(Buffer content) {
+	if (content.length)
+		UnmapViewOfFile(content.data);
+}
+
+#elif PLATFORM_LINUX || PLATFORM_MAC
+
+bool Http_MapFile(const String path, Buffer *content) {
+	char cpath[4096];
+	if (path.length >= (ptrdiff_t)sizeof(cpath)) {
+		LogErrorEx("Http", "Invalid file path: " StrFmt, StrArg(path));
+		return false;
+	}
+	memcpy(cpath, path.data, path.length);
+	cpath[path.length] = 0;
+
+	int fd = open(cpath, O_RDONLY);
+	if (fd < 0) {
+		LogErrorEx("Http", "Failed to open file: " StrFmt, StrArg(path));
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		LogErrorEx("Http", "Failed to get size of file: " StrFmt, StrArg(path));
+		close(fd);
+		return false;
+	}
+
+	*content = Buffer();
+
+	if (st.st_size) {
+		void *view = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view == MAP_FAILED) {
+			LogErrorEx("Http", "Failed to map file: " StrFmt, StrArg(path));
+			close(fd);
+			return false;
+		}
+		// Pages are read in as they are sent
+		madvise(view, st.st_size, MADV_SEQUENTIAL);
+		*content = Buffer((uint8_t *)view, (ptrdiff_t)st.st_size);
+	}
+
+	close(fd);
+	return true;
+}
+
+void Http_UnmapFile(Buffer content) {
+	if (content.length)
+		munmap(content.data, content.length);
+}
+
+#endif
+
+//
+// Downloads
+//
+
+#if PLATFORM_WINDOWS
+
+typedef HANDLE Http_File;
+static const Http_File HttpInvalidFile = INVALID_HANDLE_VALUE;
+
+static bool Http_FilePath(const String path, wchar_t *buffer, int length) {
+	int wlen = MultiByteToWideChar(CP_UTF8, 0, (char *)path.data, (int)path.length, buffer, length - 1);
+	buffer[wlen] = 0;
+	return wlen != 0;
+}
+
+static Http_File Http_FileOpen(const String path, bool create) {
+	wchar_t wpath[1024];
+	if (!Http_FilePath(path, wpath, ArrayCount(wpath)))
+		return HttpInvalidFile;
+	return CreateFileW(wpath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+}
+
+static void Http_FileClose(Http_File file) {
+	CloseHandle(file);
+}
+
+static bool Http_FileDelete(const String path) {
+	wchar_t wpath[1024];
+	return Http_FilePath(path, wpath, ArrayCount(wpath)) && DeleteFileW(wpath);
+}
+
+static int64_t Http_FileSize(Http_File file) {
+	LARGE_INTEGER size;
+	return GetFileSizeEx(file, &size) ? size.QuadPart : -1;
+}
+
+static bool Http_FileResize(Http_File file, int64_t length) {
+	LARGE_INTEGER offset;
+	offset.QuadPart = length;
+	return SetFilePointerEx(file, offset, nullptr, FILE_BEGIN) && SetEndOfFile(file);
+}
+
+static bool Http_FileWrite(Http_File file, int64_t offset, const void *data, ptrdiff_t length) {
+	const uint8_t *src = (const uint8_t *)data;
+	while (length) {
+		OVERLAPPED overlapped = {};
+		overlapped.Offset     = (DWORD)offset;
+		overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+		DWORD written = 0;
+		if (!WriteFile(file, src, (DWORD)Minimum(length, (ptrdiff_t)MegaBytes(64)), &written, &overlapped) || !written)
+			return false;
+
+		src    += written;
+		offset += written;
+		length -= written;
+	}
+	return true;
+}
+
+static bool Http_FileRead(Http_File file, int64_t offset, void *data, ptrdiff_t length) {
+	OVERLAPPED overlapped = {};
+	overlapped.Offset     = (DWORD)offset;
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+
+	DWORD read = 0;
+	return ReadFile(file, data, (DWORD)length, &read, &overlapped) && read == (DWORD)length;
+}
+
+#elif PLATFORM_LINUX || PLATFORM_MAC
+
+typedef int Http_File;
+static const Http_File HttpInvalidFile = -1;
+
+static bool Http_FilePath(const String path, char *buffer, ptrdiff_t length) {
+	if (path.length >= length)
+		return false;
+	memcpy(buffer, path.data, path.length);
+	buffer[path.length] = 0;
+	return true;
+}
+
+static Http_File Http_FileOpen(const String path, bool create) {
+	char cpath[4096];
+	if (!Http_FilePath(path, cpath, sizeof(cpath)))
+		return HttpInvalidFile;
+	return open(cpath, create ? O_RDWR | O_CREAT : O_RDWR, 0644);
+}
+
+static void Http_FileClose(Http_File file) {
+	close(file);
+}
+
+static bool Http_FileDelete(const String path) {
+	char cpath[4096];
+	return Http_FilePath(path, cpath, sizeof(cpath)) && unlink(cpath) == 0;
+}
+
+static int64_t Http_FileSize(Http_File file) {
+	struct stat st;
+	return fstat(file, &st) == 0 ? (int64_t)st.st_size : -1;
+}
+
+static bool Http_FileResize(Http_File file, int64_t length) {
+	if (ftruncate(file, length) != 0)
+		return false;
+#if PLATFORM_LINUX
+	// Reserves the blocks up front so that parallel writes don't fragment the file, not every file system supports it
+	if (length) posix_fallocate(file, 0, length);
+#endif
+	return true;
+}
+
+static bool Http_FileWrite(Http_File file, int64_t offset, const void *data, ptrdiff_t length) {
+	const uint8_t *src = (const uint8_t *)data;
+	while (length) {
+		ssize_t written = pwrite(file, src, length, offset);
+		if (written <= 0)
+			return false;
+		src    += written;
+		offset += written;
+		length -= written;
+	}
+	return true;
+}
+
+static bool Http_FileRead(Http_File file, int64_t offset, void *data, ptrdiff_t length) {
+	return pread(file, data, length, offset) == length;
+}
+
+#endif
+
+constexpr uint32_t HTTP_DOWNLOAD_MAGIC         = 0x314c444b; // "KDL1"
+constexpr int      HTTP_DOWNLOAD_MAX_VALIDATOR = 128;
+constexpr int      HTTP_DOWNLOAD_MAX_WORKERS   = 16;
+constexpr int      HTTP_DOWNLOAD_MAX_PATH      = 1024;
+constexpr int      HTTP_DOWNLOAD_RETRY_DELAY   = 250; // ms, doubled on every retry of a chunk
+constexpr int      HTTP_DOWNLOAD_MAX_DELAY     = 4000;
+
+// Header of the progress file, followed by one byte per chunk that is set once the chunk is written
+struct Http_Download_State {
+	uint32_t magic;
+	uint32_t chunk_size;
+	int64_t  length;
+	int32_t  validator_length;
+	uint8_t  validator[HTTP_DOWNLOAD_MAX_VALIDATOR]; // ETag or Last-Modified of the resource
+};
+
+struct Http_Download_Job {
+	Http_Pool *         pool;
+	String              endpoint;
+	Http_File           file;
+	Http_File           progress;
+	Http_Download_State state;
+	int32_t             chunk_count;
+	uint8_t *           done;
+	uint32_t            retries;
+	volatile int32_t    next;
+	volatile int32_t    failed;
+};
+
+struct Http_Download_Writer {
+	Http_File       file;
+	Http_Response * response;
+	int64_t         offset;
+	int64_t         expected; // -1 when unknown
+	int64_t         written;
+	bool            ranged;   // cleared when the server answers with the whole resource
+	bool            probe;    // only the first request may write the whole resource
+	bool            failed;
+};
+
+static void Http_DownloadWriterProc(Http_Header &header, uint8_t *buffer, ptrdiff_t length, void *context) {
+	Http_Download_Writer *writer = (Http_Download_Writer *)context;
+	if (writer->failed)
+		return;
+
+	if (writer->written == 0 && writer->ranged && writer->response->status.code == 200) {
+		// Other chunks are being written in parallel, the body of a worker must not overwrite them
+		if (!writer->probe) {
+			writer->failed = true;
+			return;
+		}
+
+		// Range was ignored, the body is the whole resource
+		writer->ranged   = false;
+		writer->offset   = 0;
+		writer->expected = -1;
+	}
+
+	if (writer->expected >= 0 && writer->written + length > writer->expected) {
+		LogErrorEx("Http", "Download received more data than requested");
+		writer->failed = true;
+		return;
+	}
+
+	if (!Http_FileWrite(writer->file, writer->offset + writer->written, buffer, length)) {
+		LogErrorEx("Http", "Download could not be written to the file");
+		writer->failed = true;
+		return;
+	}
+
+	writer->written += length;
+}
+
+static String Http_DownloadValidator(Http_Response *res) {
+	String validator = Http_GetHeader(res, HTTP_HEADER_ETAG);
+	if (!validator.length)
+		validator = Http_GetHeader(res, HTTP_HEADER_LAST_MODIFIED);
+	return validator.length <= HTTP_DOWNLOAD_MAX_VALIDATOR ? validator : String();
+}
+
+// Content-Range: bytes first-last/length
+static bool Http_DownloadParseRange(Http_Response *res, int64_t *first, int64_t *last, int64_t *length) {
+	String range = Http_GetHeader(res, HTTP_HEADER_CONTENT_RANGE);
+	if (!StrStartsWithICase(range, "bytes "))
+		return false;
+
+	range = StrTrim(SubStr(range, 6));
+
+	ptrdiff_t dash  = StrFindChar(range, '-');
+	ptrdiff_t slash = StrFindChar(range, '/');
+	if (dash < 0 || slash < dash)
+		return false;
+
+	ptrdiff_t a, b, total;
+	if (!ParseInt(SubStr(range, 0, dash), &a) || !ParseInt(SubStr(range, dash + 1, slash - dash - 1), &b) || !ParseInt(SubStr(range, slash + 1), &total))
+		return false;
+
+	*first  = a;
+	*last   = b;
+	*length = total;
+	return a <= b && b < total;
+}
+
+static void Http_DownloadInitRequest(Http *http, Http_Request *req, int64_t first, int64_t last) {
+	Http_InitRequest(req);
+	Http_SetHost(req, http);
+	Http_SetHeader(req, HTTP_HEADER_CONNECTION, "keep-alive");
+	// Ranges are of the stored bytes, an encoded body could not be written in place
+	Http_SetHeader(req, HTTP_HEADER_ACCEPT_ENCODING, "identity");
+	Http_SetHeaderFmt(req, HTTP_HEADER_RANGE, "bytes=%lld-%lld", (long long)first, (long long)last);
+}
+
+static bool Http_DownloadChunk(Http_Download_Job *download, int32_t chunk) {
+	int64_t first  = (int64_t)chunk * download->state.chunk_size;
+	int64_t length = Minimum((int64_t)download->state.chunk_size, download->state.length - first);
+	String expected_validator(download->state.validator, download->state.validator_length);
+
+	Http_Request req;
+	Http_Response res;
+
+	for (uint32_t attempt = 0; attempt <= download->retries; ++attempt) {
+		if (attempt)
+			Thread_Sleep(Minimum(HTTP_DOWNLOAD_RETRY_DELAY << Minimum(attempt - 1, 4u), HTTP_DOWNLOAD_MAX_DELAY));
+
+		Http *http = Http_PoolCheckout(download->pool);
+		if (!http) {
+			LogWarningEx("Http", "Download of range %lld-%lld could not get a connection, retrying", (long long)first, (long long)(first + length - 1));
+			continue;
+		}
+
+		Http_DownloadInitRequest(http, &req, first, first + length - 1);
+
+		Http_Download_Writer writer = { download->file, &res, first, length, 0, true, false, false };
+		Http_Writer proc = { Http_DownloadWriterProc, &writer };
+
+		bool received = Http_Get(http, download->endpoint, req, &res, proc);
+		Http_PoolCheckin(download->pool, http, received && Http_IsKeepAlive(res));
+
+		int64_t a, b, total;
+		if (received && res.status.code == 206 && !writer.failed && writer.written == length &&
+			Http_DownloadParseRange(&res, &a, &b, &total) && a == first && b == first + length - 1 &&
+			total == download->state.length && Http_DownloadValidator(&res) == expected_validator) {
+			download->done[chunk] = 1;
+			Http_FileWrite(download->progress, sizeof(Http_Download_State) + chunk, &download->done[chunk], 1);
+			return true;
+		}
+
+		if (received && (res.status.code == 200 || (res.status.code == 206 && total != download->state.length))) {
+			LogErrorEx("Http", "Resource changed during download: " StrFmt, StrArg(download->endpoint));
+			return false;
+		}
+
+		LogWarningEx("Http", "Download of range %lld-%lld failed (status: %u), retrying", (long long)first, (long long)(first + length - 1), received ? res.status.code : 0);
+	}
+
+	return false;
+}
+
+static int Http_DownloadWorkerProc(void *arg) {
+	Http_Download_Job *download = (Http_Download_Job *)arg;
+
+	while (!AtomicLoad(&download->failed)) {
+		int32_t chunk = AtomicAdd(&download->next, 1) - 1;
+		if (chunk >= download->chunk_count)
+			break;
+		if (download->done[chunk])
+			continue;
+		if (!Http_DownloadChunk(download, chunk))
+			AtomicStore(&download->failed, 1);
+	}
+
+	return 0;
+}
+
+// Loads the progress of an earlier download, the first missing chunk is returned or -1 if there is none to resume
+static int32_t Http_DownloadLoadProgress(Http_Download_Job *download, Memory_Allocator allocator) {
+	Http_Download_State state;
+	if (!Http_FileRead(download->progress, 0, &state, sizeof(state)) || state.magic != HTTP_DOWNLOAD_MAGIC ||
+		!state.chunk_size || state.length <= 0 || state.validator_length < 0 || state.validator_length > HTTP_DOWNLOAD_MAX_VALIDATOR ||
+		Http_FileSize(download->file) != state.length)
+		return -1;
+
+	int64_t count = (state.length + state.chunk_size - 1) / state.chunk_size;
+	if (count > INT32_MAX)
+		return -1;
+
+	uint8_t *done = (uint8_t *)MemoryAllocate(count, allocator);
+	if (!done)
+		return -1;
+
+	if (!Http_FileRead(download->progress, sizeof(state), done, count)) {
+		MemoryFree(done, count, allocator);
+		return -1;
+	}
+
+	download->state       = state;
+	download->chunk_count = (int32_t)count;
+	download->done        = done;
+
+	for (int32_t chunk = 0; chunk < download->chunk_count; ++chunk) {
+		if (!done[chunk])
+			return chunk;
+	}
+
+	return download->chunk_count;
+}
+
+static bool Http_DownloadSaveProgress(Http_Download_Job *download) {
+	return Http_FileResize(download->progress, 0) &&
+		Http_FileWrite(download->progress, 0, &download->state, sizeof(download->state)) &&
+		Http_FileWrite(download->progress, sizeof(download->state), download->done, download->chunk_count);
+}
+
+bool Http_Download(Http_Pool *pool, const String endpoint, const String path, Http_Download_Spec spec, Memory_Allocator allocator) {
+	char progress_path[HTTP_DOWNLOAD_MAX_PATH];
+	int progress_length = snprintf(progress_path, sizeof(progress_path), StrFmt ".download", StrArg(path));
+	if (progress_length <= 0 || progress_length >= (int)sizeof(progress_path)) {
+		LogErrorEx("Http", "Download path too long: " StrFmt, StrArg(path));
+		return false;
+	}
+	String progress_name(progress_path, progress_length);
+
+	Http_Download_Job download = {};
+	download.pool     = pool;
+	download.endpoint = endpoint;
+	download.retries  = spec.retries;
+	download.file     = Http_FileOpen(path, true);
+	download.progress = Http_FileOpen(progress_name, true);
+
+	if (download.file == HttpInvalidFile || download.progress == HttpInvalidFile) {
+		LogErrorEx("Http", "Download file could not be opened: " StrFmt, StrArg(path));
+		if (download.file != HttpInvalidFile) Http_FileClose(download.file);
+		if (download.progress != HttpInvalidFile) Http_FileClose(download.progress);
+		return false;
+	}
+
+	spec.chunk_size = Maximum(spec.chunk_size, KiloBytes(64));
+
+	int32_t resume = Http_DownloadLoadProgress(&download, allocator);
+
+	// The first request learns the length and whether ranges are supported, it fetches the first missing chunk
+	int64_t probe_first = resume > 0 ? (int64_t)resume * download.state.chunk_size : 0;
+	int64_t probe_size  = resume >= 0 ? download.state.chunk_size : spec.chunk_size;
+
+	bool succeeded = false;
+
+	Http_Request req;
+	Http_Response res;
+	Http_Download_Writer writer = { download.file, &res, probe_first, probe_size, 0, true, true, false };
+
+	if (resume >= 0 && resume == download.chunk_count) {
+		succeeded = true;
+	} else if (Http *http = Http_PoolCheckout(pool)) {
+		Http_DownloadInitRequest(http, &req, probe_first, probe_first + probe_size - 1);
+
+		Http_Writer proc = { Http_DownloadWriterProc, &writer };
+		bool received = Http_Get(http, endpoint, req, &res, proc);
+		Http_PoolCheckin(pool, http, received && Http_IsKeepAlive(res));
+
+		int64_t first, last, total;
+
+		if (!received || writer.failed) {
+			LogErrorEx("Http", "Download failed: " StrFmt, StrArg(endpoint));
+		} else if (res.status.code == 200) {
+			// No ranges, the whole resource was written by this request
+			ptrdiff_t content_length = -1;
+			String value = Http_GetHeader(&res, HTTP_HEADER_CONTENT_LENGTH);
+			if (value.length && (!ParseInt(value, &content_length) || content_length != writer.written)) {
+				LogErrorEx("Http", "Download length does not match Content-Length: " StrFmt, StrArg(endpoint));
+			} else {
+				succeeded = Http_FileResize(download.file, writer.written);
+			}
+			download.chunk_count = 0;
+		} else if (res.status.code == 416 && Http_GetHeader(&res, HTTP_HEADER_CONTENT_RANGE) == "bytes */0") {
+			succeeded = Http_FileResize(download.file, 0);
+			download.chunk_count = 0;
+		} else if (res.status.code == 206 && Http_DownloadParseRange(&res, &first, &last, &total) && first == probe_first && writer.written == last - first + 1) {
+			String validator = Http_DownloadValidator(&res);
+
+			if (resume >= 0 && (total != download.state.length || validator != String(download.state.validator, download.state.validator_length))) {
+				LogWarningEx("Http", "Resource changed since the download was interrupted, restarting: " StrFmt, StrArg(endpoint));
+				memset(download.done, 0, download.chunk_count);
+				if (probe_first || total != download.state.length) {
+					MemoryFree(download.done, download.chunk_count, allocator);
+					download.done = nullptr;
+					resume        = -1;
+				}
+			}
+
+			if (resume < 0) {
+				download.state.magic            = HTTP_DOWNLOAD_MAGIC;
+				download.state.chunk_size       = spec.chunk_size;
+				download.state.length           = total;
+				download.state.validator_length = (int32_t)validator.length;
+				memcpy(download.state.validator, validator.data, validator.length);
+
+				int64_t count = (total + spec.chunk_size - 1) / spec.chunk_size;
+				download.chunk_count = count <= INT32_MAX ? (int32_t)count : 0;
+				download.done        = download.chunk_count ? (uint8_t *)MemoryAllocate(download.chunk_count, allocator) : nullptr;
+				if (download.done)
+					memset(download.done, 0, download.chunk_count);
+			} else {
+				download.state.validator_length = (int32_t)validator.length;
+				memcpy(download.state.validator, validator.data, validator.length);
+			}
+
+			bool complete = writer.written == Minimum(probe_size, total - probe_first);
+
+			if (!download.done) {
+				LogErrorEx("Http", "Failed to allocate memory for download progress");
+			} else if (!complete || !Http_FileResize(download.file, total)) {
+				LogErrorEx("Http", "Download could not be started: " StrFmt, StrArg(endpoint));
+			} else {
+				// After a restart the probe was fetched with the previous chunk size, so only the
+				// chunks it fully covers are marked
+				int64_t chunk_size = download.state.chunk_size;
+				int64_t covered    = probe_first + writer.written;
+				for (int64_t chunk = (probe_first + chunk_size - 1) / chunk_size;
+					chunk < download.chunk_count && Minimum((chunk + 1) * chunk_size, total) <= covered; ++chunk)
+					download.done[chunk] = 1;
+
+				if (!Http_DownloadSaveProgress(&download))
+					LogWarningEx("Http", "Download progress could not be saved, it can not be resumed");
+
+				Thread_Context_Params params = ThreadContextDefaultParams;
+				params.logger                = ThreadContext.logger;
+
+				Thread *workers[HTTP_DOWNLOAD_MAX_WORKERS];
+				int32_t worker_count = Clamp(1, HTTP_DOWNLOAD_MAX_WORKERS, (int32_t)spec.connections) - 1;
+				worker_count         = Minimum(worker_count, download.chunk_count - 1);
+
+				int32_t started = 0;
+				for (; started < worker_count; ++started) {
+					workers[started] = Thread_Create(Http_DownloadWorkerProc, &download, 0, params);
+					if (!workers[started])
+						break;
+				}
+
+				// The calling thread is one of the workers
+				Http_DownloadWorkerProc(&download);
+
+				for (int32_t index = 0; index < started; ++index) {
+					Thread_Wait(workers[index], -1);
+					Thread_Destroy(workers[index]);
+				}
+
+				succeeded = !download.failed;
+				for (int32_t chunk = 0; succeeded && chunk < download.chunk_count; ++chunk)
+					succeeded = download.done[chunk] != 0;
+			}
+		} else {
+			LogErrorEx("Http", "Download failed with status %u: " StrFmt, res.status.code, StrArg(endpoint));
+		}
+	}
+
+	if (download.done)
+		MemoryFree(download.done, download.chunk_count, allocator);
+
+	Http_FileClose(download.file);
+	Http_FileClose(download.progress);
+
+	// The progress is kept for failed downloads so that they are resumed by the next call
+	if (succeeded || download.chunk_count == 0)
+		Http_FileDelete(progress_name);
+
+	return succeeded;
+}
+
+bool Http_Download(const String url, const String path, Http_Download_Spec spec, Memory_Allocator allocator) {
+	ptrdiff_t scheme = StrFind(url, "://");
+	ptrdiff_t slash  = StrFindChar(url, '/', scheme >= 0 ? scheme + 3 : 0);
+
+	String host     = slash >= 0 ? SubStr(url, 0, slash) : url;
+	String endpoint = slash >= 0 ? SubStr(url, slash) : String("/");
+
+	Http_Pool_Spec pool_spec  = HttpPoolDefaultSpec;
+	pool_spec.max_connections = Clamp(1, HTTP_DOWNLOAD_MAX_WORKERS, (int32_t)spec.connections);
+
+	Http_Pool *pool = Http_CreatePool(host, HTTP_DEFAULT, pool_spec, allocator);
+	if (!pool)
+		return false;
+
+	bool succeeded = Http_Download(pool, endpoint, path, spec, allocator);
+	Http_DestroyPool(pool);
+
+	return succeeded;
+}
+
+//
+// Asset Cache
+//
+
+#if PLATFORM_WINDOWS
+
+static bool Http_FileRename(const String from, const String to) {
+	wchar_t wfrom[1024], wto[1024];
+	return Http_FilePath(from, wfrom, ArrayCount(wfrom)) && Http_FilePath(to, wto, ArrayCount(wto)) && MoveFileExW(wfrom, wto, MOVEFILE_REPLACE_EXISTING);
+}
+
+static bool Http_CreateDirectory(const String path) {
+	wchar_t wpath[1024];
+	return Http_FilePath(path, wpath, ArrayCount(wpath)) && (CreateDirectoryW(wpath, nullptr) || GetLastError() == ERROR_ALREADY_EXISTS);
+}
+
+typedef void(*Http_Directory_Proc)(const String name, int64_t size, uint64_t modified, void *context);
+
+static bool Http_ListDirectory(const String path, Http_Directory_Proc proc, void *context) {
+	wchar_t wpath[1024];
+	if (!Http_FilePath(path, wpath, ArrayCount(wpath) - 2))
+		return false;
+	wcscat(wpath, L"\\*");
+
+	WIN32_FIND_DATAW data;
+	HANDLE find = FindFirstFileW(wpath, &data);
+	if (find == INVALID_HANDLE_VALUE)
+		return false;
+
+	do {
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		char name[MAX_PATH * 3];
+		int length = WideCharToMultiByte(CP_UTF8, 0, data.cFileName, -1, name, sizeof(name), nullptr, nullptr);
+		if (length <= 1)
+			continue;
+		int64_t  size     = ((int64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+		uint64_t modified = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+		proc(String(name, length - 1), size, modified, context);
+	} while (FindNextFileW(find, &data));
+
+	FindClose(find);
+	return true;
+}
+
+#elif PLATFORM_LINUX || PLATFORM_MAC
+
+static bool Http_FileRename(const String from, const String to) {
+	char cfrom[4096], cto[4096];
+	return Http_FilePath(from, cfrom, sizeof(cfrom)) && Http_FilePath(to, cto, sizeof(cto)) && rename(cfrom, cto) == 0;
+}
+
+static bool Http_CreateDirectory(const String path) {
+	char cpath[4096];
+	return Http_FilePath(path, cpath, sizeof(cpath)) && (mkdir(cpath, 0755) == 0 || errno == EEXIST);
+}
+
+typedef void(*Http_Directory_Proc)(const String name, int64_t size, uint64_t modified, void *context);
+
+static bool Http_ListDirectory(const String path, Http_Directory_Proc proc, void *context) {
+	char cpath[4096];
+	if (!Http_FilePath(path, cpath, sizeof(cpath)))
+		return false;
+
+	DIR *dir = opendir(cpath);
+	if (!dir)
+		return false;
+
+	int fd = dirfd(dir);
+	while (struct dirent *ent = readdir(dir)) {
+		struct stat st;
+		if (fstatat(fd, ent->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+			continue;
+		proc(String(ent->d_name, strlen(ent->d_name)), (int64_t)st.st_size, (uint64_t)st.st_mtime, context);
+	}
+
+	closedir(dir);
+	return true;
+}
+
+#endif
+
+constexpr int HTTP_CACHE_NAME_LENGTH = 40; // hex digest of the endpoint
+constexpr int HTTP_CACHE_MAX_PATH    = 1024;
+
+enum Http_Cache_State {
+	HTTP_CACHE_FETCHING,
+	HTTP_CACHE_READY,
+	HTTP_CACHE_FAILED,
+};
+
+struct Http_Cache_Entry {
+	uint64_t           key;
+	int64_t            size;
+	uint64_t           modified;
+	Http_Cache_State   state;
+	int32_t            refs;    // acquired assets and threads waiting for the fetch, entries in use are not evicted
+	int32_t            waiters;
+	Semaphore *        fetched; // signalled once for each waiter when the fetch completes
+	Http_Cache_Entry * prev;
+	Http_Cache_Entry * next;
+	char               name[HTTP_CACHE_NAME_LENGTH + 1];
+};
+
+struct Http_Cache {
+	Memory_Allocator                        allocator;
+	Http_Cache_Spec                         spec;
+	Http_Pool *                             pool;
+	Atomic_Guard                            guard; // protects everything below
+	Hash_Table<uint64_t, Http_Cache_Entry*> entries;
+	Http_Cache_Entry                        lru;   // sentinel, most recently used after it
+	uint64_t                                size;
+	ptrdiff_t                               length;
+	char                                    directory[HTTP_CACHE_MAX_PATH];
+};
+
+static String Http_CachePath(Http_Cache *cache, const char *name, const char *suffix, char *buffer, int size) {
+	int length = snprintf(buffer, size, "%.*s/%s%s", (int)cache->length, cache->directory, name, suffix);
+	return String(buffer, Clamp(0, size - 1, length));
+}
+
+static void Http_CacheUnlink(Http_Cache_Entry *entry) {
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+	entry->prev       = entry;
+	entry->next       = entry;
+}
+
+static void Http_CacheLinkFront(Http_Cache *cache, Http_Cache_Entry *entry) {
+	entry->prev           = &cache->lru;
+	entry->next           = cache->lru.next;
+	cache->lru.next->prev = entry;
+	cache->lru.next       = entry;
+}
+
+static Http_Cache_Entry *Http_CacheAllocEntry(Http_Cache *cache, uint64_t key) {
+	Http_Cache_Entry *entry = (Http_Cache_Entry *)MemoryAllocate(sizeof(Http_Cache_Entry), cache->allocator);
+	if (entry) {
+		memset(entry, 0, sizeof(*entry));
+		entry->key  = key;
+		entry->prev = entry;
+		entry->next = entry;
+	}
+	return entry;
+}
+
+static void Http_CacheFreeEntry(Http_Cache *cache, Http_Cache_Entry *entry) {
+	MemoryFree(entry, sizeof(*entry), cache->allocator);
+}
+
+// Detaches least recently used entries that are not in use until the cache fits the budget,
+// the detached entries are returned as a list whose files are deleted outside of the lock
+static Http_Cache_Entry *Http_CacheEvict(Http_Cache *cache) {
+	Http_Cache_Entry *evicted = nullptr;
+	Http_Cache_Entry *entry   = cache->lru.prev;
+
+	while (cache->size > cache->spec.budget && entry != &cache->lru) {
+		Http_Cache_Entry *prev = entry->prev;
+		if (entry->refs == 0) {
+			Http_CacheUnlink(entry);
+			cache->entries.Remove(entry->key);
+			cache->size -= entry->size;
+			entry->next  = evicted;
+			evicted      = entry;
+		}
+		entry = prev;
+	}
+
+	return evicted;
+}
+
+static void Http_CacheDeleteEvicted(Http_Cache *cache, Http_Cache_Entry *evicted) {
+	while (evicted) {
+		Http_Cache_Entry *next = evicted->next;
+		char buffer[HTTP_CACHE_MAX_PATH + 64];
+		Http_FileDelete(Http_CachePath(cache, evicted->name, "", buffer, sizeof(buffer)));
+		Http_CacheFreeEntry(cache, evicted);
+		evicted = next;
+	}
+}
+
+static bool Http_CacheParseName(const String name, uint64_t *key) {
+	if (name.length != HTTP_CACHE_NAME_LENGTH)
+		return false;
+
+	uint64_t value = 0;
+	for (ptrdiff_t index = 0; index < name.length; ++index) {
+		uint8_t ch = name[index];
+		uint8_t digit;
+		if (ch >= '0' && ch <= '9')      digit = ch - '0';
+		else if (ch >= 'a' && ch <= 'f') digit = ch - 'a' + 10;
+		else return false;
+		if (index < 16)
+			value = (value << 4) | digit;
+	}
+
+	*key = value;
+	return true;
+}
+
+static void Http_CacheLoadProc(const String name, int64_t size, uint64_t modified, void *context) {
+	Http_Cache *cache = (Http_Cache *)context;
+
+	uint64_t key;
+	if (!Http_CacheParseName(name, &key)) {
+		// Left over from an interrupted fetch
+		if (name.length > HTTP_CACHE_NAME_LENGTH && StrEndsWith(name, ".tmp")) {
+			char buffer[HTTP_CACHE_MAX_PATH + 64];
+			int length = snprintf(buffer, sizeof(buffer), "%.*s/" StrFmt, (int)cache->length, cache->directory, StrArg(name));
+			Http_FileDelete(String(buffer, Clamp(0, (int)sizeof(buffer) - 1, length)));
+		}
+		return;
+	}
+
+	Http_Cache_Entry *entry = Http_CacheAllocEntry(cache, key);
+	if (!entry)
+		return;
+
+	entry->size     = size;
+	entry->modified = modified;
+	entry->state    = HTTP_CACHE_READY;
+	memcpy(entry->name, name.data, HTTP_CACHE_NAME_LENGTH);
+
+	// Older files are placed behind newer ones so the order survives restarts
+	Http_Cache_Entry *after = &cache->lru;
+	while (after->next != &cache->lru && after->next->modified > modified)
+		after = after->next;
+
+	entry->prev       = after;
+	entry->next       = after->next;
+	after->next->prev = entry;
+	after->next       = entry;
+
+	cache->entries.Put(key, entry);
+	cache->size += size;
+}
+
+Http_Cache *Http_CreateCache(const String hostname, const String directory, Http_Cache_Spec spec, Memory_Allocator allocator) {
+	if (directory.length >= HTTP_CACHE_MAX_PATH) {
+		LogErrorEx("Http", "Cache directory path too long: " StrFmt, StrArg(directory));
+		return nullptr;
+	}
+
+	if (!Http_CreateDirectory(directory)) {
+		LogErrorEx("Http", "Cache directory could not be created: " StrFmt, StrArg(directory));
+		return nullptr;
+	}
+
+	Http_Cache *cache = (Http_Cache *)MemoryAllocate(sizeof(Http_Cache), allocator);
+	if (!cache) {
+		LogErrorEx("Http", "Failed to allocate memory for asset cache");
+		return nullptr;
+	}
+
+	*cache = Http_Cache{};
+
+	Http_Pool_Spec pool_spec  = HttpPoolDefaultSpec;
+	pool_spec.max_connections = Maximum(spec.connections, 1);
+	pool_spec.prewarm         = 0;
+
+	cache->allocator = allocator;
+	cache->spec      = spec;
+	cache->entries   = Hash_Table<uint64_t, Http_Cache_Entry *>(allocator);
+	cache->lru.prev  = &cache->lru;
+	cache->lru.next  = &cache->lru;
+	cache->length    = directory.length;
+	cache->pool      = Http_CreatePool(hostname, HTTP_DEFAULT, pool_spec, allocator);
+
+	memcpy(cache->directory, directory.data, directory.length);
+
+	if (!cache->pool) {
+		MemoryFree(cache, sizeof(*cache), allocator);
+		return nullptr;
+	}
+
+	Http_ListDirectory(directory, Http_CacheLoadProc, cache);
+	Http_CacheDeleteEvicted(cache, Http_CacheEvict(cache));
+
+	return cache;
+}
+
+void Http_DestroyCache(Http_Cache *cache) {
+	// Entries that are still being fetched are only in the table, they are not linked into the lru yet
+	for (auto &pair : cache->entries) {
+		Http_Cache_Entry *entry = pair.value;
+		Assert(entry->refs == 0);
+		if (entry->fetched)
+			Semaphore_Destory(entry->fetched);
+		Http_CacheFreeEntry(cache, entry);
+	}
+
+	Free(&cache->entries);
+	Http_DestroyPool(cache->pool);
+	MemoryFree(cache, sizeof(*cache), cache->allocator);
+}
+
+uint64_t Http_CacheSize(Http_Cache *cache) {
+	SpinLock(&cache->guard);
+	uint64_t size = cache->size;
+	SpinUnlock(&cache->guard);
+	return size;
+}
+
+struct Http_Cache_Writer {
+	Http_File file;
+	int64_t   written;
+	bool      failed;
+};
+
+static void Http_CacheWriterProc(Http_Header &header, uint8_t *buffer, ptrdiff_t length, void *context) {
+	Http_Cache_Writer *writer = (Http_Cache_Writer *)context;
+	if (!writer->failed && Http_FileWrite(writer->file, writer->written, buffer, length)) {
+		writer->written += length;
+	} else {
+		writer->failed = true;
+	}
+}
+
+static bool Http_CacheFetch(Http_Cache *cache, const String endpoint, Http_Cache_Entry *entry) {
+	char temp_buffer[HTTP_CACHE_MAX_PATH + 64];
+	char path_buffer[HTTP_CACHE_MAX_PATH + 64];
+	String temp = Http_CachePath(cache, entry->name, ".tmp", temp_buffer, sizeof(temp_buffer));
+	String path = Http_CachePath(cache, entry->name, "", path_buffer, sizeof(path_buffer));
+
+	Http_Cache_Writer writer = {};
+	writer.file = Http_FileOpen(temp, true);
+	if (writer.file == HttpInvalidFile || !Http_FileResize(writer.file, 0)) {
+		LogErrorEx("Http", "Cache file could not be created: " StrFmt, StrArg(temp));
+		if (writer.file != HttpInvalidFile) Http_FileClose(writer.file);
+		return false;
+	}
+
+	bool fetched = false;
+
+	Http *http = Http_PoolCheckout(cache->pool);
+	if (http) {
+		Http_Request req;
+		Http_Response res;
+
+		Http_InitRequest(&req);
+		Http_SetHost(&req, http);
+		Http_SetHeader(&req, HTTP_HEADER_CONNECTION, "keep-alive");
+
+		Http_Writer proc = { Http_CacheWriterProc, &writer };
+		bool received = Http_Get(http, endpoint, req, &res, proc);
+		Http_PoolCheckin(cache->pool, http, received && Http_IsKeepAlive(res));
+
+		if (!received || writer.failed) {
+			LogErrorEx("Http", "Asset could not be fetched: " StrFmt, StrArg(endpoint));
+		} else if (res.status.code != 200) {
+			LogErrorEx("Http", "Asset fetch failed with status %u: " StrFmt, res.status.code, StrArg(endpoint));
+		} else {
+			fetched = true;
+		}
+	}
+
+	Http_FileClose(writer.file);
+
+	// Assets only become visible under their name once complete
+	if (fetched && !Http_FileRename(temp, path)) {
+		LogErrorEx("Http", "Cache file could not be renamed: " StrFmt, StrArg(path));
+		fetched = false;
+	}
+
+	if (!fetched)
+		Http_FileDelete(temp);
+
+	entry->size = writer.written;
+	return fetched;
+}
+
+static bool Http_CacheMap(Http_Cache *cache, Http_Cache_Entry *entry, Http_Cache_Asset *asset) {
+	char buffer[HTTP_CACHE_MAX_PATH + 64];
+	if (Http_MapFile(Http_CachePath(cache, entry->name, "", buffer, sizeof(buffer)), &asset->content)) {
+		asset->entry = entry;
+		return true;
+	}
+
+	// The file was removed behind the cache, drop the entry so that the next acquire fetches it again
+	SpinLock(&cache->guard);
+	if (entry->state == HTTP_CACHE_READY) {
+		Http_CacheUnlink(entry);
+		cache->entries.Remove(entry->key);
+		cache->size  -= entry->size;
+		entry->state  = HTTP_CACHE_FAILED;
+	}
+	SpinUnlock(&cache->guard);
+
+	Http_Cache_Asset failed = { Buffer(), entry };
+	Http_CacheRelease(cache, &failed);
+	return false;
+}
+
+bool Http_CacheAcquire(Http_Cache *cache, const String endpoint, Http_Cache_Asset *asset) {
+	uint8_t digest[20];
+	SHA1((char *)digest, (char *)endpoint.data, (int)endpoint.length);
+
+	uint64_t key = 0;
+	for (int index = 0; index < 8; ++index)
+		key = (key << 8) | digest[index];
+
+	*asset = Http_Cache_Asset{};
+
+	SpinLock(&cache->guard);
+
+	Http_Cache_Entry **found = cache->entries.Find(key);
+
+	if (found && (*found)->state == HTTP_CACHE_READY) {
+		Http_Cache_Entry *entry = *found;
+		entry->refs += 1;
+		Http_CacheUnlink(entry);
+		Http_CacheLinkFront(cache, entry);
+		SpinUnlock(&cache->guard);
+		return Http_CacheMap(cache, entry, asset);
+	}
+
+	if (found) {
+		// Another thread is fetching the asset, wait for it instead of fetching it again
+		Http_Cache_Entry *entry = *found;
+		entry->refs    += 1;
+		entry->waiters += 1;
+		SpinUnlock(&cache->guard);
+
+		Semaphore_Wait(entry->fetched, -1);
+
+		SpinLock(&cache->guard);
+		entry->waiters -= 1;
+		if (entry->waiters == 0) {
+			Semaphore_Destory(entry->fetched);
+			entry->fetched = nullptr;
+		}
+		bool ready = entry->state == HTTP_CACHE_READY;
+		if (ready) {
+			Http_CacheUnlink(entry);
+			Http_CacheLinkFront(cache, entry);
+		}
+		SpinUnlock(&cache->guard);
+
+		if (ready)
+			return Http_CacheMap(cache, entry, asset);
+
+		Http_Cache_Asset failed = { Buffer(), entry };
+		Http_CacheRelease(cache, &failed);
+		return false;
+	}
+
+	Http_Cache_Entry *entry = Http_CacheAllocEntry(cache, key);
+	Semaphore *fetched      = entry ? Semaphore_Create(0) : nullptr;
+	if (!fetched) {
+		SpinUnlock(&cache->guard);
+		if (entry) Http_CacheFreeEntry(cache, entry);
+		LogErrorEx("Http", "Failed to allocate memory for asset cache entry");
+		return false;
+	}
+
+	for (int index = 0; index < HTTP_CACHE_NAME_LENGTH / 2; ++index)
+		snprintf(entry->name + index * 2, 3, "%02x", digest[index]);
+
+	entry->state   = HTTP_CACHE_FETCHING;
+	entry->refs    = 1;
+	entry->fetched = fetched;
+	cache->entries.Put(key, entry);
+
+	SpinUnlock(&cache->guard);
+
+	bool succeeded = Http_CacheFetch(cache, endpoint, entry);
+
+	SpinLock(&cache->guard);
+
+	if (succeeded) {
+		entry->state  = HTTP_CACHE_READY;
+		cache->size  += entry->size;
+		Http_CacheLinkFront(cache, entry);
+	} else {
+		// Failed entries are dropped from the table so that the next acquire fetches again
+		entry->state = HTTP_CACHE_FAILED;
+		cache->entries.Remove(key);
+	}
+
+	for (int32_t waiter = 0; waiter < entry->waiters; ++waiter)
+		Semaphore_Signal(entry->fetched);
+
+	if (entry->waiters == 0) {
+		Semaphore_Destory(entry->fetched);
+		entry->fetched = nullptr;
+	}
+
+	Http_Cache_Entry *evicted = Http_CacheEvict(cache);
+
+	SpinUnlock(&cache->guard);
+
+	Http_CacheDeleteEvicted(cache, evicted);
+
+	if (succeeded)
+		return Http_CacheMap(cache, entry, asset);
+
+	Http_Cache_Asset failed = { Buffer(), entry };
+	Http_CacheRelease(cache, &failed);
+	return false;
+}
+
+void Http_CacheRelease(Http_Cache *cache, Http_Cache_Asset *asset) {
+	Http_Cache_Entry *entry = asset->entry;
+	if (!entry)
+		return;
+
+	Http_UnmapFile(asset->content);
+	*asset = Http_Cache_Asset{};
+
+	SpinLock(&cache->guard);
+	entry->refs -= 1;
+
+	bool release = entry->state == HTTP_CACHE_FAILED && entry->refs == 0;
+	Http_Cache_Entry *evicted = entry->refs == 0 ? Http_CacheEvict(cache) : nullptr;
+	SpinUnlock(&cache->guard);
+
+	Http_CacheDeleteEvicted(cache, evicted);
+
+	if (release)
+		Http_CacheFreeEntry(cache, entry);
+}
@@ -101,6 +101,7 @@ struct Http_Query_Params {
 enum Http_Version : uint32_t {
 	HTTP_VERSION_1_1,
 	HTTP_VERSION_1_0,
+	HTTP_VERSION_2,
 };
 
 struct Http_Status {
@@ -115,6 +116,9 @@ struct Http_Request {
 	ptrdiff_t    length;
 	uint8_t      buffer[HTTP_MAX_HEADER_SIZE];
 	Buffer       body;
+	// When present the body is sent from these buffers in place of body, without being copied
+	const Buffer *segments;
+	ptrdiff_t     segment_count;
 };
 
 struct Http_Response {
@@ -143,14 +147,67 @@ struct Http;
 Net_Socket *Http_GetSocket(Http *http);
 Http *      Http_FromSocket(Net_Socket *socket);
 
-Http *Http_Connect(const String host, const String port, Http_Connection connection, Memory_Allocator allocator);
-Http *Http_Connect(const String hostname, Http_Connection connection = HTTP_DEFAULT, Memory_Allocator allocator = ThreadContext.allocator);
+Http *Http_Connect(const String host, const String port, Http_Connection connection, Memory_Allocator allocator, const Net_Socket_Options &options = NetDefaultSocketOptions);
+Http *Http_Connect(const String hostname, Http_Connection connection = HTTP_DEFAULT, Memory_Allocator allocator = ThreadContext.allocator, const Net_Socket_Options &options = NetDefaultSocketOptions);
 bool  Http_Reconnect(Http *http);
 void  Http_Disconnect(Http *http);
+bool  Http_IsKeepAlive(const Http_Response &res);
+
+//
+// Keep-alive connections to a single host. A connection is checked out for the duration of a request
+// and checked back in when the response is read, upto max_connections requests can be in flight
+//
+
+struct Http_Pool;
+
+struct Http_Pool_Spec {
+	uint32_t           max_connections;
+	uint32_t           prewarm;      // connections opened up front
+	uint32_t           idle_timeout; // ms before an unused connection is closed
+	Net_Socket_Options socket;
+};
+
+constexpr Http_Pool_Spec HttpPoolDefaultSpec = { 4, 1, 60 * 1000, NetDefaultSocketOptions };
+
+Http_Pool *Http_CreatePool(const String hostname, Http_Connection connection = HTTP_DEFAULT, Http_Pool_Spec spec = HttpPoolDefaultSpec, Memory_Allocator allocator = ThreadContext.allocator);
+void       Http_DestroyPool(Http_Pool *pool);
+int        Http_PoolPrewarm(Http_Pool *pool, int count);
+Http *     Http_PoolCheckout(Http_Pool *pool, int timeout = -1);
+void       Http_PoolCheckin(Http_Pool *pool, Http *http, bool reuse);
+void       Http_PoolEvictIdle(Http_Pool *pool);
+
+//
+// Pipelining: upto depth requests are written back to back on one connection without waiting for their
+// responses, which are then received in the order the requests were sent. Only idempotent requests
+// should be pipelined since queued requests are lost if the server closes the connection.
+// Http_PipelineEnd returns whether the connection can be reused for further requests
+//
+
+struct Http_Pipeline;
+
+Http_Pipeline *Http_PipelineBegin(Http *http, int depth, Memory_Allocator allocator = ThreadContext.allocator);
+bool           Http_PipelineEnd(Http_Pipeline *pipeline);
+int            Http_PipelinePending(Http_Pipeline *pipeline);
+bool           Http_PipelineCanSend(Http_Pipeline *pipeline);
+bool           Http_PipelineSend(Http_Pipeline *pipeline, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req);
+bool           Http_PipelineReceive(Http_Pipeline *pipeline, Http_Response *res, Http_Writer writer);
+bool           Http_PipelineReceive(Http_Pipeline *pipeline, Http_Response *res, Memory_Arena *arena);
+
+//
+// Content-Encoding decoding for transports that frame the body themselves. Begin returns nullptr when
+// the body needs no decoding, End returns false when the body did not decode completely
+//
+
+struct Http_Body_Decoder;
+
+Http_Body_Decoder *Http_BeginBodyDecoder(const String content_encoding, Http_Writer writer, Memory_Allocator allocator = ThreadContext.allocator);
+Http_Writer        Http_BodyDecoderWriter(Http_Body_Decoder *decoder);
+bool               Http_EndBodyDecoder(Http_Body_Decoder *decoder);
 
 void      Http_DumpProc(Http_Header &header, uint8_t *buffer, ptrdiff_t length, void *context);
 ptrdiff_t Http_BuildRequest(const String method, const String endpoint, const Http_Query_Params *params, const Http_Request &req, uint8_t *buffer, ptrdiff_t buff_len);
 bool      Http_SendRequest(Http *http, const String header, Http_Reader reader);
+bool      Http_SendRequest(Http *http, const String header, const Http_Request &req);
 bool      Http_ReceiveResponse(Http *http, Http_Response *res, Http_Writer writer);
 
 bool Http_CustomMethod(Http *http, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Reader reader, Http_Response *res, Http_Writer writer);
@@ -211,8 +268,12 @@ bool Http_Put(Http *http, const String endpoint, const Http_Request &req, Http_R
 void   Http_QueryParamSet(Http_Query_Params *params, String name, String value);
 String Http_QueryParamGet(Http_Query_Params *params, String name);
 
+String Http_GetHeaderName(Http_Header_Id id);
+
 void   Http_DumpHeader(const Http_Request &req);
 void   Http_DumpHeader(const Http_Response &res);
+
+// Accept-Encoding is set to the codings compiled in (HTTP_ZLIB_ENABLE, HTTP_BROTLI_ENABLE), such responses are decoded on receive
 void   Http_InitRequest(Http_Request *req);
 void   Http_SetHost(Http_Request *req, Http *http);
 void   Http_SetHeaderFmt(Http_Request *req, Http_Header_Id id, const char *fmt, ...);
@@ -223,6 +284,7 @@ void   Http_AppendHeader(Http_Request *req, Http_Header_Id id, String value);
 void   Http_AppendHeader(Http_Request *req, String name, String value);
 void   Http_SetContentLength(Http_Request *req, ptrdiff_t length);
 void   Http_SetContent(Http_Request *req, String type, Buffer content);
+void   Http_SetContent(Http_Request *req, String type, const Buffer *segments, ptrdiff_t count);
 void   Http_SetBody(Http_Request *req, Buffer content);
 String Http_GetHeader(Http_Request *req, Http_Header_Id id);
 String Http_GetHeader(Http_Request *req, const String name);
@@ -234,6 +296,8 @@ void   Http_SetHeader(Http_Response *res, Http_Header_Id id, String value);
 void   Http_SetHeader(Http_Response *res, String name, String value);
 void   Http_AppendHeader(Http_Response *res, Http_Header_Id id, String value);
 void   Http_AppendHeader(Http_Response *res, String name, String value);
+// Copies name and value into the response buffer, repeated headers are combined
+bool   Http_StoreHeader(Http_Response *res, String name, String value);
 void   Http_SetContentLength(Http_Response *res, ptrdiff_t length);
 void   Http_SetContent(Http_Response *res, String type, Buffer content);
 void   Http_SetBody(Http_Response *res, Buffer content);
@@ -244,7 +308,8 @@ String Http_GetHeader(Http_Response *res, const String name);
 //
 //
 
-constexpr int HTTP_MULTIPART_LENGTH = 64;
+constexpr int HTTP_MULTIPART_LENGTH       = 64;
+constexpr int HTTP_MULTIPART_MAX_SEGMENTS = 48;
 
 struct Http_Multipart {
 	uint8_t       boundary[HTTP_MULTIPART_LENGTH];
@@ -252,9 +317,64 @@ struct Http_Multipart {
 	uint8_t *memory = nullptr;
 	uint8_t *current = nullptr;
 	Memory_Arena *arena = nullptr;
+	Buffer        segments[HTTP_MULTIPART_MAX_SEGMENTS];
+	ptrdiff_t     segment_count = 0;
 };
 
 Http_Multipart Http_MultipartBegin(Memory_Arena *arena);
 bool Http_MultipartData(Http_Multipart *mt, String content, String filename);
 bool Http_MultipartData(Http_Multipart *mt, String content, String content_type, String filename);
 String Http_MultipartEnd(Http_Multipart *mt);
+
+// The content is not copied into the arena but sent in place, it must stay valid until the request is sent.
+// Such multiparts are ended with Http_MultipartEndSegments and sent with Http_SetContent(req, type, segments, count)
+bool Http_MultipartReference(Http_Multipart *mt, Buffer content, String content_type, String content_disposition);
+Array_View<Buffer> Http_MultipartEndSegments(Http_Multipart *mt);
+
+// Maps a file read only so that large uploads are paged in while they are sent instead of being read up front
+bool Http_MapFile(const String path, Buffer *content);
+void Http_UnmapFile(Buffer content);
+
+//
+// Downloads are fetched as ranges of chunk_size written in place into the preallocated file, upto connections
+// of them in parallel over the pool. Progress is kept next to the file in path + ".download" so that a failed
+// download resumes with its missing chunks. Servers that ignore Range are downloaded with a single request
+//
+
+struct Http_Download_Spec {
+	uint32_t connections;
+	uint32_t chunk_size;
+	uint32_t retries;     // of each chunk
+};
+
+constexpr Http_Download_Spec HttpDownloadDefaultSpec = { 4, MegaBytes(4), 3 };
+
+bool Http_Download(Http_Pool *pool, const String endpoint, const String path, Http_Download_Spec spec = HttpDownloadDefaultSpec, Memory_Allocator allocator = ThreadContext.allocator);
+bool Http_Download(const String url, const String path, Http_Download_Spec spec = HttpDownloadDefaultSpec, Memory_Allocator allocator = ThreadContext.allocator);
+
+//
+// Assets are cached on disk in directory under the SHA-1 of their endpoint and returned mapped read only.
+// The least recently used assets that are not acquired are deleted once the cache grows past budget.
+// Concurrent acquires of an asset that is not cached yet wait for a single fetch from hostname
+//
+
+struct Http_Cache;
+struct Http_Cache_Entry;
+
+struct Http_Cache_Asset {
+	Buffer             content;
+	Http_Cache_Entry * entry;
+};
+
+struct Http_Cache_Spec {
+	uint64_t budget;      // bytes of assets kept on disk
+	uint32_t connections;
+};
+
+constexpr Http_Cache_Spec HttpCacheDefaultSpec = { MegaBytes(256), 4 };
+
+Http_Cache *Http_CreateCache(const String hostname, const String directory, Http_Cache_Spec spec = HttpCacheDefaultSpec, Memory_Allocator allocator = ThreadContext.allocator);
+void        Http_DestroyCache(Http_Cache *cache);
+uint64_t    Http_CacheSize(Http_Cache *cache);
+bool        Http_CacheAcquire(Http_Cache *cache, const String endpoint, Http_Cache_Asset *asset);
+void        Http_CacheRelease(Http_Cache *cache, Http_Cache_Asset *asset);
@@ -0,0 +1,1631 @@
+#include "Http2.h"
+#include "Kr/KrString.h"
+
+//
+// HPACK (RFC 7541)
+//
+
+constexpr int HPACK_TABLE_SIZE     = 4096;
+constexpr int HPACK_ENTRY_OVERHEAD = 32;
+constexpr int HPACK_MAX_ENTRIES    = HPACK_TABLE_SIZE / HPACK_ENTRY_OVERHEAD;
+
+struct Hpack_Field {
+	String name;
+	String value;
+};
+
+struct Hpack_Huffman_Code {
+	uint32_t code;
+	uint32_t bits;
+};
+
+static const Hpack_Field HpackStaticTable[] = {
+	{ ":authority",                  "" },
+	{ ":method",                     "GET" },
+	{ ":method",                     "POST" },
+	{ ":path",                       "/" },
+	{ ":path",                       "/index.html" },
+	{ ":scheme",                     "http" },
+	{ ":scheme",                     "https" },
+	{ ":status",                     "200" },
+	{ ":status",                     "204" },
+	{ ":status",                     "206" },
+	{ ":status",                     "304" },
+	{ ":status",                     "400" },
+	{ ":status",                     "404" },
+	{ ":status",                     "500" },
+	{ "accept-charset",              "" },
+	{ "accept-encoding",             "gzip, deflate" },
+	{ "accept-language",             "" },
+	{ "accept-ranges",               "" },
+	{ "accept",                      "" },
+	{ "access-control-allow-origin", "" },
+	{ "age",                         "" },
+	{ "allow",                       "" },
+	{ "authorization",               "" },
+	{ "cache-control",               "" },
+	{ "content-disposition",         "" },
+	{ "content-encoding",            "" },
+	{ "content-language",            "" },
+	{ "content-length",              "" },
+	{ "content-location",            "" },
+	{ "content-range",               "" },
+	{ "content-type",                "" },
+	{ "cookie",                      "" },
+	{ "date",                        "" },
+	{ "etag",                        "" },
+	{ "expect",                      "" },
+	{ "expires",                     "" },
+	{ "from",                        "" },
+	{ "host",                        "" },
+	{ "if-match",                    "" },
+	{ "if-modified-since",           "" },
+	{ "if-none-match",               "" },
+	{ "if-range",                    "" },
+	{ "if-unmodified-since",         "" },
+	{ "last-modified",               "" },
+	{ "link",                        "" },
+	{ "location",                    "" },
+	{ "max-forwards",                "" },
+	{ "proxy-authenticate",          "" },
+	{ "proxy-authorization",         "" },
+	{ "range",                       "" },
+	{ "referer",                     "" },
+	{ "refresh",                     "" },
+	{ "retry-after",                 "" },
+	{ "server",                      "" },
+	{ "set-cookie",                  "" },
+	{ "strict-transport-security",   "" },
+	{ "transfer-encoding",           "" },
+	{ "user-agent",                  "" },
+	{ "vary",                        "" },
+	{ "via",                         "" },
+	{ "www-authenticate",            "" },
+};
+
+// Huffman code (RFC 7541, Appendix B), the last entry is EOS
+static const Hpack_Huffman_Code HpackHuffmanCodes[] = {
+	{ 0x00001ff8, 13 }, { 0x007fffd8, 23 }, { 0x0fffffe2, 28 }, { 0x0fffffe3, 28 },
+	{ 0x0fffffe4, 28 }, { 0x0fffffe5, 28 }, { 0x0fffffe6, 28 }, { 0x0fffffe7, 28 },
+	{ 0x0fffffe8, 28 }, { 0x00ffffea, 24 }, { 0x3ffffffc, 30 }, { 0x0fffffe9, 28 },
+	{ 0x0fffffea, 28 }, { 0x3ffffffd, 30 }, { 0x0fffffeb, 28 }, { 0x0fffffec, 28 },
+	{ 0x0fffffed, 28 }, { 0x0fffffee, 28 }, { 0x0fffffef, 28 }, { 0x0ffffff0, 28 },
+	{ 0x0ffffff1, 28 }, { 0x0ffffff2, 28 }, { 0x3ffffffe, 30 }, { 0x0ffffff3, 28 },
+	{ 0x0ffffff4, 28 }, { 0x0ffffff5, 28 }, { 0x0ffffff6, 28 }, { 0x0ffffff7, 28 },
+	{ 0x0ffffff8, 28 }, { 0x0ffffff9, 28 }, { 0x0ffffffa, 28 }, { 0x0ffffffb, 28 },
+	{ 0x00000014,  6 }, { 0x000003f8, 10 }, { 0x000003f9, 10 }, { 0x00000ffa, 12 },
+	{ 0x00001ff9, 13 }, { 0x00000015,  6 }, { 0x000000f8,  8 }, { 0x000007fa, 11 },
+	{ 0x000003fa, 10 }, { 0x000003fb, 10 }, { 0x000000f9,  8 }, { 0x000007fb, 11 },
+	{ 0x000000fa,  8 }, { 0x00000016,  6 }, { 0x00000017,  6 }, { 0x00000018,  6 },
+	{ 0x00000000,  5 }, { 0x00000001,  5 }, { 0x00000002,  5 }, { 0x00000019,  6 },
+	{ 0x0000001a,  6 }, { 0x0000001b,  6 }, { 0x0000001c,  6 }, { 0x0000001d,  6 },
+	{ 0x0000001e,  6 }, { 0x0000001f,  6 }, { 0x0000005c,  7 }, { 0x000000fb,  8 },
+	{ 0x00007ffc, 15 }, { 0x00000020,  6 }, { 0x00000ffb, 12 }, { 0x000003fc, 10 },
+	{ 0x00001ffa, 13 }, { 0x00000021,  6 }, { 0x0000005d,  7 }, { 0x0000005e,  7 },
+	{ 0x0000005f,  7 }, { 0x00000060,  7 }, { 0x00000061,  7 }, { 0x00000062,  7 },
+	{ 0x00000063,  7 }, { 0x00000064,  7 }, { 0x00000065,  7 }, { 0x00000066,  7 },
+	{ 0x00000067,  7 }, { 0x00000068,  7 }, { 0x00000069,  7 }, { 0x0000006a,  7 },
+	{ 0x0000006b,  7 }, { 0x0000006c,  7 }, { 0x0000006d,  7 }, { 0x0000006e,  7 },
+	{ 0x0000006f,  7 }, { 0x00000070,  7 }, { 0x00000071,  7 }, { 0x00000072,  7 },
+	{ 0x000000fc,  8 }, { 0x00000073,  7 }, { 0x000000fd,  8 }, { 0x00001ffb, 13 },
+	{ 0x0007fff0, 19 }, { 0x00001ffc, 13 }, { 0x00003ffc, 14 }, { 0x00000022,  6 },
+	{ 0x00007ffd, 15 }, { 0x00000003,  5 }, { 0x00000023,  6 }, { 0x00000004,  5 },
+	{ 0x00000024,  6 }, { 0x00000005,  5 }, { 0x00000025,  6 }, { 0x00000026,  6 },
+	{ 0x00000027,  6 }, { 0x00000006,  5 }, { 0x00000074,  7 }, { 0x00000075,  7 },
+	{ 0x00000028,  6 }, { 0x00000029,  6 }, { 0x0000002a,  6 }, { 0x00000007,  5 },
+	{ 0x0000002b,  6 }, { 0x00000076,  7 }, { 0x0000002c,  6 }, { 0x00000008,  5 },
+	{ 0x00000009,  5 }, { 0x0000002d,  6 }, { 0x00000077,  7 }, { 0x00000078,  7 },
+	{ 0x00000079,  7 }, { 0x0000007a,  7 }, { 0x0000007b,  7 }, { 0x00007ffe, 15 },
+	{ 0x000007fc, 11 }, { 0x00003ffd, 14 }, { 0x00001ffd, 13 }, { 0x0ffffffc, 28 },
+	{ 0x000fffe6, 20 }, { 0x003fffd2, 22 }, { 0x000fffe7, 20 }, { 0x000fffe8, 20 },
+	{ 0x003fffd3, 22 }, { 0x003fffd4, 22 }, { 0x003fffd5, 22 }, { 0x007fffd9, 23 },
+	{ 0x003fffd6, 22 }, { 0x007fffda, 23 }, { 0x007fffdb, 23 }, { 0x007fffdc, 23 },
+	{ 0x007fffdd, 23 }, { 0x007fffde, 23 }, { 0x00ffffeb, 24 }, { 0x007fffdf, 23 },
+	{ 0x00ffffec, 24 }, { 0x00ffffed, 24 }, { 0x003fffd7, 22 }, { 0x007fffe0, 23 },
+	{ 0x00ffffee, 24 }, { 0x007fffe1, 23 }, { 0x007fffe2, 23 }, { 0x007fffe3, 23 },
+	{ 0x007fffe4, 23 }, { 0x001fffdc, 21 }, { 0x003fffd8, 22 }, { 0x007fffe5, 23 },
+	{ 0x003fffd9, 22 }, { 0x007fffe6, 23 }, { 0x007fffe7, 23 }, { 0x00ffffef, 24 },
+	{ 0x003fffda, 22 }, { 0x001fffdd, 21 }, { 0x000fffe9, 20 }, { 0x003fffdb, 22 },
+	{ 0x003fffdc, 22 }, { 0x007fffe8, 23 }, { 0x007fffe9, 23 }, { 0x001fffde, 21 },
+	{ 0x007fffea, 23 }, { 0x003fffdd, 22 }, { 0x003fffde, 22 }, { 0x00fffff0, 24 },
+	{ 0x001fffdf, 21 }, { 0x003fffdf, 22 }, { 0x007fffeb, 23 }, { 0x007fffec, 23 },
+	{ 0x001fffe0, 21 }, { 0x001fffe1, 21 }, { 0x003fffe0, 22 }, { 0x001fffe2, 21 },
+	{ 0x007fffed, 23 }, { 0x003fffe1, 22 }, { 0x007fffee, 23 }, { 0x007fffef, 23 },
+	{ 0x000fffea, 20 }, { 0x003fffe2, 22 }, { 0x003fffe3, 22 }, { 0x003fffe4, 22 },
+	{ 0x007ffff0, 23 }, { 0x003fffe5, 22 }, { 0x003fffe6, 22 }, { 0x007ffff1, 23 },
+	{ 0x03ffffe0, 26 }, { 0x03ffffe1, 26 }, { 0x000fffeb, 20 }, { 0x0007fff1, 19 },
+	{ 0x003fffe7, 22 }, { 0x007ffff2, 23 }, { 0x003fffe8, 22 }, { 0x01ffffec, 25 },
+	{ 0x03ffffe2, 26 }, { 0x03ffffe3, 26 }, { 0x03ffffe4, 26 }, { 0x07ffffde, 27 },
+	{ 0x07ffffdf, 27 }, { 0x03ffffe5, 26 }, { 0x00fffff1, 24 }, { 0x01ffffed, 25 },
+	{ 0x0007fff2, 19 }, { 0x001fffe3, 21 }, { 0x03ffffe6, 26 }, { 0x07ffffe0, 27 },
+	{ 0x07ffffe1, 27 }, { 0x03ffffe7, 26 }, { 0x07ffffe2, 27 }, { 0x00fffff2, 24 },
+	{ 0x001fffe4, 21 }, { 0x001fffe5, 21 }, { 0x03ffffe8, 26 }, { 0x03ffffe9, 26 },
+	{ 0x0ffffffd, 28 }, { 0x07ffffe3, 27 }, { 0x07ffffe4, 27 }, { 0x07ffffe5, 27 },
+	{ 0x000fffec, 20 }, { 0x00fffff3, 24 }, { 0x000fffed, 20 }, { 0x001fffe6, 21 },
+	{ 0x003fffe9, 22 }, { 0x001fffe7, 21 }, { 0x001fffe8, 21 }, { 0x007ffff3, 23 },
+	{ 0x003fffea, 22 }, { 0x003fffeb, 22 }, { 0x01ffffee, 25 }, { 0x01ffffef, 25 },
+	{ 0x00fffff4, 24 }, { 0x00fffff5, 24 }, { 0x03ffffea, 26 }, { 0x007ffff4, 23 },
+	{ 0x03ffffeb, 26 }, { 0x07ffffe6, 27 }, { 0x03ffffec, 26 }, { 0x03ffffed, 26 },
+	{ 0x07ffffe7, 27 }, { 0x07ffffe8, 27 }, { 0x07ffffe9, 27 }, { 0x07ffffea, 27 },
+	{ 0x07ffffeb, 27 }, { 0x0ffffffe, 28 }, { 0x07ffffec, 27 }, { 0x07ffffed, 27 },
+	{ 0x07ffffee, 27 }, { 0x07ffffef, 27 }, { 0x07fffff0, 27 }, { 0x03ffffee, 26 },
+	{ 0x3fffffff, 30 },
+};
+
+// The code is canonical, so it is decoded with the number of codes of each length and the symbols sorted by code
+static const uint8_t HpackHuffmanLengthCount[] = {
+	0, 0, 0, 0, 0, 10, 26, 32, 6, 0, 5, 3, 2, 6, 2, 3, 0, 0, 0, 3, 8, 13, 26, 29, 12, 4, 15, 19, 29, 0, 4,
+};
+
+static const uint16_t HpackHuffmanSymbols[] = {
+	48, 49, 50, 97, 99, 101, 105, 111, 115, 116, 32, 37, 45, 46, 47, 51,
+	52, 53, 54, 55, 56, 57, 61, 65, 95, 98, 100, 102, 103, 104, 108, 109,
+	110, 112, 114, 117, 58, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76,
+	77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 89, 106, 107, 113, 118,
+	119, 120, 121, 122, 38, 42, 44, 59, 88, 90, 33, 34, 40, 41, 63, 39,
+	43, 124, 35, 62, 0, 36, 64, 91, 93, 126, 94, 125, 60, 96, 123, 92,
+	195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161, 167, 172, 176, 177,
+	179, 209, 216, 217, 227, 229, 230, 129, 132, 133, 134, 136, 146, 154, 156, 160,
+	163, 164, 169, 170, 173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+	233, 1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150, 151, 152, 155, 157,
+	158, 165, 166, 168, 174, 175, 180, 182, 183, 188, 191, 197, 231, 239, 9, 142,
+	144, 145, 148, 159, 171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+	200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243, 255, 203, 204, 211,
+	212, 214, 221, 222, 223, 241, 244, 245, 246, 247, 248, 250, 251, 252, 253, 254,
+	2, 3, 4, 5, 6, 7, 8, 11, 12, 14, 15, 16, 17, 18, 19, 20,
+	21, 23, 24, 25, 26, 27, 28, 29, 30, 31, 127, 220, 249, 10, 13, 22,
+	256,
+};
+
+static_assert(ArrayCount(HpackStaticTable) == 61, "");
+static_assert(ArrayCount(HpackHuffmanCodes) == 257, "");
+static_assert(ArrayCount(HpackHuffmanLengthCount) == 31, "");
+
+// Entries are kept oldest first with their strings packed in the same order
+struct Hpack_Entry {
+	uint32_t offset;
+	uint32_t name_length;
+	uint32_t value_length;
+};
+
+struct Hpack_Table {
+	uint32_t    size;     // as counted by the rfc, including the entry overhead
+	uint32_t    max_size;
+	uint32_t    count;
+	uint32_t    used;     // bytes of data
+	Hpack_Entry entries[HPACK_MAX_ENTRIES];
+	uint8_t     data[HPACK_TABLE_SIZE];
+};
+
+struct Hpack_Writer {
+	uint8_t *ptr;
+	uint8_t *last;
+	bool     overflow;
+};
+
+typedef void(*Hpack_Field_Proc)(const Hpack_Field &field, void *context);
+
+static void Hpack_InitTable(Hpack_Table *table) {
+	table->size     = 0;
+	table->max_size = HPACK_TABLE_SIZE;
+	table->count    = 0;
+	table->used     = 0;
+}
+
+static void Hpack_EvictOldest(Hpack_Table *table) {
+	Hpack_Entry oldest = table->entries[0];
+	uint32_t length    = oldest.name_length + oldest.value_length;
+
+	table->size  -= length + HPACK_ENTRY_OVERHEAD;
+	table->used  -= length;
+	table->count -= 1;
+
+	memmove(table->data, table->data + length, table->used);
+	memmove(table->entries, table->entries + 1, table->count * sizeof(Hpack_Entry));
+	for (uint32_t index = 0; index < table->count; ++index)
+		table->entries[index].offset -= length;
+}
+
+static void Hpack_SetMaxSize(Hpack_Table *table, uint32_t max_size) {
+	table->max_size = max_size;
+	while (table->size > table->max_size)
+		Hpack_EvictOldest(table);
+}
+
+static void Hpack_Insert(Hpack_Table *table, const Hpack_Field &field) {
+	uint32_t length = (uint32_t)(field.name.length + field.value.length);
+	uint32_t size   = length + HPACK_ENTRY_OVERHEAD;
+
+	// The name may refer to an entry that is about to be evicted
+	uint8_t copy[HPACK_TABLE_SIZE];
+	if (size <= table->max_size) {
+		memcpy(copy, field.name.data, field.name.length);
+		memcpy(copy + field.name.length, field.value.data, field.value.length);
+	}
+
+	while (table->count && table->size + size > table->max_size)
+		Hpack_EvictOldest(table);
+
+	// An entry larger than the table only empties it
+	if (size > table->max_size)
+		return;
+
+	Hpack_Entry *entry  = &table->entries[table->count];
+	entry->offset       = table->used;
+	entry->name_length  = (uint32_t)field.name.length;
+	entry->value_length = (uint32_t)field.value.length;
+
+	memcpy(table->data + table->used, copy, length);
+
+	table->used  += length;
+	table->size  += size;
+	table->count += 1;
+}
+
+static bool Hpack_Get(Hpack_Table *table, uint64_t index, Hpack_Field *field) {
+	if (index == 0)
+		return false;
+
+	if (index <= ArrayCount(HpackStaticTable)) {
+		*field = HpackStaticTable[index - 1];
+		return true;
+	}
+
+	index -= ArrayCount(HpackStaticTable) + 1;
+	if (index >= table->count)
+		return false;
+
+	const Hpack_Entry &entry = table->entries[table->count - 1 - index];
+	field->name  = String(table->data + entry.offset, entry.name_length);
+	field->value = String(table->data + entry.offset + entry.name_length, entry.value_length);
+	return true;
+}
+
+// Returns the index of the field in the static or dynamic table, *name_only is set when only the name matched
+static uint64_t Hpack_Find(Hpack_Table *table, const Hpack_Field &field, bool *name_only) {
+	uint64_t name_index = 0;
+
+	for (int index = 0; index < (int)ArrayCount(HpackStaticTable); ++index) {
+		const Hpack_Field &entry = HpackStaticTable[index];
+		if (entry.name == field.name) {
+			if (entry.value == field.value) {
+				*name_only = false;
+				return index + 1;
+			}
+			if (!name_index)
+				name_index = index + 1;
+		}
+	}
+
+	for (uint32_t index = 0; index < table->count; ++index) {
+		Hpack_Field entry;
+		Hpack_Get(table, ArrayCount(HpackStaticTable) + 1 + index, &entry);
+		if (entry.name == field.name) {
+			if (entry.value == field.value) {
+				*name_only = false;
+				return ArrayCount(HpackStaticTable) + 1 + index;
+			}
+			if (!name_index)
+				name_index = ArrayCount(HpackStaticTable) + 1 + index;
+		}
+	}
+
+	*name_only = true;
+	return name_index;
+}
+
+static bool Hpack_DecodeInt(uint8_t **ptr, uint8_t *last, int prefix, uint64_t *value) {
+	uint8_t *trav = *ptr;
+	if (trav >= last)
+		return false;
+
+	uint64_t mask   = (1u << prefix) - 1;
+	uint64_t result = *trav++ & mask;
+
+	if (result == mask) {
+		for (int shift = 0;; shift += 7) {
+			if (trav >= last || shift > 28)
+				return false;
+			uint8_t byte = *trav++;
+			result += (uint64_t)(byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+				break;
+		}
+	}
+
+	*ptr   = trav;
+	*value = result;
+	return true;
+}
+
+static bool Hpack_HuffmanDecode(const uint8_t *src, ptrdiff_t length, Hpack_Writer *out) {
+	uint32_t code   = 0;
+	uint32_t first  = 0; // first code of the current length
+	uint32_t offset = 0; // symbols of the shorter lengths
+	uint32_t bits   = 0;
+
+	for (ptrdiff_t index = 0; index < length; ++index) {
+		for (int bit = 7; bit >= 0; --bit) {
+			code  = (code << 1) | ((src[index] >> bit) & 1);
+			bits += 1;
+
+			uint32_t count = HpackHuffmanLengthCount[bits];
+			if (code - first < count) {
+				uint16_t symbol = HpackHuffmanSymbols[offset + code - first];
+				if (symbol == 256 || out->ptr == out->last)
+					return false;
+				*out->ptr++ = (uint8_t)symbol;
+
+				code = first = offset = bits = 0;
+			} else {
+				if (bits == ArrayCount(HpackHuffmanLengthCount) - 1)
+					return false;
+				offset += count;
+				first   = (first + count) << 1;
+			}
+		}
+	}
+
+	// Padding is the most significant bits of EOS, which are all ones
+	return bits <= 7 && code == (1u << bits) - 1;
+}
+
+static bool Hpack_DecodeString(uint8_t **ptr, uint8_t *last, Hpack_Writer *out, String *str) {
+	if (*ptr >= last)
+		return false;
+
+	bool huffman = (**ptr & 0x80) != 0;
+
+	uint64_t length;
+	if (!Hpack_DecodeInt(ptr, last, 7, &length) || length > (uint64_t)(last - *ptr))
+		return false;
+
+	uint8_t *start = out->ptr;
+
+	if (huffman) {
+		if (!Hpack_HuffmanDecode(*ptr, (ptrdiff_t)length, out))
+			return false;
+	} else {
+		if (length > (uint64_t)(out->last - out->ptr))
+			return false;
+		memcpy(out->ptr, *ptr, length);
+		out->ptr += length;
+	}
+
+	*ptr += length;
+	*str  = String(start, out->ptr - start);
+	return true;
+}
+
+static bool Hpack_Decode(Hpack_Table *table, uint8_t *block, ptrdiff_t length, uint8_t *scratch, ptrdiff_t scratch_size, Hpack_Field_Proc proc, void *context) {
+	uint8_t *trav = block;
+	uint8_t *last = block + length;
+
+	while (trav < last) {
+		uint8_t byte = *trav;
+
+		Hpack_Writer out = { scratch, scratch + scratch_size, false };
+
+		if (byte & 0x80) {
+			uint64_t index;
+			Hpack_Field field;
+			if (!Hpack_DecodeInt(&trav, last, 7, &index) || !Hpack_Get(table, index, &field))
+				return false;
+			proc(field, context);
+		} else if ((byte & 0xe0) == 0x20) {
+			uint64_t size;
+			if (!Hpack_DecodeInt(&trav, last, 5, &size) || size > HPACK_TABLE_SIZE)
+				return false;
+			Hpack_SetMaxSize(table, (uint32_t)size);
+		} else {
+			// Literal with incremental indexing, without indexing or never indexed
+			bool indexing = (byte & 0xc0) == 0x40;
+			int  prefix   = indexing ? 6 : 4;
+
+			uint64_t index;
+			if (!Hpack_DecodeInt(&trav, last, prefix, &index))
+				return false;
+
+			Hpack_Field field;
+			if (index) {
+				Hpack_Field named;
+				if (!Hpack_Get(table, index, &named))
+					return false;
+				field.name = named.name;
+			} else if (!Hpack_DecodeString(&trav, last, &out, &field.name)) {
+				return false;
+			}
+
+			if (!Hpack_DecodeString(&trav, last, &out, &field.value))
+				return false;
+
+			proc(field, context);
+
+			if (indexing)
+				Hpack_Insert(table, field);
+		}
+	}
+
+	return true;
+}
+
+static void Hpack_WriteBytes(Hpack_Writer *out, const void *data, ptrdiff_t length) {
+	if (out->overflow || length > out->last - out->ptr) {
+		out->overflow = true;
+		return;
+	}
+	memcpy(out->ptr, data, length);
+	out->ptr += length;
+}
+
+static void Hpack_EncodeInt(Hpack_Writer *out, uint8_t pattern, int prefix, uint64_t value) {
+	uint8_t  bytes[16];
+	int      count = 0;
+	uint64_t mask  = (1u << prefix) - 1;
+
+	if (value < mask) {
+		bytes[count++] = pattern | (uint8_t)value;
+	} else {
+		bytes[count++] = pattern | (uint8_t)mask;
+		value -= mask;
+		while (value >= 0x80) {
+			bytes[count++] = (uint8_t)(value & 0x7f) | 0x80;
+			value >>= 7;
+		}
+		bytes[count++] = (uint8_t)value;
+	}
+
+	Hpack_WriteBytes(out, bytes, count);
+}
+
+static void Hpack_EncodeString(Hpack_Writer *out, String str) {
+	uint64_t bits = 0;
+	for (uint8_t ch : str)
+		bits += HpackHuffmanCodes[ch].bits;
+
+	ptrdiff_t length = (ptrdiff_t)((bits + 7) / 8);
+
+	if (length >= str.length) {
+		Hpack_EncodeInt(out, 0x00, 7, str.length);
+		Hpack_WriteBytes(out, str.data, str.length);
+		return;
+	}
+
+	Hpack_EncodeInt(out, 0x80, 7, length);
+
+	if (out->overflow || length > out->last - out->ptr) {
+		out->overflow = true;
+		return;
+	}
+
+	uint64_t acc  = 0;
+	uint32_t used = 0;
+
+	for (uint8_t ch : str) {
+		const Hpack_Huffman_Code &code = HpackHuffmanCodes[ch];
+		acc   = (acc << code.bits) | code.code;
+		used += code.bits;
+		while (used >= 8) {
+			used -= 8;
+			*out->ptr++ = (uint8_t)(acc >> used);
+		}
+	}
+
+	if (used)
+		*out->ptr++ = (uint8_t)((acc << (8 - used)) | (0xff >> used));
+}
+
+// Fields that change with every request are not worth a slot in the dynamic table
+static void Hpack_EncodeField(Hpack_Table *table, Hpack_Writer *out, const Hpack_Field &field, bool indexing) {
+	bool name_only;
+	uint64_t index = Hpack_Find(table, field, &name_only);
+
+	if (index && !name_only) {
+		Hpack_EncodeInt(out, 0x80, 7, index);
+		return;
+	}
+
+	if (indexing) {
+		Hpack_EncodeInt(out, 0x40, 6, index);
+	} else {
+		Hpack_EncodeInt(out, 0x00, 4, index);
+	}
+
+	if (!index)
+		Hpack_EncodeString(out, field.name);
+	Hpack_EncodeString(out, field.value);
+
+	if (indexing)
+		Hpack_Insert(table, field);
+}
+
+//
+// Framing (RFC 7540)
+//
+
+enum Http2_Frame_Type : uint8_t {
+	HTTP2_FRAME_DATA          = 0x0,
+	HTTP2_FRAME_HEADERS       = 0x1,
+	HTTP2_FRAME_PRIORITY      = 0x2,
+	HTTP2_FRAME_RST_STREAM    = 0x3,
+	HTTP2_FRAME_SETTINGS      = 0x4,
+	HTTP2_FRAME_PUSH_PROMISE  = 0x5,
+	HTTP2_FRAME_PING          = 0x6,
+	HTTP2_FRAME_GOAWAY        = 0x7,
+	HTTP2_FRAME_WINDOW_UPDATE = 0x8,
+	HTTP2_FRAME_CONTINUATION  = 0x9,
+};
+
+enum Http2_Frame_Flags : uint8_t {
+	HTTP2_FLAG_END_STREAM  = 0x1,
+	HTTP2_FLAG_ACK         = 0x1,
+	HTTP2_FLAG_END_HEADERS = 0x4,
+	HTTP2_FLAG_PADDED      = 0x8,
+	HTTP2_FLAG_PRIORITY    = 0x20,
+};
+
+enum Http2_Setting : uint16_t {
+	HTTP2_SETTINGS_HEADER_TABLE_SIZE      = 0x1,
+	HTTP2_SETTINGS_ENABLE_PUSH            = 0x2,
+	HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+	HTTP2_SETTINGS_INITIAL_WINDOW_SIZE    = 0x4,
+	HTTP2_SETTINGS_MAX_FRAME_SIZE         = 0x5,
+	HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE   = 0x6,
+};
+
+enum Http2_Error_Code : uint32_t {
+	HTTP2_NO_ERROR           = 0x0,
+	HTTP2_PROTOCOL_ERROR     = 0x1,
+	HTTP2_INTERNAL_ERROR     = 0x2,
+	HTTP2_FLOW_CONTROL_ERROR = 0x3,
+	HTTP2_FRAME_SIZE_ERROR   = 0x6,
+	HTTP2_REFUSED_STREAM     = 0x7,
+	HTTP2_CANCEL             = 0x8,
+	HTTP2_COMPRESSION_ERROR  = 0x9,
+};
+
+constexpr int     HTTP2_FRAME_HEADER_SIZE    = 9;
+constexpr int     HTTP2_MAX_HEADER_BLOCK     = KiloBytes(32);
+constexpr int     HTTP2_READ_BUFFER_SIZE     = HTTP2_FRAME_HEADER_SIZE + 2 * HTTP2_MAX_FRAME_SIZE;
+constexpr int     HTTP2_MAX_AUTHORITY        = 512;
+constexpr int64_t HTTP2_DEFAULT_WINDOW       = 65535;
+constexpr int64_t HTTP2_MAX_WINDOW           = 0x7fffffff;
+constexpr int32_t HTTP2_STREAM_WINDOW        = MegaBytes(1);
+constexpr int32_t HTTP2_CONNECTION_WINDOW    = MegaBytes(16);
+
+static const String Http2Preface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+struct Http2_Stream {
+	int32_t               id; // 0 when the slot is free
+	Http_Response *       response;
+	Http_Writer           writer;
+	Http_Body_Decoder *   decoder;
+	Http2_Completion_Proc proc;
+	void *                context;
+	int64_t               send_window;
+	int32_t               receive_consumed;
+	Buffer                body;
+	const Buffer *        segments;
+	ptrdiff_t             segment_count;
+	ptrdiff_t             segment_index;
+	ptrdiff_t             segment_offset;
+	ptrdiff_t             body_remaining;
+	bool                  headers_received;
+	bool                  end_stream_sent;
+};
+
+struct Http2 {
+	Net_Socket *     socket;
+	Memory_Allocator allocator;
+
+	int32_t          next_stream_id;
+	int32_t          active;
+	uint32_t         max_streams;     // limit of the peer
+	uint32_t         max_frame_size;  // for frames sent to the peer
+	int64_t          initial_window;  // of the streams opened by us
+	int64_t          send_window;     // connection level
+	int32_t          receive_consumed;
+	int32_t          last_stream_id;  // streams after this one are not processed once going away
+	bool             settings_received;
+	bool             going_away;
+	bool             failed;
+	bool             encoder_resized; // dynamic table size update is due in the next header block
+
+	int32_t          header_stream;   // stream of the header block being assembled from CONTINUATION frames
+	uint8_t          header_flags;
+	ptrdiff_t        header_length;
+
+	ptrdiff_t        read_length;
+	ptrdiff_t        authority_length;
+	char             authority[HTTP2_MAX_AUTHORITY];
+
+	Hpack_Table      encoder;
+	Hpack_Table      decoder;
+	Http2_Stream     streams[HTTP2_MAX_STREAMS];
+	uint8_t          header_block[HTTP2_MAX_HEADER_BLOCK];
+	uint8_t          send_block[HTTP2_MAX_HEADER_BLOCK];
+	uint8_t          read_buffer[HTTP2_READ_BUFFER_SIZE];
+};
+
+static inline uint32_t Http2_Read32(const uint8_t *src) {
+	return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8) | (uint32_t)src[3];
+}
+
+static inline void Http2_Write32(uint8_t *dst, uint32_t value) {
+	dst[0] = (uint8_t)(value >> 24);
+	dst[1] = (uint8_t)(value >> 16);
+	dst[2] = (uint8_t)(value >> 8);
+	dst[3] = (uint8_t)value;
+}
+
+static bool Http2_Write(Http2 *http2, Buffer *buffers, int count) {
+	int index = 0;
+
+	while (index < count) {
+		int sent = Net_SendVectoredBlocked(http2->socket, buffers + index, count - index, HTTP2_DEFAULT_TIMEOUT);
+		if (sent <= 0) {
+			if (Net_GetLastError(http2->socket) == NET_E_TIMED_OUT)
+				LogErrorEx("Http2", "Sending timed out");
+			http2->failed = true;
+			return false;
+		}
+
+		while (index < count && sent >= buffers[index].length) {
+			sent -= (int)buffers[index].length;
+			index += 1;
+		}
+
+		if (index < count) {
+			buffers[index].data   += sent;
+			buffers[index].length -= sent;
+		}
+	}
+
+	return true;
+}
+
+static bool Http2_SendFrame(Http2 *http2, Http2_Frame_Type type, uint8_t flags, int32_t stream, const void *payload, ptrdiff_t length) {
+	if (http2->failed)
+		return false;
+
+	uint8_t header[HTTP2_FRAME_HEADER_SIZE];
+	header[0] = (uint8_t)(length >> 16);
+	header[1] = (uint8_t)(length >> 8);
+	header[2] = (uint8_t)length;
+	header[3] = type;
+	header[4] = flags;
+	Http2_Write32(header + 5, (uint32_t)stream & 0x7fffffff);
+
+	Buffer buffers[] = { Buffer(header, sizeof(header)), Buffer((uint8_t *)payload, length) };
+	return Http2_Write(http2, buffers, length ? 2 : 1);
+}
+
+static void Http2_SendWindowUpdate(Http2 *http2, int32_t stream, uint32_t increment) {
+	uint8_t payload[4];
+	Http2_Write32(payload, increment & 0x7fffffff);
+	Http2_SendFrame(http2, HTTP2_FRAME_WINDOW_UPDATE, 0, stream, payload, sizeof(payload));
+}
+
+static void Http2_SendReset(Http2 *http2, int32_t stream, Http2_Error_Code error) {
+	uint8_t payload[4];
+	Http2_Write32(payload, error);
+	Http2_SendFrame(http2, HTTP2_FRAME_RST_STREAM, 0, stream, payload, sizeof(payload));
+}
+
+static void Http2_SendGoaway(Http2 *http2, Http2_Error_Code error) {
+	uint8_t payload[8];
+	Http2_Write32(payload, 0);
+	Http2_Write32(payload + 4, error);
+	Http2_SendFrame(http2, HTTP2_FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+}
+
+static Http2_Stream *Http2_FindStream(Http2 *http2, int32_t id) {
+	if (id <= 0)
+		return nullptr;
+	for (Http2_Stream &stream : http2->streams) {
+		if (stream.id == id)
+			return &stream;
+	}
+	return nullptr;
+}
+
+static void Http2_ReleaseStream(Http2 *http2, Http2_Stream *stream) {
+	if (stream->decoder) {
+		Http_EndBodyDecoder(stream->decoder);
+		stream->decoder = nullptr;
+	}
+	stream->id = 0;
+	http2->active -= 1;
+}
+
+static void Http2_CompleteStream(Http2 *http2, Http2_Stream *stream, bool success, int *completed) {
+	if (stream->decoder) {
+		success &= Http_EndBodyDecoder(stream->decoder);
+		stream->decoder = nullptr;
+	}
+
+	success &= stream->headers_received;
+
+	// The response may arrive before the whole request was sent
+	if (!stream->end_stream_sent && !http2->failed)
+		Http2_SendReset(http2, stream->id, HTTP2_CANCEL);
+
+	Http2_Completion_Proc proc = stream->proc;
+	Http_Response *response    = stream->response;
+	void *context              = stream->context;
+
+	// Released before the proc runs so that it can submit the next request on the slot
+	Http2_ReleaseStream(http2, stream);
+	*completed += 1;
+
+	if (proc)
+		proc(http2, response, success, context);
+}
+
+static void Http2_FailStreams(Http2 *http2, int32_t after, int *completed) {
+	for (Http2_Stream &stream : http2->streams) {
+		if (stream.id > after) {
+			stream.end_stream_sent = true;
+			Http2_CompleteStream(http2, &stream, false, completed);
+		}
+	}
+}
+
+static void Http2_ConnectionError(Http2 *http2, Http2_Error_Code error, const char *reason, int *completed) {
+	LogErrorEx("Http2", "Connection error: %s", reason);
+	if (!http2->failed)
+		Http2_SendGoaway(http2, error);
+	http2->failed = true;
+	Http2_FailStreams(http2, 0, completed);
+}
+
+static bool Http2_SendData(Http2 *http2, Http2_Stream *stream) {
+	while (stream->body_remaining) {
+		while (stream->segment_offset == stream->segments[stream->segment_index].length) {
+			stream->segment_index += 1;
+			stream->segment_offset = 0;
+		}
+
+		int64_t window = Minimum(stream->send_window, http2->send_window);
+		if (window <= 0)
+			return true; // resumed on WINDOW_UPDATE
+
+		const Buffer &segment = stream->segments[stream->segment_index];
+
+		ptrdiff_t chunk = segment.length - stream->segment_offset;
+		chunk = Minimum(chunk, (ptrdiff_t)window);
+		chunk = Minimum(chunk, (ptrdiff_t)http2->max_frame_size);
+
+		bool last   = chunk == stream->body_remaining;
+		uint8_t flags = last ? HTTP2_FLAG_END_STREAM : 0;
+
+		if (!Http2_SendFrame(http2, HTTP2_FRAME_DATA, flags, stream->id, segment.data + stream->segment_offset, chunk))
+			return false;
+
+		stream->segment_offset += chunk;
+		stream->body_remaining -= chunk;
+		stream->send_window    -= chunk;
+		http2->send_window     -= chunk;
+		stream->end_stream_sent = last;
+	}
+	return true;
+}
+
+static void Http2_SendPendingData(Http2 *http2) {
+	for (Http2_Stream &stream : http2->streams) {
+		if (stream.id && stream.body_remaining) {
+			if (!Http2_SendData(http2, &stream))
+				return;
+		}
+	}
+}
+
+//
+//
+//
+
+static String Http2_LowerName(String name, char *buffer, ptrdiff_t length) {
+	if (name.length > length)
+		return String();
+	for (ptrdiff_t index = 0; index < name.length; ++index) {
+		uint8_t ch = name.data[index];
+		buffer[index] = (ch >= 'A' && ch <= 'Z') ? (char)(ch + ('a' - 'A')) : (char)ch;
+	}
+	return String((uint8_t *)buffer, name.length);
+}
+
+static bool Http2_IsConnectionHeader(String name) {
+	static const String Names[] = { "connection", "keep-alive", "proxy-connection", "transfer-encoding", "upgrade", "host", "te" };
+	for (const String &entry : Names) {
+		if (StrMatchICase(name, entry))
+			return true;
+	}
+	return false;
+}
+
+static bool Http2_EncodeHeader(Http2 *http2, Hpack_Writer *out, String name, String value) {
+	if (Http2_IsConnectionHeader(name))
+		return true;
+
+	char buffer[256];
+	String lower = Http2_LowerName(name, buffer, sizeof(buffer));
+	if (!lower.length) {
+		LogErrorEx("Http2", "Header name too long: " StrFmt, StrArg(name));
+		return false;
+	}
+
+	bool indexing = lower != "content-length";
+	Hpack_EncodeField(&http2->encoder, out, Hpack_Field{ lower, value }, indexing);
+	return !out->overflow;
+}
+
+static String Http2_BuildPath(const String endpoint, const Http_Query_Params *params, uint8_t *buffer, ptrdiff_t length) {
+	String path = endpoint;
+
+	// Absolute endpoints are sent with the authority stripped
+	ptrdiff_t scheme = StrFind(path, "://");
+	if (scheme >= 0) {
+		ptrdiff_t slash = StrFindChar(path, '/', scheme + 3);
+		path = slash >= 0 ? SubStr(path, slash) : String("/");
+	}
+
+	Builder builder;
+	BuilderBegin(&builder, buffer, length);
+	BuilderWrite(&builder, path.length ? path : String("/"));
+
+	if (params) {
+		for (ptrdiff_t index = 0; index < params->count; ++index) {
+			BuilderWrite(&builder, index ? String("&") : String("?"));
+			BuilderWrite(&builder, params->queries[index].name, String("="), params->queries[index].value);
+		}
+	}
+
+	if (builder.thrown)
+		return String();
+
+	return BuilderEnd(&builder);
+}
+
+static bool Http2_SendHeaders(Http2 *http2, int32_t stream, uint8_t *block, ptrdiff_t length, bool end_stream) {
+	Http2_Frame_Type type = HTTP2_FRAME_HEADERS;
+	uint8_t flags         = end_stream ? HTTP2_FLAG_END_STREAM : 0;
+
+	do {
+		ptrdiff_t chunk = Minimum(length, (ptrdiff_t)http2->max_frame_size);
+		uint8_t last    = chunk == length ? HTTP2_FLAG_END_HEADERS : 0;
+
+		if (!Http2_SendFrame(http2, type, flags | last, stream, block, chunk))
+			return false;
+
+		block  += chunk;
+		length -= chunk;
+		type    = HTTP2_FRAME_CONTINUATION;
+		flags   = 0;
+	} while (length);
+
+	return true;
+}
+
+static Http2_Stream *Http2_SubmitStream(Http2 *http2, const String method, const String endpoint, const Http_Query_Params *params, const Http_Request &req, Http_Response *res, Http_Writer writer, Http2_Completion_Proc proc, void *context) {
+	if (!Http2_CanSubmit(http2)) {
+		LogErrorEx("Http2", "Request could not be submitted: no stream available");
+		return nullptr;
+	}
+
+	Http2_Stream *stream = nullptr;
+	for (Http2_Stream &slot : http2->streams) {
+		if (!slot.id) {
+			stream = &slot;
+			break;
+		}
+	}
+
+	uint8_t path_buffer[HTTP_MAX_HEADER_SIZE];
+	String path = Http2_BuildPath(endpoint, params, path_buffer, sizeof(path_buffer));
+	if (!path.length) {
+		LogErrorEx("Http2", "Request path too long");
+		return nullptr;
+	}
+
+	String authority = req.headers.known[HTTP_HEADER_HOST];
+	if (!authority.length)
+		authority = String((uint8_t *)http2->authority, http2->authority_length);
+
+	Hpack_Writer out = { http2->send_block, http2->send_block + sizeof(http2->send_block), false };
+
+	if (http2->encoder_resized) {
+		Hpack_EncodeInt(&out, 0x20, 5, http2->encoder.max_size);
+		http2->encoder_resized = false;
+	}
+
+	Hpack_EncodeField(&http2->encoder, &out, Hpack_Field{ ":method", method }, true);
+	Hpack_EncodeField(&http2->encoder, &out, Hpack_Field{ ":scheme", "https" }, true);
+	Hpack_EncodeField(&http2->encoder, &out, Hpack_Field{ ":authority", authority }, true);
+	Hpack_EncodeField(&http2->encoder, &out, Hpack_Field{ ":path", path }, false);
+
+	bool encoded = !out.overflow;
+
+	for (int id = 0; encoded && id < _HTTP_HEADER_COUNT; ++id) {
+		String value = req.headers.known[id];
+		if (value.length)
+			encoded = Http2_EncodeHeader(http2, &out, Http_GetHeaderName((Http_Header_Id)id), value);
+	}
+
+	for (ptrdiff_t index = 0; encoded && index < req.headers.raw.count; ++index) {
+		const Http_Raw_Headers::Header &raw = req.headers.raw.data[index];
+		encoded = Http2_EncodeHeader(http2, &out, raw.name, raw.value);
+	}
+
+	if (!encoded) {
+		// The encoder table no longer matches the one of the peer
+		int completed = 0;
+		Http2_ConnectionError(http2, HTTP2_COMPRESSION_ERROR, "request header too large", &completed);
+		return nullptr;
+	}
+
+	Http_InitResponse(res);
+
+	stream->id               = http2->next_stream_id;
+	stream->response         = res;
+	stream->writer           = writer;
+	stream->decoder          = nullptr;
+	stream->proc             = proc;
+	stream->context          = context;
+	stream->send_window      = http2->initial_window;
+	stream->receive_consumed = 0;
+	stream->body             = req.body;
+	stream->segments         = req.segments ? req.segments : &stream->body;
+	stream->segment_count    = req.segments ? req.segment_count : 1;
+	stream->segment_index    = 0;
+	stream->segment_offset   = 0;
+	stream->body_remaining   = 0;
+	stream->headers_received = false;
+
+	for (ptrdiff_t index = 0; index < stream->segment_count; ++index)
+		stream->body_remaining += stream->segments[index].length;
+
+	stream->end_stream_sent = stream->body_remaining == 0;
+
+	http2->next_stream_id += 2;
+	http2->active += 1;
+
+	if (!Http2_SendHeaders(http2, stream->id, http2->send_block, out.ptr - http2->send_block, stream->end_stream_sent) ||
+		!Http2_SendData(http2, stream)) {
+		Http2_ReleaseStream(http2, stream);
+		return nullptr;
+	}
+
+	return stream;
+}
+
+//
+//
+//
+
+struct Http2_Header_Context {
+	Http2_Stream *stream;
+	bool          informational;
+	bool          trailers;
+	bool          failed;
+};
+
+static void Http2_HeaderFieldProc(const Hpack_Field &field, void *context) {
+	Http2_Header_Context *header = (Http2_Header_Context *)context;
+	Http2_Stream *stream         = header->stream;
+
+	if (!stream || header->trailers || header->failed)
+		return;
+
+	Http_Response *res = stream->response;
+
+	if (field.name == ":status") {
+		ptrdiff_t code = 0;
+		for (uint8_t ch : field.value) {
+			if (ch < '0' || ch > '9') {
+				header->failed = true;
+				return;
+			}
+			code = code * 10 + (ch - '0');
+		}
+		res->status.version = HTTP_VERSION_2;
+		res->status.code    = (uint32_t)code;
+		header->informational = code >= 100 && code < 200;
+		return;
+	}
+
+	if (header->informational || StrStartsWithChar(field.name, ':'))
+		return;
+
+	Http_StoreHeader(res, field.name, field.value);
+}
+
+static void Http2_ProcessHeaderBlock(Http2 *http2, int *completed) {
+	Http2_Stream *stream = Http2_FindStream(http2, http2->header_stream);
+
+	Http2_Header_Context header;
+	header.stream        = stream;
+	header.informational = false;
+	header.trailers      = stream && stream->headers_received;
+	header.failed        = false;
+
+	uint8_t scratch[HTTP_MAX_HEADER_SIZE];
+
+	// Blocks of unknown streams are decoded all the same to keep the table in sync
+	if (!Hpack_Decode(&http2->decoder, http2->header_block, http2->header_length, scratch, sizeof(scratch), Http2_HeaderFieldProc, &header)) {
+		Http2_ConnectionError(http2, HTTP2_COMPRESSION_ERROR, "invalid header block", completed);
+		return;
+	}
+
+	bool end_stream = (http2->header_flags & HTTP2_FLAG_END_STREAM) != 0;
+
+	http2->header_stream = 0;
+	http2->header_length = 0;
+
+	if (!stream)
+		return;
+
+	if (header.failed || (!header.trailers && !stream->response->status.code)) {
+		Http2_SendReset(http2, stream->id, HTTP2_PROTOCOL_ERROR);
+		stream->end_stream_sent = true;
+		Http2_CompleteStream(http2, stream, false, completed);
+		return;
+	}
+
+	if (!header.trailers && !header.informational) {
+		stream->headers_received = true;
+
+		String encoding = stream->response->headers.known[HTTP_HEADER_CONTENT_ENCODING];
+		if (encoding.length)
+			stream->decoder = Http_BeginBodyDecoder(encoding, stream->writer, http2->allocator);
+	}
+
+	if (end_stream)
+		Http2_CompleteStream(http2, stream, true, completed);
+}
+
+static void Http2_ReceiveData(Http2 *http2, int32_t id, uint8_t flags, uint8_t *payload, ptrdiff_t length, int *completed) {
+	ptrdiff_t frame_length = length;
+
+	if (flags & HTTP2_FLAG_PADDED) {
+		if (!length || payload[0] >= length) {
+			Http2_ConnectionError(http2, HTTP2_PROTOCOL_ERROR, "invalid padding", completed);
+			return;
+		}
+		length  -= 1 + payload[0];
+		payload += 1;
+	}
+
+	// Flow control counts the whole frame, including the data of streams no longer open
+	http2->receive_consumed += (int32_t)frame_length;
+	if (http2->receive_consumed >= HTTP2_CONNECTION_WINDOW / 2) {
+		Http2_SendWindowUpdate(http2, 0, http2->receive_consumed);
+		http2->receive_consumed = 0;
+	}
+
+	Http2_Stream *stream = Http2_FindStream(http2, id);
+	if (!stream)
+		return;
+
+	if (!stream->headers_received) {
+		Http2_SendReset(http2, stream->id, HTTP2_PROTOCOL_ERROR);
+		stream->end_stream_sent = true;
+		Http2_CompleteStream(http2, stream, false, completed);
+		return;
+	}
+
+	if (length) {
+		Http_Writer writer = stream->decoder ? Http_BodyDecoderWriter(stream->decoder) : stream->writer;
+		if (writer.proc)
+			writer.proc(stream->response->headers, payload, length, writer.context);
+	}
+
+	if (flags & HTTP2_FLAG_END_STREAM) {
+		Http2_CompleteStream(http2, stream, true, completed);
+		return;
+	}
+
+	stream->receive_consumed += (int32_t)frame_length;
+	if (stream->receive_consumed >= HTTP2_STREAM_WINDOW / 2) {
+		Http2_SendWindowUpdate(http2, stream->id, stream->receive_consumed);
+		stream->receive_consumed = 0;
+	}
+}
+
+static void Http2_ReceiveSettings(Http2 *http2, uint8_t flags, uint8_t *payload, ptrdiff_t length, int *completed) {
+	if (flags & HTTP2_FLAG_ACK)
+		return;
+
+	if (length % 6) {
+		Http2_ConnectionError(http2, HTTP2_FRAME_SIZE_ERROR, "invalid settings frame", completed);
+		return;
+	}
+
+	for (ptrdiff_t offset = 0; offset < length; offset += 6) {
+		uint16_t id    = (uint16_t)((payload[offset] << 8) | payload[offset + 1]);
+		uint32_t value = Http2_Read32(payload + offset + 2);
+
+		switch (id) {
+			case HTTP2_SETTINGS_HEADER_TABLE_SIZE: {
+				Hpack_SetMaxSize(&http2->encoder, Minimum(value, (uint32_t)HPACK_TABLE_SIZE));
+				http2->encoder_resized = true;
+			} break;
+
+			case HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS: {
+				http2->max_streams = Minimum(value, (uint32_t)HTTP2_MAX_STREAMS);
+			} break;
+
+			case HTTP2_SETTINGS_INITIAL_WINDOW_SIZE: {
+				if (value > HTTP2_MAX_WINDOW) {
+					Http2_ConnectionError(http2, HTTP2_FLOW_CONTROL_ERROR, "invalid initial window size", completed);
+					return;
+				}
+				int64_t delta = (int64_t)value - http2->initial_window;
+				for (Http2_Stream &stream : http2->streams) {
+					if (stream.id)
+						stream.send_window += delta;
+				}
+				http2->initial_window = value;
+			} break;
+
+			case HTTP2_SETTINGS_MAX_FRAME_SIZE: {
+				if (value < HTTP2_MAX_FRAME_SIZE || value > 0xffffff) {
+					Http2_ConnectionError(http2, HTTP2_PROTOCOL_ERROR, "invalid max frame size", completed);
+					return;
+				}
+			} break;
+		}
+	}
+
+	http2->settings_received = true;
+
+	Http2_SendFrame(http2, HTTP2_FRAME_SETTINGS, HTTP2_FLAG_ACK, 0, nullptr, 0);
+	Http2_SendPendingData(http2);
+}
+
+static void Http2_ReceiveWindowUpdate(Http2 *http2, int32_t id, uint8_t *payload, ptrdiff_t length, int *completed) {
+	if (length != 4) {
+		Http2_ConnectionError(http2, HTTP2_FRAME_SIZE_ERROR, "invalid window update", completed);
+		return;
+	}
+
+	uint32_t increment = Http2_Read32(payload) & 0x7fffffff;
+
+	if (id == 0) {
+		http2->send_window += increment;
+		if (!increment || http2->send_window > HTTP2_MAX_WINDOW) {
+			Http2_ConnectionError(http2, HTTP2_FLOW_CONTROL_ERROR, "invalid connection window update", completed);
+			return;
+		}
+		Http2_SendPendingData(http2);
+		return;
+	}
+
+	Http2_Stream *stream = Http2_FindStream(http2, id);
+	if (!stream)
+		return;
+
+	stream->send_window += increment;
+	if (!increment || stream->send_window > HTTP2_MAX_WINDOW) {
+		Http2_SendReset(http2, stream->id, HTTP2_FLOW_CONTROL_ERROR);
+		stream->end_stream_sent = true;
+		Http2_CompleteStream(http2, stream, false, completed);
+		return;
+	}
+
+	if (stream->body_remaining)
+		Http2_SendData(http2, stream);
+}
+
+static void Http2_ProcessFrame(Http2 *http2, uint8_t type, uint8_t flags, int32_t id, uint8_t *payload, ptrdiff_t length, int *completed) {
+	if (http2->header_stream && (type != HTTP2_FRAME_CONTINUATION || id != http2->header_stream)) {
+		Http2_ConnectionError(http2, HTTP2_PROTOCOL_ERROR, "header block interrupted", completed);
+		return;
+	}
+
+	switch (type) {
+		case HTTP2_FRAME_DATA: {
+			if (!id) {
+				Http2_ConnectionError(http2, HTTP2_PROTOCOL_ERROR, "data frame on stream 0", completed);
+				return;
+			}
+			Http2_ReceiveData(http2, id, flags, payload, length, completed);
+		} break;
+
+		case HTTP2_FRAME_HEADERS:
+		case HTTP2_FRAME_CONTINUATION: {
+			if (!id || (type == HTTP2_FRAME_CONTINUATION && !http2->header_stream)) {
+				Http2_ConnectionError(http2, HTTP2_PROTOCOL_ERROR, "unexpected header frame", completed);
+				return;
+			}
+
+			if (type == HTTP2_FRAME_HEADERS) {
+				ptrdiff_t skip = 0, padding = 0;
+				if (flags & HTTP2_FLAG_PADDED) {
+					padding = length ? payload[0] : 0;
+					skip += 1;
+				}
+				if (flags & HTTP2_FLAG_PRIORITY)
+					skip += 5;
+				if (skip + padding > length) {
+					Http2_ConnectionError(http2, HTTP2_PROTOCOL_ERROR, "invalid padding", completed);
+					return;
+				}
+				payload += skip;
+				length  -= skip + padding;
+
+				http2->header_stream = id;
+				http2->header_flags  = flags;
+				http2->header_length = 0;
+			}
+
+			if (http2->header_length + length > HTTP2_MAX_HEADER_BLOCK) {
+				Http2_ConnectionError(http2, HTTP2_INTERNAL_ERROR, "header block too large", completed);
+				return;
+			}
+
+			memcpy(http2->header_block + http2->header_length, payload, length);
+			http2->header_length += length;
+
+			if (flags & HTTP2_FLAG_END_HEADERS)
+				Http2_ProcessHeaderBlock(http2, completed);
+		} break;
+
+		case HTTP2_FRAME_RST_STREAM: {
+			Http2_Stream *stream = Http2_FindStream(http2, id);
+			if (stream) {
+				uint32_t error = length == 4 ? Http2_Read32(payload) : HTTP2_PROTOCOL_ERROR;
+				LogWarningEx("Http2", "Stream %d reset by the server, error: %u", id, error);
+				stream->end_stream_sent = true;
+				Http2_CompleteStream(http2, stream, false, completed);
+			}
+		} break;
+
+		case HTTP2_FRAME_SETTINGS: {
+			if (id) {
+				Http2_ConnectionError(http2, HTTP2_PROTOCOL_ERROR, "settings frame on a stream", completed);
+				return;
+			}
+			Http2_ReceiveSettings(http2, flags, payload, length, completed);
+		} break;
+
+		case HTTP2_FRAME_PUSH_PROMISE: {
+			Http2_ConnectionError(http2, HTTP2_PROTOCOL_ERROR, "push promise received with push disabled", completed);
+		} break;
+
+		case HTTP2_FRAME_PING: {
+			if (length != 8) {
+				Http2_ConnectionError(http2, HTTP2_FRAME_SIZE_ERROR, "invalid ping frame", completed);
+				return;
+			}
+			if (!(flags & HTTP2_FLAG_ACK))
+				Http2_SendFrame(http2, HTTP2_FRAME_PING, HTTP2_FLAG_ACK, 0, payload, length);
+		} break;
+
+		case HTTP2_FRAME_GOAWAY: {
+			if (length < 8) {
+				Http2_ConnectionError(http2, HTTP2_FRAME_SIZE_ERROR, "invalid goaway frame", completed);
+				return;
+			}
+			int32_t last_stream = (int32_t)(Http2_Read32(payload) & 0x7fffffff);
+			uint32_t error      = Http2_Read32(payload + 4);
+			if (error != HTTP2_NO_ERROR)
+				LogWarningEx("Http2", "Server is going away, error: %u", error);
+			http2->going_away = true;
+			Http2_FailStreams(http2, last_stream, completed);
+		} break;
+
+		case HTTP2_FRAME_WINDOW_UPDATE: {
+			Http2_ReceiveWindowUpdate(http2, id, payload, length, completed);
+		} break;
+
+		// PRIORITY and unknown frames are ignored
+	}
+}
+
+//
+//
+//
+
+Http2 *Http2_Connect(const String hostname, Memory_Allocator allocator, const Net_Socket_Options &options) {
+	String host = hostname;
+	String port = "443";
+
+	ptrdiff_t scheme = StrFind(host, "://");
+	if (scheme >= 0) {
+		if (!StrMatchICase(SubStr(host, 0, scheme), "https")) {
+			LogErrorEx("Http2", "Only https is supported: " StrFmt, StrArg(hostname));
+			return nullptr;
+		}
+		host = SubStr(host, scheme + 3);
+	}
+
+	ptrdiff_t slash = StrFindChar(host, '/');
+	if (slash >= 0)
+		host = SubStr(host, 0, slash);
+
+	ptrdiff_t colon = StrFindChar(host, ':');
+	if (colon >= 0) {
+		port = SubStr(host, colon + 1);
+		host = SubStr(host, 0, colon);
+	}
+
+	if (!host.length || host.length + port.length + 1 > HTTP2_MAX_AUTHORITY) {
+		LogErrorEx("Http2", "Invalid hostname: " StrFmt, StrArg(hostname));
+		return nullptr;
+	}
+
+	Net_Socket *socket = Net_OpenConnection(host, port, NET_SOCKET_TCP, allocator, options);
+	if (!socket)
+		return nullptr;
+
+	String protocols[] = { "h2" };
+	if (!Net_OpenSecureChannel(socket, Array_View<String>(protocols, ArrayCount(protocols)), true)) {
+		Net_CloseConnection(socket);
+		return nullptr;
+	}
+
+	if (Net_GetApplicationProtocol(socket) != "h2") {
+		LogWarningEx("Http2", "Server " StrFmt " did not negotiate h2", StrArg(host));
+		Net_CloseConnection(socket);
+		return nullptr;
+	}
+
+	Net_SetSocketBlockingMode(socket, false);
+
+	Http2 *http2 = (Http2 *)MemoryAllocate(sizeof(Http2), allocator);
+	if (!http2) {
+		LogErrorEx("Http2", "Connection allocation failed: out of memory");
+		Net_CloseConnection(socket);
+		return nullptr;
+	}
+
+	memset((void *)http2, 0, sizeof(*http2));
+
+	http2->socket          = socket;
+	http2->allocator       = allocator;
+	http2->next_stream_id  = 1;
+	http2->max_streams     = HTTP2_MAX_STREAMS;
+	http2->max_frame_size  = HTTP2_MAX_FRAME_SIZE;
+	http2->initial_window  = HTTP2_DEFAULT_WINDOW;
+	http2->send_window     = HTTP2_DEFAULT_WINDOW;
+	http2->last_stream_id  = 0x7fffffff;
+
+	Hpack_InitTable(&http2->encoder);
+	Hpack_InitTable(&http2->decoder);
+
+	if (port == "443") {
+		memcpy(http2->authority, host.data, host.length);
+		http2->authority_length = host.length;
+	} else {
+		http2->authority_length = snprintf(http2->authority, HTTP2_MAX_AUTHORITY, StrFmt ":" StrFmt, StrArg(host), StrArg(port));
+	}
+
+	uint8_t settings[3 * 6];
+	uint16_t ids[]    = { HTTP2_SETTINGS_ENABLE_PUSH, HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, HTTP2_SETTINGS_INITIAL_WINDOW_SIZE };
+	uint32_t values[] = { 0, HTTP2_MAX_STREAMS, HTTP2_STREAM_WINDOW };
+	for (int index = 0; index < (int)ArrayCount(ids); ++index) {
+		settings[index * 6 + 0] = (uint8_t)(ids[index] >> 8);
+		settings[index * 6 + 1] = (uint8_t)ids[index];
+		Http2_Write32(settings + index * 6 + 2, values[index]);
+	}
+
+	Buffer preface[] = { Buffer((uint8_t *)Http2Preface.data, Http2Preface.length) };
+
+	if (!Http2_Write(http2, preface, ArrayCount(preface)) ||
+		!Http2_SendFrame(http2, HTTP2_FRAME_SETTINGS, 0, 0, settings, sizeof(settings))) {
+		Http2_Disconnect(http2);
+		return nullptr;
+	}
+
+	Http2_SendWindowUpdate(http2, 0, HTTP2_CONNECTION_WINDOW - HTTP2_DEFAULT_WINDOW);
+
+	// Streams are opened once the limits of the server are known
+	uint64_t deadline = Net_GetMilliseconds() + HTTP2_DEFAULT_TIMEOUT;
+	while (!http2->settings_received) {
+		uint64_t now = Net_GetMilliseconds();
+		if (now >= deadline || Http2_Poll(http2, (int)(deadline - now)) < 0) {
+			LogErrorEx("Http2", "Settings of the server not received");
+			Http2_Disconnect(http2);
+			return nullptr;
+		}
+	}
+
+	return http2;
+}
+
+void Http2_Disconnect(Http2 *http2) {
+	if (!http2->failed)
+		Http2_SendGoaway(http2, HTTP2_NO_ERROR);
+
+	// Streams still in flight are completed so that their owners can retry or release them
+	int completed = 0;
+	Http2_FailStreams(http2, 0, &completed);
+
+	Net_CloseConnection(http2->socket);
+	MemoryFree(http2, sizeof(Http2), http2->allocator);
+}
+
+bool Http2_IsConnected(Http2 *http2) {
+	return !http2->failed && !http2->going_away;
+}
+
+int Http2_ActiveStreams(Http2 *http2) {
+	return http2->active;
+}
+
+bool Http2_CanSubmit(Http2 *http2) {
+	return !http2->failed && !http2->going_away &&
+		http2->active < (int32_t)http2->max_streams &&
+		http2->next_stream_id > 0;
+}
+
+bool Http2_Submit(Http2 *http2, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Response *res, Http_Writer writer, Http2_Completion_Proc proc, void *context) {
+	return Http2_SubmitStream(http2, method, endpoint, &params, req, res, writer, proc, context) != nullptr;
+}
+
+int Http2_Poll(Http2 *http2, int timeout) {
+	int completed = 0;
+
+	// A failed write only marks the connection, its streams are failed here so that the completion
+	// procs don't run from inside of Http2_Submit
+	if (http2->failed) {
+		Http2_FailStreams(http2, 0, &completed);
+		return -1;
+	}
+
+	do {
+		uint8_t *dst  = http2->read_buffer + http2->read_length;
+		int available = (int)(sizeof(http2->read_buffer) - http2->read_length);
+
+		// Records already decrypted by TLS are not seen by poll
+		int received;
+		if (Net_HasPendingData(http2->socket)) {
+			received = Net_Receive(http2->socket, dst, available);
+		} else {
+			received = Net_ReceiveBlocked(http2->socket, dst, available, timeout);
+		}
+
+		if (received < 0) {
+			http2->failed = true;
+			Http2_FailStreams(http2, 0, &completed);
+			return -1;
+		}
+
+		http2->read_length += received;
+
+		uint8_t *trav = http2->read_buffer;
+		uint8_t *last = http2->read_buffer + http2->read_length;
+
+		while (last - trav >= HTTP2_FRAME_HEADER_SIZE && !http2->failed) {
+			ptrdiff_t length = ((ptrdiff_t)trav[0] << 16) | ((ptrdiff_t)trav[1] << 8) | trav[2];
+			uint8_t type     = trav[3];
+			uint8_t flags    = trav[4];
+			int32_t id       = (int32_t)(Http2_Read32(trav + 5) & 0x7fffffff);
+
+			if (length > HTTP2_MAX_FRAME_SIZE) {
+				Http2_ConnectionError(http2, HTTP2_FRAME_SIZE_ERROR, "frame too large", &completed);
+				break;
+			}
+
+			if (last - trav < HTTP2_FRAME_HEADER_SIZE + length)
+				break;
+
+			Http2_ProcessFrame(http2, type, flags, id, trav + HTTP2_FRAME_HEADER_SIZE, length, &completed);
+			trav += HTTP2_FRAME_HEADER_SIZE + length;
+		}
+
+		if (http2->failed) {
+			Http2_FailStreams(http2, 0, &completed);
+			return -1;
+		}
+
+		http2->read_length = last - trav;
+		memmove(http2->read_buffer, trav, http2->read_length);
+
+		timeout = 0;
+	} while (Net_HasPendingData(http2->socket));
+
+	return completed;
+}
+
+//
+//
+//
+
+struct Http2_Blocking_Context {
+	bool done;
+	bool success;
+};
+
+static void Http2_BlockingProc(Http2 *http2, Http_Response *res, bool success, void *context) {
+	Http2_Blocking_Context *blocking = (Http2_Blocking_Context *)context;
+	blocking->done    = true;
+	blocking->success = success;
+}
+
+struct Http2_Arena_Writer {
+	Memory_Arena *arena;
+	uint8_t *     last_pos;
+	ptrdiff_t     length;
+};
+
+static void Http2_ArenaWriterProc(Http_Header &header, uint8_t *buffer, ptrdiff_t length, void *context) {
+	Http2_Arena_Writer *writer = (Http2_Arena_Writer *)context;
+	if (writer->length >= 0) {
+		uint8_t *dst = (uint8_t *)PushSize(writer->arena, length);
+		if (dst) {
+			Assert(dst == writer->last_pos);
+			memcpy(dst, buffer, length);
+			writer->last_pos = dst + length;
+			writer->length += length;
+			return;
+		}
+	}
+	LogErrorEx("Http2", "Receiving body failed: arena writer out of memory");
+	writer->length = -1;
+}
+
+static bool Http2_ArenaExchange(Http2 *http2, const String method, const String endpoint, const Http_Query_Params *params, const Http_Request &req, Http_Response *res, Memory_Arena *arena) {
+	uint8_t *body = (uint8_t *)MemoryArenaGetCurrent(arena);
+	auto temp     = BeginTemporaryMemory(arena);
+
+	Http2_Arena_Writer arena_writer;
+	arena_writer.arena    = arena;
+	arena_writer.last_pos = body;
+	arena_writer.length   = 0;
+
+	Http_Writer writer;
+	writer.proc    = Http2_ArenaWriterProc;
+	writer.context = &arena_writer;
+
+	Http2_Blocking_Context blocking = { false, false };
+
+	Http2_Stream *stream = Http2_SubmitStream(http2, method, endpoint, params, req, res, writer, Http2_BlockingProc, &blocking);
+	if (!stream) {
+		EndTemporaryMemory(&temp);
+		return false;
+	}
+
+	int32_t id        = stream->id;
+	uint64_t deadline = Net_GetMilliseconds() + HTTP2_DEFAULT_TIMEOUT;
+
+	// Other streams of the connection complete meanwhile
+	while (!blocking.done) {
+		uint64_t now = Net_GetMilliseconds();
+		if (now >= deadline) {
+			LogErrorEx("Http2", "Request timed out");
+			stream = Http2_FindStream(http2, id);
+			if (stream) {
+				Http2_SendReset(http2, id, HTTP2_CANCEL);
+				Http2_ReleaseStream(http2, stream);
+			}
+			break;
+		}
+		if (Http2_Poll(http2, (int)(deadline - now)) < 0)
+			break;
+	}
+
+	if (blocking.done && blocking.success && arena_writer.length >= 0) {
+		res->body = Buffer(body, arena_writer.length);
+		return true;
+	}
+
+	EndTemporaryMemory(&temp);
+	return false;
+}
+
+bool Http2_CustomMethod(Http2 *http2, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Response *res, Memory_Arena *arena) {
+	return Http2_ArenaExchange(http2, method, endpoint, &params, req, res, arena);
+}
+
+bool Http2_CustomMethod(Http2 *http2, const String method, const String endpoint, const Http_Request &req, Http_Response *res, Memory_Arena *arena) {
+	return Http2_ArenaExchange(http2, method, endpoint, nullptr, req, res, arena);
+}
+
+bool Http2_Get(Http2 *http2, const String endpoint, const Http_Request &req, Http_Response *res, Memory_Arena *arena) {
+	return Http2_ArenaExchange(http2, "GET", endpoint, nullptr, req, res, arena);
+}
+
+bool Http2_Post(Http2 *http2, const String endpoint, const Http_Request &req, Http_Response *res, Memory_Arena *arena) {
+	return Http2_ArenaExchange(http2, "POST", endpoint, nullptr, req, res, arena);
+}
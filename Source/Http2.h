@@ -0,0 +1,33 @@
+#pragma once
+#include "Http.h"
+
+//
+// HTTP/2 client (RFC 7540) over a TLS connection that negotiated "h2" with ALPN. Requests are
+// multiplexed on the connection as streams and their responses are delivered to the completion
+// proc from Http2_Poll, in the order they finish. A connection must only be used by one thread.
+// The request body, the response and the writer of a stream must stay valid until it completes.
+// The completion proc may submit further requests but must not disconnect.
+//
+
+constexpr int HTTP2_MAX_STREAMS        = 128;
+constexpr int HTTP2_MAX_FRAME_SIZE     = 16384;
+constexpr int HTTP2_DEFAULT_TIMEOUT    = 5000;
+
+struct Http2;
+
+typedef void(*Http2_Completion_Proc)(Http2 *http2, Http_Response *res, bool success, void *context);
+
+Http2 *Http2_Connect(const String hostname, Memory_Allocator allocator = ThreadContext.allocator, const Net_Socket_Options &options = NetDefaultSocketOptions);
+void   Http2_Disconnect(Http2 *http2);
+bool   Http2_IsConnected(Http2 *http2);
+int    Http2_ActiveStreams(Http2 *http2);
+bool   Http2_CanSubmit(Http2 *http2);
+bool   Http2_Submit(Http2 *http2, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Response *res, Http_Writer writer, Http2_Completion_Proc proc, void *context);
+
+// Processes the frames received within timeout, returns the number of streams completed or -1 once the connection is lost
+int    Http2_Poll(Http2 *http2, int timeout);
+
+bool Http2_CustomMethod(Http2 *http2, const String method, const String endpoint, const Http_Query_Params &params, const Http_Request &req, Http_Response *res, Memory_Arena *arena);
+bool Http2_CustomMethod(Http2 *http2, const String method, const String endpoint, const Http_Request &req, Http_Response *res, Memory_Arena *arena);
+bool Http2_Get(Http2 *http2, const String endpoint, const Http_Request &req, Http_Response *res, Memory_Arena *arena);
+bool Http2_Post(Http2 *http2, const String endpoint, const Http_Request &req, Http_Response *res, Memory_Arena *arena);
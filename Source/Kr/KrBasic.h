@@ -289,7 +289,7 @@ struct Hash_Table {
 
 		new_p2allocated = NextPowerOf2(new_p2allocated);
 
-		Bucket *nbuckets = (Bucket *)MemoryAllocate(sizeof(Bucket) * (new_p2allocated >> HASHTABLE_BUCKET_SHIFT));
+		Bucket *nbuckets = (Bucket *)MemoryAllocate(sizeof(Bucket) * (new_p2allocated >> HASHTABLE_BUCKET_SHIFT), allocator);
 		if (!nbuckets) return false;
 
 		memset(nbuckets, 0, sizeof(Bucket) * (new_p2allocated >> HASHTABLE_BUCKET_SHIFT));
@@ -526,7 +526,7 @@ struct Hash_Table {
 		ptrdiff_t shrink_threshold = p2allocated >> 2;
 		ptrdiff_t tombstone_threshold = (p2allocated >> 3) + (p2allocated >> 4);
 		if (count < shrink_threshold && p2allocated > HASHTABLE_INITIAL_SIZE)
-			Resize(p2allocated >> 2);
+			Resize(Maximum(p2allocated >> 2, (ptrdiff_t)HASHTABLE_INITIAL_SIZE));
 		else if (tombstones > tombstone_threshold)
 			Resize(p2allocated);
 	}
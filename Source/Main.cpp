@@ -1,4 +1,5 @@
 ﻿#include "Discord.h"
+#include "Http.h"
 #include "Kr/KrString.h"
 #include "Base64.h"
 
@@ -17,7 +18,7 @@ void LogProcedure(void *context, Log_Level level, const char *source, const char
 }
 
 static volatile bool Logout = false;
-static String        ImageFile = "";
+static Buffer        ImageFile;
 
 void OnTick(Discord::Client *client) {
 	if (Logout) {
@@ -109,6 +110,11 @@ void OnMessage(Discord::Client *client, const Discord::Message &message) {
 			Discord::EditMessage(client, msg->channel_id, msg->id, edited);
 		}
 	} else if (message.content == "editperms") {
+		// Editing overwrites without MANAGE_ROLES is refused by Discord
+		Discord::Permission permissions;
+		if (Discord::ComputeCurrentUserPermissions(client, message.channel_id, &permissions) && !(permissions & Discord::PermissionBit::MANAGE_ROLES))
+			return;
+
 		Discord::Channel *channel = Discord::GetChannel(client, message.channel_id);
 		if (channel) {
 			if (channel->permission_overwrites.count) {
@@ -201,24 +207,6 @@ static void InterruptHandler(int signo) {
 
 #include <signal.h>
 
-static String ReadEntireFile(const char *filename) {
-	FILE *f = fopen(filename, "rb");
-
-	if (!f)
-		return String();
-
-	fseek(f, 0, SEEK_END);
-	long fsize = ftell(f);
-	fseek(f, 0, SEEK_SET);
-
-	char *string = (char *)MemoryAllocate(fsize + 1);
-	fread(string, fsize, 1, f);
-	fclose(f);
-
-	string[fsize] = 0;
-	return String(string, fsize);
-}
-
 int main(int argc, char **argv) {
 	InitThreadContext(0);
 	ThreadContextSetLogger({ LogProcedure, nullptr });
@@ -228,8 +216,11 @@ int main(int argc, char **argv) {
 		return 1;
 	}
 
-	ImageFile = ReadEntireFile("SampleImage.png");
-	Assert(ImageFile.length);
+	// Mapped rather than read so that the upload is paged in while it is sent
+	if (!Http_MapFile("SampleImage.png", &ImageFile)) {
+		fprintf(stderr, "SampleImage.png could not be opened\n");
+		return 1;
+	}
 
 	signal(SIGINT, InterruptHandler);
 
@@ -258,7 +249,12 @@ int main(int argc, char **argv) {
 	events.message_create = OnMessage;
 	events.message_reaction_add = OnReaction;
 
-	Discord::LoginSharded(token, intents, events, &presence);
+	Discord::ShardSpec specs;
+	specs.default_spec.cache = true;
+
+	Discord::LoginSharded(token, intents, events, &presence, 0, specs);
+
+	Http_UnmapFile(ImageFile);
 
 	return 0;
 }
@@ -1,6 +1,9 @@
 #include "Network.h"
 
 #include "NetworkNative.h"
+#include "Kr/KrAtomic.h"
+#include "Kr/KrBasic.h"
+#include "Kr/KrThread.h"
 
 #if PLATFORM_WINDOWS
 #include <ws2tcpip.h>
@@ -25,15 +28,20 @@
 //
 
 constexpr int NET_DEFAULT_USER_SIZE = 8;
+constexpr int NET_MAX_GATHER_SIZE   = KiloBytes(16); // maximum TLS record payload
 
 typedef int(*Net_Write_Proc)(struct Net_Socket *net, void *buffer, int length);
 typedef int(*Net_Read_Proc)(struct Net_Socket *net, void *buffer, int length);
+typedef int(*Net_Write_Vectored_Proc)(struct Net_Socket *net, const Buffer *buffers, int count);
 
 struct Net_Socket {
-	Net_Write_Proc   write;
-	Net_Read_Proc    read;
+	Net_Write_Proc          write;
+	Net_Read_Proc           read;
+	Net_Write_Vectored_Proc writev;
 #ifdef NETWORK_OPENSSL_ENABLE
 	SSL *            ssl;
+	bool             secure; // never falls back to plain text once a secure channel is opened
+	bool             verify;
 #endif
 	SOCKET           descriptor;
 	Net_Error        error;
@@ -46,11 +54,40 @@ struct Net_Socket {
 	sockaddr_storage address;
 	Memory_Allocator allocator;
 	ptrdiff_t        allocated;
+	Net_Socket_Options options;
+	bool             ktls_send; // writes bypass OpenSSL, the kernel builds the records
+	uint8_t          alpn[NET_MAX_ALPN_LENGTH]; // protocols offered during the handshake, in wire format
+	int              alpnlen;
+	char             alpn_selected[NET_MAX_ALPN_LENGTH];
+	Net_Event_Loop * loop;
+	Net_Event_Proc   proc;
+	void *           context;
+	uint32_t         interest;
+	uint32_t         rwait;    // direction the last read is waiting on, TLS may need to write to read
+	uint32_t         wwait;    // direction the last write is waiting on
+	volatile int32_t notified;
+	volatile int32_t removing;
 	uint8_t          user[NET_DEFAULT_USER_SIZE + 0]; // this is extented upto give user size
 };
 
 static constexpr int SocketTypeMap[] = { SOCK_STREAM, SOCK_DGRAM };
 
+constexpr int NET_MAX_RESOLVED_ADDRESSES = 16;
+
+struct Net_Address {
+	int              family;
+	int              socktype;
+	int              protocol;
+	int              addrlen;
+	sockaddr_storage address;
+};
+
+struct Net_Resolved {
+	char        canonname[NET_MAX_CANON_NAME];
+	int         count;
+	Net_Address addresses[NET_MAX_RESOLVED_ADDRESSES];
+};
+
 //
 //
 //
@@ -93,66 +130,50 @@ static bool PL_Net_Initialize() {
 	return true;
 }
 
-static SOCKET PL_Net_OpenSocketDescriptor(const String node, const String service, Net_Socket_Type type, char(&hostname)[NET_MAX_CANON_NAME], sockaddr_storage *addr, ptrdiff_t *addrelen, int *pfamily, int *ptype, int *pprotocol) {
+static bool PL_Net_Resolve(const char *node, const char *service, int socktype, Net_Resolved *resolved) {
 	ADDRINFOW hints;
 	memset(&hints, 0, sizeof(hints));
 	hints.ai_flags    = AI_CANONNAME;
 	hints.ai_family   = AF_UNSPEC;
-	hints.ai_socktype = SocketTypeMap[type];
+	hints.ai_socktype = socktype;
 
-	wchar_t nodename[2048];
+	wchar_t nodename[NET_MAX_CANON_NAME];
 	wchar_t servicename[512];
 
-	if (node.length + 1 >= ArrayCount(nodename) || service.length + 1 >= ArrayCount(servicename)) {
-		LogError("Net:Windows", "Could not create socket: Out of memory");
-		return INVALID_SOCKET;
-	}
-
-	PL_Net_UnicodeToWideChar(nodename, ArrayCount(nodename), (char *)node.data, (int)node.length);
-	PL_Net_UnicodeToWideChar(servicename, ArrayCount(servicename), (char *)service.data, (int)service.length);
+	PL_Net_UnicodeToWideChar(nodename, ArrayCount(nodename), node, (int)strlen(node));
+	PL_Net_UnicodeToWideChar(servicename, ArrayCount(servicename), service, (int)strlen(service));
 
 	ADDRINFOW *address = nullptr;
 	int error = GetAddrInfoW(nodename, servicename, &hints, &address);
 	if (error) {
 		PL_Net_ReportError(error);
-		return INVALID_SOCKET;
+		return false;
 	}
 
-	SOCKET descriptor = INVALID_SOCKET;
-	for (auto ptr = address; ptr; ptr = ptr->ai_next) {
-		descriptor = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
-
-		if (descriptor == INVALID_SOCKET) {
-			FreeAddrInfoW(address);
-			PL_Net_ReportLastSocketError();
-			return INVALID_SOCKET;
-		}
-
-		error = connect(descriptor, ptr->ai_addr, (int)ptr->ai_addrlen);
-		if (error) {
-			closesocket(descriptor);
-			descriptor = INVALID_SOCKET;
-			continue;
-		}
-
-		snprintf(hostname, sizeof(hostname), "%S", address->ai_canonname);
-		*addrelen = ptr->ai_addrlen;
-		memcpy(addr, ptr->ai_addr, ptr->ai_addrlen);
-
-		*pfamily   = ptr->ai_family;
-		*ptype     = ptr->ai_socktype;
-		*pprotocol = ptr->ai_protocol;
+	snprintf(resolved->canonname, sizeof(resolved->canonname), "%S", address->ai_canonname ? address->ai_canonname : nodename);
 
-		break;
+	resolved->count = 0;
+	for (auto ptr = address; ptr && resolved->count < NET_MAX_RESOLVED_ADDRESSES; ptr = ptr->ai_next) {
+		Net_Address *dst = &resolved->addresses[resolved->count++];
+		dst->family   = ptr->ai_family;
+		dst->socktype = ptr->ai_socktype;
+		dst->protocol = ptr->ai_protocol;
+		dst->addrlen  = (int)ptr->ai_addrlen;
+		memcpy(&dst->address, ptr->ai_addr, ptr->ai_addrlen);
 	}
 
 	FreeAddrInfoW(address);
 
-	if (error) {
-		PL_Net_ReportError(WSAGetLastError());
-	}
+	return resolved->count > 0;
+}
 
-	return descriptor;
+static bool PL_Net_SetDescriptorBlocking(SOCKET descriptor, bool blocking) {
+	u_long mode = blocking ? 0 : 1;
+	return ioctlsocket(descriptor, FIONBIO, &mode) == 0;
+}
+
+static bool PL_Net_ConnectInProgress() {
+	return WSAGetLastError() == WSAEWOULDBLOCK;
 }
 
 static void PL_Net_CloseSocketDescriptor(SOCKET descriptor) {
@@ -195,83 +216,403 @@ static bool PL_Net_Initialize() {
 	return true;
 }
 
-static SOCKET PL_Net_OpenSocketDescriptor(const String node, const String service, Net_Socket_Type type, char(&hostname)[NET_MAX_CANON_NAME], sockaddr_storage *addr, ptrdiff_t *addrelen, int *pfamily, int *ptype, int *pprotocol) {
-	static constexpr int SocketTypeMap[] = { SOCK_STREAM, SOCK_DGRAM };
-
+static bool PL_Net_Resolve(const char *node, const char *service, int socktype, Net_Resolved *resolved) {
 	addrinfo hints;
 	memset(&hints, 0, sizeof(hints));
 	hints.ai_flags    = AI_CANONNAME;
 	hints.ai_family   = AF_UNSPEC;
-	hints.ai_socktype = SocketTypeMap[type];
+	hints.ai_socktype = socktype;
 
-	char nodename[2048];
-	char servicename[512];
+	addrinfo *address = nullptr;
+	int error = getaddrinfo(node, service, &hints, &address);
+	if (error) {
+		PL_Net_ReportError(error);
+		return false;
+	}
 
-	if (node.length + 1 >= ArrayCount(nodename) || service.length + 1 >= ArrayCount(servicename)) {
-		const char *source = "";
-#if PLATFORM_LINUX
-			source = "Net:Linux";
-#elif PLATFORM_MAC
-			source = "Net:Mac";
+	snprintf(resolved->canonname, sizeof(resolved->canonname), "%s", address->ai_canonname ? address->ai_canonname : node);
+
+	resolved->count = 0;
+	for (auto ptr = address; ptr && resolved->count < NET_MAX_RESOLVED_ADDRESSES; ptr = ptr->ai_next) {
+		Net_Address *dst = &resolved->addresses[resolved->count++];
+		dst->family   = ptr->ai_family;
+		dst->socktype = ptr->ai_socktype;
+		dst->protocol = ptr->ai_protocol;
+		dst->addrlen  = (int)ptr->ai_addrlen;
+		memcpy(&dst->address, ptr->ai_addr, ptr->ai_addrlen);
+	}
+
+	freeaddrinfo(address);
+
+	return resolved->count > 0;
+}
+
+static bool PL_Net_SetDescriptorBlocking(SOCKET descriptor, bool blocking) {
+	int flags = fcntl(descriptor, F_GETFL, 0);
+	if (flags < 0) return false;
+	flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+	return fcntl(descriptor, F_SETFL, flags) == 0;
+}
+
+static bool PL_Net_ConnectInProgress() {
+	return errno == EINPROGRESS;
+}
+
+static void PL_Net_CloseSocketDescriptor(SOCKET descriptor) {
+	close(descriptor);
+}
 #endif
-		LogErrorEx(source, "Could not create socket: Out of memory");
-		return INVALID_SOCKET;
+
+//
+//
+//
+
+static uint64_t PL_Net_Milliseconds() {
+#if PLATFORM_WINDOWS
+	return GetTickCount64();
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#endif
+}
+
+static int PL_Net_GetSocketError(SOCKET descriptor) {
+	int error        = 0;
+	socklen_t length = sizeof(error);
+	if (getsockopt(descriptor, SOL_SOCKET, SO_ERROR, (char *)&error, &length))
+		return -1;
+	return error;
+}
+
+//
+// Resolved addresses are cached for a fixed time since getaddrinfo doesn't report the record TTL.
+// Connection attempts race the address families as described in RFC 8305 (Happy Eyeballs)
+//
+
+constexpr int NET_DNS_CACHE_SIZE        = 32;
+constexpr int NET_DNS_CACHE_TTL         = 60 * 1000;
+constexpr int NET_CONNECT_ATTEMPT_DELAY = 250;
+constexpr int NET_CONNECT_TIMEOUT       = 10 * 1000;
+
+struct Net_Dns_Entry {
+	char         node[256];
+	char         service[32];
+	int          socktype;
+	uint64_t     expires;
+	Net_Resolved resolved;
+};
+
+struct Net_Dns_Cache {
+	Atomic_Guard  guard;
+	Net_Dns_Entry entries[NET_DNS_CACHE_SIZE];
+};
+
+static Net_Dns_Cache DnsCache;
+
+static Net_Dns_Entry *Net_DnsCacheFind(const char *node, const char *service, int socktype) {
+	for (Net_Dns_Entry &entry : DnsCache.entries) {
+		if (entry.expires && entry.socktype == socktype && !strcmp(entry.node, node) && !strcmp(entry.service, service))
+			return &entry;
 	}
+	return nullptr;
+}
 
-	memcpy(nodename, node.data, node.length);
-	memcpy(servicename, service.data, service.length);
+static bool Net_DnsCacheLookup(const char *node, const char *service, int socktype, Net_Resolved *resolved) {
+	bool found = false;
 
-	nodename[node.length]       = 0;
-	servicename[service.length] = 0;
+	SpinLock(&DnsCache.guard);
+	Net_Dns_Entry *entry = Net_DnsCacheFind(node, service, socktype);
+	if (entry) {
+		if (entry->expires > PL_Net_Milliseconds()) {
+			memcpy(resolved, &entry->resolved, sizeof(*resolved));
+			found = true;
+		} else {
+			entry->expires = 0;
+		}
+	}
+	SpinUnlock(&DnsCache.guard);
 
-	addrinfo *address = nullptr;
-	int error = getaddrinfo(nodename, servicename, &hints, &address);
-	if (error) {
-		PL_Net_ReportError(error);
-		return INVALID_SOCKET;
+	return found;
+}
+
+static void Net_DnsCacheStore(const char *node, const char *service, int socktype, const Net_Resolved *resolved) {
+	if (strlen(node) >= sizeof(Net_Dns_Entry::node) || strlen(service) >= sizeof(Net_Dns_Entry::service))
+		return;
+
+	SpinLock(&DnsCache.guard);
+
+	Net_Dns_Entry *dst = Net_DnsCacheFind(node, service, socktype);
+	if (!dst) {
+		// Replace the one closest to expiring, unused entries have already expired
+		dst = &DnsCache.entries[0];
+		for (Net_Dns_Entry &entry : DnsCache.entries) {
+			if (entry.expires < dst->expires)
+				dst = &entry;
+		}
 	}
 
-	SOCKET descriptor = INVALID_SOCKET;
-	for (auto ptr = address; ptr; ptr = ptr->ai_next) {
-		descriptor = socket(ptr->ai_family, ptr->ai_socktype, ptr->ai_protocol);
+	strcpy(dst->node, node);
+	strcpy(dst->service, service);
+	dst->socktype = socktype;
+	dst->expires  = PL_Net_Milliseconds() + NET_DNS_CACHE_TTL;
+	memcpy(&dst->resolved, resolved, sizeof(*resolved));
 
-		if (descriptor == INVALID_SOCKET) {
-			freeaddrinfo(address);
-			PL_Net_ReportError(error);
-			return INVALID_SOCKET;
+	SpinUnlock(&DnsCache.guard);
+}
+
+static void Net_DnsCacheUpdate(const char *node, const char *service, int socktype, const Net_Address *connected) {
+	SpinLock(&DnsCache.guard);
+	Net_Dns_Entry *entry = Net_DnsCacheFind(node, service, socktype);
+	if (entry) {
+		Net_Resolved *resolved = &entry->resolved;
+		if (!connected) {
+			// None of the addresses worked, resolve again next time
+			entry->expires = 0;
+		} else {
+			// Try the address that worked first on the next connection
+			for (int index = 1; index < resolved->count; ++index) {
+				Net_Address *address = &resolved->addresses[index];
+				if (address->addrlen == connected->addrlen && !memcmp(&address->address, &connected->address, address->addrlen)) {
+					Net_Address first = *address;
+					memmove(resolved->addresses + 1, resolved->addresses, index * sizeof(Net_Address));
+					resolved->addresses[0] = first;
+					break;
+				}
+			}
+		}
+	}
+	SpinUnlock(&DnsCache.guard);
+}
+
+uint64_t Net_GetMilliseconds() {
+	return PL_Net_Milliseconds();
+}
+
+void Net_FlushDnsCache() {
+	SpinLock(&DnsCache.guard);
+	for (Net_Dns_Entry &entry : DnsCache.entries)
+		entry.expires = 0;
+	SpinUnlock(&DnsCache.guard);
+}
+
+static void Net_InterleaveAddressFamilies(Net_Resolved *resolved) {
+	// Alternate families starting with the one getaddrinfo preferred, keeping the order within a family
+	Net_Address sorted[NET_MAX_RESOLVED_ADDRESSES];
+	bool        taken[NET_MAX_RESOLVED_ADDRESSES] = {};
+
+	int family = resolved->addresses[0].family;
+	for (int count = 0; count < resolved->count; ++count) {
+		int pick = -1;
+		for (int index = 0; index < resolved->count; ++index) {
+			if (taken[index]) continue;
+			if (pick < 0) pick = index;
+			if (resolved->addresses[index].family == family) {
+				pick = index;
+				break;
+			}
 		}
+		taken[pick]   = true;
+		sorted[count] = resolved->addresses[pick];
+		family        = sorted[count].family == AF_INET6 ? AF_INET : AF_INET6;
+	}
+
+	memcpy(resolved->addresses, sorted, resolved->count * sizeof(Net_Address));
+}
+
+static void Net_ApplySocketOptions(SOCKET descriptor, int socktype, const Net_Socket_Options &options) {
+	auto set = [descriptor](int level, int name, int value, const char *option) {
+		if (setsockopt(descriptor, level, name, (const char *)&value, sizeof(value)))
+			LogWarningEx("Net", "Failed to set %s", option);
+	};
+
+	if (options.receive_buffer > 0)
+		set(SOL_SOCKET, SO_RCVBUF, options.receive_buffer, "SO_RCVBUF");
+	if (options.send_buffer > 0)
+		set(SOL_SOCKET, SO_SNDBUF, options.send_buffer, "SO_SNDBUF");
+
+#if PLATFORM_LINUX
+	if (options.busy_poll > 0)
+		set(SOL_SOCKET, SO_BUSY_POLL, options.busy_poll, "SO_BUSY_POLL");
+	if (options.incoming_cpu >= 0)
+		set(SOL_SOCKET, SO_INCOMING_CPU, options.incoming_cpu, "SO_INCOMING_CPU");
+#endif
+
+	if (socktype != SOCK_STREAM)
+		return;
+
+	if (options.nodelay)
+		set(IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+
+	if (options.keepalive) {
+		set(SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+#if defined(TCP_KEEPIDLE)
+		if (options.keepalive_idle > 0)
+			set(IPPROTO_TCP, TCP_KEEPIDLE, options.keepalive_idle, "TCP_KEEPIDLE");
+#elif defined(TCP_KEEPALIVE)
+		if (options.keepalive_idle > 0)
+			set(IPPROTO_TCP, TCP_KEEPALIVE, options.keepalive_idle, "TCP_KEEPALIVE");
+#endif
+#if defined(TCP_KEEPINTVL)
+		if (options.keepalive_interval > 0)
+			set(IPPROTO_TCP, TCP_KEEPINTVL, options.keepalive_interval, "TCP_KEEPINTVL");
+#endif
+#if defined(TCP_KEEPCNT)
+		if (options.keepalive_count > 0)
+			set(IPPROTO_TCP, TCP_KEEPCNT, options.keepalive_count, "TCP_KEEPCNT");
+#endif
+	}
+}
+
+static void Net_ApplyConnectedOptions(SOCKET descriptor, int socktype, const Net_Socket_Options &options) {
+#if PLATFORM_LINUX
+	// Only takes effect on an established connection, and the kernel falls back to delayed acks
+	// on its own, so this only affects the start of the connection
+	if (socktype == SOCK_STREAM && options.quickack) {
+		int value = 1;
+		if (setsockopt(descriptor, IPPROTO_TCP, TCP_QUICKACK, (const char *)&value, sizeof(value)))
+			LogWarningEx("Net", "Failed to set %s", "TCP_QUICKACK");
+	}
+#endif
+}
+
+static SOCKET Net_ConnectAddresses(const Net_Resolved *resolved, const Net_Socket_Options &options, int *connected) {
+	SOCKET descriptors[NET_MAX_RESOLVED_ADDRESSES];
+	int    indices[NET_MAX_RESOLVED_ADDRESSES];
+	pollfd fds[NET_MAX_RESOLVED_ADDRESSES];
+	int    pending = 0;
+	int    next    = 0;
+
+	SOCKET   result   = INVALID_SOCKET;
+	uint64_t now      = PL_Net_Milliseconds();
+	uint64_t deadline = now + NET_CONNECT_TIMEOUT;
+	uint64_t attempt  = now;
+
+	while (result == INVALID_SOCKET && now < deadline) {
+		// Start the next attempt when the previous one is taking too long or has failed
+		if (next < resolved->count && (now >= attempt || !pending)) {
+			const Net_Address *address = &resolved->addresses[next];
+
+			SOCKET descriptor = socket(address->family, address->socktype, address->protocol);
+			if (descriptor != INVALID_SOCKET) {
+				// Buffer sizes have to be set before connecting for the window scale to pick them up
+				Net_ApplySocketOptions(descriptor, address->socktype, options);
+				PL_Net_SetDescriptorBlocking(descriptor, false);
+				if (connect(descriptor, (sockaddr *)&address->address, address->addrlen) == 0) {
+					result     = descriptor;
+					*connected = next;
+					break;
+				}
+				if (PL_Net_ConnectInProgress()) {
+					descriptors[pending] = descriptor;
+					indices[pending]     = next;
+					pending += 1;
+				} else {
+					PL_Net_CloseSocketDescriptor(descriptor);
+				}
+			}
 
-		error = connect(descriptor, ptr->ai_addr, (int)ptr->ai_addrlen);
-		if (error) {
-			close(descriptor);
-			descriptor = INVALID_SOCKET;
+			next   += 1;
+			attempt = now + NET_CONNECT_ATTEMPT_DELAY;
 			continue;
 		}
 
-		snprintf(hostname, sizeof(hostname), "%s", address->ai_canonname);
-		*addrelen = ptr->ai_addrlen;
-		memcpy(addr, ptr->ai_addr, ptr->ai_addrlen);
+		if (!pending) break;
+
+		uint64_t wake = deadline;
+		if (next < resolved->count)
+			wake = Minimum(wake, attempt);
+
+		for (int index = 0; index < pending; ++index) {
+			fds[index].fd      = descriptors[index];
+			fds[index].events  = POLLWRNORM;
+			fds[index].revents = 0;
+		}
+
+		int count = poll(fds, pending, (int)(wake - now));
+		now = PL_Net_Milliseconds();
+		if (count <= 0) continue;
+
+		for (int index = pending - 1; index >= 0; --index) {
+			if (!fds[index].revents) continue;
+
+			if ((fds[index].revents & POLLWRNORM) && PL_Net_GetSocketError(descriptors[index]) == 0) {
+				result     = descriptors[index];
+				*connected = indices[index];
+			} else {
+				PL_Net_CloseSocketDescriptor(descriptors[index]);
+				attempt = now;
+			}
 
-		*pfamily   = ptr->ai_family;
-		*ptype     = ptr->ai_socktype;
-		*pprotocol = ptr->ai_protocol;
+			pending -= 1;
+			descriptors[index] = descriptors[pending];
+			indices[index]     = indices[pending];
+			fds[index]         = fds[pending];
 
-		break;
+			if (result != INVALID_SOCKET) break;
+		}
 	}
 
-	freeaddrinfo(address);
+	for (int index = 0; index < pending; ++index)
+		PL_Net_CloseSocketDescriptor(descriptors[index]);
 
-	if (error) {
-		PL_Net_ReportError(errno);
+	if (result != INVALID_SOCKET) {
+		PL_Net_SetDescriptorBlocking(result, true);
+		Net_ApplyConnectedOptions(result, resolved->addresses[*connected].socktype, options);
 	}
 
-	return descriptor;
+	return result;
 }
 
-static void PL_Net_CloseSocketDescriptor(SOCKET descriptor) {
-	close(descriptor);
+static SOCKET Net_OpenSocketDescriptor(const String node, const String service, Net_Socket_Type type, const Net_Socket_Options &options, char(&hostname)[NET_MAX_CANON_NAME], sockaddr_storage *addr, ptrdiff_t *addrelen, int *pfamily, int *ptype, int *pprotocol) {
+	char nodename[NET_MAX_CANON_NAME];
+	char servicename[512];
+
+	if (node.length + 1 >= (ptrdiff_t)ArrayCount(nodename) || service.length + 1 >= (ptrdiff_t)ArrayCount(servicename)) {
+		LogErrorEx("Net", "Could not create socket: Out of memory");
+		return INVALID_SOCKET;
+	}
+
+	memcpy(nodename, node.data, node.length);
+	memcpy(servicename, service.data, service.length);
+
+	nodename[node.length]       = 0;
+	servicename[service.length] = 0;
+
+	int socktype = SocketTypeMap[type];
+
+	static thread_local Net_Resolved resolved;
+
+	if (!Net_DnsCacheLookup(nodename, servicename, socktype, &resolved)) {
+		if (!PL_Net_Resolve(nodename, servicename, socktype, &resolved))
+			return INVALID_SOCKET;
+		Net_InterleaveAddressFamilies(&resolved);
+		Net_DnsCacheStore(nodename, servicename, socktype, &resolved);
+	}
+
+	int connected     = 0;
+	SOCKET descriptor = Net_ConnectAddresses(&resolved, options, &connected);
+
+	if (descriptor == INVALID_SOCKET) {
+		Net_DnsCacheUpdate(nodename, servicename, socktype, nullptr);
+		LogErrorEx("Net", "Failed to connect to %s:%s", nodename, servicename);
+		return INVALID_SOCKET;
+	}
+
+	const Net_Address *address = &resolved.addresses[connected];
+	if (connected)
+		Net_DnsCacheUpdate(nodename, servicename, socktype, address);
+
+	memcpy(hostname, resolved.canonname, sizeof(hostname));
+	memcpy(addr, &address->address, address->addrlen);
+
+	*addrelen  = address->addrlen;
+	*pfamily   = address->family;
+	*ptype     = address->socktype;
+	*pprotocol = address->protocol;
+
+	return descriptor;
 }
-#endif
 
 //
 //
@@ -287,6 +628,29 @@ static int PL_Net_Read(Net_Socket *net, void *buffer, int length) {
 	return read;
 }
 
+static int PL_Net_WriteVectored(Net_Socket *net, const Buffer *buffers, int count) {
+	count = Minimum(count, NET_MAX_IO_VECTORS);
+#if PLATFORM_WINDOWS
+	WSABUF vectors[NET_MAX_IO_VECTORS];
+	for (int index = 0; index < count; ++index) {
+		vectors[index].buf = (char *)buffers[index].data;
+		vectors[index].len = (ULONG)buffers[index].length;
+	}
+	DWORD written = 0;
+	if (WSASend((SOCKET)net->descriptor, vectors, (DWORD)count, &written, 0, nullptr, nullptr) == SOCKET_ERROR)
+		return -1;
+	return (int)written;
+#elif PLATFORM_LINUX || PLATFORM_MAC
+	iovec vectors[NET_MAX_IO_VECTORS];
+	for (int index = 0; index < count; ++index) {
+		vectors[index].iov_base = buffers[index].data;
+		vectors[index].iov_len  = buffers[index].length;
+	}
+	int written = (int)writev(net->descriptor, vectors, count);
+	return written;
+#endif
+}
+
 //
 //
 //
@@ -294,6 +658,8 @@ static int PL_Net_Read(Net_Socket *net, void *buffer, int length) {
 #ifdef NETWORK_OPENSSL_ENABLE
 static SSL_CTX *DefaultClientContext;
 static SSL_CTX *DefaultClientVerifyContext;
+static volatile int32_t KernelTLS;         // only changed before Net_Initialize
+static volatile int32_t KernelTLSReported;
 
 static void PL_Net_ReportOpenSSLError() {
 	char message[1024];
@@ -307,7 +673,122 @@ static void PL_Net_ReportOpenSSLError() {
 	}
 }
 
+//
+// Client side session cache keyed on host, port and verification mode, so that reconnects can
+// resume with an abbreviated handshake. OpenSSL's internal cache is only used by servers
+//
+
+constexpr int NET_SESSION_CACHE_SIZE = 64;
+
+struct Net_Session_Entry {
+	char          hostname[NET_MAX_CANON_NAME];
+	int           port;
+	bool          verify;
+	uint64_t      used;
+	SSL_SESSION * session;
+};
+
+struct Net_Session_Cache {
+	Atomic_Guard      guard;
+	uint64_t          clock;
+	Net_Session_Stats stats;
+	Net_Session_Entry entries[NET_SESSION_CACHE_SIZE];
+};
+
+static Net_Session_Cache SessionCache;
+
+static Net_Session_Entry *PL_Net_SessionCacheFind(Net_Socket *net, bool verify) {
+	int port = Net_GetPort(net);
+	for (Net_Session_Entry &entry : SessionCache.entries) {
+		if (entry.session && entry.port == port && entry.verify == verify && !strcmp(entry.hostname, net->hostname))
+			return &entry;
+	}
+	return nullptr;
+}
+
+static void PL_Net_SessionCacheStore(Net_Socket *net, bool verify, SSL_SESSION *session) {
+	SpinLock(&SessionCache.guard);
+
+	Net_Session_Entry *dst = PL_Net_SessionCacheFind(net, verify);
+	if (!dst) {
+		// Evict the least recently used one when full
+		dst = &SessionCache.entries[0];
+		for (Net_Session_Entry &entry : SessionCache.entries) {
+			if (!entry.session) {
+				dst = &entry;
+				break;
+			}
+			if (entry.used < dst->used)
+				dst = &entry;
+		}
+	}
+
+	SSL_SESSION *prev = dst->session;
+
+	memcpy(dst->hostname, net->hostname, sizeof(dst->hostname));
+	dst->port    = Net_GetPort(net);
+	dst->verify  = verify;
+	dst->used    = ++SessionCache.clock;
+	dst->session = session;
+
+	SpinUnlock(&SessionCache.guard);
+
+	if (prev)
+		SSL_SESSION_free(prev);
+}
+
+static SSL_SESSION *PL_Net_SessionCacheTake(Net_Socket *net, bool verify) {
+	SpinLock(&SessionCache.guard);
+
+	SSL_SESSION *session     = nullptr;
+	Net_Session_Entry *entry = PL_Net_SessionCacheFind(net, verify);
+	if (entry) {
+		session = entry->session;
+		// TLS 1.3 tickets are single use, a fresh one is sent after the resumed handshake
+		if (SSL_SESSION_get_protocol_version(session) >= TLS1_3_VERSION) {
+			entry->session = nullptr;
+		} else {
+			SSL_SESSION_up_ref(session);
+			entry->used = ++SessionCache.clock;
+		}
+	}
+
+	SpinUnlock(&SessionCache.guard);
+	return session;
+}
+
+static void PL_Net_SessionCacheRecord(bool resumed) {
+	SpinLock(&SessionCache.guard);
+	SessionCache.stats.handshakes += 1;
+	SessionCache.stats.resumed    += resumed;
+	SpinUnlock(&SessionCache.guard);
+}
+
+static void PL_Net_SessionCacheClear() {
+	for (Net_Session_Entry &entry : SessionCache.entries) {
+		if (entry.session) {
+			SSL_SESSION_free(entry.session);
+			entry.session = nullptr;
+		}
+	}
+}
+
+static int PL_Net_OpenSSLNewSession(SSL *ssl, SSL_SESSION *session) {
+	Net_Socket *net = (Net_Socket *)SSL_get_app_data(ssl);
+	if (!net || !SSL_SESSION_is_resumable(session))
+		return 0;
+	PL_Net_SessionCacheStore(net, SSL_get_SSL_CTX(ssl) == DefaultClientVerifyContext, session);
+	return 1; // cache holds on to the reference
+}
+
 static void PL_Net_OpenSSLShutdown() {
+	const Net_Session_Stats &stats = SessionCache.stats;
+	if (stats.handshakes) {
+		LogInfoEx("Net:OpenSSL", "TLS sessions resumed: %llu of %llu handshakes (%.1f%%)",
+			(unsigned long long)stats.resumed, (unsigned long long)stats.handshakes, 100.0 * (double)stats.resumed / (double)stats.handshakes);
+	}
+
+	PL_Net_SessionCacheClear();
 	SSL_CTX_free(DefaultClientContext);
 	SSL_CTX_free(DefaultClientVerifyContext);
 }
@@ -332,6 +813,14 @@ static bool PL_Net_OpenSSLInitialize() {
 
 	SSL_CTX_set_verify(DefaultClientVerifyContext, SSL_VERIFY_PEER, nullptr);
 
+	SSL_CTX_set_mode(DefaultClientContext, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+	SSL_CTX_set_mode(DefaultClientVerifyContext, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+	SSL_CTX_set_session_cache_mode(DefaultClientContext, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_set_session_cache_mode(DefaultClientVerifyContext, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(DefaultClientContext, PL_Net_OpenSSLNewSession);
+	SSL_CTX_sess_set_new_cb(DefaultClientVerifyContext, PL_Net_OpenSSLNewSession);
+
 #if PLATFORM_WINDOWS
 	X509_STORE *store = SSL_CTX_get_cert_store(DefaultClientVerifyContext);
 	if (!store) {
@@ -383,34 +872,128 @@ static int PL_Net_OpenSSLRead(Net_Socket *net, void *buffer, int length) {
 	return read;
 }
 
-static bool PL_Net_OpenSSLOpenChannel(Net_Socket *net, bool verify) {
+static int PL_Net_OpenSSLWriteVectored(Net_Socket *net, const Buffer *buffers, int count) {
+	// OpenSSL has no gather write, so small buffers are packed into a single record.
+	// When SSL_write has to be retried, the caller passes the same leading buffers again
+	// so the packed contents are the same as the previous call
+	if (count == 1 || buffers[0].length >= NET_MAX_GATHER_SIZE)
+		return SSL_write(net->ssl, buffers[0].data, (int)buffers[0].length);
+
+	static thread_local uint8_t gather[NET_MAX_GATHER_SIZE];
+
+	int length = 0;
+	for (int index = 0; index < count && length < NET_MAX_GATHER_SIZE; ++index) {
+		int copy = (int)Minimum(buffers[index].length, NET_MAX_GATHER_SIZE - length);
+		memcpy(gather + length, buffers[index].data, copy);
+		length += copy;
+	}
+
+	int written = SSL_write(net->ssl, gather, length);
+	return written;
+}
+
+static void PL_Net_OpenSSLSetProcs(Net_Socket *net) {
+	net->read      = PL_Net_OpenSSLRead;
+	net->write     = PL_Net_OpenSSLWrite;
+	net->writev    = PL_Net_OpenSSLWriteVectored;
+	net->ktls_send = false;
+
+#if PLATFORM_LINUX && defined(SSL_OP_ENABLE_KTLS)
+	// Reads stay on SSL_read even with kTLS receive, since OpenSSL has to pick up the non
+	// application records (alerts, session tickets) from the control messages
+	if (AtomicLoad(&KernelTLS)) {
+		if (BIO_get_ktls_send(SSL_get_wbio(net->ssl))) {
+			net->write     = PL_Net_Write;
+			net->writev    = PL_Net_WriteVectored;
+			net->ktls_send = true;
+		} else if (AtomicCmpExg(&KernelTLSReported, 1, 0) == 0) {
+			LogWarningEx("Net", "Kernel TLS did not engage for %s, secure channels use user space TLS", net->hostname);
+		}
+	}
+#endif
+}
+
+static SSL *PL_Net_OpenSSLConnect(Net_Socket *net, bool verify) {
 	SSL *ssl = SSL_new(verify ? DefaultClientVerifyContext : DefaultClientContext);
 
 	if (!ssl) {
 		PL_Net_ReportOpenSSLError();
-		return false;
+		return nullptr;
 	}
 
 	if (!SSL_set_tlsext_host_name(ssl, net->hostname)) {
 		PL_Net_ReportOpenSSLError();
 		SSL_free(ssl);
-		return false;
+		return nullptr;
+	}
+
+#if PLATFORM_LINUX && defined(SSL_OP_ENABLE_KTLS)
+	// OpenSSL quietly stays in user space if the kernel has no tls ULP
+	if (AtomicLoad(&KernelTLS))
+		SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+#endif
+
+	SSL_SESSION *session = PL_Net_SessionCacheTake(net, verify);
+	if (session) {
+		SSL_set_session(ssl, session);
+		SSL_SESSION_free(session);
+	}
+
+	if (net->alpnlen && SSL_set_alpn_protos(ssl, net->alpn, net->alpnlen) != 0) {
+		PL_Net_ReportOpenSSLError();
+		SSL_free(ssl);
+		return nullptr;
 	}
 
+	SSL_set_app_data(ssl, net);
 	SSL_set_fd(ssl, (int)net->descriptor);
-	if (SSL_connect(ssl) == -1) {
+	if (SSL_connect(ssl) != 1) {
 		PL_Net_ReportOpenSSLError();
 		SSL_free(ssl);
-		return false;
+		return nullptr;
 	}
 
-	net->ssl   = ssl;
-	net->read  = PL_Net_OpenSSLRead;
-	net->write = PL_Net_OpenSSLWrite;
+	PL_Net_SessionCacheRecord(SSL_session_reused(ssl));
+
+	const unsigned char *selected = nullptr;
+	unsigned int selected_len     = 0;
+	SSL_get0_alpn_selected(ssl, &selected, &selected_len);
+	selected_len = Minimum(selected_len, NET_MAX_ALPN_LENGTH - 1);
+	memcpy(net->alpn_selected, selected, selected_len);
+	net->alpn_selected[selected_len] = 0;
+
+	return ssl;
+}
+
+static bool PL_Net_OpenSSLOpenChannel(Net_Socket *net, bool verify) {
+	SSL *ssl = PL_Net_OpenSSLConnect(net, verify);
+	if (!ssl) return false;
+
+	net->ssl    = ssl;
+	net->secure = true;
+	net->verify = verify;
+	PL_Net_OpenSSLSetProcs(net);
 
 	return true;
 }
 
+static void PL_Net_OpenSSLFailChannel(Net_Socket *net) {
+	if (net->ssl) {
+		SSL_free(net->ssl);
+		net->ssl = nullptr;
+	}
+
+	if (net->secure) {
+		// Socket is closed so that every read and write fails until the next reconnect
+		net->read      = PL_Net_Read;
+		net->write     = PL_Net_Write;
+		net->writev    = PL_Net_WriteVectored;
+		net->ktls_send = false;
+		PL_Net_CloseSocketDescriptor(net->descriptor);
+		net->descriptor = INVALID_SOCKET;
+	}
+}
+
 static void PL_Net_OpenSSLCloseChannel(Net_Socket *net) {
 	if (net->ssl) {
 		SSL_shutdown(net->ssl);
@@ -419,12 +1002,21 @@ static void PL_Net_OpenSSLCloseChannel(Net_Socket *net) {
 }
 
 static bool PL_Net_OpenSSLReconnect(Net_Socket *net) {
-	if (net->ssl) {
-		SSL_set_fd(net->ssl, (int)net->descriptor);
-		if (SSL_connect(net->ssl) == -1) {
-			PL_Net_ReportOpenSSLError();
+	if (net->secure) {
+		// The previous connection is gone, a fresh SSL object picks up the cached session
+		if (net->ssl) {
+			SSL_free(net->ssl);
+			net->ssl = nullptr;
+		}
+
+		SSL *ssl = PL_Net_OpenSSLConnect(net, net->verify);
+		if (!ssl) {
+			PL_Net_OpenSSLFailChannel(net);
 			return false;
 		}
+
+		net->ssl = ssl;
+		PL_Net_OpenSSLSetProcs(net);
 	}
 	return true;
 }
@@ -433,6 +1025,7 @@ static bool PL_Net_OpenSSLReconnect(Net_Socket *net) {
 #define PL_Net_OpenSSLShutdown(...)
 #define PL_Net_OpenSSLOpenChannel(...) (false)
 #define PL_Net_OpenSSLCloseChannel(...)
+#define PL_Net_OpenSSLFailChannel(...)
 #define PL_Net_OpenSSLResetDescriptor(...) (true)
 #define PL_Net_OpenSSLReconnect(...) (true)
 #endif
@@ -443,6 +1036,17 @@ static bool PL_Net_OpenSSLReconnect(Net_Socket *net) {
 
 static bool IsInitialized = false;
 
+void Net_EnableKernelTLS(bool enable) {
+#if defined(NETWORK_OPENSSL_ENABLE) && PLATFORM_LINUX
+	// Connections may be opened from any thread, so the setting is fixed once the network is initialized
+	if (IsInitialized) {
+		LogWarningEx("Net", "Kernel TLS must be enabled before Net_Initialize");
+		return;
+	}
+	AtomicStore(&KernelTLS, enable);
+#endif
+}
+
 bool Net_Initialize() {
 	if (IsInitialized) return true;
 
@@ -452,6 +1056,16 @@ bool Net_Initialize() {
 	return IsInitialized;
 }
 
+Net_Session_Stats Net_GetSessionStats() {
+	Net_Session_Stats stats = {};
+#ifdef NETWORK_OPENSSL_ENABLE
+	SpinLock(&SessionCache.guard);
+	stats = SessionCache.stats;
+	SpinUnlock(&SessionCache.guard);
+#endif
+	return stats;
+}
+
 void Net_Shutdown() {
 	if (IsInitialized) {
 		PL_Net_OpenSSLShutdown();
@@ -463,13 +1077,13 @@ void Net_Shutdown() {
 //
 //
 
-Net_Socket *Net_OpenConnection(const String node, const String service, Net_Socket_Type type, ptrdiff_t user_size, Memory_Allocator allocator) {
+Net_Socket *Net_OpenConnection(const String node, const String service, Net_Socket_Type type, ptrdiff_t user_size, Memory_Allocator allocator, const Net_Socket_Options &options) {
 	char hostname[NET_MAX_CANON_NAME];
 
 	sockaddr_storage addr;
 	ptrdiff_t        addr_len;
 	int              family, socktype, protocol;
-	SOCKET descriptor = PL_Net_OpenSocketDescriptor(node, service, type, hostname, &addr, &addr_len, &family, &socktype, &protocol);
+	SOCKET descriptor = Net_OpenSocketDescriptor(node, service, type, options, hostname, &addr, &addr_len, &family, &socktype, &protocol);
 	if (descriptor == INVALID_SOCKET)
 		return nullptr;
 
@@ -484,6 +1098,7 @@ Net_Socket *Net_OpenConnection(const String node, const String service, Net_Sock
 
 		net->write      = PL_Net_Write;
 		net->read       = PL_Net_Read;
+		net->writev     = PL_Net_WriteVectored;
 		net->descriptor = descriptor;
 		net->family     = family;
 		net->type       = socktype;
@@ -492,6 +1107,9 @@ Net_Socket *Net_OpenConnection(const String node, const String service, Net_Sock
 		net->addrlen    = (int)addr_len;
 		net->hostlen    = (int)strlen(hostname);
 		net->allocated  = allocation_size;
+		net->options    = options;
+		net->rwait      = NET_EVENT_READ;
+		net->wwait      = NET_EVENT_WRITE;
 
 		memcpy(net->hostname, hostname, sizeof(hostname));
 		memcpy(&net->address, &addr, sizeof(addr));
@@ -508,15 +1126,33 @@ Net_Socket *Net_OpenConnection(const String node, const String service, Net_Sock
 	return nullptr;
 }
 
-Net_Socket *Net_OpenConnection(const String node, const String service, Net_Socket_Type type, Memory_Allocator allocator) {
-	return Net_OpenConnection(node, service, type, NET_DEFAULT_USER_SIZE, allocator);
+Net_Socket *Net_OpenConnection(const String node, const String service, Net_Socket_Type type, Memory_Allocator allocator, const Net_Socket_Options &options) {
+	return Net_OpenConnection(node, service, type, NET_DEFAULT_USER_SIZE, allocator, options);
 }
 
 bool Net_OpenSecureChannel(Net_Socket *net, bool verify) {
 	return PL_Net_OpenSSLOpenChannel(net, verify);
 }
 
+bool Net_OpenSecureChannel(Net_Socket *net, Array_View<String> protocols, bool verify) {
+	int length = 0;
+	for (const String &protocol : protocols) {
+		if (!protocol.length || protocol.length > 255 || length + 1 + protocol.length > NET_MAX_ALPN_LENGTH) {
+			LogErrorEx("Net", "Invalid application protocol: " StrFmt, StrArg(protocol));
+			return false;
+		}
+		net->alpn[length] = (uint8_t)protocol.length;
+		memcpy(net->alpn + length + 1, protocol.data, protocol.length);
+		length += 1 + (int)protocol.length;
+	}
+	net->alpnlen = length;
+
+	return PL_Net_OpenSSLOpenChannel(net, verify);
+}
+
 void Net_CloseConnection(Net_Socket *net) {
+	if (net->loop)
+		Net_EventLoopRemove(net->loop, net);
 	PL_Net_OpenSSLCloseChannel(net);
 	PL_Net_CloseSocketDescriptor(net->descriptor);
 	MemoryFree(net, net->allocated, net->allocator);
@@ -539,6 +1175,12 @@ void Net_SetSocketSendBufferSize(Net_Socket *net, int size) {
 	setsockopt(net->descriptor, SOL_SOCKET, SO_SNDBUF, (char *)&size, sizeof(size));
 }
 
+void Net_SetSocketOptions(Net_Socket *net, const Net_Socket_Options &options) {
+	net->options = options;
+	Net_ApplySocketOptions(net->descriptor, net->type, options);
+	Net_ApplyConnectedOptions(net->descriptor, net->type, options);
+}
+
 void *Net_GetUserBuffer(Net_Socket *net) {
 	return net->user;
 }
@@ -558,15 +1200,21 @@ bool Net_TryReconnect(Net_Socket *net) {
 	if (net->descriptor < 0) {
 		net->descriptor = INVALID_SOCKET;
 		PL_Net_ReportLastSocketError();
+		PL_Net_OpenSSLFailChannel(net);
 		return false;
 	}
 
+	Net_ApplySocketOptions(net->descriptor, net->type, net->options);
+
 	sockaddr *addr = (sockaddr *)&net->address;
 	int error      = connect(net->descriptor, addr, (int)net->addrlen);
 	if (error) {
 		PL_Net_ReportLastSocketError();
+		PL_Net_OpenSSLFailChannel(net);
 		return false;
 	}
+
+	Net_ApplyConnectedOptions(net->descriptor, net->type, net->options);
 	return PL_Net_OpenSSLReconnect(net);
 }
 
@@ -583,6 +1231,25 @@ int32_t Net_GetSocketDescriptor(Net_Socket *net) {
 	return (int32_t)net->descriptor;
 }
 
+bool Net_IsKernelTLS(Net_Socket *net) {
+	return net->ktls_send;
+}
+
+String Net_GetApplicationProtocol(Net_Socket *net) {
+	return String(net->alpn_selected, strlen(net->alpn_selected));
+}
+
+bool Net_IsConnectionIdle(Net_Socket *net) {
+	// Nothing should arrive on an idle connection, anything readable is either EOF or garbage
+	if (Net_HasPendingData(net))
+		return false;
+
+	pollfd fds = {};
+	fds.fd     = net->descriptor;
+	fds.events = POLLRDNORM;
+	return poll(&fds, 1, 0) == 0;
+}
+
 bool Net_SetSocketBlockingMode(Net_Socket *net, bool blocking) {
 	SOCKET fd = net->descriptor;
 #if PLATFORM_WINDOWS
@@ -609,6 +1276,11 @@ static void Net_ReportError(Net_Socket *net) {
 }
 
 int Net_SendBlocked(Net_Socket *net, void *buffer, int length, int timeout) {
+	Buffer single((uint8_t *)buffer, length);
+	return Net_SendVectoredBlocked(net, &single, 1, timeout);
+}
+
+int Net_SendVectoredBlocked(Net_Socket *net, const Buffer *buffers, int count, int timeout) {
 	pollfd fds = {};
 	fds.fd = net->descriptor;
 	fds.events = POLLWRNORM;
@@ -620,10 +1292,10 @@ int Net_SendBlocked(Net_Socket *net, void *buffer, int length, int timeout) {
 
 		if (presult > 0) {
 			if (fds.revents & POLLWRNORM) {
-				int written = net->write(net, buffer, length);
+				int written = count == 1 ? net->write(net, buffers[0].data, (int)buffers[0].length) : net->writev(net, buffers, count);
 
 #ifdef NETWORK_OPENSSL_ENABLE
-				if (net->ssl) {
+				if (net->ssl && !net->ktls_send) {
 					if (SSL_get_error(net->ssl, written) == SSL_ERROR_WANT_WRITE) {
 						time_t current = clock();
 						int time_passed = (1000 * (int)(current - counter)) / CLOCKS_PER_SEC;
@@ -718,17 +1390,62 @@ int Net_ReceiveBlocked(Net_Socket *net, void *buffer, int length, int timeout) {
 	return -1;
 }
 
+static bool PL_Net_OpenSSLWouldBlock(Net_Socket *net, int result, uint32_t *wait) {
+#ifdef NETWORK_OPENSSL_ENABLE
+	// Writes with kTLS are plain socket writes, SSL_get_error would report the last SSL_read
+	if (net->ssl && !(net->ktls_send && wait == &net->wwait)) {
+		int error = SSL_get_error(net->ssl, result);
+		if (error == SSL_ERROR_WANT_WRITE) {
+			*wait      = NET_EVENT_WRITE;
+			net->error = NET_E_WOULD_BLOCK;
+			return true;
+		}
+		if (error == SSL_ERROR_WANT_READ) {
+			*wait      = NET_EVENT_READ;
+			net->error = NET_E_WOULD_BLOCK;
+			return true;
+		}
+	}
+#endif
+	return false;
+}
+
 int Net_Send(Net_Socket *net, void *buffer, int length) {
+	net->wwait = NET_EVENT_WRITE;
 	int written = net->write(net, buffer, length);
 	if (written < 0) {
-#ifdef NETWORK_OPENSSL_ENABLE
-		if (net->ssl) {
-			if (SSL_get_error(net->ssl, written) == SSL_ERROR_WANT_WRITE) {
-				return 0;
-			}
+		if (PL_Net_OpenSSLWouldBlock(net, written, &net->wwait))
+			return 0;
+
+#if PLATFORM_WINDOWS
+		if (WSAGetLastError() == WSAEWOULDBLOCK) {
+			net->error = NET_E_WOULD_BLOCK;
+			return 0;
+		}
+#elif PLATFORM_LINUX || PLATFORM_MAC
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			net->error = NET_E_WOULD_BLOCK;
+			return 0;
 		}
 #endif
 
+		Net_ReportError(net);
+		net->error = NET_E_CONNECTION_LOST;
+		return -1;
+	}
+	net->error = NET_E_NONE;
+	return written;
+}
+
+int Net_SendVectored(Net_Socket *net, const Buffer *buffers, int count) {
+	if (!count) return 0;
+
+	net->wwait = NET_EVENT_WRITE;
+	int written = net->writev(net, buffers, count);
+	if (written < 0) {
+		if (PL_Net_OpenSSLWouldBlock(net, written, &net->wwait))
+			return 0;
+
 #if PLATFORM_WINDOWS
 		if (WSAGetLastError() == WSAEWOULDBLOCK) {
 			net->error = NET_E_WOULD_BLOCK;
@@ -750,16 +1467,11 @@ int Net_Send(Net_Socket *net, void *buffer, int length) {
 }
 
 int Net_Receive(Net_Socket *net, void *buffer, int length) {
+	net->rwait = NET_EVENT_READ;
 	int read = net->read(net, buffer, length);
 	if (read <= 0) {
-
-#ifdef NETWORK_OPENSSL_ENABLE
-		if (net->ssl) {
-			if (SSL_get_error(net->ssl, read) == SSL_ERROR_WANT_READ) {
-				return 0;
-			}
-		}
-#endif
+		if (PL_Net_OpenSSLWouldBlock(net, read, &net->rwait))
+			return 0;
 
 #if PLATFORM_WINDOWS
 		if (WSAGetLastError() == WSAEWOULDBLOCK) {
@@ -780,3 +1492,630 @@ int Net_Receive(Net_Socket *net, void *buffer, int length) {
 	}
 	return read;
 }
+
+//
+//
+//
+
+#if PLATFORM_WINDOWS
+static bool PL_Net_CreateWakeup(Net_Wakeup *wakeup) {
+	// WSAPoll only accepts sockets, so use a UDP socket connected to itself
+	SOCKET descriptor = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (descriptor == INVALID_SOCKET) {
+		PL_Net_ReportLastSocketError();
+		return false;
+	}
+
+	sockaddr_in addr = {};
+	addr.sin_family      = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port        = 0;
+
+	int addrlen = sizeof(addr);
+	u_long mode = 1;
+
+	if (bind(descriptor, (sockaddr *)&addr, sizeof(addr)) ||
+		getsockname(descriptor, (sockaddr *)&addr, &addrlen) ||
+		connect(descriptor, (sockaddr *)&addr, addrlen) ||
+		ioctlsocket(descriptor, FIONBIO, &mode)) {
+		PL_Net_ReportLastSocketError();
+		closesocket(descriptor);
+		return false;
+	}
+
+	wakeup->descriptor[0] = (ptrdiff_t)descriptor;
+	wakeup->descriptor[1] = (ptrdiff_t)descriptor;
+	return true;
+}
+
+static void PL_Net_DestroyWakeup(Net_Wakeup *wakeup) {
+	closesocket((SOCKET)wakeup->descriptor[0]);
+}
+
+static void PL_Net_SignalWakeup(Net_Wakeup *wakeup) {
+	char signal = 1;
+	send((SOCKET)wakeup->descriptor[1], &signal, 1, 0);
+}
+
+static void PL_Net_ClearWakeup(Net_Wakeup *wakeup) {
+	char buffer[64];
+	while (recv((SOCKET)wakeup->descriptor[0], buffer, sizeof(buffer), 0) > 0);
+}
+#elif PLATFORM_LINUX
+static bool PL_Net_CreateWakeup(Net_Wakeup *wakeup) {
+	int descriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (descriptor < 0) {
+		PL_Net_ReportLastPlatformError();
+		return false;
+	}
+	wakeup->descriptor[0] = descriptor;
+	wakeup->descriptor[1] = descriptor;
+	return true;
+}
+
+static void PL_Net_DestroyWakeup(Net_Wakeup *wakeup) {
+	close((int)wakeup->descriptor[0]);
+}
+
+static void PL_Net_SignalWakeup(Net_Wakeup *wakeup) {
+	uint64_t value = 1;
+	ssize_t res = write((int)wakeup->descriptor[1], &value, sizeof(value));
+	(void)res;
+}
+
+static void PL_Net_ClearWakeup(Net_Wakeup *wakeup) {
+	uint64_t value;
+	ssize_t res = read((int)wakeup->descriptor[0], &value, sizeof(value));
+	(void)res;
+}
+#elif PLATFORM_MAC
+static bool PL_Net_CreateWakeup(Net_Wakeup *wakeup) {
+	int descriptors[2];
+	if (pipe(descriptors)) {
+		PL_Net_ReportLastPlatformError();
+		return false;
+	}
+	for (int descriptor : descriptors) {
+		fcntl(descriptor, F_SETFL, fcntl(descriptor, F_GETFL, 0) | O_NONBLOCK);
+		fcntl(descriptor, F_SETFD, FD_CLOEXEC);
+	}
+	wakeup->descriptor[0] = descriptors[0];
+	wakeup->descriptor[1] = descriptors[1];
+	return true;
+}
+
+static void PL_Net_DestroyWakeup(Net_Wakeup *wakeup) {
+	close((int)wakeup->descriptor[0]);
+	close((int)wakeup->descriptor[1]);
+}
+
+static void PL_Net_SignalWakeup(Net_Wakeup *wakeup) {
+	char signal = 1;
+	ssize_t res = write((int)wakeup->descriptor[1], &signal, 1);
+	(void)res;
+}
+
+static void PL_Net_ClearWakeup(Net_Wakeup *wakeup) {
+	char buffer[64];
+	while (read((int)wakeup->descriptor[0], buffer, sizeof(buffer)) > 0);
+}
+#endif
+
+bool Net_CreateWakeup(Net_Wakeup *wakeup) {
+	wakeup->descriptor[0] = INVALID_SOCKET;
+	wakeup->descriptor[1] = INVALID_SOCKET;
+	wakeup->signalled     = 0;
+	return PL_Net_CreateWakeup(wakeup);
+}
+
+void Net_DestroyWakeup(Net_Wakeup *wakeup) {
+	if (wakeup->descriptor[0] != (ptrdiff_t)INVALID_SOCKET) {
+		PL_Net_DestroyWakeup(wakeup);
+		wakeup->descriptor[0] = INVALID_SOCKET;
+		wakeup->descriptor[1] = INVALID_SOCKET;
+	}
+}
+
+void Net_SignalWakeup(Net_Wakeup *wakeup) {
+	// Only the first signal after a clear needs to touch the descriptor
+	if (AtomicCmpExg(&wakeup->signalled, 1, 0) == 0)
+		PL_Net_SignalWakeup(wakeup);
+}
+
+void Net_ClearWakeup(Net_Wakeup *wakeup) {
+	// Drain before resetting the flag, otherwise a signal in between could be lost
+	PL_Net_ClearWakeup(wakeup);
+	AtomicStore(&wakeup->signalled, 0);
+}
+
+int32_t Net_GetWakeupDescriptor(Net_Wakeup *wakeup) {
+	return (int32_t)wakeup->descriptor[0];
+}
+
+//
+//
+//
+
+struct Net_Timer {
+	uint64_t       deadline;
+	uint32_t       id;
+	int32_t        interval; // 0 for one shot timers
+	Net_Timer_Proc proc;
+	void *         context;
+};
+
+struct Net_Ready {
+	Net_Socket *net;
+	uint32_t    events;
+};
+
+constexpr int NET_EVENT_LOOP_BATCH = 256;
+
+struct Net_Event_Loop {
+	Memory_Allocator    allocator;
+#if PLATFORM_LINUX
+	int                 epoll;
+#else
+	Array<Net_Socket *> sockets;
+	Array<pollfd>       fds;
+#endif
+	Net_Wakeup          wakeup;
+	Atomic_Guard        guard;     // protects added, notified and removed
+	Array<Net_Socket *> added;
+	Array<Net_Socket *> notified;
+	Array<Net_Socket *> removed;
+	Array<Net_Ready>    ready;     // events not reported by the kernel, e.g. buffered TLS data
+	Array<Net_Ready>    dispatch;
+	Array<Net_Socket *> swap;
+	Array<Net_Timer>    timers;    // min heap on deadline
+	uint32_t            next_timer;
+	volatile int32_t    running;
+	volatile int32_t    stop;
+};
+
+static thread_local Net_Event_Loop *NetCurrentEventLoop;
+
+#if PLATFORM_LINUX
+static bool PL_Net_LoopCreate(Net_Event_Loop *loop) {
+	loop->epoll = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epoll < 0) {
+		LogErrorEx("Net:Linux", "epoll_create1 failed: %s", strerror(errno));
+		return false;
+	}
+
+	epoll_event ev = {};
+	ev.events   = EPOLLIN;
+	ev.data.ptr = nullptr; // wakeup
+	if (epoll_ctl(loop->epoll, EPOLL_CTL_ADD, Net_GetWakeupDescriptor(&loop->wakeup), &ev)) {
+		LogErrorEx("Net:Linux", "epoll_ctl failed: %s", strerror(errno));
+		close(loop->epoll);
+		return false;
+	}
+	return true;
+}
+
+static void PL_Net_LoopDestroy(Net_Event_Loop *loop) {
+	close(loop->epoll);
+}
+
+static bool PL_Net_LoopAdd(Net_Event_Loop *loop, Net_Socket *net) {
+	// Register for both directions once, edges of directions not in the interest are filtered out
+	epoll_event ev = {};
+	ev.events   = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	ev.data.ptr = net;
+	if (epoll_ctl(loop->epoll, EPOLL_CTL_ADD, net->descriptor, &ev)) {
+		LogErrorEx("Net:Linux", "epoll_ctl failed: %s", strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+static void PL_Net_LoopRemove(Net_Event_Loop *loop, Net_Socket *net) {
+	epoll_ctl(loop->epoll, EPOLL_CTL_DEL, net->descriptor, nullptr);
+}
+
+static void PL_Net_LoopWait(Net_Event_Loop *loop, int timeout) {
+	epoll_event events[NET_EVENT_LOOP_BATCH];
+	int count = epoll_wait(loop->epoll, events, NET_EVENT_LOOP_BATCH, timeout);
+
+	for (int index = 0; index < count; ++index) {
+		Net_Socket *net = (Net_Socket *)events[index].data.ptr;
+		if (!net) {
+			Net_ClearWakeup(&loop->wakeup);
+			continue;
+		}
+
+		uint32_t flags = 0;
+		if (events[index].events & EPOLLIN)  flags |= NET_EVENT_READ;
+		if (events[index].events & EPOLLOUT) flags |= NET_EVENT_WRITE;
+		if (events[index].events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) flags |= NET_EVENT_HANGUP;
+		loop->dispatch.Add(Net_Ready{ net, flags });
+	}
+}
+#else
+static bool PL_Net_LoopCreate(Net_Event_Loop *loop) {
+	loop->sockets = Array<Net_Socket *>(loop->allocator);
+	loop->fds     = Array<pollfd>(loop->allocator);
+	return true;
+}
+
+static void PL_Net_LoopDestroy(Net_Event_Loop *loop) {
+	Free(&loop->sockets);
+	Free(&loop->fds);
+}
+
+static bool PL_Net_LoopAdd(Net_Event_Loop *loop, Net_Socket *net) {
+	loop->sockets.Add(net);
+	return true;
+}
+
+static void PL_Net_LoopRemove(Net_Event_Loop *loop, Net_Socket *net) {
+	ptrdiff_t index = Find(Array_View<Net_Socket *>(loop->sockets), net);
+	if (index >= 0)
+		loop->sockets.RemoveUnordered(index);
+}
+
+static void PL_Net_LoopWait(Net_Event_Loop *loop, int timeout) {
+	// poll is level triggered, so only ask for the directions someone is waiting on
+	loop->fds.Reset();
+
+	pollfd *wake = loop->fds.Add();
+	wake->fd      = (SOCKET)Net_GetWakeupDescriptor(&loop->wakeup);
+	wake->events  = POLLRDNORM;
+	wake->revents = 0;
+
+	for (Net_Socket *net : loop->sockets) {
+		uint32_t interest = 0;
+		if (net->interest & NET_EVENT_READ)  interest |= net->rwait;
+		if (net->interest & NET_EVENT_WRITE) interest |= net->wwait;
+
+		pollfd *fd  = loop->fds.Add();
+		fd->fd      = net->descriptor;
+		fd->events  = 0;
+		fd->revents = 0;
+		if (interest & NET_EVENT_READ)  fd->events |= POLLRDNORM;
+		if (interest & NET_EVENT_WRITE) fd->events |= POLLWRNORM;
+	}
+
+	int count = poll(loop->fds.data, (int)loop->fds.count, timeout);
+	if (count <= 0) return;
+
+	if (loop->fds[0].revents & POLLRDNORM)
+		Net_ClearWakeup(&loop->wakeup);
+
+	for (ptrdiff_t index = 1; index < loop->fds.count; ++index) {
+		short revents = loop->fds[index].revents;
+		if (!revents) continue;
+
+		uint32_t flags = 0;
+		if (revents & POLLRDNORM) flags |= NET_EVENT_READ;
+		if (revents & POLLWRNORM) flags |= NET_EVENT_WRITE;
+		if (revents & (POLLHUP | POLLERR)) flags |= NET_EVENT_HANGUP;
+		loop->dispatch.Add(Net_Ready{ loop->sockets[index - 1], flags });
+	}
+}
+#endif
+
+static void Net_TimerSiftUp(Array<Net_Timer> &timers, ptrdiff_t index) {
+	while (index) {
+		ptrdiff_t parent = (index - 1) / 2;
+		if (timers[parent].deadline <= timers[index].deadline) break;
+		Net_Timer temp = timers[parent]; timers[parent] = timers[index]; timers[index] = temp;
+		index = parent;
+	}
+}
+
+static void Net_TimerSiftDown(Array<Net_Timer> &timers, ptrdiff_t index) {
+	while (true) {
+		ptrdiff_t smallest = index;
+		ptrdiff_t left     = 2 * index + 1;
+		ptrdiff_t right    = left + 1;
+		if (left < timers.count && timers[left].deadline < timers[smallest].deadline) smallest = left;
+		if (right < timers.count && timers[right].deadline < timers[smallest].deadline) smallest = right;
+		if (smallest == index) break;
+		Net_Timer temp = timers[smallest]; timers[smallest] = timers[index]; timers[index] = temp;
+		index = smallest;
+	}
+}
+
+static void Net_TimerRemoveAt(Array<Net_Timer> &timers, ptrdiff_t index) {
+	timers.RemoveUnordered(index);
+	if (index < timers.count) {
+		Net_TimerSiftUp(timers, index);
+		Net_TimerSiftDown(timers, index);
+	}
+}
+
+// Must be called with the loop guard held, since the notified list is also purged
+static void Net_EventLoopDetach(Net_Event_Loop *loop, Net_Socket *net) {
+	PL_Net_LoopRemove(loop, net);
+
+	// Drop the events that are yet to be dispatched
+	for (Net_Ready &ready : loop->dispatch) {
+		if (ready.net == net) ready.net = nullptr;
+	}
+	for (ptrdiff_t index = 0; index < loop->ready.count;) {
+		if (loop->ready[index].net == net)
+			loop->ready.Remove(index);
+		else
+			index += 1;
+	}
+	for (ptrdiff_t index = 0; index < loop->notified.count;) {
+		if (loop->notified[index] == net)
+			loop->notified.Remove(index);
+		else
+			index += 1;
+	}
+	AtomicStore(&net->notified, 0);
+
+	net->loop     = nullptr;
+	net->proc     = nullptr;
+	net->context  = nullptr;
+	net->interest = 0;
+	AtomicStore(&net->removing, 0);
+}
+
+static void Net_EventLoopDispatch(Net_Event_Loop *loop, Net_Socket *net, uint32_t events) {
+	uint32_t flags = events & (NET_EVENT_HANGUP | NET_EVENT_NOTIFY);
+
+	// TLS can wait on the opposite direction of the operation
+	if ((net->interest & NET_EVENT_READ) && (events & net->rwait))
+		flags |= NET_EVENT_READ;
+	if ((net->interest & NET_EVENT_WRITE) && (events & net->wwait))
+		flags |= NET_EVENT_WRITE;
+
+	if (!flags) return;
+
+	net->proc(loop, net, flags, net->context);
+
+	// Data already decrypted by OpenSSL won't produce another edge
+	if (net->loop == loop && (net->interest & NET_EVENT_READ) && Net_HasPendingData(net))
+		loop->ready.Add(Net_Ready{ net, NET_EVENT_READ });
+}
+
+Net_Event_Loop *Net_CreateEventLoop(Memory_Allocator allocator) {
+	Net_Event_Loop *loop = (Net_Event_Loop *)MemoryAllocate(sizeof(Net_Event_Loop), allocator);
+	if (!loop) {
+		LogErrorEx("Net", "Failed to allocate memory for event loop");
+		return nullptr;
+	}
+
+	*loop = Net_Event_Loop{};
+	loop->allocator  = allocator;
+	loop->added      = Array<Net_Socket *>(allocator);
+	loop->notified   = Array<Net_Socket *>(allocator);
+	loop->removed    = Array<Net_Socket *>(allocator);
+	loop->ready      = Array<Net_Ready>(allocator);
+	loop->dispatch   = Array<Net_Ready>(allocator);
+	loop->swap       = Array<Net_Socket *>(allocator);
+	loop->timers     = Array<Net_Timer>(allocator);
+	loop->next_timer = 1;
+
+	if (!Net_CreateWakeup(&loop->wakeup)) {
+		MemoryFree(loop, sizeof(*loop), allocator);
+		return nullptr;
+	}
+
+	if (!PL_Net_LoopCreate(loop)) {
+		Net_DestroyWakeup(&loop->wakeup);
+		MemoryFree(loop, sizeof(*loop), allocator);
+		return nullptr;
+	}
+
+	return loop;
+}
+
+void Net_DestroyEventLoop(Net_Event_Loop *loop) {
+	PL_Net_LoopDestroy(loop);
+	Net_DestroyWakeup(&loop->wakeup);
+	Free(&loop->added);
+	Free(&loop->notified);
+	Free(&loop->removed);
+	Free(&loop->ready);
+	Free(&loop->dispatch);
+	Free(&loop->swap);
+	Free(&loop->timers);
+	MemoryFree(loop, sizeof(*loop), loop->allocator);
+}
+
+bool Net_EventLoopAdd(Net_Event_Loop *loop, Net_Socket *net, uint32_t events, Net_Event_Proc proc, void *context) {
+	Assert(!net->loop);
+
+	net->proc     = proc;
+	net->context  = context;
+	net->interest = events;
+	net->loop     = loop;
+
+	if (NetCurrentEventLoop != loop && AtomicLoad(&loop->running)) {
+		// Registered by the loop thread before the next dispatch
+		SpinLock(&loop->guard);
+		loop->added.Add(net);
+		SpinUnlock(&loop->guard);
+		Net_SignalWakeup(&loop->wakeup);
+		return true;
+	}
+
+	if (!PL_Net_LoopAdd(loop, net)) {
+		net->loop = nullptr;
+		return false;
+	}
+
+	// Edge may have already happened before registering
+	loop->ready.Add(Net_Ready{ net, events });
+	return true;
+}
+
+void Net_EventLoopModify(Net_Event_Loop *loop, Net_Socket *net, uint32_t events) {
+	Assert(net->loop == loop);
+	uint32_t added = events & ~net->interest;
+	net->interest  = events;
+	if (added)
+		loop->ready.Add(Net_Ready{ net, added });
+}
+
+void Net_EventLoopRemove(Net_Event_Loop *loop, Net_Socket *net) {
+	if (net->loop != loop) return;
+
+	if (NetCurrentEventLoop == loop || !AtomicLoad(&loop->running)) {
+		SpinLock(&loop->guard);
+		Net_EventLoopDetach(loop, net);
+		SpinUnlock(&loop->guard);
+		return;
+	}
+
+	// Let the loop thread detach it in between dispatches
+	AtomicStore(&net->removing, 1);
+	SpinLock(&loop->guard);
+	loop->removed.Add(net);
+	SpinUnlock(&loop->guard);
+	Net_SignalWakeup(&loop->wakeup);
+
+	while (AtomicLoad(&net->removing) && AtomicLoad(&loop->running))
+		Thread_Yield();
+	if (net->loop) {
+		SpinLock(&loop->guard);
+		Net_EventLoopDetach(loop, net);
+		SpinUnlock(&loop->guard);
+	}
+}
+
+void Net_EventLoopNotify(Net_Event_Loop *loop, Net_Socket *net) {
+	if (AtomicCmpExg(&net->notified, 1, 0) == 0) {
+		// Detaching is done with the guard held, so a socket that is no longer registered is never queued
+		SpinLock(&loop->guard);
+		bool registered = net->loop == loop;
+		if (registered)
+			loop->notified.Add(net);
+		else
+			AtomicStore(&net->notified, 0);
+		SpinUnlock(&loop->guard);
+
+		if (registered)
+			Net_SignalWakeup(&loop->wakeup);
+	}
+}
+
+uint32_t Net_EventLoopAddTimer(Net_Event_Loop *loop, int millisecs, bool repeat, Net_Timer_Proc proc, void *context) {
+	Net_Timer *timer = loop->timers.Add();
+	if (!timer) return 0;
+
+	timer->deadline = PL_Net_Milliseconds() + Maximum(millisecs, 0);
+	timer->id       = loop->next_timer++;
+	timer->interval = repeat ? Maximum(millisecs, 1) : 0;
+	timer->proc     = proc;
+	timer->context  = context;
+
+	uint32_t id = timer->id;
+	Net_TimerSiftUp(loop->timers, loop->timers.count - 1);
+	return id;
+}
+
+void Net_EventLoopRemoveTimer(Net_Event_Loop *loop, uint32_t timer) {
+	for (ptrdiff_t index = 0; index < loop->timers.count; ++index) {
+		if (loop->timers[index].id == timer) {
+			Net_TimerRemoveAt(loop->timers, index);
+			return;
+		}
+	}
+}
+
+int Net_EventLoopPoll(Net_Event_Loop *loop, int timeout) {
+	Net_Event_Loop *prev_loop = NetCurrentEventLoop;
+	NetCurrentEventLoop = loop;
+	Defer{ NetCurrentEventLoop = prev_loop; };
+
+	if (loop->ready.count || AtomicLoad(&loop->wakeup.signalled))
+		timeout = 0;
+
+	if (loop->timers.count) {
+		uint64_t now      = PL_Net_Milliseconds();
+		uint64_t deadline = loop->timers[0].deadline;
+		int remaining     = deadline > now ? (int)Minimum(deadline - now, (uint64_t)INT32_MAX) : 0;
+		timeout = timeout < 0 ? remaining : Minimum(timeout, remaining);
+	}
+
+	loop->dispatch.Reset();
+	PL_Net_LoopWait(loop, timeout);
+
+	int dispatched = 0;
+
+	// Requests from other threads
+	loop->swap.Reset();
+	SpinLock(&loop->guard);
+	for (Net_Socket *net : loop->added) {
+		if (PL_Net_LoopAdd(loop, net))
+			loop->ready.Add(Net_Ready{ net, net->interest });
+		else
+			loop->ready.Add(Net_Ready{ net, NET_EVENT_HANGUP });
+	}
+	loop->added.Reset();
+	for (Net_Socket *net : loop->removed) {
+		if (net->loop == loop)
+			Net_EventLoopDetach(loop, net);
+	}
+	loop->removed.Reset();
+	for (Net_Socket *net : loop->notified)
+		loop->swap.Add(net);
+	loop->notified.Reset();
+	SpinUnlock(&loop->guard);
+
+	for (Net_Socket *net : loop->swap)
+		loop->dispatch.Add(Net_Ready{ net, NET_EVENT_NOTIFY });
+
+	for (Net_Ready &ready : loop->ready)
+		loop->dispatch.Add(ready);
+	loop->ready.Reset();
+
+	for (ptrdiff_t index = 0; index < loop->dispatch.count; ++index) {
+		Net_Ready ready = loop->dispatch[index];
+		if (!ready.net || ready.net->loop != loop) continue;
+
+		if (ready.events & NET_EVENT_NOTIFY)
+			AtomicStore(&ready.net->notified, 0);
+
+		Net_EventLoopDispatch(loop, ready.net, ready.events);
+		dispatched += 1;
+	}
+
+	if (loop->timers.count) {
+		uint64_t now = PL_Net_Milliseconds();
+		while (loop->timers.count && loop->timers[0].deadline <= now) {
+			Net_Timer timer = loop->timers[0];
+			if (timer.interval) {
+				loop->timers[0].deadline = now + timer.interval;
+				Net_TimerSiftDown(loop->timers, 0);
+			} else {
+				Net_TimerRemoveAt(loop->timers, 0);
+			}
+			timer.proc(loop, timer.context);
+			dispatched += 1;
+		}
+	}
+
+	return dispatched;
+}
+
+void Net_EventLoopRun(Net_Event_Loop *loop) {
+	AtomicStore(&loop->running, 1);
+	while (!AtomicLoad(&loop->stop))
+		Net_EventLoopPoll(loop, -1);
+	AtomicStore(&loop->stop, 0);
+	AtomicStore(&loop->running, 0);
+}
+
+void Net_EventLoopStop(Net_Event_Loop *loop) {
+	AtomicStore(&loop->stop, 1);
+	Net_SignalWakeup(&loop->wakeup);
+}
+
+Net_Event_Loop *Net_GetEventLoop(Net_Socket *net) {
+	return net->loop;
+}
+
+bool Net_HasPendingData(Net_Socket *net) {
+#ifdef NETWORK_OPENSSL_ENABLE
+	if (net->ssl)
+		return SSL_pending(net->ssl) > 0;
+#endif
+	return false;
+}
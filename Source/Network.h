@@ -2,6 +2,8 @@
 #include "Kr/KrCommon.h"
 
 constexpr int NET_TIMEOUT_MILLISECS = 2000;
+constexpr int NET_MAX_IO_VECTORS    = 64;
+constexpr int NET_MAX_ALPN_LENGTH   = 32;
 
 enum Net_Error {
 	NET_E_NONE,
@@ -20,21 +22,58 @@ enum Net_Socket_Type {
 
 struct Net_Socket;
 
+// Applied to the socket before connecting, zero sizes and times keep the system defaults.
+// busy_poll, quickack and incoming_cpu are only supported on Linux
+struct Net_Socket_Options {
+	bool nodelay;
+	bool keepalive;
+	int  keepalive_idle;     // seconds before the first probe
+	int  keepalive_interval; // seconds between probes
+	int  keepalive_count;    // unanswered probes before the connection is dropped
+	int  busy_poll;          // microseconds to busy poll the device queue on blocking reads
+	bool quickack;
+	int  receive_buffer;
+	int  send_buffer;
+	int  incoming_cpu;       // -1 for any cpu
+};
+
+constexpr Net_Socket_Options NetDefaultSocketOptions = { true, true, 60, 10, 3, 0, false, 0, 0, -1 };
+
 bool   Net_Initialize();
 void   Net_Shutdown();
+void   Net_FlushDnsCache();
+
+uint64_t Net_GetMilliseconds();
+
+// Opt-in kernel TLS (Linux), must be called before Net_Initialize. Secure channels hand the record layer
+// to the kernel after the handshake, so writes skip the user space encryption and copy. Connections stay
+// on user space TLS when the kernel or OpenSSL lack support for it, or the negotiated cipher, which is
+// logged once. Net_IsKernelTLS tells whether a connection uses it
+void   Net_EnableKernelTLS(bool enable);
+
+// Secure channels resume sessions cached per host and port, including reconnects
+struct Net_Session_Stats {
+	uint64_t handshakes;
+	uint64_t resumed;
+};
+
+Net_Session_Stats Net_GetSessionStats();
 
 /*
 * Send: -ve means error, +ve means number of bytes sent, 0 means success or wait
 * Receive: -ve means error, +ve means number of bytes received, 0 means wait
 */
 
-Net_Socket * Net_OpenConnection(const String node, const String service, Net_Socket_Type type, ptrdiff_t user_size, Memory_Allocator allocator = ThreadContext.allocator);
-Net_Socket  *Net_OpenConnection(const String node, const String service, Net_Socket_Type type, Memory_Allocator allocator = ThreadContext.allocator);
+Net_Socket * Net_OpenConnection(const String node, const String service, Net_Socket_Type type, ptrdiff_t user_size, Memory_Allocator allocator = ThreadContext.allocator, const Net_Socket_Options &options = NetDefaultSocketOptions);
+Net_Socket  *Net_OpenConnection(const String node, const String service, Net_Socket_Type type, Memory_Allocator allocator = ThreadContext.allocator, const Net_Socket_Options &options = NetDefaultSocketOptions);
 bool         Net_OpenSecureChannel(Net_Socket *net, bool verify = true);
+// Offers the application protocols (ALPN) in order of preference, the server may pick none of them
+bool         Net_OpenSecureChannel(Net_Socket *net, Array_View<String> protocols, bool verify = true);
 void         Net_CloseConnection(Net_Socket *net);
 void         Net_Shutdown(Net_Socket *net);
 void         Net_SetSocketReceiveBufferSize(Net_Socket *net, int size);
 void         Net_SetSocketSendBufferSize(Net_Socket *net, int size);
+void         Net_SetSocketOptions(Net_Socket *net, const Net_Socket_Options &options);
 void *       Net_GetUserBuffer(Net_Socket *net);
 Net_Error    Net_GetLastError(Net_Socket *net);
 void         Net_SetError(Net_Socket *net, Net_Error error);
@@ -42,8 +81,61 @@ bool         Net_TryReconnect(Net_Socket *net);
 String       Net_GetHostname(Net_Socket *net);
 int          Net_GetPort(Net_Socket *net);
 int32_t      Net_GetSocketDescriptor(Net_Socket *net);
+bool         Net_IsKernelTLS(Net_Socket *net);
+String       Net_GetApplicationProtocol(Net_Socket *net);
+bool         Net_IsConnectionIdle(Net_Socket *net);
 bool         Net_SetSocketBlockingMode(Net_Socket *net, bool blocking);
 int          Net_SendBlocked(Net_Socket *net, void *buffer, int length, int timeout = NET_TIMEOUT_MILLISECS);
+int          Net_SendVectoredBlocked(Net_Socket *net, const Buffer *buffers, int count, int timeout = NET_TIMEOUT_MILLISECS);
 int          Net_ReceiveBlocked(Net_Socket *net, void *buffer, int length, int timeout = NET_TIMEOUT_MILLISECS);
 int          Net_Send(Net_Socket *net, void *buffer, int length);
+int          Net_SendVectored(Net_Socket *net, const Buffer *buffers, int count);
 int          Net_Receive(Net_Socket *net, void *buffer, int length);
+
+//
+// Wakeup is a pollable descriptor that other threads can signal to interrupt a poll
+//
+
+struct Net_Wakeup {
+	ptrdiff_t        descriptor[2]; // [0] is polled, [1] is written to
+	volatile int32_t signalled;
+};
+
+bool    Net_CreateWakeup(Net_Wakeup *wakeup);
+void    Net_DestroyWakeup(Net_Wakeup *wakeup);
+void    Net_SignalWakeup(Net_Wakeup *wakeup);
+void    Net_ClearWakeup(Net_Wakeup *wakeup);
+int32_t Net_GetWakeupDescriptor(Net_Wakeup *wakeup);
+
+//
+// Event loop multiplexes many non-blocking sockets on a single thread. Readiness is edge triggered
+// where supported, so handlers must read and write until Net_Receive/Net_Send would block.
+// Net_EventLoopAdd, Net_EventLoopRemove, Net_EventLoopNotify and Net_EventLoopStop can be called
+// from any thread, everything else must be called from the thread running the loop
+//
+
+struct Net_Event_Loop;
+
+enum Net_Event_Flags : uint32_t {
+	NET_EVENT_READ   = 0x1,
+	NET_EVENT_WRITE  = 0x2,
+	NET_EVENT_HANGUP = 0x4,
+	NET_EVENT_NOTIFY = 0x8,
+};
+
+typedef void(*Net_Event_Proc)(Net_Event_Loop *loop, Net_Socket *net, uint32_t events, void *context);
+typedef void(*Net_Timer_Proc)(Net_Event_Loop *loop, void *context);
+
+Net_Event_Loop *Net_CreateEventLoop(Memory_Allocator allocator = ThreadContext.allocator);
+void            Net_DestroyEventLoop(Net_Event_Loop *loop);
+bool            Net_EventLoopAdd(Net_Event_Loop *loop, Net_Socket *net, uint32_t events, Net_Event_Proc proc, void *context);
+void            Net_EventLoopModify(Net_Event_Loop *loop, Net_Socket *net, uint32_t events);
+void            Net_EventLoopRemove(Net_Event_Loop *loop, Net_Socket *net);
+void            Net_EventLoopNotify(Net_Event_Loop *loop, Net_Socket *net);
+uint32_t        Net_EventLoopAddTimer(Net_Event_Loop *loop, int millisecs, bool repeat, Net_Timer_Proc proc, void *context);
+void            Net_EventLoopRemoveTimer(Net_Event_Loop *loop, uint32_t timer);
+int             Net_EventLoopPoll(Net_Event_Loop *loop, int timeout);
+void            Net_EventLoopRun(Net_Event_Loop *loop);
+void            Net_EventLoopStop(Net_Event_Loop *loop);
+Net_Event_Loop *Net_GetEventLoop(Net_Socket *net);
+bool            Net_HasPendingData(Net_Socket *net);
@@ -10,10 +10,18 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <errno.h>
 #include <poll.h>
 #include <fcntl.h>
+#if PLATFORM_LINUX
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#endif
+#include <time.h>
 #define SOCKET int
 #define INVALID_SOCKET -1
 #endif
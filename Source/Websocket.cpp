@@ -6,6 +6,18 @@
 #include "Base64.h"
 #include "SHA1.h"
 
+#include <time.h>
+
+#ifdef NETWORK_OPENSSL_ENABLE
+#include <openssl/rand.h>
+#endif
+
+#if ARCH_X64
+#include <immintrin.h>
+#elif ARCH_ARM64
+#include <arm_neon.h>
+#endif
+
 void Websocket_InitHeader(Websocket_Header *header) {
 	memset(header, 0, sizeof(*header));
 }
@@ -122,6 +134,8 @@ struct Websocket_Queue {
 		Node *    next;
 		int32_t   header;
 		ptrdiff_t len;
+		uint8_t * overflow;    // set when the message did not fit in buff
+		ptrdiff_t overflowcap;
 		uint8_t   buff[WEBSOCKET_QUEUE_MIN_BUFFER_SIZE + 0]; // this is extended upto buffp2cap
 	};
 	Atomic_Guard    rguard;
@@ -141,8 +155,18 @@ struct Websocket_Queue {
 #endif
 };
 
+// Counting semaphore that only goes to the kernel when the consumer is asleep,
+// and lets the consumer claim many units at once
+struct Websocket_Ready_Count {
+	volatile int32_t count; // negative when a consumer is waiting
+	Semaphore *      sem;
+};
+
 constexpr uint32_t WEBSOCKET_WRITER_CONTROL_BUFFER_SIZE = 256;
 constexpr uint32_t WEBSOCKET_MIN_QUEUE_SIZE             = 16;
+constexpr int      WEBSOCKET_WRITE_BATCH_COUNT          = 32;
+
+static_assert(WEBSOCKET_WRITE_BATCH_COUNT + 1 <= NET_MAX_IO_VECTORS, "");
 
 struct Websocket_Frame {
 	int32_t   header;
@@ -166,29 +190,40 @@ struct Websocket_Frame_Parser {
 };
 
 struct Websocket_Read_Stream {
-	ptrdiff_t start;
-	ptrdiff_t stop;
-	ptrdiff_t p2cap;
-	uint8_t * buffer;
-	ptrdiff_t seriallen;
-	uint8_t * serialized;
+	ptrdiff_t        start;
+	ptrdiff_t        stop;
+	ptrdiff_t        p2cap;
+	uint8_t *        buffer;
+	ptrdiff_t        seriallen;
+	ptrdiff_t        serialcap;
+	uint8_t *        serialized; // points to either inlined or the overflow buffer
+	uint8_t *        inlined;
+	ptrdiff_t        maxcap;
 };
 
 struct Websocket_Reader {
 	Websocket_Frame_Parser parser;
 	Websocket_Queue::Node *curr_node;
 	Websocket_Read_Stream  stream;
+	int32_t                fragmented; // header of the first frame of a fragmented message, 0 when there is none
 };
 
 struct Websocket_Writer {
 	struct {
-		ptrdiff_t              written;
-		Websocket_Queue::Node *curr_node;
+		ptrdiff_t              written; // of the first node
+		int                    count;
+		Websocket_Queue::Node *nodes[WEBSOCKET_WRITE_BATCH_COUNT];
 	} normal;
 	struct {
 		ptrdiff_t length;
+		ptrdiff_t written;
 		uint8_t   buffer[WEBSOCKET_WRITER_CONTROL_BUFFER_SIZE];
-	} control;
+	} control, deferred; // deferred holds the control frame created while control is frozen
+	struct {
+		bool      active;
+		ptrdiff_t control;
+		int       count;
+	} frozen; // batch that has to be retried as it is
 };
 
 struct Websocket_Context {
@@ -196,13 +231,41 @@ struct Websocket_Context {
 	Websocket_Role         role;
 	Websocket_Queue        readq;
 	Websocket_Reader       reader;
-	Semaphore *            readsem;
+	Websocket_Ready_Count  readready;
 	Websocket_Writer       writer;
 	Websocket_Queue        writeq;
 	Semaphore *            writesem;
+	volatile int32_t       mask_seed;
+	Net_Socket *           socket;
+	Net_Event_Loop *       loop;
+	Net_Wakeup             wakeup;
 	Thread *               thread;
+	Memory_Allocator       allocator; // of the connection, overflow buffers are allocated from it
 };
 
+static inline uint32_t XorShift32(uint32_t x) {
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+static uint32_t Websocket_RandomSeed(const void *salt) {
+#ifdef NETWORK_OPENSSL_ENABLE
+	uint32_t random = 0;
+	if (RAND_bytes((unsigned char *)&random, sizeof(random)) == 1 && random)
+		return random;
+#endif
+
+	// splitmix64 finalizer over whatever entropy is cheaply available
+	uint64_t z = (uint64_t)time(nullptr) ^ ((uint64_t)clock() << 32) ^ (uint64_t)(ptrdiff_t)salt;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	z = z ^ (z >> 31);
+	uint32_t seed = (uint32_t)(z ^ (z >> 32));
+	return seed ? seed : 0x9e3779b9;
+}
+
 static ptrdiff_t Websocket_GetReaderSize(uint32_t p2buff_size) {
 	Assert(IsPower2(p2buff_size));
 	return p2buff_size * 2; // circular + serial buffer
@@ -226,10 +289,13 @@ static ptrdiff_t Websocket_GetContextSize(Websocket_Spec spec) {
 	return size;
 }
 
-static uint8_t *Websocket_InitReader(Websocket_Reader *reader, uint32_t p2buff_size, uint8_t *mem) {
+static uint8_t *Websocket_InitReader(Websocket_Reader *reader, uint32_t p2buff_size, uint32_t max_message_size, uint8_t *mem) {
 	reader->stream.p2cap      = p2buff_size;
 	reader->stream.buffer     = mem;
+	reader->stream.serialcap  = p2buff_size;
 	reader->stream.serialized = mem + p2buff_size;
+	reader->stream.inlined    = reader->stream.serialized;
+	reader->stream.maxcap     = Maximum(p2buff_size, max_message_size);
 	return mem + 2 * p2buff_size;
 }
 
@@ -256,31 +322,24 @@ static uint8_t *Websocket_InitQueue(Websocket_Queue *queue, uint32_t p2buff_size
 	return mem;
 }
 
-static void Websocket_InitContextClient(Websocket_Context *context, Websocket_Spec spec, uint8_t *mem) {
-	mem = Websocket_InitReader(&context->reader, spec.read_size, mem);
+static void Websocket_InitContextClient(Websocket_Context *context, Websocket_Spec spec, Memory_Allocator allocator, uint8_t *mem) {
+	mem = Websocket_InitReader(&context->reader, spec.read_size, spec.max_message_size, mem);
 	mem = Websocket_InitQueue(&context->readq, spec.read_size, spec.queue_size, mem);
 	mem = Websocket_InitQueue(&context->writeq, spec.write_size, spec.queue_size, mem);
 
 	context->connection = WEBSOCKET_CONNECTED;
 	context->role       = WEBSOCKET_ROLE_CLIENT;
-	context->readsem    = Semaphore_Create(0);
+	context->readready.count = 0;
+	context->readready.sem   = Semaphore_Create(0);
 	context->writesem   = Semaphore_Create(spec.queue_size);
+	context->mask_seed  = (int32_t)Websocket_RandomSeed(context);
+	context->allocator  = allocator;
 }
 
 //
 //
 //
 
-static inline uint32_t XorShift32() {
-	static uint32_t XorShift32Seed = (0xffffffff & (ptrdiff_t)&XorShift32Seed);
-	uint32_t x = XorShift32Seed;
-	x ^= x << 13;
-	x ^= x >> 17;
-	x ^= x << 5;
-	XorShift32Seed = x;
-	return x;
-}
-
 static constexpr int WEBSOCKET_KEY_LENGTH        = 24;
 static constexpr uint8_t WebsocketKeySalt[]      = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 static constexpr int WEBSOCKET_SALT_LENGTH       = sizeof(WebsocketKeySalt) - 1;
@@ -290,8 +349,16 @@ struct Websocket_Key { uint8_t data[WEBSOCKET_KEY_LENGTH]; };
 
 static Websocket_Key Websocket_GenerateSecurityKey() {
 	uint8_t nonce[16];
-	for (auto &n : nonce)
-		n = XorShift32() & 255;
+#ifdef NETWORK_OPENSSL_ENABLE
+	if (RAND_bytes(nonce, sizeof(nonce)) != 1)
+#endif
+	{
+		uint32_t seed = Websocket_RandomSeed(nonce);
+		for (auto &n : nonce) {
+			seed = XorShift32(seed);
+			n    = seed & 255;
+		}
+	}
 	static_assert(sizeof(nonce) == 16, "");
 	Websocket_Key key;
 	EncodeBase64(Buffer((uint8_t *)nonce, sizeof(nonce)), key.data, sizeof(key.data));
@@ -299,6 +366,7 @@ static Websocket_Key Websocket_GenerateSecurityKey() {
 }
 
 static int Websocket_ThreadProc(void *arg);
+static void Websocket_EventProc(Net_Event_Loop *loop, Net_Socket *websocket, uint32_t events, void *context);
 
 static uint32_t NextPowerOf2(uint32_t v) {
 	v--;
@@ -321,10 +389,11 @@ Websocket *Websocket_Connect(String uri, Http_Response *res, Websocket_Header *h
 	spec.read_size  = Maximum(WEBSOCKET_QUEUE_MIN_BUFFER_SIZE, NextPowerOf2(spec.read_size));
 	spec.write_size = Maximum(WEBSOCKET_QUEUE_MIN_BUFFER_SIZE, NextPowerOf2(spec.write_size));
 	spec.queue_size = Maximum(WEBSOCKET_MIN_QUEUE_SIZE, spec.queue_size);
+	spec.max_message_size = Maximum(spec.read_size, spec.max_message_size);
 
 	ptrdiff_t context_size = sizeof(Websocket_Context) + Websocket_GetContextSize(spec);
 
-	Net_Socket *socket = Net_OpenConnection(websocket_uri.host, websocket_uri.port, NET_SOCKET_TCP, context_size, allocator);
+	Net_Socket *socket = Net_OpenConnection(websocket_uri.host, websocket_uri.port, NET_SOCKET_TCP, context_size, allocator, spec.socket);
 	if (!socket) return nullptr;
 
 	if (websocket_uri.secure) {
@@ -441,7 +510,25 @@ Websocket *Websocket_Connect(String uri, Http_Response *res, Websocket_Header *h
 
 		uint8_t *user = (uint8_t *)Net_GetUserBuffer(socket);;
 		Websocket_Context *context = (Websocket_Context *)user;
-		Websocket_InitContextClient(context, spec, user + sizeof(Websocket_Context));
+		Websocket_InitContextClient(context, spec, allocator, user + sizeof(Websocket_Context));
+
+		context->socket = socket;
+		context->loop   = spec.loop;
+
+		context->wakeup.descriptor[0] = (ptrdiff_t)INVALID_SOCKET;
+		context->wakeup.descriptor[1] = (ptrdiff_t)INVALID_SOCKET;
+
+		if (spec.loop) {
+			if (!Net_EventLoopAdd(spec.loop, socket, NET_EVENT_READ | NET_EVENT_WRITE, Websocket_EventProc, context)) {
+				LogErrorEx("Websocket", "Failed to add connection to the event loop");
+				Http_Disconnect(http);
+				return nullptr;
+			}
+			return (Websocket *)socket;
+		}
+
+		if (!Net_CreateWakeup(&context->wakeup))
+			LogWarningEx("Websocket", "Failed to create wakeup descriptor, writes will wait for the next poll timeout");
 
 		Thread_Context_Params params = ThreadContextDefaultParams;
 		params.logger = ThreadContext.logger;
@@ -455,10 +542,6 @@ Websocket *Websocket_Connect(String uri, Http_Response *res, Websocket_Header *h
 	return nullptr;
 }
 
-void Websocket_Disconnect(Websocket *websocket) {
-	Net_CloseConnection((Net_Socket *)websocket);
-}
-
 //
 //
 //
@@ -495,6 +578,7 @@ static void Websocket_QueuePush(Websocket_Queue *q, Websocket_Queue::Node *node)
 	Assert(!node->next);
 	q->tail->next = node;
 	node->next = &q->head;
+	q->tail    = node;
 #if defined(WEBSOCKET_ENABLE_DEBUG_INFO)
 	AtomicDec(&q->debug_info.allocated);
 	AtomicInc(&q->debug_info.in_queue);
@@ -506,9 +590,14 @@ static Websocket_Queue::Node *Websocket_QueuePop(Websocket_Queue *q) {
 	Websocket_Queue::Node *node = nullptr;
 	SpinLock(&q->rguard);
 	if (q->head.next != &q->head) {
+		// Writer lock is needed for the tail when the last node is popped
+		SpinLock(&q->wguard);
 		node         = q->head.next;
 		auto next    = node->next;
 		q->head.next = next;
+		if (q->tail == node)
+			q->tail = &q->head;
+		SpinUnlock(&q->wguard);
 		node->next   = nullptr;
 #if defined(WEBSOCKET_ENABLE_DEBUG_INFO)
 		AtomicInc(&q->debug_info.allocated);
@@ -519,6 +608,47 @@ static Websocket_Queue::Node *Websocket_QueuePop(Websocket_Queue *q) {
 	return node;
 }
 
+static void Websocket_ReadyPost(Websocket_Ready_Count *ready) {
+	if (AtomicInc(&ready->count) <= 0)
+		Semaphore_Signal(ready->sem);
+}
+
+static int Websocket_ReadyClaim(Websocket_Ready_Count *ready, int max_count) {
+	while (true) {
+		int32_t count = AtomicLoad(&ready->count);
+		if (count <= 0) return 0;
+		int32_t claim = Minimum(count, max_count);
+		if (AtomicCmpExg(&ready->count, count - claim, count) == count)
+			return claim;
+	}
+}
+
+static int Websocket_ReadyWait(Websocket_Ready_Count *ready, int max_count, int timeout) {
+	int claimed = Websocket_ReadyClaim(ready, max_count);
+	if (claimed) return claimed;
+
+	// Nothing ready, register as a waiter
+	if (AtomicDec(&ready->count) >= 0)
+		return 1 + Websocket_ReadyClaim(ready, max_count - 1);
+
+	int wait = Semaphore_Wait(ready->sem, timeout);
+	if (wait > 0)
+		return 1 + Websocket_ReadyClaim(ready, max_count - 1);
+
+	// Unregister, unless a post has already counted on us being asleep
+	while (true) {
+		int32_t count = AtomicLoad(&ready->count);
+		if (count >= 0) {
+			Semaphore_Wait(ready->sem, -1);
+			return 1 + Websocket_ReadyClaim(ready, max_count - 1);
+		}
+		if (AtomicCmpExg(&ready->count, count + 1, count) == count)
+			break;
+	}
+
+	return wait;
+}
+
 //
 //
 //
@@ -559,74 +689,197 @@ static ptrdiff_t Websocket_StreamRead(Websocket_Read_Stream *stream, uint8_t *bu
 	}
 	if (read != size) {
 		ptrdiff_t read_size = Minimum(size - read, stream->stop - stream->start);
-		memcpy(buff, stream->buffer + stream->start, read_size);
+		memcpy(buff + read, stream->buffer + stream->start, read_size);
 		read += read_size;
 		stream->start = (stream->start + read_size) & (stream->p2cap - 1);
 	}
 	return read;
 }
 
+static bool Websocket_StreamReserve(Websocket_Read_Stream *stream, ptrdiff_t size, Memory_Allocator allocator) {
+	ptrdiff_t required = stream->seriallen + size;
+	if (required <= stream->serialcap)
+		return true;
+	if (required > stream->maxcap)
+		return false;
+
+	ptrdiff_t capacity = Minimum(Maximum(stream->serialcap * 2, required), stream->maxcap);
+
+	uint8_t *mem;
+	if (stream->serialized == stream->inlined) {
+		mem = (uint8_t *)MemoryAllocate(capacity, allocator);
+		if (mem) memcpy(mem, stream->serialized, stream->seriallen);
+	} else {
+		mem = (uint8_t *)MemoryReallocate(stream->serialcap, capacity, stream->serialized, allocator);
+	}
+
+	if (!mem) {
+		LogWarningEx("Websocket", "Failed to allocate %d bytes for overflow buffer", (int)capacity);
+		return false;
+	}
+
+	stream->serialized = mem;
+	stream->serialcap  = capacity;
+	return true;
+}
+
+static void Websocket_StreamReleaseOverflow(Websocket_Read_Stream *stream, Memory_Allocator allocator) {
+	if (stream->serialized != stream->inlined) {
+		MemoryFree(stream->serialized, stream->serialcap, allocator);
+		stream->serialized = stream->inlined;
+		stream->serialcap  = stream->p2cap;
+	}
+}
+
+static void Websocket_WakeIO(Websocket_Context *ctx) {
+	if (ctx->loop)
+		Net_EventLoopNotify(ctx->loop, ctx->socket);
+	else
+		Net_SignalWakeup(&ctx->wakeup);
+}
+
+static void Websocket_ReleaseReadNode(Websocket_Context *ctx, Websocket_Queue::Node *node) {
+	if (node->overflow) {
+		MemoryFree(node->overflow, node->overflowcap, ctx->allocator);
+		node->overflow    = nullptr;
+		node->overflowcap = 0;
+	}
+	Websocket_QueueFree(&ctx->readq, node);
+}
+
+static void Websocket_ReadQueueFree(Websocket_Context *ctx, Websocket_Queue::Node *node) {
+	Websocket_ReleaseReadNode(ctx, node);
+
+	// I/O thread stops reading when it runs out of nodes
+	if (!ctx->reader.curr_node)
+		Websocket_WakeIO(ctx);
+}
+
+static inline uint8_t *Websocket_NodeData(Websocket_Queue::Node *node) {
+	return node->overflow ? node->overflow : node->buff;
+}
+
+void Websocket_Disconnect(Websocket *websocket) {
+	Net_Socket *socket     = (Net_Socket *)websocket;
+	Websocket_Context *ctx = (Websocket_Context *)Net_GetUserBuffer(socket);
+
+	// The I/O side has to be stopped first, it touches the reader and the queues
+	if (ctx->loop) {
+		Net_EventLoopRemove(ctx->loop, socket);
+		ctx->loop = nullptr;
+	} else if (ctx->thread) {
+		ctx->connection = WEBSOCKET_CLOSED;
+		Net_SignalWakeup(&ctx->wakeup);
+		Thread_Wait(ctx->thread, -1);
+		Thread_Destroy(ctx->thread);
+		ctx->thread = nullptr;
+	}
+	ctx->connection = WEBSOCKET_CLOSED;
+
+	// The I/O side is gone, so the nodes are released without waking it
+	Websocket_StreamReleaseOverflow(&ctx->reader.stream, ctx->allocator);
+	for (Websocket_Queue::Node *node = Websocket_QueuePop(&ctx->readq); node; node = Websocket_QueuePop(&ctx->readq))
+		Websocket_ReleaseReadNode(ctx, node);
+
+	Semaphore_Destory(ctx->readready.sem);
+	Semaphore_Destory(ctx->writesem);
+	Net_DestroyWakeup(&ctx->wakeup);
+	Net_CloseConnection(socket);
+}
+
 //
 //
 //
 
-static void Websocket_MaskPayload(uint8_t *dst, uint8_t *src, uint64_t length, uint8_t mask[4]) {
-	for (uint64_t i = 0; i < length; ++i)
-		dst[i] = src[i] ^ mask[i & 3];
+static uint32_t Websocket_NextMask(Websocket_Context *ctx) {
+	// Frames can be created from multiple threads on the same connection
+	int32_t prev, next;
+	do {
+		prev = AtomicLoad(&ctx->mask_seed);
+		next = (int32_t)XorShift32((uint32_t)prev);
+	} while (AtomicCmpExg(&ctx->mask_seed, next, prev) != prev);
+	return (uint32_t)next;
 }
 
-static ptrdiff_t Websocket_CreateFrame(uint8_t *dst, ptrdiff_t dst_size, Buffer payload, bool masked, int opcode) {
-	uint8_t header[14]; // the last 4 bytes are for mask but is not actually used
-	memset(header, 0, sizeof(header));
+static void Websocket_MaskPayload(uint8_t *dst, const uint8_t *src, uint64_t length, const uint8_t mask[4]) {
+	// Every block size below is a multiple of 4, so the mask is always at the same phase
+	// at the start of a block and can be repeated across the whole register
+	uint32_t mask32;
+	memcpy(&mask32, mask, sizeof(mask32));
 
-	header[0] |= 0x80; // FIN
-	header[0] |= opcode;
-	header[1] |= masked ? 0x80 : 0x00; // mask
+	uint64_t i = 0;
 
-	int header_size;
+#if ARCH_X64
+#if defined(__AVX2__)
+	const __m256i mask256 = _mm256_set1_epi32((int)mask32);
+	for (; i + 32 <= length; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(v, mask256));
+	}
+#endif
+	const __m128i mask128 = _mm_set1_epi32((int)mask32);
+	for (; i + 16 <= length; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(v, mask128));
+	}
+#elif ARCH_ARM64
+	const uint8x16_t mask128 = vreinterpretq_u8_u32(vdupq_n_u32(mask32));
+	for (; i + 16 <= length; i += 16) {
+		uint8x16_t v = vld1q_u8(src + i);
+		vst1q_u8(dst + i, veorq_u8(v, mask128));
+	}
+#endif
+
+	const uint64_t mask64 = ((uint64_t)mask32 << 32) | mask32;
+	for (; i + 8 <= length; i += 8) {
+		uint64_t v;
+		memcpy(&v, src + i, sizeof(v));
+		v ^= mask64;
+		memcpy(dst + i, &v, sizeof(v));
+	}
 
-	if (payload.length <= 125) {
+	for (; i < length; ++i)
+		dst[i] = src[i] ^ mask[i & 3];
+}
+
+static int Websocket_EncodeFrameHeader(uint8_t *dst, uint64_t payload_len, int opcode, bool masked, uint32_t mask) {
+	dst[0] = (uint8_t)(0x80 | opcode); // FIN
+	uint8_t maskbit = masked ? 0x80 : 0x00;
+
+	int header_size;
+	if (payload_len <= 125) {
+		dst[1] = maskbit | (uint8_t)payload_len;
 		header_size = 2;
-		header[1] |= (uint8_t)payload.length;
-	} else if (payload.length <= UINT16_MAX) {
+	} else if (payload_len <= UINT16_MAX) {
+		dst[1] = maskbit | 126;
+		dst[2] = (uint8_t)(payload_len >> 8);
+		dst[3] = (uint8_t)(payload_len >> 0);
 		header_size = 4;
-		header[1] |= 126;
-		header[2] = ((payload.length & 0xff00) >> 8);
-		header[3] = ((payload.length & 0x00ff) >> 0);
 	} else {
+		dst[1] = maskbit | 127;
+		for (int index = 0; index < 8; ++index)
+			dst[2 + index] = (uint8_t)(payload_len >> (56 - 8 * index));
 		header_size = 10;
-		header[1] |= 127;
-		header[2] = (uint8_t)((payload.length & 0xff00000000000000) >> 56);
-		header[3] = (uint8_t)((payload.length & 0x00ff000000000000) >> 48);
-		header[4] = (uint8_t)((payload.length & 0x0000ff0000000000) >> 40);
-		header[5] = (uint8_t)((payload.length & 0x000000ff00000000) >> 32);
-		header[6] = (uint8_t)((payload.length & 0x00000000ff000000) >> 24);
-		header[7] = (uint8_t)((payload.length & 0x0000000000ff0000) >> 16);
-		header[8] = (uint8_t)((payload.length & 0x000000000000ff00) >> 8);
-		header[9] = (uint8_t)((payload.length & 0x00000000000000ff) >> 0);
 	}
 
-	if (masked)
+	if (masked) {
+		memcpy(dst + header_size, &mask, sizeof(mask));
 		header_size += 4;
+	}
 
+	return header_size;
+}
+
+static ptrdiff_t Websocket_CreateFrame(uint8_t *dst, ptrdiff_t dst_size, Buffer payload, bool masked, uint32_t mask, int opcode) {
+	int header_size      = Websocket_EncodeFrameHeader(dst, payload.length, opcode, masked, mask);
 	ptrdiff_t frame_size = header_size + payload.length;
 
-	uint8_t *frame = dst;
 	Assert(frame_size <= dst_size);
 
-	memcpy(frame, header, header_size);
-
 	if (masked) {
-		uint32_t mask = XorShift32();
-		uint8_t *mask_write = frame + header_size - 4;
-		mask_write[0] = ((mask & 0xff000000) >> 24);
-		mask_write[1] = ((mask & 0x00ff0000) >> 16);
-		mask_write[2] = ((mask & 0x0000ff00) >> 8);
-		mask_write[3] = ((mask & 0x000000ff) >> 0);
-
-		Websocket_MaskPayload(frame + header_size, payload.data, payload.length, mask_write);
+		Websocket_MaskPayload(dst + header_size, payload.data, payload.length, dst + header_size - 4);
 	} else {
-		memcpy(frame + header_size, payload.data, payload.length);
+		memcpy(dst + header_size, payload.data, payload.length);
 	}
 
 	return frame_size;
@@ -637,8 +890,11 @@ static ptrdiff_t Websocket_CreateFrame(uint8_t *dst, ptrdiff_t dst_size, Buffer
 //
 
 static void Websocket_InitReadNode(Websocket_Context *ctx) {
-	if (ctx->reader.curr_node)
-		ctx->reader.curr_node->header = 0;
+	if (ctx->reader.curr_node) {
+		ctx->reader.curr_node->header      = 0;
+		ctx->reader.curr_node->overflow    = nullptr;
+		ctx->reader.curr_node->overflowcap = 0;
+	}
 }
 
 static void Websocket_InspectWriteFrameForClose(Websocket_Context *ctx, int opcode) {
@@ -650,14 +906,48 @@ static void Websocket_InspectWriteFrameForClose(Websocket_Context *ctx, int opco
 	}
 }
 
+static void Websocket_FillWriteBatch(Websocket_Context *ctx) {
+	auto &normal = ctx->writer.normal;
+	while (normal.count < WEBSOCKET_WRITE_BATCH_COUNT) {
+		// Nothing can be sent after the close frame
+		if (normal.count && (normal.nodes[normal.count - 1]->header & 0x0f) == WEBSOCKET_OP_CONNECTION_CLOSE)
+			break;
+		Websocket_Queue::Node *node = Websocket_QueuePop(&ctx->writeq);
+		if (!node) break;
+		normal.nodes[normal.count++] = node;
+	}
+}
+
+static void Websocket_ConsumeWriteBatch(Websocket_Context *ctx, ptrdiff_t sent) {
+	auto &normal = ctx->writer.normal;
+
+	int completed = 0;
+	for (; completed < normal.count && sent; ++completed) {
+		Websocket_Queue::Node *node = normal.nodes[completed];
+		ptrdiff_t remaining = node->len - normal.written;
+		if (sent < remaining) {
+			normal.written += sent;
+			break;
+		}
+
+		sent -= remaining;
+		normal.written = 0;
+
+		Websocket_InspectWriteFrameForClose(ctx, node->header & 0x0f);
+		Websocket_QueueFree(&ctx->writeq, node);
+		Semaphore_Signal(ctx->writesem);
+	}
+
+	if (completed) {
+		normal.count -= completed;
+		memmove(normal.nodes, normal.nodes + completed, normal.count * sizeof(normal.nodes[0]));
+	}
+}
+
 static bool Websocket_HasWrite(Websocket_Context *ctx) {
 	if (ctx->connection != WEBSOCKET_SENT_CLOSE) {
-		if (!ctx->writer.control.length) {
-			if (ctx->writer.normal.curr_node)
-				return true;
-			ctx->writer.normal.curr_node = Websocket_QueuePop(&ctx->writeq);
-			return ctx->writer.normal.curr_node;
-		}
+		Websocket_FillWriteBatch(ctx);
+		return ctx->writer.control.length || ctx->writer.normal.count;
 	}
 	return false;
 }
@@ -688,10 +978,20 @@ static void Websocket_SendImmediateControlMessage(Websocket_Context *ctx, String
 			return;
 	}
 
+	// The control frame of a frozen batch can't be replaced until the batch is written
+	auto &target = (ctx->writer.frozen.active && ctx->writer.frozen.control) ? ctx->writer.deferred : ctx->writer.control;
+
+	if (target.length) {
+		int opcode = target.buffer[0] & 0x0f;
+		if (opcode == WEBSOCKET_OP_CONNECTION_CLOSE)
+			return;
+	}
+
 	Assert(msg.length <= 125);
 	bool masked = ctx->role == WEBSOCKET_ROLE_CLIENT;
-	ctx->writer.control.length = Websocket_CreateFrame(ctx->writer.control.buffer, 
-		WEBSOCKET_WRITER_CONTROL_BUFFER_SIZE, msg, masked, opcode);
+	uint32_t mask = masked ? Websocket_NextMask(ctx) : 0;
+	target.length = Websocket_CreateFrame(target.buffer, 
+		WEBSOCKET_WRITER_CONTROL_BUFFER_SIZE, msg, masked, mask, opcode);
 }
 
 static String Websocket_CloseReasonMessage(Websocket_Close_Reason reason) {
@@ -733,12 +1033,12 @@ static void Websocket_ImmediatePong(Websocket_Context *ctx, String message) {
 	Websocket_SendImmediateControlMessage(ctx, message, WEBSOCKET_OP_PONG);
 }
 
-static inline void Websocket_ResetParser(Websocket_Context *ctx) {
-	// Pop back the payload of the current frame
-	// This will make sure that the fragmented frames are serially joined
-	// in the cases where a control frames is received in between fragmented frames
-	ctx->reader.stream.seriallen -= ctx->reader.parser.payload_parsed;
-	memset(&ctx->reader.parser, 0, sizeof(ctx->reader.parser));
+static inline void Websocket_ResetParser(Websocket_Context *ctx, bool keep_payload) {
+	// The payload of a data frame is kept so that fragmented frames are serially joined, the payload
+	// of a control frame received in between fragmented frames is popped back
+	if (!keep_payload)
+		ctx->reader.stream.seriallen -= ctx->reader.parser.payload_parsed;
+	ctx->reader.parser = Websocket_Frame_Parser{};
 }
 
 static bool Websocket_ParseFrame(Websocket_Context *ctx) {
@@ -807,13 +1107,12 @@ static bool Websocket_ParseFrame(Websocket_Context *ctx) {
 	if (parser.state == PARSING_PAYLOAD_PRECHECK) {
 		Assert(parser.frame.payload.data == nullptr);
 
-		ptrdiff_t remaining_cap = reader.stream.p2cap - reader.stream.seriallen;
-		if (parser.frame.payload.length > remaining_cap) {
+		if (Websocket_StreamReserve(&stream, parser.frame.payload.length, ctx->allocator)) {
+			parser.state = PARSING_PAYLOAD;
+		} else {
 			parser.state = PARSING_DROPPED;
 			LogWarningEx("Websocket", "Dropped %d bytes. Frame payload too big. Skipped frame", (int)parser.frame.payload.length);
 			Websocket_SendImmediateClose(ctx, WEBSOCKET_CLOSE_MESSAGE_TOO_BIG);
-		} else {
-			parser.state = PARSING_PAYLOAD;
 		}
 	}
 
@@ -835,12 +1134,17 @@ static bool Websocket_ParseFrame(Websocket_Context *ctx) {
 	}
 
 	if (parser.state == PARSING_DROPPED) {
-		ptrdiff_t remaining = parser.frame.payload.length - reader.stream.seriallen;
+		ptrdiff_t remaining = parser.frame.payload.length - parser.payload_parsed;
 		ptrdiff_t dropped   = Websocket_StreamDrop(&stream, remaining);
-		reader.stream.seriallen += dropped;
+		parser.payload_parsed += dropped;
 		remaining -= dropped;
-		if (!remaining)
-			Websocket_ResetParser(ctx);
+		if (!remaining) {
+			// Fragments received before the dropped frame are useless now
+			reader.stream.seriallen = 0;
+			reader.fragmented       = 0;
+			Websocket_StreamReleaseOverflow(&reader.stream, ctx->allocator);
+			Websocket_ResetParser(ctx, true);
+		}
 	}
 
 	return false;
@@ -853,31 +1157,55 @@ static void Websocket_PushEventAndReadNext(Websocket_Context *ctx, Buffer buffer
 	ctx->reader.curr_node->len    = buffer.length;
 	Websocket_QueuePush(&ctx->readq, ctx->reader.curr_node);
 	ctx->reader.curr_node = nullptr;
-	Semaphore_Signal(ctx->readsem);
+	Websocket_ReadyPost(&ctx->readready);
 	ctx->reader.curr_node = Websocket_QueueAlloc(&ctx->readq);
 	Websocket_InitReadNode(ctx);
 }
 
+static void Websocket_PushMessageAndReadNext(Websocket_Context *ctx, int32_t header) {
+	Websocket_Read_Stream &stream = ctx->reader.stream;
+
+	if (stream.serialized != stream.inlined) {
+		// Hand over the overflow buffer to the receiver instead of copying
+		ctx->reader.curr_node->overflow    = stream.serialized;
+		ctx->reader.curr_node->overflowcap = stream.serialcap;
+		ctx->reader.curr_node->header      = header;
+		ctx->reader.curr_node->len         = stream.seriallen;
+		Websocket_QueuePush(&ctx->readq, ctx->reader.curr_node);
+		ctx->reader.curr_node = nullptr;
+		Websocket_ReadyPost(&ctx->readready);
+		ctx->reader.curr_node = Websocket_QueueAlloc(&ctx->readq);
+		Websocket_InitReadNode(ctx);
+
+		stream.serialized = stream.inlined;
+		stream.serialcap  = stream.p2cap;
+	} else {
+		Websocket_PushEventAndReadNext(ctx, Buffer(stream.serialized, stream.seriallen), header);
+	}
+
+	stream.seriallen = 0;
+}
+
 static bool Websocket_HandleMessage(Websocket_Context *ctx) {
 	Websocket_Frame &frame = ctx->reader.parser.frame;
-	Buffer msg             = Buffer(ctx->reader.stream.serialized, ctx->reader.stream.seriallen);
+	Buffer msg             = frame.payload;
 
 	if (frame.rsv) {
-		Websocket_ResetParser(ctx);
+		Websocket_ResetParser(ctx, false);
 		Websocket_SendImmediateClose(ctx, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
 		return false;
 	}
 
 	if (ctx->role == WEBSOCKET_ROLE_CLIENT && frame.masked) {
 		LogErrorEx("Websocket", "Server sent masked payload. Closing...");
-		Websocket_ResetParser(ctx);
+		Websocket_ResetParser(ctx, false);
 		Websocket_SendImmediateClose(ctx, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
 		return false;
 	}
 
 	if (ctx->role == WEBSOCKET_ROLE_SERVER && !frame.masked) {
 		LogErrorEx("Websocket", "Client sent unmasked payload. Closing...");
-		Websocket_ResetParser(ctx);
+		Websocket_ResetParser(ctx, false);
 		Websocket_SendImmediateClose(ctx, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
 		return false;
 	}
@@ -890,14 +1218,14 @@ static bool Websocket_HandleMessage(Websocket_Context *ctx) {
 		// control frame
 		if (!frame.fin) {
 			LogErrorEx("Websocket", "Server sent fragmented control frame. Closing...");
-			Websocket_ResetParser(ctx);
+			Websocket_ResetParser(ctx, false);
 			Websocket_SendImmediateClose(ctx, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
 			return false;
 		}
 
 		if (frame.payload.length > 125) {
 			LogErrorEx("Websocket", "Server sent control frame with %d bytes payload. Only upto 125 bytes is allowed. Closing...", (int)frame.payload.length);
-			Websocket_ResetParser(ctx);
+			Websocket_ResetParser(ctx, false);
 			Websocket_SendImmediateClose(ctx, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
 			return false;
 		}
@@ -929,63 +1257,158 @@ static bool Websocket_HandleMessage(Websocket_Context *ctx) {
 			}
 		}
 
-		Websocket_ResetParser(ctx);
+		Websocket_ResetParser(ctx, false);
 		return true;
 	}
 
+	// The header of the first fragment is kept in the reader, control frames in between fragments
+	// are pushed through their own nodes
+	int32_t fragmented = ctx->reader.fragmented;
+
+	if (fragmented && frame.opcode) {
+		LogErrorEx("Websocket", "Expected next fragment with 0x0 opcode, but got %d. Closing...", frame.opcode);
+		Websocket_SendImmediateClose(ctx, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+		Websocket_ResetParser(ctx, false);
+		return false;
+	}
+
+	if (!fragmented && !frame.opcode) {
+		LogErrorEx("Websocket", "Received continuation frame without a fragmented message. Closing...");
+		Websocket_SendImmediateClose(ctx, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
+		Websocket_ResetParser(ctx, false);
+		return false;
+	}
+
 	if (frame.fin) {
-		if (frame.opcode != WEBSOCKET_OP_CONTINUATION_FRAME) {
-			// single frame
-			Websocket_PushEventAndReadNext(ctx, msg, frame.header);
-		} else {
-			// final frame of fragmented frame
-			Websocket_PushEventAndReadNext(ctx, msg, ctx->reader.curr_node->header);
-		}
-	} else {
-		int header      = ctx->reader.curr_node->header;
-		int prev_fin    = (header & 0x80) >> 7;
-		int prev_opcode = (header & 0x0f) >> 0;
-
-		if (prev_opcode) {
-			// continuation of fragmented frame
-			if (frame.opcode) {
-				LogErrorEx("Websocket", "Expected next fragment with 0x0 opcode, but got %d. Closing...", frame.opcode);
-				Websocket_SendImmediateClose(ctx, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
-				Websocket_ResetParser(ctx);
-				return false;
-			}
-		} else {
-			// first part of fragmented frame
-			if (!frame.opcode) {
-				LogErrorEx("Websocket", "Expected next fragment with 0x0 opcode, but got %d. Closing...", frame.opcode);
-				Websocket_SendImmediateClose(ctx, WEBSOCKET_CLOSE_PROTOCOL_ERROR);
-				Websocket_ResetParser(ctx);
-				return false;
-			}
-			ctx->reader.curr_node->header = frame.header;
-		}
+		// single frame or final frame of fragmented frame
+		Websocket_PushMessageAndReadNext(ctx, fragmented ? fragmented : frame.header);
+		ctx->reader.fragmented = 0;
+	} else if (!fragmented) {
+		// first part of fragmented frame
+		ctx->reader.fragmented = frame.header;
 	}
 
-	Websocket_ResetParser(ctx);
+	Websocket_ResetParser(ctx, true);
 	return true;
 }
 
-static bool Websocket_NetReceiveStream(Net_Socket *socket, Websocket_Read_Stream *stream) {
+// Returns -1 on error, 0 when the socket is drained and 1 when the stream is full
+static int Websocket_NetReceiveStream(Net_Socket *socket, Websocket_Read_Stream *stream) {
 	const ptrdiff_t buffer_size = stream->p2cap;
 	while (true) {
+		ptrdiff_t read_size;
 		if (stream->stop >= stream->start) {
-			ptrdiff_t read_size = buffer_size - stream->stop;
-			ptrdiff_t read = Net_Receive(socket, stream->buffer + stream->stop, (int)read_size);
-			if (read == 0) return true;
-			if (read < 0) return false;
-			stream->stop = (stream->stop + read) & (buffer_size - 1);
+			// Keep one byte empty so that full stream is not seen as empty
+			read_size = buffer_size - stream->stop - (stream->start == 0 ? 1 : 0);
 		} else {
-			ptrdiff_t read_size = stream->start - stream->stop - 1;
-			ptrdiff_t read = Net_Receive(socket, stream->buffer + stream->stop, (int)read_size);
-			if (read == 0) return true;
-			if (read < 0) return false;
-			stream->stop = (stream->stop + read) & (buffer_size - 1);
+			read_size = stream->start - stream->stop - 1;
 		}
+
+		if (read_size <= 0) return 1;
+
+		ptrdiff_t read = Net_Receive(socket, stream->buffer + stream->stop, (int)read_size);
+		if (read == 0) return 0;
+		if (read < 0) return -1;
+		stream->stop = (stream->stop + read) & (buffer_size - 1);
+	}
+	return 0;
+}
+
+static bool Websocket_FlushWrites(Net_Socket *websocket, Websocket_Context *ctx) {
+	// Gather the control frame and all the queued frames so that a burst
+	// of small frames goes out with a single syscall
+	Buffer buffers[WEBSOCKET_WRITE_BATCH_COUNT + 1];
+	int    count = 0;
+
+	auto &frozen = ctx->writer.frozen;
+
+	// A write that has to be retried (SSL_write) must be given the same buffers, so the
+	// batch is not rebuilt until some of it goes through
+	ptrdiff_t control = 0;
+	int       nodes   = ctx->writer.normal.count;
+	if (frozen.active) {
+		control = frozen.control;
+		nodes   = frozen.count;
+	} else if (ctx->writer.control.length && !ctx->writer.normal.written) {
+		control = ctx->writer.control.length;
+	}
+
+	ptrdiff_t control_written = ctx->writer.control.written;
+	if (control)
+		buffers[count++] = Buffer(ctx->writer.control.buffer + control_written, control - control_written);
+
+	for (int index = 0; index < nodes; ++index) {
+		Websocket_Queue::Node *node = ctx->writer.normal.nodes[index];
+		ptrdiff_t offset = index ? 0 : ctx->writer.normal.written;
+		buffers[count++] = Buffer(node->buff + offset, node->len - offset);
+	}
+
+	int sent = Net_SendVectored(websocket, buffers, count);
+	if (sent < 0) {
+		LogErrorEx("Websocket", "Connection lost abrubtly while writing");
+		ctx->connection = WEBSOCKET_CLOSED;
+		return false;
+	}
+
+	if (!sent) {
+		frozen.active  = count != 0;
+		frozen.control = control;
+		frozen.count   = nodes;
+		return true;
+	}
+
+	if (control) {
+		ptrdiff_t remaining = control - control_written;
+		if (sent < remaining) {
+			// Rest of the control frame goes first in the next write once the socket is
+			// writable again, it stays frozen so that it can't be replaced in the meantime
+			ctx->writer.control.written += sent;
+			frozen.active  = true;
+			frozen.control = control;
+			frozen.count   = nodes;
+			return true;
+		}
+
+		int opcode = (ctx->writer.control.buffer[0] & 0x0f) >> 0;
+		ctx->writer.control.length  = 0;
+		ctx->writer.control.written = 0;
+		Websocket_InspectWriteFrameForClose(ctx, opcode);
+
+		if (ctx->writer.deferred.length) {
+			memcpy(ctx->writer.control.buffer, ctx->writer.deferred.buffer, ctx->writer.deferred.length);
+			ctx->writer.control.length  = ctx->writer.deferred.length;
+			ctx->writer.deferred.length = 0;
+		}
+
+		sent -= (int)remaining;
+	}
+
+	frozen.active = false;
+
+	Websocket_ConsumeWriteBatch(ctx, sent);
+	return true;
+}
+
+// Returns -1 on error, 0 when the socket is drained and 1 when reading stopped early
+static int Websocket_ReadFrames(Net_Socket *websocket, Websocket_Context *ctx) {
+	int res = Websocket_NetReceiveStream(websocket, &ctx->reader.stream);
+	if (res < 0) {
+		LogErrorEx("Websocket", "Connection lost abrubtly while reading");
+		ctx->connection = WEBSOCKET_CLOSED;
+		return -1;
+	}
+
+	while (ctx->reader.curr_node && Websocket_ParseFrame(ctx))
+		Websocket_HandleMessage(ctx);
+
+	return res;
+}
+
+static bool Websocket_CheckHangup(Websocket_Context *ctx) {
+	if (ctx->connection == WEBSOCKET_CONNECTED) {
+		LogErrorEx("Websocket", "Connection lost abrubtly");
+		ctx->connection = WEBSOCKET_CLOSED;
+		return false;
 	}
 	return true;
 }
@@ -994,88 +1417,94 @@ static int Websocket_ThreadProc(void *arg) {
 	Net_Socket *websocket  = (Net_Socket *)arg;
 	Websocket_Context *ctx = (Websocket_Context *)Net_GetUserBuffer(websocket);
 
-	pollfd fd;
-	fd.fd = Net_GetSocketDescriptor(websocket);
+	pollfd fds[2];
+	fds[0].fd = Net_GetSocketDescriptor(websocket);
+	fds[1].fd = Net_GetWakeupDescriptor(&ctx->wakeup);
+
+	int nfds = (fds[1].fd != INVALID_SOCKET) ? 2 : 1;
+
+	pollfd &fd = fds[0];
 
 	while (ctx->connection != WEBSOCKET_CLOSED) {
 		fd.events  = 0;
 		fd.revents = 0;
 
+		fds[1].events  = POLLRDNORM;
+		fds[1].revents = 0;
+
 		if (Websocket_HasWrite(ctx))
 			fd.events |= POLLWRNORM;
 
 		if (Websocket_HasRead(ctx))
 			fd.events |= POLLRDNORM;
 
-		int presult = poll(&fd, 1, WEBSOCKET_MAX_WAIT_MS);
+		int presult = poll(fds, nfds, WEBSOCKET_MAX_WAIT_MS);
 
 		if (presult <= 0) continue;
 
-		if (fd.revents & POLLWRNORM) {
-			if (ctx->writer.control.length && !ctx->writer.normal.written) {
-				// Send control frames all at once since they will be replaced with another control frame
-				// if control frames are sent, and breaking them will cause error
-				ptrdiff_t remaining = ctx->writer.control.length;
-				uint8_t *write_ptr  = ctx->writer.control.buffer;
-				while (remaining) {
-					int sent = Net_SendBlocked(websocket, write_ptr, (int)remaining);
-					if (sent < 0) {
-						LogErrorEx("Websocket", "Connection lost abrubtly while writing");
-						ctx->connection = WEBSOCKET_CLOSED;
-						return 1;
-					}
-					remaining -= sent;
-					write_ptr += sent;
-				}
-
-				int opcode = (ctx->writer.control.buffer[0] & 0x0f) >> 0;
-				Websocket_InspectWriteFrameForClose(ctx, opcode);
-			} else if (ctx->writer.normal.curr_node) {
-				ptrdiff_t remaining = ctx->writer.normal.curr_node->len - ctx->writer.normal.written;
-				uint8_t *write_ptr  = ctx->writer.normal.curr_node->buff + ctx->writer.normal.written;
-
-				while (remaining) {
-					int bytes_sent = Net_Send(websocket, write_ptr, (int)remaining);
-					if (bytes_sent < 0) return 1;
-					if (bytes_sent == 0) break;
-					remaining -= bytes_sent;
-					write_ptr += bytes_sent;
-					ctx->writer.normal.written += bytes_sent;
-				}
+		if (fds[1].revents & POLLRDNORM) {
+			// Woken up by a writer, the queues are checked again at the top of the loop
+			Net_ClearWakeup(&ctx->wakeup);
+		}
 
-				if (!remaining) {
-					Websocket_InspectWriteFrameForClose(ctx, ctx->writer.normal.curr_node->header & 0x0f);
-					ctx->writer.normal.written = 0;
-					Websocket_QueueFree(&ctx->writeq, ctx->writer.normal.curr_node);
-					ctx->writer.normal.curr_node = Websocket_QueuePop(&ctx->writeq);
-					Semaphore_Signal(ctx->writesem);
-				}
-			}
+		if (fd.revents & POLLWRNORM) {
+			if (!Websocket_FlushWrites(websocket, ctx))
+				return 1;
 		}
 
 		if (fd.revents & POLLRDNORM) {
-			if (!Websocket_NetReceiveStream(websocket, &ctx->reader.stream)) {
-				LogErrorEx("Websocket", "Connection lost abrubtly while reading");
-				ctx->connection = WEBSOCKET_CLOSED;
+			if (Websocket_ReadFrames(websocket, ctx) < 0)
 				return 1;
-			}
-
-			while (Websocket_ParseFrame(ctx)) {
-				if (Websocket_HandleMessage(ctx) && ctx->reader.curr_node)
-					continue;
-			}
 		}
 
-		if (fd.revents & (POLLHUP | POLLERR) && ctx->connection == WEBSOCKET_CONNECTED) {
-			LogErrorEx("Websocket", "Connection lost abrubtly");
-			ctx->connection = WEBSOCKET_CLOSED;
-			return 1;
+		if (fd.revents & (POLLHUP | POLLERR)) {
+			if (!Websocket_CheckHangup(ctx))
+				return 1;
 		}
 	}
 
 	return 0;
 }
 
+static void Websocket_EventProc(Net_Event_Loop *loop, Net_Socket *websocket, uint32_t events, void *context) {
+	Websocket_Context *ctx = (Websocket_Context *)context;
+
+	// Notifications come from Websocket_Send and from the receiver freeing read nodes
+	if (events & NET_EVENT_NOTIFY)
+		events |= NET_EVENT_READ | NET_EVENT_WRITE;
+
+	bool rearm = false;
+
+	if ((events & NET_EVENT_WRITE) && Websocket_HasWrite(ctx)) {
+		if (!Websocket_FlushWrites(websocket, ctx)) {
+			Net_EventLoopRemove(loop, websocket);
+			return;
+		}
+	}
+
+	if ((events & NET_EVENT_READ) && Websocket_HasRead(ctx)) {
+		int res = Websocket_ReadFrames(websocket, ctx);
+		if (res < 0) {
+			Net_EventLoopRemove(loop, websocket);
+			return;
+		}
+		// Edge won't be reported again for the data left in the socket
+		rearm = (res > 0 && ctx->reader.curr_node);
+	}
+
+	if (events & NET_EVENT_HANGUP) {
+		Websocket_CheckHangup(ctx);
+	}
+
+	if (ctx->connection == WEBSOCKET_CLOSED) {
+		Net_EventLoopRemove(loop, websocket);
+		return;
+	}
+
+	if (rearm)
+		Net_EventLoopNotify(loop, websocket);
+}
+
 //
 //
 //
@@ -1143,10 +1572,12 @@ Websocket_Result Websocket_Send(Websocket *websocket, String raw_data, Websocket
 
 		Websocket_Queue::Node *node = Websocket_QueueAlloc(&ctx->writeq);
 
-		bool masked  = ctx->role == WEBSOCKET_ROLE_CLIENT;
-		node->len    = Websocket_CreateFrame(node->buff, ctx->writeq.buffp2cap, raw_data, masked, opcode);
+		bool masked   = ctx->role == WEBSOCKET_ROLE_CLIENT;
+		uint32_t mask = masked ? Websocket_NextMask(ctx) : 0;
+		node->len     = Websocket_CreateFrame(node->buff, ctx->writeq.buffp2cap, raw_data, masked, mask, opcode);
 		node->header = node->buff[0];
 		Websocket_QueuePush(&ctx->writeq, node);
+		Websocket_WakeIO(ctx);
 		return WEBSOCKET_OK;
 	}
 
@@ -1209,7 +1640,7 @@ static Websocket_Queue::Node *Websocket_ReceiveNode(Websocket_Context *ctx, Webs
 		return nullptr;
 	}
 
-	int wait = Semaphore_Wait(ctx->readsem, timeout);
+	int wait = Websocket_ReadyWait(&ctx->readready, 1, timeout);
 	if (wait == 0) {
 		if (ctx->connection == WEBSOCKET_CLOSED) {
 			*res = WEBSOCKET_E_CLOSED;
@@ -1236,54 +1667,99 @@ Websocket_Result Websocket_Receive(Websocket *websocket, Websocket_Event *event,
 
 		event->message.data = buff;
 		if (node->len <= bufflen) {
-			memcpy(event->message.data, node->buff, node->len);
+			memcpy(event->message.data, Websocket_NodeData(node), node->len);
 			event->message.length = node->len;
 			res = WEBSOCKET_OK;
 		} else {
 			LogWarningEx("Websocket", "Full frame not read. Reason: Out of memory");
-			memcpy(event->message.data, node->buff, bufflen);
+			memcpy(event->message.data, Websocket_NodeData(node), bufflen);
 			event->message.length = bufflen;
 			res = WEBSOCKET_E_NOMEM;
 		}
 
-		Websocket_QueueFree(&ctx->readq, node);
+		Websocket_ReadQueueFree(ctx, node);
 	}
 
 	return res;
 }
 
+static Websocket_Result Websocket_NodeToEvent(Websocket_Context *ctx, Websocket_Queue::Node *node, Websocket_Event *event, Memory_Arena *arena) {
+	event->type = Websocket_OpcodeToEventType(node->header & 0x0f);
+
+	uint8_t *buff = (uint8_t *)PushSize(arena, node->len);
+	if (buff) {
+		event->message.data = buff;
+		memcpy(event->message.data, Websocket_NodeData(node), node->len);
+		event->message.length = node->len;
+		Websocket_ReadQueueFree(ctx, node);
+		return WEBSOCKET_OK;
+	}
+
+	LogWarningEx("Websocket", "Full frame not read. Reason: Out of memory");
+
+	ptrdiff_t len = MemoryArenaEmptySize(arena);
+	buff = (uint8_t *)PushSize(arena, len);
+	if (buff) {
+		event->message.data = buff;
+		memcpy(event->message.data, Websocket_NodeData(node), len);
+		event->message.length = len;
+	} else {
+		event->message = Buffer();
+	}
+
+	Websocket_ReadQueueFree(ctx, node);
+	return WEBSOCKET_E_NOMEM;
+}
+
 Websocket_Result Websocket_Receive(Websocket *websocket, Websocket_Event *event, Memory_Arena *arena, int timeout) {
 	Net_Socket *socket = (Net_Socket *)websocket;
 	Websocket_Context *ctx = (Websocket_Context *)Net_GetUserBuffer(socket);
 
 	Websocket_Result res;
 	Websocket_Queue::Node *node = Websocket_ReceiveNode(ctx, &res, timeout);
-	if (node) {
-		event->type = Websocket_OpcodeToEventType(node->header & 0x0f);
+	if (node)
+		return Websocket_NodeToEvent(ctx, node, event, arena);
 
-		uint8_t *buff = (uint8_t *)PushSize(arena, node->len);
-		if (buff) {
-			event->message.data = buff;
-			memcpy(event->message.data, node->buff, node->len);
-			event->message.length = node->len;
-			Websocket_QueueFree(&ctx->readq, node);
-			return WEBSOCKET_OK;
-		}
+	return res;
+}
 
-		LogWarningEx("Websocket", "Full frame not read. Reason: Out of memory");
+Websocket_Result Websocket_ReceiveMany(Websocket *websocket, Websocket_Event *events, int max_events, int *count, Memory_Arena *arena, int timeout) {
+	Net_Socket *socket     = (Net_Socket *)websocket;
+	Websocket_Context *ctx = (Websocket_Context *)Net_GetUserBuffer(socket);
 
-		ptrdiff_t len = MemoryArenaEmptySize(arena);
-		buff = (uint8_t *)PushSize(arena, len);
-		if (buff) {
-			event->message.data = buff;
-			memcpy(event->message.data, node->buff, len);
-			event->message.length = len;
-		} else {
-			event->message = Buffer();
+	*count = 0;
+
+	if (ctx->connection == WEBSOCKET_CLOSED)
+		return WEBSOCKET_E_CLOSED;
+
+	int claimed = Websocket_ReadyWait(&ctx->readready, max_events, timeout);
+	if (claimed == 0)
+		return WEBSOCKET_E_WAIT;
+	if (claimed < 0)
+		return WEBSOCKET_E_SYSTEM;
+
+	Websocket_Result res = WEBSOCKET_OK;
+
+	for (int index = 0; index < claimed; ++index) {
+		Websocket_Queue::Node *node = ctx->readq.head.next;
+		Assert(node != &ctx->readq.head);
+
+		// Leave the rest in the queue if they don't fit, they are returned in the next call
+		if (index && node->len > (ptrdiff_t)MemoryArenaEmptySize(arena)) {
+			for (; index < claimed; ++index)
+				Websocket_ReadyPost(&ctx->readready);
+			break;
 		}
 
-		Websocket_QueueFree(&ctx->readq, node);
-		return WEBSOCKET_E_NOMEM;
+		node = Websocket_QueuePop(&ctx->readq);
+		res  = Websocket_NodeToEvent(ctx, node, &events[index], arena);
+		*count += 1;
+
+		if (res != WEBSOCKET_OK) {
+			for (index += 1; index < claimed; ++index)
+				Websocket_ReadyPost(&ctx->readready);
+			break;
+		}
 	}
 
 	return res;
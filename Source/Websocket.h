@@ -28,9 +28,17 @@ struct Websocket_Spec {
 	uint32_t read_size;
 	uint32_t write_size;
 	uint32_t queue_size;
+	// Messages larger than read_size are spilled into an overflow buffer that grows upto this size,
+	// bigger messages are dropped with WEBSOCKET_CLOSE_MESSAGE_TOO_BIG. The overflow buffer is
+	// allocated from the allocator of the connection and released by the receiving thread, so that
+	// allocator must be thread safe when this is larger than read_size
+	uint32_t max_message_size;
+	// When set, the connection is serviced by this event loop instead of a dedicated thread
+	Net_Event_Loop *loop;
+	Net_Socket_Options socket;
 };
 
-constexpr Websocket_Spec WebsocketDefaultSpec = { KiloBytes(12), KiloBytes(12), 1024 };
+constexpr Websocket_Spec WebsocketDefaultSpec = { KiloBytes(12), KiloBytes(12), 1024, 0, nullptr, NetDefaultSocketOptions };
 
 Websocket *Websocket_Connect(String uri, Http_Response *res, Websocket_Header *header = nullptr, Websocket_Spec spec = WebsocketDefaultSpec, Memory_Allocator allocator = ThreadContext.allocator);
 void       Websocket_Disconnect(Websocket *websocket);
@@ -97,3 +105,4 @@ Websocket_Result Websocket_Close(Websocket *websocket, Websocket_Close_Reason re
 Websocket_Result Websocket_Close(Websocket *websocket, int reason, String data, int timeout = WEBSOCKET_DEFAULT_TIMEOUT);
 Websocket_Result Websocket_Receive(Websocket *websocket, Websocket_Event *event, uint8_t *buff, ptrdiff_t bufflen, int timeout = WEBSOCKET_DEFAULT_TIMEOUT);
 Websocket_Result Websocket_Receive(Websocket *websocket, Websocket_Event *event, Memory_Arena *arena, int timeout);
+Websocket_Result Websocket_ReceiveMany(Websocket *websocket, Websocket_Event *events, int max_events, int *count, Memory_Arena *arena, int timeout);
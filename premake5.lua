@@ -33,10 +33,12 @@ project "Katachi"
       runtime "Release"
 
    filter "system:linux"
-   		links { "ssl", "crypto" }
+   		links { "ssl", "crypto", "z" }
+   		defines { "HTTP_ZLIB_ENABLE" }
 
    filter "system:macosx"
-   		links { "ssl", "crypto" }
+   		links { "ssl", "crypto", "z" }
+   		defines { "HTTP_ZLIB_ENABLE" }
 
    filter "system:windows"
       systemversion "latest"